@@ -0,0 +1,546 @@
+#include "stdafx.h"
+#include "BezierPatch.h"
+#include <cmath>
+
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+const int MAXDEPTH = 3;             // Deepest level of the patch hierarchy
+const double FLATNESS = 0.02;       // Deviation from flat relative to size for a leaf
+const int MAXITERATIONS = 10;       // Newton iterations before we give up
+const double EDGE = 1e-7;           // Hits this far past the patch edge still count
+
+CBezierPatch::CBezierPatch(const CGrVector *p_points, double p_s0, double p_s1, double p_t0, double p_t1)
+{
+    for(int i=0;  i<16;  i++)
+        m_points[i] = p_points[i];
+
+    m_s0 = p_s0;
+    m_s1 = p_s1;
+    m_t0 = p_t0;
+    m_t1 = p_t1;
+
+    m_nodes.push_back(Node());
+    m_nodes[0].m_u0 = 0;
+    m_nodes[0].m_u1 = 1;
+    m_nodes[0].m_v0 = 0;
+    m_nodes[0].m_v1 = 1;
+    Build(0, m_points, 0);
+
+    SetBoundingBox(m_nodes[0].m_box);
+
+    CGrVector extent = m_nodes[0].m_box.Extent();
+    m_epsilon = extent.Length3() * 1e-9;
+    if(m_epsilon < TINY * TINY)
+        m_epsilon = TINY * TINY;
+}
+
+CBezierPatch::~CBezierPatch(void)
+{
+}
+
+
+//
+// Name :         CBezierPatch::Build()
+// Description :  Bound a piece of the patch and split it in four if it
+//                is not flat enough.  With positive weights the piece
+//                lies inside the hull of its projected control points.
+//                Its corners are on the surface, so the distance of the
+//                control points from the bilinear patch through the
+//                corners says how far the piece is from flat.
+//
+
+void CBezierPatch::Build(int p_node, const CGrVector *p_points, int p_depth)
+{
+    CGrVector q[16];
+    for(int i=0;  i<16;  i++)
+    {
+        q[i] = p_points[i] / p_points[i].W();
+        q[i].W() = 1;
+    }
+
+    CBoundingBox box(q[0]);
+    for(int i=1;  i<16;  i++)
+        box.Include(q[i]);
+
+    // The box of a flat piece has no thickness, so pad it for roundoff
+    double pad = box.Extent().Length3() * 1e-9 + TINY;
+    box.Include(box.Min() - CGrVector(pad, pad, pad, 0));
+    box.Include(box.Max() + CGrVector(pad, pad, pad, 0));
+
+    m_nodes[p_node].m_box = box;
+    m_nodes[p_node].m_child = -1;
+    if(p_depth >= MAXDEPTH)
+        return;
+
+    double deviation = 0;
+    for(int i=0;  i<4;  i++)
+    {
+        double u = i / 3.;
+        for(int j=0;  j<4;  j++)
+        {
+            double v = j / 3.;
+            CGrVector flat = q[0] * ((1 - u) * (1 - v)) + q[12] * (u * (1 - v)) +
+                q[3] * ((1 - u) * v) + q[15] * (u * v);
+
+            double d = (q[i * 4 + j] - flat).Length3();
+            deviation = d > deviation ? d : deviation;
+        }
+    }
+
+    if(deviation <= FLATNESS * box.Extent().Length3())
+        return;
+
+    CGrVector children[64];
+    Subdivide(p_points, children);
+
+    int child = int(m_nodes.size());
+    m_nodes.resize(child + 4);
+    m_nodes[p_node].m_child = child;
+
+    const Node parent = m_nodes[p_node];
+    double um = (parent.m_u0 + parent.m_u1) * 0.5;
+    double vm = (parent.m_v0 + parent.m_v1) * 0.5;
+    for(int c=0;  c<4;  c++)
+    {
+        Node &node = m_nodes[child + c];
+        node.m_u0 = c < 2 ? parent.m_u0 : um;
+        node.m_u1 = c < 2 ? um : parent.m_u1;
+        node.m_v0 = (c & 1) == 0 ? parent.m_v0 : vm;
+        node.m_v1 = (c & 1) == 0 ? vm : parent.m_v1;
+    }
+
+    for(int c=0;  c<4;  c++)
+        Build(child + c, children + c * 16, p_depth + 1);
+}
+
+
+//
+// Name :         CBezierPatch::Subdivide()
+// Description :  de Casteljau subdivision at the middle, first along u
+//                for each column of control points, then along v.
+//
+
+static void Split(const CGrVector *p_in, int p_stride, CGrVector *p_left, CGrVector *p_right)
+{
+    const CGrVector &p0 = p_in[0];
+    const CGrVector &p1 = p_in[p_stride];
+    const CGrVector &p2 = p_in[2 * p_stride];
+    const CGrVector &p3 = p_in[3 * p_stride];
+
+    CGrVector p01 = (p0 + p1) * 0.5;
+    CGrVector p12 = (p1 + p2) * 0.5;
+    CGrVector p23 = (p2 + p3) * 0.5;
+    CGrVector p012 = (p01 + p12) * 0.5;
+    CGrVector p123 = (p12 + p23) * 0.5;
+
+    p_left[0] = p0;
+    p_left[p_stride] = p01;
+    p_left[2 * p_stride] = p012;
+    p_left[3 * p_stride] = (p012 + p123) * 0.5;
+    p_right[0] = p_left[3 * p_stride];
+    p_right[p_stride] = p123;
+    p_right[2 * p_stride] = p23;
+    p_right[3 * p_stride] = p3;
+}
+
+void CBezierPatch::Subdivide(const CGrVector *p_points, CGrVector *p_children)
+{
+    CGrVector halves[32];
+    for(int j=0;  j<4;  j++)
+        Split(p_points + j, 4, halves + j, halves + 16 + j);
+
+    for(int h=0;  h<2;  h++)
+    {
+        for(int i=0;  i<4;  i++)
+        {
+            Split(halves + h * 16 + i * 4, 1, p_children + (h * 2) * 16 + i * 4,
+                p_children + (h * 2 + 1) * 16 + i * 4);
+        }
+    }
+}
+
+
+//
+// Name :         CBezierPatch::Evaluate()
+// Description :  The point and the partial derivatives of the rational
+//                patch.  With S = P / w in homogeneous coordinates,
+//                dS/du = (dP/du - S dw/du) / w.
+//
+
+static void Bernstein(double u, double *b, double *db)
+{
+    double s = 1 - u;
+    b[0] = s * s * s;
+    b[1] = 3 * u * s * s;
+    b[2] = 3 * u * u * s;
+    b[3] = u * u * u;
+
+    db[0] = -3 * s * s;
+    db[1] = 3 * s * s - 6 * u * s;
+    db[2] = 6 * u * s - 3 * u * u;
+    db[3] = 3 * u * u;
+}
+
+void CBezierPatch::Evaluate(const CGrVector *p_points, double u, double v,
+                   CGrVector &p_point, CGrVector &p_du, CGrVector &p_dv)
+{
+    double bu[4], dbu[4], bv[4], dbv[4];
+    Bernstein(u, bu, dbu);
+    Bernstein(v, bv, dbv);
+
+    CGrVector p(0, 0, 0, 0);
+    CGrVector pu(0, 0, 0, 0);
+    CGrVector pv(0, 0, 0, 0);
+    for(int i=0;  i<4;  i++)
+    {
+        for(int j=0;  j<4;  j++)
+        {
+            const CGrVector &c = p_points[i * 4 + j];
+            p.WeightedAdd(c, bu[i] * bv[j]);
+            pu.WeightedAdd(c, dbu[i] * bv[j]);
+            pv.WeightedAdd(c, bu[i] * dbv[j]);
+        }
+    }
+
+    double w = p.W();
+    p_point = CGrVector(p.X() / w, p.Y() / w, p.Z() / w);
+    p_du = CGrVector((pu.X() - p_point.X() * pu.W()) / w, (pu.Y() - p_point.Y() * pu.W()) / w,
+        (pu.Z() - p_point.Z() * pu.W()) / w, 0);
+    p_dv = CGrVector((pv.X() - p_point.X() * pv.W()) / w, (pv.Y() - p_point.Y() * pv.W()) / w,
+        (pv.Z() - p_point.Z() * pv.W()) / w, 0);
+}
+
+
+//
+// Name :         CBezierPatch::SurfaceNormal()
+// Description :  Where an edge of the patch is collapsed to a point, as
+//                at the pole of a surface of revolution, the cross
+//                product vanishes.  The normal just inside is used there.
+//
+
+CGrVector CBezierPatch::SurfaceNormal(const CGrVector *p_points, double u, double v)
+{
+    CGrVector point, du, dv;
+    for(int i=0;  i<4;  i++)
+    {
+        Evaluate(p_points, u, v, point, du, dv);
+
+        CGrVector n = Cross(du, dv);
+        double len = n.Length3();
+        if(len > TINY * (du.Length3() * dv.Length3()) && len > 0)
+        {
+            n /= len;
+            n.W() = 0;
+            return n;
+        }
+
+        u += (0.5 - u) * 1e-4;
+        v += (0.5 - v) * 1e-4;
+    }
+
+    return CGrVector(0, 0, 0, 0);
+}
+
+
+//
+// Name :         CBezierPatch::ComputeT()
+// Description :  Walk the pieces of the patch the ray passes through,
+//                nearest first within each level, and run Newton
+//                iteration in each leaf closer than the best hit so far.
+//
+
+static bool SlabTest(const CBoundingBox &p_box, const CRayp &ray, double &p_t0, double &p_t1)
+{
+    double t0 = -1e300;
+    double t1 = 1e300;
+
+    for(int d=0;  d<3;  d++)
+    {
+        double o = ray.Origin(d);
+        if(ray.Direction(d) >= -TINY && ray.Direction(d) <= TINY)
+        {
+            if(o < p_box.Min(d) || o > p_box.Max(d))
+                return false;
+            continue;
+        }
+
+        double ta = (p_box.Min(d) - o) * ray.InvDirection()[d];
+        double tb = (p_box.Max(d) - o) * ray.InvDirection()[d];
+        if(ta > tb)
+        {
+            double s = ta;  ta = tb;  tb = s;
+        }
+
+        t0 = ta > t0 ? ta : t0;
+        t1 = tb < t1 ? tb : t1;
+    }
+
+    p_t0 = t0;
+    p_t1 = t1;
+    return t0 <= t1;
+}
+
+double CBezierPatch::ComputeT(const CRayp &ray)
+{
+    double best = -1;
+
+    int stack[4 * MAXDEPTH + 1];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top > 0)
+    {
+        const Node &node = m_nodes[stack[--top]];
+
+        double t0, t1;
+        if(!SlabTest(node.m_box, ray, t0, t1) || t1 < -TINY || (best > 0 && t0 > best))
+            continue;
+
+        if(node.m_child < 0)
+        {
+            double t;
+            if(Newton(ray, node, t) && (best < 0 || t < best))
+                best = t;
+            continue;
+        }
+
+        // Push the farthest children first so the nearest are tried first
+        double tc[4];
+        int order[4];
+        for(int c=0;  c<4;  c++)
+        {
+            double c1;
+            order[c] = c;
+            if(!SlabTest(m_nodes[node.m_child + c].m_box, ray, tc[c], c1))
+                tc[c] = 1e300;
+        }
+
+        for(int a=1;  a<4;  a++)
+        {
+            for(int b=a;  b>0 && tc[order[b]] > tc[order[b - 1]];  b--)
+            {
+                int s = order[b];  order[b] = order[b - 1];  order[b - 1] = s;
+            }
+        }
+
+        for(int c=0;  c<4;  c++)
+        {
+            if(tc[order[c]] < 1e300)
+                stack[top++] = node.m_child + order[c];
+        }
+    }
+
+    return best;
+}
+
+
+//
+// Name :         CBezierPatch::Newton()
+// Description :  The ray is the intersection of two planes that contain
+//                it.  Newton iteration finds the u, v where the surface
+//                point is on both planes, starting from the middle of
+//                the piece.  A root outside the piece belongs to another
+//                piece, which will find it itself.
+//
+
+bool CBezierPatch::Newton(const CRayp &ray, const Node &p_node, double &p_t) const
+{
+    const CGrVector &o = ray.Origin();
+    const CGrVector &d = ray.Direction();
+
+    CGrVector n1;
+    if(fabs(d.X()) > fabs(d.Y()) && fabs(d.X()) > fabs(d.Z()))
+        n1 = CGrVector(d.Y(), -d.X(), 0, 0);
+    else
+        n1 = CGrVector(0, d.Z(), -d.Y(), 0);
+    n1.Normalize3();
+
+    CGrVector n2 = Normalize3(Cross(n1, d));
+    n2.W() = 0;
+
+    double e1 = -Dot3(n1, o);
+    double e2 = -Dot3(n2, o);
+
+    double du = p_node.m_u1 - p_node.m_u0;
+    double dv = p_node.m_v1 - p_node.m_v0;
+    double u = p_node.m_u0 + du * 0.5;
+    double v = p_node.m_v0 + dv * 0.5;
+
+    CGrVector s, su, sv;
+    for(int i=0;  i<MAXITERATIONS;  i++)
+    {
+        Evaluate(m_points, u, v, s, su, sv);
+
+        double f1 = Dot3(n1, s) + e1;
+        double f2 = Dot3(n2, s) + e2;
+        if(fabs(f1) < m_epsilon && fabs(f2) < m_epsilon)
+        {
+            // Converged.  Is the root in this piece?
+            double mu = du * 0.01;
+            double mv = dv * 0.01;
+            if(u < p_node.m_u0 - mu || u > p_node.m_u1 + mu ||
+               v < p_node.m_v0 - mv || v > p_node.m_v1 + mv ||
+               u < -EDGE || u > 1 + EDGE || v < -EDGE || v > 1 + EDGE)
+                return false;
+
+            p_t = Dot3(s - o, d) / Dot3(d, d);
+            return p_t > TINY;
+        }
+
+        double j11 = Dot3(n1, su);
+        double j12 = Dot3(n1, sv);
+        double j21 = Dot3(n2, su);
+        double j22 = Dot3(n2, sv);
+        double det = j11 * j22 - j12 * j21;
+        if(det == 0)
+            return false;
+
+        u -= (j22 * f1 - j12 * f2) / det;
+        v -= (j11 * f2 - j21 * f1) / det;
+
+        // Wandered off the piece
+        if(u < p_node.m_u0 - du || u > p_node.m_u1 + du ||
+           v < p_node.m_v0 - dv || v > p_node.m_v1 + dv)
+            return false;
+    }
+
+    return false;
+}
+
+
+//
+// Name :         CBezierPatch::Project()
+// Description :  Find u, v of a point on the patch.  Only a point is
+//                passed to IntersectInfo(), so the parameters of the hit
+//                are found again by Gauss-Newton iteration on the
+//                distance, from the middle of each leaf that contains the
+//                point.  The closest result wins.  A point that may be
+//                off the patch tries every leaf.
+//
+
+void CBezierPatch::Project(const CGrVector &p_point, double &p_u, double &p_v, bool p_everywhere) const
+{
+    double best = 1e300;
+    p_u = 0.5;
+    p_v = 0.5;
+
+    CGrVector slack(m_epsilon * 1000, m_epsilon * 1000, m_epsilon * 1000, 0);
+    for(int pass=p_everywhere ? 1 : 0;  pass<2 && best == 1e300;  pass++)
+    {
+        for(std::vector<Node>::const_iterator node=m_nodes.begin();  node!=m_nodes.end();  node++)
+        {
+            if(node->m_child >= 0)
+                continue;
+
+            // The first pass tries only the leaves that contain the point
+            const CGrVector &lo = node->m_box.Min();
+            const CGrVector &hi = node->m_box.Max();
+            if(pass == 0 &&
+               (p_point.X() < lo.X() - slack.X() || p_point.X() > hi.X() + slack.X() ||
+                p_point.Y() < lo.Y() - slack.Y() || p_point.Y() > hi.Y() + slack.Y() ||
+                p_point.Z() < lo.Z() - slack.Z() || p_point.Z() > hi.Z() + slack.Z()))
+                continue;
+
+            double u = (node->m_u0 + node->m_u1) * 0.5;
+            double v = (node->m_v0 + node->m_v1) * 0.5;
+            CGrVector s, su, sv;
+            for(int i=0;  i<MAXITERATIONS;  i++)
+            {
+                Evaluate(m_points, u, v, s, su, sv);
+
+                CGrVector r = p_point - s;
+                double g11 = Dot3(su, su);
+                double g12 = Dot3(su, sv);
+                double g22 = Dot3(sv, sv);
+                double det = g11 * g22 - g12 * g12;
+                if(det <= 0)
+                    break;
+
+                double a = Dot3(su, r);
+                double b = Dot3(sv, r);
+                u += (g22 * a - g12 * b) / det;
+                v += (g11 * b - g12 * a) / det;
+                u = u < 0 ? 0 : (u > 1 ? 1 : u);
+                v = v < 0 ? 0 : (v > 1 ? 1 : v);
+            }
+
+            Evaluate(m_points, u, v, s, su, sv);
+            double dist = (p_point - s).LengthSquared3();
+            if(dist < best)
+            {
+                best = dist;
+                p_u = u;
+                p_v = v;
+            }
+        }
+    }
+}
+
+
+//
+// Name :         CBezierPatch::ClosestPoint()
+// Description :  The nearest of the local minimums of the distance found
+//                from the middle of each leaf.
+//
+
+bool CBezierPatch::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    double u, v;
+    Project(p, u, v, true);
+
+    CGrVector du, dv;
+    Evaluate(m_points, u, v, p_closest, du, dv);
+    return true;
+}
+
+
+//
+// Name :         CBezierPatch::IntersectInfo()
+// Description :  The normal is du x dv.  The texture coordinate is the
+//                surface parameter.
+//
+
+void CBezierPatch::IntersectInfo(const CGrVector &intersect,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    double u, v;
+    Project(intersect, u, v);
+
+    p_normal = SurfaceNormal(m_points, u, v);
+    p_texcoord = CGrVector(m_s0 + u * (m_s1 - m_s0), m_t0 + v * (m_t1 - m_t0), 0);
+}
+
+
+//
+// Name :         CBezierPatch::TexCoordGradient()
+// Description :  s changes only with u and t only with v.  The gradient
+//                of a function f(u, v) on the surface is
+//                [du dv] G^-1 [df/du df/dv], where G is the matrix of dot
+//                products of du and dv.
+//
+
+void CBezierPatch::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    double u, v;
+    Project(intersect, u, v);
+
+    CGrVector s, su, sv;
+    Evaluate(m_points, u, v, s, su, sv);
+    p_normal = SurfaceNormal(m_points, u, v);
+
+    double g11 = Dot3(su, su);
+    double g12 = Dot3(su, sv);
+    double g22 = Dot3(sv, sv);
+    double det = g11 * g22 - g12 * g12;
+    if(det <= TINY * g11 * g22 || det <= 0)
+    {
+        p_dsdp = CGrVector(0, 0, 0, 0);
+        p_dtdp = CGrVector(0, 0, 0, 0);
+        return;
+    }
+
+    double ks = (m_s1 - m_s0) / det;
+    double kt = (m_t1 - m_t0) / det;
+    p_dsdp = su * (g22 * ks) - sv * (g12 * ks);
+    p_dtdp = sv * (g11 * kt) - su * (g12 * kt);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include "IntersectionObject.h"
+
+//
+// class CBezierPatch
+// One bicubic rational Bezier patch of a NURBS surface, intersected
+// directly.  The control points are homogeneous, (wx, wy, wz, w), with
+// m_points[i * 4 + j] at i along u and j along v.
+//
+// The patch keeps a small hierarchy of bounding boxes over pieces of
+// itself, subdivided until each piece is nearly flat.  A ray finds the
+// pieces it passes through and Newton iteration from the middle of each
+// piece finds the hit.  The texture coordinate is the surface parameter
+// scaled to 0 to 1 over the whole surface.
+//
+
+class CBezierPatch : public CIntersectionObject
+{
+public:
+    CBezierPatch(const CGrVector *p_points, double p_s0, double p_s1, double p_t0, double p_t1);
+    virtual ~CBezierPatch(void);
+
+    virtual CRayIntersection::ObjectType Type() const {return CRayIntersection::Nurbs;}
+
+    // The patch is not built from vertices
+    virtual void AddVertex(const CGrVector &/*v*/) {}
+    virtual void AddNormal(const CGrVector &/*n*/) {}
+    virtual void AddTexVertex(const CGrVector &/*t*/) {}
+
+    virtual double ComputeT(const CRayp &ray);
+    virtual bool SurfaceTest(const CGrVector &/*intersect*/) {return true;}
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+
+    virtual void IntersectInfo(const CGrVector &intersect,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+    int GetNodeCnt() const {return int(m_nodes.size());}
+    size_t GetNodeMemory() const {return m_nodes.capacity() * sizeof(Node);}
+
+    // Evaluate a patch at u, v from 0 to 1.  p_point is the surface
+    // point and p_du and p_dv are the partial derivatives.
+    static void Evaluate(const CGrVector *p_points, double u, double v,
+                   CGrVector &p_point, CGrVector &p_du, CGrVector &p_dv);
+
+    // The unit normal, or the normal just inside the patch where the
+    // derivatives vanish, as they do at a collapsed edge
+    static CGrVector SurfaceNormal(const CGrVector *p_points, double u, double v);
+
+    // Split a patch at u = 0.5 and v = 0.5 into four, numbered
+    // u-major as p_children[(iu * 2 + iv) * 16]
+    static void Subdivide(const CGrVector *p_points, CGrVector *p_children);
+
+private:
+    // A piece of the patch over [m_u0, m_u1] x [m_v0, m_v1].  Interior
+    // nodes have four children starting at m_child.
+    struct Node
+    {
+        CBoundingBox    m_box;
+        double          m_u0, m_u1;
+        double          m_v0, m_v1;
+        int             m_child;
+    };
+
+    void Build(int p_node, const CGrVector *p_points, int p_depth);
+    bool Newton(const CRayp &ray, const Node &p_node, double &p_t) const;
+    void Project(const CGrVector &p_point, double &p_u, double &p_v, bool p_everywhere=false) const;
+
+    CGrVector           m_points[16];
+    double              m_s0, m_s1;     // Texture coordinate range
+    double              m_t0, m_t1;
+    double              m_epsilon;      // Convergence distance
+    std::vector<Node>   m_nodes;
+};
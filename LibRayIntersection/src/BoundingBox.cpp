@@ -1,4 +1,4 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "BoundingBox.h"
 
 
@@ -42,6 +42,9 @@ void CBoundingBox::Include(const CGrVector &p)
 //
 // Name :         CBoundingBox::IntersectWith()
 // Description :  Make this bounding box the intersection with another.
+//                If they do not overlap the result is inverted, which
+//                IsEmpty() reports.  A box that is flat in some dimension,
+//                such as the box of an axis aligned polygon, is not empty.
 //
 void CBoundingBox::IntersectWith(const CBoundingBox &box)
 {
@@ -51,15 +54,6 @@ void CBoundingBox::IntersectWith(const CBoundingBox &box)
     mBounds[1].X(bmin(mBounds[1].X(), box.mBounds[1].X()));
     mBounds[1].Y(bmin(mBounds[1].Y(), box.mBounds[1].Y()));
     mBounds[1].Z(bmin(mBounds[1].Z(), box.mBounds[1].Z()));
-
-    // Determine if empty...
-    if(mBounds[0].X() >= mBounds[1].X() ||
-        mBounds[0].Y() >= mBounds[1].Y() ||
-        mBounds[0].Z() >= mBounds[1].Z())
-    {
-        mBounds[0].Set(0, 0, 0);
-        mBounds[1].Set(0, 0, 0);
-    }
 }
 
 
@@ -132,4 +126,91 @@ bool CBoundingBox::IntersectTest(const CRayp &ray, double t0, double t1) const
         tmax = tzmax;
 
     return ( (tmin < t1) && (tmax > t0) );
-}
\ No newline at end of file
+}
+
+
+//
+// Name :         CBoundingBox::Distance2()
+// Description :  The squared distance from a point to the box, 0 for a
+//                point inside.
+//
+
+double CBoundingBox::Distance2(const CGrVector &p) const
+{
+    double d2 = 0;
+    for(int d=0;  d<3;  d++)
+    {
+        double e = p[d] < mBounds[0][d] ? mBounds[0][d] - p[d] : (p[d] > mBounds[1][d] ? p[d] - mBounds[1][d] : 0);
+        d2 += e * e;
+    }
+
+    return d2;
+}
+
+
+//
+// Name :         CBoundingBox::Outside()
+// Description :  Is the box entirely on the outside of one of the planes?
+//                The inside of plane (a, b, c, d) is ax + by + cz + d >= 0.
+//                Only the corner farthest inside needs to be tested.  A box
+//                outside of the region the planes bound may not be outside
+//                of any one plane, so this can miss a box that is outside.
+//
+
+bool CBoundingBox::Outside(const CGrVector *p_planes, int p_count) const
+{
+    for(int i=0;  i<p_count;  i++)
+    {
+        const CGrVector &plane = p_planes[i];
+        double x = plane.X() >= 0 ? mBounds[1].X() : mBounds[0].X();
+        double y = plane.Y() >= 0 ? mBounds[1].Y() : mBounds[0].Y();
+        double z = plane.Z() >= 0 ? mBounds[1].Z() : mBounds[0].Z();
+        if(plane.X() * x + plane.Y() * y + plane.Z() * z + plane.W() < 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+//
+// Name :         CBoundingBox::Entry()
+// Description :  Where a ray enters the box grown by p_grow on every
+//                side, 0 if it starts inside.  A sphere of radius p_grow
+//                on the ray cannot touch anything in the box before then.
+// Returns :      false if the ray misses the grown box before p_maxt.
+//
+
+bool CBoundingBox::Entry(const CRayp &ray, double p_grow, double p_maxt, double &p_t) const
+{
+    double t0 = 0;
+    double t1 = p_maxt;
+
+    for(int d=0;  d<3;  d++)
+    {
+        double o = ray.Origin(d);
+        double lo = mBounds[0][d] - p_grow;
+        double hi = mBounds[1][d] + p_grow;
+        if(ray.Direction(d) == 0)
+        {
+            if(o < lo || o > hi)
+                return false;
+            continue;
+        }
+
+        double ta = (lo - o) * ray.InvDirection()[d];
+        double tb = (hi - o) * ray.InvDirection()[d];
+        if(ta > tb)
+        {
+            double s = ta;  ta = tb;  tb = s;
+        }
+
+        t0 = bmax(t0, ta);
+        t1 = bmin(t1, tb);
+        if(t0 > t1)
+            return false;
+    }
+
+    p_t = t0;
+    return true;
+}
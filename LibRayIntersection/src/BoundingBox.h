@@ -31,10 +31,13 @@ public:
 
     void IntersectWith(const CBoundingBox &box);
     bool IntersectTest(const CRayp &ray, double t0=0, double t1=1e10) const;
+    double Distance2(const CGrVector &p) const;
+    bool Outside(const CGrVector *p_planes, int p_count) const;
+    bool Entry(const CRayp &ray, double p_grow, double p_maxt, double &p_t) const;
 
-    bool IsEmpty() {return mBounds[0].X() >= mBounds[1].X() || 
-                           mBounds[0].Y() >= mBounds[1].Y() || 
-                           mBounds[0].Z() >= mBounds[1].Z();}
+    bool IsEmpty() {return mBounds[0].X() > mBounds[1].X() || 
+                           mBounds[0].Y() > mBounds[1].Y() || 
+                           mBounds[0].Z() > mBounds[1].Z();}
 
 private:
     CGrVector       mBounds[2];     // 0=min, 1=max
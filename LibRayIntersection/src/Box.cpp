@@ -0,0 +1,346 @@
+#include "stdafx.h"
+#include "Box.h"
+#include <cmath>
+
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+
+inline double bmin(double a, double b) {return a < b ? a : b;}
+
+//
+// The faces are numbered 2 * dimension, plus one for the maximum side.
+// For each face, the texture coordinates are
+//     s = (p[sdim] - m_min[sdim]) / extent, reversed if sflip
+//     t = (p[tdim] - m_min[tdim]) / extent, reversed if tflip
+//
+
+struct BoxFace
+{
+    int     m_sdim;
+    bool    m_sflip;
+    int     m_tdim;
+    bool    m_tflip;
+};
+
+static const BoxFace Faces[6] = {
+    {2, false, 1, false},       // Left, x = min
+    {2, true, 1, false},        // Right, x = max
+    {0, false, 2, false},       // Bottom, y = min
+    {0, false, 2, true},        // Top, y = max
+    {0, true, 1, false},        // Back, z = min
+    {0, false, 1, false}        // Front, z = max
+};
+
+
+CBox::CBox(const CGrVector &p_min, const CGrVector &p_max)
+{
+    m_min = p_min;
+    m_max = p_max;
+
+    CBoundingBox box(p_min);
+    box.Include(p_max);
+    SetBoundingBox(box);
+}
+
+CBox::~CBox(void)
+{
+}
+
+
+//
+// Name :         CBox::Slabs()
+// Description :  The slab test.  The ray is inside the box between the
+//                largest entry and the smallest exit over the three 
+//                dimensions.  Returns false if the ray misses.
+//
+
+bool CBox::Slabs(const CRayp &ray, double &p_t0, double &p_t1) const
+{
+    p_t0 = -1e300;
+    p_t1 = 1e300;
+
+    for(int d=0;  d<3;  d++)
+    {
+        double o = ray.Origin(d);
+        if(ray.Direction(d) >= -TINY && ray.Direction(d) <= TINY)
+        {
+            // Parallel to the slab
+            if(o < m_min[d] || o > m_max[d])
+                return false;
+            continue;
+        }
+
+        double ta = (m_min[d] - o) * ray.InvDirection()[d];
+        double tb = (m_max[d] - o) * ray.InvDirection()[d];
+        if(ta > tb)
+        {
+            double s = ta;  ta = tb;  tb = s;
+        }
+
+        if(ta > p_t0)
+            p_t0 = ta;
+        if(tb < p_t1)
+            p_t1 = tb;
+        if(p_t0 > p_t1)
+            return false;
+    }
+
+    return true;
+}
+
+
+//
+// Name :         CBox::ComputeT()
+// Description :  The entry, or the exit for a ray that starts inside.
+//
+
+double CBox::ComputeT(const CRayp &ray)
+{
+    double t0, t1;
+    if(!Slabs(ray, t0, t1))
+        return -1;
+
+    if(t0 > TINY)
+        return t0;
+    return t1 > TINY ? t1 : -1;
+}
+
+
+//
+// Name :         CBox::ComputeNextT()
+// Description :  The exit, if it is beyond t.
+//
+
+double CBox::ComputeNextT(const CRayp &ray, double t)
+{
+    double t0, t1;
+    if(!Slabs(ray, t0, t1))
+        return -1;
+
+    return t1 > t + TINY ? t1 : -1;
+}
+
+
+//
+// Name :         CBox::ClosestPoint()
+// Description :  A point outside is clamped to the box.  A point inside
+//                moves to the nearest face.
+//
+
+bool CBox::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    p_closest = p;
+    bool inside = true;
+    for(int d=0;  d<3;  d++)
+    {
+        if(p[d] < m_min[d])
+        {
+            p_closest[d] = m_min[d];
+            inside = false;
+        }
+        else if(p[d] > m_max[d])
+        {
+            p_closest[d] = m_max[d];
+            inside = false;
+        }
+    }
+
+    if(inside)
+    {
+        int dim = 0;
+        double nearest = 1e300;
+        double to = 0;
+        for(int d=0;  d<3;  d++)
+        {
+            if(p[d] - m_min[d] < nearest)
+            {
+                nearest = p[d] - m_min[d];
+                dim = d;
+                to = m_min[d];
+            }
+
+            if(m_max[d] - p[d] < nearest)
+            {
+                nearest = m_max[d] - p[d];
+                dim = d;
+                to = m_max[d];
+            }
+        }
+
+        p_closest[dim] = to;
+    }
+
+    return true;
+}
+
+
+//
+// Name :         CBox::SweepSphere()
+// Description :  From outside, the sphere touches when its center enters
+//                the box grown by r with rounded edges and corners.  The
+//                slab test on the grown box finds that if the entry point
+//                is beside a face.  Beyond an edge or a corner, the center
+//                enters one of the rounded parts, which are the edge and
+//                corner tests.  From inside, the center leaves the box 
+//                shrunk by r.
+//
+
+bool CBox::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
+{
+    const CGrVector &o = ray.Origin();
+
+    // Touching already
+    CGrVector closest;
+    ClosestPoint(o, closest);
+    if((closest - o).LengthSquared3() <= p_radius * p_radius)
+    {
+        p_t = 0;
+        p_contact = closest;
+        return true;
+    }
+
+    bool inside = true;
+    for(int d=0;  d<3;  d++)
+    {
+        if(o[d] < m_min[d] || o[d] > m_max[d])
+            inside = false;
+    }
+
+    double t = 1e300;
+    if(inside)
+    {
+        for(int d=0;  d<3;  d++)
+        {
+            if(ray.Direction(d) > TINY)
+                t = bmin(t, (m_max[d] - p_radius - o[d]) * ray.InvDirection()[d]);
+            else if(ray.Direction(d) < -TINY)
+                t = bmin(t, (m_min[d] + p_radius - o[d]) * ray.InvDirection()[d]);
+        }
+    }
+    else
+    {
+        CBoundingBox grown(m_min);
+        grown.Include(m_max);
+        double entry;
+        if(!grown.Entry(ray, p_radius, p_maxt, entry))
+            return false;
+
+        CGrVector p = ray.PointOnRay(entry);
+        int outside = 0;
+        for(int d=0;  d<3;  d++)
+        {
+            if(p[d] < m_min[d] - TINY || p[d] > m_max[d] + TINY)
+                outside++;
+        }
+
+        if(outside <= 1)
+            t = entry;
+        else
+        {
+            // The twelve edges, each from a corner to the corner across
+            // one dimension, and the eight corners
+            for(int c=0;  c<8;  c++)
+            {
+                CGrVector corner((c & 1) ? m_max.X() : m_min.X(), (c & 2) ? m_max.Y() : m_min.Y(), 
+                    (c & 4) ? m_max.Z() : m_min.Z());
+
+                double tc;
+                CGrVector contact;
+                if(SweepPoint(corner, ray, p_radius, tc))
+                    t = bmin(t, tc);
+
+                for(int d=0;  d<3;  d++)
+                {
+                    if(c & (1 << d))
+                        continue;
+
+                    CGrVector other = corner;
+                    other[d] = m_max[d];
+                    if(SweepEdge(corner, other, ray, p_radius, tc, contact))
+                        t = bmin(t, tc);
+                }
+            }
+        }
+    }
+
+    if(t < 0 || t > p_maxt)
+        return false;
+
+    p_t = t;
+    return ClosestPoint(ray.PointOnRay(t), p_contact);
+}
+
+
+//
+// Name :         CBox::Face()
+// Description :  The face a surface point is on, the one it is nearest.
+//
+
+int CBox::Face(const CGrVector &intersect) const
+{
+    int face = 0;
+    double nearest = 1e300;
+    for(int d=0;  d<3;  d++)
+    {
+        double dmin = fabs(intersect[d] - m_min[d]);
+        double dmax = fabs(intersect[d] - m_max[d]);
+        if(dmin < nearest)
+        {
+            nearest = dmin;
+            face = 2 * d;
+        }
+
+        if(dmax < nearest)
+        {
+            nearest = dmax;
+            face = 2 * d + 1;
+        }
+    }
+
+    return face;
+}
+
+
+void CBox::IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    int face = Face(intersect);
+    const BoxFace &f = Faces[face];
+
+    p_normal = CGrVector(0, 0, 0, 0);
+    p_normal[face / 2] = (face & 1) ? 1 : -1;
+
+    double st[2];
+    for(int i=0;  i<2;  i++)
+    {
+        int d = i == 0 ? f.m_sdim : f.m_tdim;
+        bool flip = i == 0 ? f.m_sflip : f.m_tflip;
+        double extent = m_max[d] - m_min[d];
+        double v = extent > 0 ? (intersect[d] - m_min[d]) / extent : 0;
+        st[i] = flip ? 1 - v : v;
+    }
+
+    p_texcoord = CGrVector(st[0], st[1], 0);
+}
+
+
+void CBox::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    int face = Face(intersect);
+    const BoxFace &f = Faces[face];
+
+    p_normal = CGrVector(0, 0, 0, 0);
+    p_normal[face / 2] = (face & 1) ? 1 : -1;
+
+    p_dsdp = CGrVector(0, 0, 0, 0);
+    p_dtdp = CGrVector(0, 0, 0, 0);
+
+    double extent = m_max[f.m_sdim] - m_min[f.m_sdim];
+    if(extent > 0)
+        p_dsdp[f.m_sdim] = (f.m_sflip ? -1 : 1) / extent;
+
+    extent = m_max[f.m_tdim] - m_min[f.m_tdim];
+    if(extent > 0)
+        p_dtdp[f.m_tdim] = (f.m_tflip ? -1 : 1) / extent;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "IntersectionObject.h"
+
+//
+// class CBox
+// An axis-aligned box intersected exactly.  Each face has texture
+// coordinates from 0 to 1 across it, oriented the way 
+// CGrComposite::Box() gives its six polygons.
+//
+
+class CBox : public CIntersectionObject
+{
+public:
+    CBox(const CGrVector &p_min, const CGrVector &p_max);
+    virtual ~CBox(void);
+
+    virtual CRayIntersection::ObjectType Type() const {return CRayIntersection::Box;}
+
+    // The box is not built from vertices
+    virtual void AddVertex(const CGrVector &/*v*/) {}
+    virtual void AddNormal(const CGrVector &/*n*/) {}
+    virtual void AddTexVertex(const CGrVector &/*t*/) {}
+
+    virtual double ComputeT(const CRayp &ray);
+    virtual double ComputeNextT(const CRayp &ray, double t);
+    virtual bool SurfaceTest(const CGrVector &/*intersect*/) {return true;}
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+    virtual bool SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const;
+
+    virtual void IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+private:
+    bool Slabs(const CRayp &ray, double &p_t0, double &p_t1) const;
+    int Face(const CGrVector &intersect) const;
+
+    CGrVector  m_min;
+    CGrVector  m_max;
+};
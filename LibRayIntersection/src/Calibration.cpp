@@ -0,0 +1,346 @@
+//
+// Name :         Calibration.cpp
+// Description :  Calibration of the kd-tree build costs.  The surface
+//                area heuristic compares the cost of testing the objects
+//                in a node against the cost of traversing a split.  We
+//                time both on this machine and derive the intersection
+//                cost from the ratio.
+//
+
+#include "stdafx.h"
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "RayIntersectionD.h"
+#include "Rayp.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+namespace
+{
+    const int CALOBJECTS = 256;         // Objects of each kind to sample
+    const int CALTESTS = 100000;        // Object tests per timing
+    const int CALNODES = 4096;          // Interior nodes in the traversal test
+    const int CALSTEPS = 200000;        // Traversal steps per timing
+    const int CALREPEAT = 5;            // Timings, we keep the fastest
+
+    const int CALVERSION = 1;           // Profile file version
+
+    // Keeps the optimizer from removing the timed work
+    volatile double g_sink;
+
+    double Nanoseconds(Clock::duration d)
+    {
+        return chrono::duration<double, nano>(d).count();
+    }
+
+    //
+    // Name :         TimeObjects()
+    // Description :  Time a distance computation and, when the plane is
+    //                hit, an interior test, which is the work a leaf does
+    //                for each member.  Each object gets a few rays aimed
+    //                near its middle so about half of the tests succeed.
+    //
+
+    double TimeObjects(const vector<CIntersectionObject *> &p_objects, mt19937 &p_random)
+    {
+        uniform_real_distribution<double> unit(-1, 1);
+
+        vector<CRayp> rays;
+        for(size_t i=0;  i<p_objects.size();  i++)
+        {
+            const CBoundingBox &box = p_objects[i]->GetBoundingBox();
+            CGrVector center = (box.Min() + box.Max()) * 0.5;
+            double size = box.Extent().Length3() + 1e-3;
+
+            CGrVector out(unit(p_random), unit(p_random), unit(p_random), 0);
+            CGrVector jitter(unit(p_random), unit(p_random), unit(p_random), 0);
+            CGrVector origin = center + Normalize3(out) * (size * 4);
+            CGrVector target = center + jitter * (size * 0.3);
+            rays.push_back(CRayp(CRay(origin, Normalize3(target - origin))));
+        }
+
+        double best = 0;
+        for(int r=0;  r<CALREPEAT;  r++)
+        {
+            double sum = 0;
+            Clock::time_point start = Clock::now();
+            for(int i=0;  i<CALTESTS;  i++)
+            {
+                size_t o = i % p_objects.size();
+                CIntersectionObject *object = p_objects[o];
+                double t = object->ComputeT(rays[o]);
+                if(t > 0 && object->SurfaceTest(rays[o].PointOnRay(t)))
+                    sum += t;
+            }
+
+            double ns = Nanoseconds(Clock::now() - start) / CALTESTS;
+            if(r == 0 || ns < best)
+                best = ns;
+            g_sink = sum;
+        }
+
+        return best;
+    }
+
+    //
+    // Name :         TimeTraverse()
+    // Description :  Time one interior node step of the traversal loop in
+    //                CRayIntersectionD::Intersect().  The nodes are visited
+    //                in a random order so the loads cost what they do in a
+    //                real tree.
+    //
+
+    double TimeTraverse(mt19937 &p_random)
+    {
+        uniform_real_distribution<double> unit(-1, 1);
+
+        struct Node
+        {
+            int     m_dim;
+            int     m_next;
+            double  m_split;
+        };
+
+        vector<Node> nodes(CALNODES);
+        for(int i=0;  i<CALNODES;  i++)
+        {
+            nodes[i].m_dim = i % 3;
+            nodes[i].m_split = unit(p_random);
+            nodes[i].m_next = uniform_int_distribution<int>(0, CALNODES - 1)(p_random);
+        }
+
+        CRayp ray(CRay(CGrVector(unit(p_random), unit(p_random), unit(p_random)),
+                       Normalize3(CGrVector(unit(p_random), unit(p_random), unit(p_random), 0))));
+
+        struct StackItem
+        {
+            StackItem(int n, double tn, double tf) : node(n), tNear(tn), tFar(tf) {}
+            int     node;
+            double  tNear;
+            double  tFar;
+        };
+
+        vector<StackItem> stack;
+        stack.reserve(64);
+
+        double best = 0;
+        for(int r=0;  r<CALREPEAT;  r++)
+        {
+            int node = 0;
+            double tNear = 0;
+            double tFar = 4;
+            double sum = 0;
+
+            Clock::time_point start = Clock::now();
+            for(int i=0;  i<CALSTEPS;  i++)
+            {
+                const Node &n = nodes[node];
+                double rFm = ray.Origin(n.m_dim) + ray.Direction(n.m_dim) * tNear;
+                double rTo = ray.Origin(n.m_dim) + ray.Direction(n.m_dim) * tFar;
+
+                if(rFm < n.m_split && rTo < n.m_split)
+                    node = n.m_next;
+                else if(rFm > n.m_split && rTo > n.m_split)
+                    node = nodes[n.m_next].m_next;
+                else
+                {
+                    double tAtSplit = (n.m_split - ray.Origin(n.m_dim)) / ray.Direction(n.m_dim);
+                    stack.push_back(StackItem(nodes[n.m_next].m_next, tAtSplit, tFar));
+                    node = n.m_next;
+                    sum += tAtSplit;
+                }
+
+                // Model the pops of the leaves we would reach
+                if(stack.size() > 8)
+                {
+                    node = stack.back().node;
+                    sum += stack.back().tNear + stack.back().tFar;
+                    stack.clear();
+                }
+            }
+
+            double ns = Nanoseconds(Clock::now() - start) / CALSTEPS;
+            if(r == 0 || ns < best)
+                best = ns;
+            g_sink = sum;
+            stack.clear();
+        }
+
+        return best;
+    }
+
+    // The hardware identification stored in a profile
+    int MachineThreads()
+    {
+        return int(thread::hardware_concurrency());
+    }
+}
+
+
+//
+// Name :         CRayIntersectionD::Calibrate()
+// Description :  Measure the object and traversal costs and keep them
+//                as the calibration.  Objects are sampled evenly from
+//                those loaded.  If none of a kind are loaded, a stand-in
+//                triangle or square is timed instead.
+//
+
+CRayIntersection::Calibration CRayIntersectionD::Calibrate()
+{
+    mt19937 random(1);
+
+    // Stand-ins
+    CTriangle triangle;
+    triangle.AddNormal(CGrVector(0, 0, 1, 0));
+    triangle.AddVertex(CGrVector(0, 0, 0));
+    triangle.AddVertex(CGrVector(1, 0, 0));
+    triangle.AddVertex(CGrVector(0, 1, 0));
+    triangle.TriangleEnd();
+
+    CPolygon square;
+    square.AddNormal(CGrVector(0, 0, 1, 0));
+    square.AddVertex(CGrVector(0, 0, 0));
+    square.AddVertex(CGrVector(1, 0, 0));
+    square.AddVertex(CGrVector(1, 1, 0));
+    square.AddVertex(CGrVector(0, 1, 0));
+    square.PolygonEnd();
+
+    vector<CIntersectionObject *> polygons;
+    size_t stride = m_polys.size() / CALOBJECTS + 1;
+    size_t i = 0;
+    for(list<CPolygon>::iterator poly=m_polys.begin();  poly!=m_polys.end();  poly++, i++)
+    {
+        if(i % stride == 0)
+            polygons.push_back(&(*poly));
+    }
+
+    if(polygons.empty())
+        polygons.push_back(&square);
+
+    vector<CIntersectionObject *> triangles;
+    stride = m_triangles.size() / CALOBJECTS + 1;
+    i = 0;
+    for(list<CTriangle>::iterator tri=m_triangles.begin();  tri!=m_triangles.end();  tri++, i++)
+    {
+        if(i % stride == 0)
+            triangles.push_back(&(*tri));
+    }
+
+    if(triangles.empty())
+        triangles.push_back(&triangle);
+
+    CRayIntersection::Calibration c;
+    c.m_traverse = TimeTraverse(random);
+    c.m_polygon = TimeObjects(polygons, random);
+    c.m_triangle = TimeObjects(triangles, random);
+
+    m_calibration = c;
+    return c;
+}
+
+
+//
+// Name :         CRayIntersectionD::ApplyCalibration()
+// Description :  Set the intersection cost for the loaded scene from the
+//                calibration.  The traversal cost is the unit, so the
+//                intersection cost is the ratio of an average object test
+//                to a traversal step.
+//
+
+void CRayIntersectionD::ApplyCalibration()
+{
+    if(!m_calibration.IsValid())
+        return;
+
+    double np = double(m_polys.size());
+    double nt = double(m_triangles.size() + m_moving.size());
+
+    // A patch test is at least as costly as a polygon test
+    np += double(m_patches.size());
+
+    // Primitive tests, and the application's own, are about the cost of
+    // a triangle test
+    nt += double(m_spheres.size() + m_boxes.size() + m_cylinders.size() + m_userPrims.size());
+    if(np + nt == 0)
+        return;
+
+    double objectTime = (np * m_calibration.m_polygon + nt * m_calibration.m_triangle) / (np + nt);
+    m_intersectionCost = m_traverseCost * objectTime / m_calibration.m_traverse;
+}
+
+
+//
+// Name :         CRayIntersection::Calibration::Save()
+// Description :  Save a calibration profile.  The format is one
+//                name and value per line.
+//
+
+bool CRayIntersection::Calibration::Save(const char *path) const
+{
+    if(!IsValid())
+        return false;
+
+    ofstream str(path);
+    if(!str)
+        return false;
+
+    str.precision(10);
+    str << "# libRayIntersection calibration profile, times in nanoseconds" << endl;
+    str << "version " << CALVERSION << endl;
+    str << "threads " << MachineThreads() << endl;
+    str << "traverse " << m_traverse << endl;
+    str << "polygon " << m_polygon << endl;
+    str << "triangle " << m_triangle << endl;
+
+    return bool(str);
+}
+
+
+bool CRayIntersection::Calibration::Load(const char *path)
+{
+    ifstream str(path);
+    if(!str)
+        return false;
+
+    Calibration c;
+    int version = 0;
+    int threads = 0;
+
+    string name;
+    while(str >> name)
+    {
+        if(name[0] == '#')
+        {
+            getline(str, name);
+            continue;
+        }
+
+        if(name == "version")
+            str >> version;
+        else if(name == "threads")
+            str >> threads;
+        else if(name == "traverse")
+            str >> c.m_traverse;
+        else if(name == "polygon")
+            str >> c.m_polygon;
+        else if(name == "triangle")
+            str >> c.m_triangle;
+        else
+            return false;
+
+        if(!str)
+            return false;
+    }
+
+    if(version != CALVERSION || threads != MachineThreads() || !c.IsValid())
+        return false;
+
+    *this = c;
+    return true;
+}
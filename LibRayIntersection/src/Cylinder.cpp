@@ -0,0 +1,436 @@
+#include "stdafx.h"
+#include "Cylinder.h"
+#include <cmath>
+
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+const double PI = 3.1415926535897932384626433832795;
+
+inline double bmin(double a, double b) {return a < b ? a : b;}
+inline double bmax(double a, double b) {return a < b ? b : a;}
+
+CCylinder::CCylinder(const CGrVector &p_base, const CGrVector &p_top, double p_radius)
+{
+    m_base = p_base;
+    m_radius = p_radius;
+
+    m_axis = p_top - p_base;
+    m_axis.W() = 0;
+    m_length = m_axis.Length3();
+    if(m_length > 0)
+        m_axis /= m_length;
+    else
+        m_axis = CGrVector(0, 1, 0, 0);
+
+    // For a cylinder along y, u is x and v is z, so the side has the
+    // same s as a sphere
+    CGrVector ref = fabs(m_axis.X()) < 0.9 ? CGrVector(1, 0, 0, 0) : CGrVector(0, 1, 0, 0);
+    m_v = Normalize3(Cross(ref, m_axis));
+    m_u = Cross(m_axis, m_v);
+
+    // The box around the two cap disks.  A disk extends r sqrt(1 - a^2)
+    // in a dimension where the axis component is a.
+    CGrVector r;
+    for(int d=0;  d<3;  d++)
+    {
+        double a = m_axis[d];
+        r[d] = p_radius * sqrt(a * a < 1 ? 1 - a * a : 0);
+    }
+    r.W() = 0;
+
+    CBoundingBox box(p_base - r);
+    box.Include(p_base + r);
+    box.Include(p_top - r);
+    box.Include(p_top + r);
+    SetBoundingBox(box);
+}
+
+CCylinder::~CCylinder(void)
+{
+}
+
+
+//
+// Name :         CCylinder::ComputeT()
+// Description :  The nearest of the hits on the infinite cylinder 
+//                between the caps and the hits on the cap disks.
+//
+
+double CCylinder::ComputeT(const CRayp &ray)
+{
+    CGrVector oc = ray.Origin() - m_base;
+    const CGrVector &d = ray.Direction();
+
+    double oa = Dot3(oc, m_axis);
+    double da = Dot3(d, m_axis);
+
+    double nearest = -1;
+
+    // The side, using the components perpendicular to the axis
+    CGrVector op = oc - m_axis * oa;
+    CGrVector dp = d - m_axis * da;
+    double a = Dot3(dp, dp);
+    if(a > TINY)
+    {
+        double b = Dot3(op, dp);
+        double c = Dot3(op, op) - m_radius * m_radius;
+        double disc = b * b - a * c;
+        if(disc >= 0)
+        {
+            double root = sqrt(disc);
+            for(int i=0;  i<2;  i++)
+            {
+                double t = (-b + (i == 0 ? -root : root)) / a;
+                if(t <= TINY)
+                    continue;
+
+                double h = oa + da * t;
+                if(h >= 0 && h <= m_length)
+                {
+                    nearest = t;
+                    break;
+                }
+            }
+        }
+    }
+
+    // The caps
+    if(da < -TINY || da > TINY)
+    {
+        for(int i=0;  i<2;  i++)
+        {
+            double t = ((i == 0 ? 0 : m_length) - oa) / da;
+            if(t <= TINY || (nearest >= 0 && t >= nearest))
+                continue;
+
+            CGrVector p = op + dp * t;
+            if(Dot3(p, p) <= m_radius * m_radius)
+                nearest = t;
+        }
+    }
+
+    return nearest;
+}
+
+
+//
+// Name :         CCylinder::ClosestPoint()
+// Description :  The nearest of the side with the height clamped to the
+//                caps and the two caps with the distance from the axis 
+//                clamped to the radius.
+//
+
+bool CCylinder::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    CGrVector bp = p - m_base;
+    double h = Dot3(bp, m_axis);
+    CGrVector across = bp - m_axis * h;
+    across.W() = 0;
+    double r = across.Length3();
+    CGrVector out = r > 0 ? across / r : m_u;
+
+    double hs = h < 0 ? 0 : (h > m_length ? m_length : h);
+    double rc = r < m_radius ? r : m_radius;
+
+    CGrVector candidates[3] = {
+        m_base + m_axis * hs + out * m_radius,
+        m_base + out * rc,
+        m_base + m_axis * m_length + out * rc};
+
+    double best = 1e300;
+    for(int i=0;  i<3;  i++)
+    {
+        double d2 = (candidates[i] - p).LengthSquared3();
+        if(d2 < best)
+        {
+            best = d2;
+            p_closest = candidates[i];
+        }
+    }
+
+    return true;
+}
+
+
+//
+// Name :         Polynomial()
+// Description :  The value of c[0] + c[1] t + ... + c[n] t^n.
+//
+
+static double Polynomial(const double *c, int n, double t)
+{
+    double v = c[n];
+    for(int i=n-1;  i>=0;  i--)
+        v = v * t + c[i];
+    return v;
+}
+
+
+//
+// Name :         Roots()
+// Description :  The real roots of a polynomial of degree 4 or less from
+//                p_lo to p_hi, in order.  Between the roots of the 
+//                derivative the polynomial only rises or only falls, so
+//                each of those pieces has one root at most, found by 
+//                bisection.  A root where the polynomial only touches 
+//                zero is not found.
+// Returns :      The number of roots.
+//
+
+static int Roots(const double *c, int n, double p_lo, double p_hi, double *p_roots)
+{
+    while(n > 0 && c[n] == 0)
+        n--;
+
+    if(n == 0)
+        return 0;
+
+    if(n == 1)
+    {
+        double t = -c[0] / c[1];
+        if(t < p_lo || t > p_hi)
+            return 0;
+
+        p_roots[0] = t;
+        return 1;
+    }
+
+    double dc[4] = {0, 0, 0, 0};
+    for(int i=1;  i<=n;  i++)
+        dc[i - 1] = c[i] * i;
+
+    double critical[4];
+    int cnt = Roots(dc, n - 1, p_lo, p_hi, critical);
+
+    int found = 0;
+    double a = p_lo;
+    double fa = Polynomial(c, n, a);
+    for(int i=0;  i<=cnt;  i++)
+    {
+        double b = i < cnt ? critical[i] : p_hi;
+        double fb = Polynomial(c, n, b);
+
+        if(fa == 0)
+        {
+            if(found == 0 || p_roots[found - 1] < a)
+                p_roots[found++] = a;
+        }
+        else if(fb == 0 || (fa < 0) != (fb < 0))
+        {
+            double lo = a;
+            double hi = b;
+            for(int j=0;  j<100 && lo < hi;  j++)
+            {
+                double mid = (lo + hi) * 0.5;
+                if(mid <= lo || mid >= hi)
+                    break;
+
+                double fm = Polynomial(c, n, mid);
+                if(fm == 0)
+                {
+                    lo = hi = mid;
+                    break;
+                }
+
+                if((fm < 0) == (fa < 0))
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+
+            p_roots[found++] = hi;
+        }
+
+        a = b;
+        fa = fb;
+    }
+
+    return found;
+}
+
+
+//
+// Name :         CCylinder::SweepSphere()
+// Description :  The sphere touches the side when its center is R + r or
+//                R - r from the axis between the caps, a cap when it is r
+//                from the cap plane within R of the axis, and a rim when
+//                it is r from the rim circle, on a torus.  Each of those
+//                is a touch, and the first touch is one of them, so it is
+//                the first of them.
+//
+
+bool CCylinder::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
+{
+    // Touching already
+    CGrVector closest;
+    ClosestPoint(ray.Origin(), closest);
+    if((closest - ray.Origin()).LengthSquared3() <= p_radius * p_radius)
+    {
+        p_t = 0;
+        p_contact = closest;
+        return true;
+    }
+
+    // The ray in the frame of the cylinder, h along the axis
+    CGrVector bo = ray.Origin() - m_base;
+    double oh = Dot3(bo, m_axis);
+    double ou = Dot3(bo, m_u);
+    double ov = Dot3(bo, m_v);
+    double dh = Dot3(ray.Direction(), m_axis);
+    double du = Dot3(ray.Direction(), m_u);
+    double dv = Dot3(ray.Direction(), m_v);
+
+    double a = du * du + dv * dv;
+    double b = ou * du + ov * dv;
+    double c = ou * ou + ov * ov;
+
+    double best = p_maxt;
+    bool found = false;
+
+    // The side, from outside and from inside
+    double reach[2] = {m_radius + p_radius, m_radius - p_radius};
+    for(int s=0;  s<2 && a > TINY;  s++)
+    {
+        double disc = b * b - a * (c - reach[s] * reach[s]);
+        if(reach[s] <= 0 || disc < 0)
+            continue;
+
+        for(int sign=-1;  sign<=1;  sign+=2)
+        {
+            double t = (-b + sign * sqrt(disc)) / a;
+            double h = oh + dh * t;
+            if(t >= 0 && t <= best && h >= 0 && h <= m_length)
+            {
+                best = t;
+                found = true;
+            }
+        }
+    }
+
+    // The caps, from either side
+    double planes[4] = {-p_radius, p_radius, m_length - p_radius, m_length + p_radius};
+    for(int p=0;  p<4 && (dh > TINY || dh < -TINY);  p++)
+    {
+        double t = (planes[p] - oh) / dh;
+        if(t >= 0 && t <= best && a * t * t + 2 * b * t + c <= m_radius * m_radius)
+        {
+            best = t;
+            found = true;
+        }
+    }
+
+    // The rims.  With p relative to the rim center and k = R^2 - r^2,
+    // the torus is (|p|^2 + k)^2 = 4 R^2 (pu^2 + pv^2).
+    double k = m_radius * m_radius - p_radius * p_radius;
+    double r4 = 4 * m_radius * m_radius;
+    double dd = a + dh * dh;
+    for(int rim=0;  rim<2;  rim++)
+    {
+        double rh = oh - (rim ? m_length : 0);
+        double g1 = 2 * (b + rh * dh);
+        double g0 = c + rh * rh + k;
+
+        double poly[5] = {g0 * g0 - r4 * c, 2 * g1 * g0 - r4 * 2 * b, 
+            g1 * g1 + 2 * dd * g0 - r4 * a, 2 * dd * g1, dd * dd};
+
+        // The torus is within r of the rim plane
+        double lo = 0;
+        double hi = best;
+        if(dh > TINY || dh < -TINY)
+        {
+            double ta = (-p_radius - rh) / dh;
+            double tb = (p_radius - rh) / dh;
+            lo = bmax(lo, ta < tb ? ta : tb);
+            hi = bmin(hi, ta < tb ? tb : ta);
+        }
+        else if(rh < -p_radius || rh > p_radius)
+            continue;
+
+        double roots[4];
+        if(lo <= hi && Roots(poly, 4, lo, hi, roots) > 0)
+        {
+            best = roots[0];
+            found = true;
+        }
+    }
+
+    if(!found)
+        return false;
+
+    p_t = best;
+    return ClosestPoint(ray.PointOnRay(best), p_contact);
+}
+
+
+//
+// Name :         CCylinder::Surface()
+// Description :  Which part of the cylinder a surface point is on, the
+//                one it is nearest.  Returns the height along the axis
+//                and the components across it.
+//
+
+CCylinder::Part CCylinder::Surface(const CGrVector &intersect, double &p_h, double &p_u, double &p_v) const
+{
+    CGrVector p = intersect - m_base;
+    p_h = Dot3(p, m_axis);
+    p_u = Dot3(p, m_u);
+    p_v = Dot3(p, m_v);
+
+    double side = fabs(sqrt(p_u * p_u + p_v * p_v) - m_radius);
+    double base = fabs(p_h);
+    double top = fabs(p_h - m_length);
+
+    if(side <= base && side <= top)
+        return Side;
+    return base < top ? Base : Top;
+}
+
+
+void CCylinder::IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    double h, u, v;
+    switch(Surface(intersect, h, u, v))
+    {
+    case Side:
+        p_normal = Normalize3(m_u * u + m_v * v);
+        p_texcoord = CGrVector(atan2(u, v) / (2 * PI) + 0.5, m_length > 0 ? h / m_length : 0, 0);
+        break;
+
+    case Base:
+        p_normal = -m_axis;
+        p_texcoord = CGrVector(0.5 + u / (2 * m_radius), 0.5 + v / (2 * m_radius), 0);
+        break;
+
+    case Top:
+        p_normal = m_axis;
+        p_texcoord = CGrVector(0.5 + u / (2 * m_radius), 0.5 + v / (2 * m_radius), 0);
+        break;
+    }
+}
+
+
+void CCylinder::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    double h, u, v;
+    Part part = Surface(intersect, h, u, v);
+    switch(part)
+    {
+    case Side:
+        {
+            // s = atan2(u, v) / 2pi around the axis
+            double uv2 = u * u + v * v;
+            p_normal = Normalize3(m_u * u + m_v * v);
+            p_dsdp = uv2 > 0 ? (m_u * v - m_v * u) / (2 * PI * uv2) : CGrVector(0, 0, 0, 0);
+            p_dtdp = m_length > 0 ? m_axis / m_length : CGrVector(0, 0, 0, 0);
+        }
+        break;
+
+    default:
+        p_normal = part == Base ? -m_axis : m_axis;
+        p_dsdp = m_u / (2 * m_radius);
+        p_dtdp = m_v / (2 * m_radius);
+        break;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "IntersectionObject.h"
+
+//
+// class CCylinder
+// A capped cylinder intersected exactly.  It runs from the center of
+// the base to the center of the top and may have any orientation.  
+// On the side s goes around the axis and t goes from 0 at the base to 
+// 1 at the top.  The caps are mapped flat, s and t from 0 to 1 across 
+// the diameter.
+//
+
+class CCylinder : public CIntersectionObject
+{
+public:
+    CCylinder(const CGrVector &p_base, const CGrVector &p_top, double p_radius);
+    virtual ~CCylinder(void);
+
+    virtual CRayIntersection::ObjectType Type() const {return CRayIntersection::Cylinder;}
+
+    // The cylinder is not built from vertices
+    virtual void AddVertex(const CGrVector &/*v*/) {}
+    virtual void AddNormal(const CGrVector &/*n*/) {}
+    virtual void AddTexVertex(const CGrVector &/*t*/) {}
+
+    virtual double ComputeT(const CRayp &ray);
+    virtual bool SurfaceTest(const CGrVector &/*intersect*/) {return true;}
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+    virtual bool SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const;
+
+    virtual void IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+private:
+    enum Part {Side, Base, Top};
+    Part Surface(const CGrVector &intersect, double &p_h, double &p_u, double &p_v) const;
+
+    CGrVector  m_base;
+    CGrVector  m_axis;          // Unit vector from base to top
+    double     m_length;
+    double     m_radius;
+
+    // Directions perpendicular to the axis the texture angle is measured in
+    CGrVector  m_u;
+    CGrVector  m_v;
+};
@@ -0,0 +1,129 @@
+//
+// Name :         Epoch.cpp
+// Description :  Implementation of CEpoch, epoch based reclamation.
+//                Each thread that reads owns a slot holding the epoch it
+//                entered in (0 when it is not reading).  Memory retired
+//                with tag e may be freed once every slot is 0 or > e.
+//                All operations are sequentially consistent, so a reader
+//                whose slot is > e is guaranteed to see the replacement.
+//
+
+#include "stdafx.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include "Epoch.h"
+
+using namespace std;
+
+namespace
+{
+    // A reader slot.  Padded so readers on different threads
+    // do not share a cache line.
+    struct Slot
+    {
+        Slot() : m_epoch(0), m_used(false), m_depth(0) {}
+
+        atomic<unsigned long long>  m_epoch;    // Epoch entered in or 0
+        bool                        m_used;     // Owned by a live thread (under lock)
+        int                         m_depth;    // Nesting depth, owner only
+        char                        m_pad[64];
+    };
+
+    atomic<unsigned long long>  g_epoch(1);     // Current epoch, never 0
+    mutex                       g_lock;         // Protects g_slots membership
+    deque<Slot>                 g_slots;        // deque keeps addresses stable
+
+    // Claims a slot for the calling thread and releases it at thread exit
+    struct SlotOwner
+    {
+        SlotOwner() : m_slot(NULL) {}
+
+        ~SlotOwner()
+        {
+            if(m_slot != NULL)
+            {
+                lock_guard<mutex> lock(g_lock);
+                m_slot->m_epoch.store(0);
+                m_slot->m_used = false;
+            }
+        }
+
+        Slot *Get()
+        {
+            if(m_slot == NULL)
+            {
+                lock_guard<mutex> lock(g_lock);
+                for(deque<Slot>::iterator s=g_slots.begin();  s!=g_slots.end();  s++)
+                {
+                    if(!s->m_used)
+                    {
+                        m_slot = &(*s);
+                        break;
+                    }
+                }
+
+                if(m_slot == NULL)
+                {
+                    g_slots.emplace_back();
+                    m_slot = &g_slots.back();
+                }
+
+                m_slot->m_used = true;
+                m_slot->m_depth = 0;
+            }
+
+            return m_slot;
+        }
+
+        Slot *m_slot;
+    };
+
+    thread_local SlotOwner t_owner;
+}
+
+
+void CEpoch::Enter()
+{
+    Slot *slot = t_owner.Get();
+    if(slot->m_depth++ == 0)
+        slot->m_epoch.store(g_epoch.load());
+}
+
+
+void CEpoch::Leave()
+{
+    Slot *slot = t_owner.m_slot;
+    if(--slot->m_depth == 0)
+        slot->m_epoch.store(0);
+}
+
+
+unsigned long long CEpoch::Advance()
+{
+    return g_epoch.fetch_add(1);
+}
+
+
+bool CEpoch::Quiescent(unsigned long long tag)
+{
+    lock_guard<mutex> lock(g_lock);
+    for(deque<Slot>::iterator s=g_slots.begin();  s!=g_slots.end();  s++)
+    {
+        unsigned long long e = s->m_epoch.load();
+        if(e != 0 && e <= tag)
+            return false;
+    }
+
+    return true;
+}
+
+
+void CEpoch::WaitQuiescent(unsigned long long tag)
+{
+    while(!Quiescent(tag))
+        this_thread::sleep_for(chrono::milliseconds(1));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+//
+// Name :         Epoch.h
+// Description :  Header for CEpoch, epoch based reclamation support.
+//                Readers announce the epoch they entered in, writers
+//                retire memory tagged with an epoch and may only free
+//                it once no reader could still be looking at it.
+//
+
+//
+// class CEpoch
+// Process wide epoch counter and per-thread reader slots.
+// Read sections may nest.  A read section must not wait on
+// a writer that is waiting for reclamation or it will deadlock.
+//
+
+class CEpoch
+{
+public:
+    // Reader side
+    static void Enter();
+    static void Leave();
+
+    // Writer side.  Call Advance() after publishing a new pointer.
+    // The returned value tags the memory that was replaced.
+    static unsigned long long Advance();
+
+    // True if no reader could still see memory retired with this tag
+    static bool Quiescent(unsigned long long tag);
+
+    // Block until Quiescent(tag) is true
+    static void WaitQuiescent(unsigned long long tag);
+};
+
+//
+// class CEpochGuard
+// Scoped read section
+//
+
+class CEpochGuard
+{
+public:
+    CEpochGuard() {CEpoch::Enter();}
+    ~CEpochGuard() {CEpoch::Leave();}
+
+private:
+    CEpochGuard(const CEpochGuard &);
+    CEpochGuard &operator=(const CEpochGuard &);
+};
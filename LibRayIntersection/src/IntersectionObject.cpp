@@ -1,17 +1,336 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "IntersectionObject.h"
 
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+const int MAXSTEPS = 1000;          // Most steps for a sphere to reach a surface
+const double MINSTEP = 1. / 16;     // Shortest step, as a part of the radius
+
 CIntersectionObject::CIntersectionObject(void)
 {
     m_texture = NULL;  
     m_material = NULL;
+    m_mask = 0xffffffff;
+}
 
+CIntersectionObject::~CIntersectionObject(void)
+{
+}
 
-    m_markVisited = 0;  // Indicates if we computed T in a pass (visited at all)
-    m_markTested = 0;   // Indicates if we did an intersection test in a pass
-    m_t = 0;            // t computed for the current ray
+
+//
+// Name :         CIntersectionObject::ComputeNextT()
+// Description :  Start the ray over a small step past t, so the crossing
+//                at t is not found again.
+//
+
+double CIntersectionObject::ComputeNextT(const CRayp &ray, double t)
+{
+    double step = 1e-7 * (t > 1 ? t : 1);
+    CRayp from(CRay(ray.PointOnRay(t + step), ray.Direction(), ray.Time()));
+    double next = ComputeT(from);
+    return next > 0 ? t + step + next : -1;
 }
 
-CIntersectionObject::~CIntersectionObject(void)
+
+void CIntersectionObject::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    CGrVector texcoord;
+    IntersectInfo(intersect, p_normal, texcoord);
+    p_dsdp = CGrVector(0, 0, 0, 0);
+    p_dtdp = CGrVector(0, 0, 0, 0);
+}
+
+
+//
+// Name :         CIntersectionObject::TriangleGradient()
+// Description :  The gradients of texture coordinates s and t that vary
+//                linearly over triangle abc.  Each gradient lies in the
+//                plane of the triangle.  We write it as x e1 + y e2 with
+//                e1 = b - a and e2 = c - a, which gives two equations in
+//                x and y from the change along each edge.
+//
+
+void CIntersectionObject::TriangleGradient(const CGrVector &a, const CGrVector &b, const CGrVector &c,
+        const CGrVector &ta, const CGrVector &tb, const CGrVector &tc, 
+        CGrVector &p_dsdp, CGrVector &p_dtdp)
+{
+    CGrVector e1 = b - a;
+    CGrVector e2 = c - a;
+    e1.W() = 0;
+    e2.W() = 0;
+
+    double d11 = Dot3(e1, e1);
+    double d12 = Dot3(e1, e2);
+    double d22 = Dot3(e2, e2);
+    double det = d11 * d22 - d12 * d12;
+    if(det <= 1e-12 * d11 * d22)
+    {
+        p_dsdp = CGrVector(0, 0, 0, 0);
+        p_dtdp = CGrVector(0, 0, 0, 0);
+        return;
+    }
+
+    double ds1 = tb.X() - ta.X(), ds2 = tc.X() - ta.X();
+    double dt1 = tb.Y() - ta.Y(), dt2 = tc.Y() - ta.Y();
+
+    p_dsdp = e1 * ((d22 * ds1 - d12 * ds2) / det) + e2 * ((d11 * ds2 - d12 * ds1) / det);
+    p_dtdp = e1 * ((d22 * dt1 - d12 * dt2) / det) + e2 * ((d11 * dt2 - d12 * dt1) / det);
+}
+
+
+//
+// Name :         CIntersectionObject::ClosestOnTriangle()
+// Description :  The point of triangle abc nearest to p.  The regions
+//                outside the triangle are tested in turn using the
+//                barycentric coordinates of the projection of p, which
+//                gives a vertex, a point on an edge, or the projection.
+//
+
+CGrVector CIntersectionObject::ClosestOnTriangle(const CGrVector &a, const CGrVector &b, const CGrVector &c,
+        const CGrVector &p)
+{
+    CGrVector ab = b - a;
+    CGrVector ac = c - a;
+    CGrVector ap = p - a;
+    double d1 = Dot3(ab, ap);
+    double d2 = Dot3(ac, ap);
+    if(d1 <= 0 && d2 <= 0)
+        return a;
+
+    CGrVector bp = p - b;
+    double d3 = Dot3(ab, bp);
+    double d4 = Dot3(ac, bp);
+    if(d3 >= 0 && d4 <= d3)
+        return b;
+
+    double vc = d1 * d4 - d3 * d2;
+    if(vc <= 0 && d1 >= 0 && d3 <= 0)
+        return a + ab * (d1 / (d1 - d3));
+
+    CGrVector cp = p - c;
+    double d5 = Dot3(ab, cp);
+    double d6 = Dot3(ac, cp);
+    if(d6 >= 0 && d5 <= d6)
+        return c;
+
+    double vb = d5 * d2 - d1 * d6;
+    if(vb <= 0 && d2 >= 0 && d6 <= 0)
+        return a + ac * (d2 / (d2 - d6));
+
+    double va = d3 * d6 - d5 * d4;
+    if(va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    double denom = va + vb + vc;
+    if(denom <= 0)
+        return a;
+
+    return a + ab * (vb / denom) + ac * (vc / denom);
+}
+
+
+//
+// Name :         CIntersectionObject::SweepSphere()
+// Description :  Conservative advancement.  The sphere can move as far as
+//                its gap to the surface without touching it, so it does,
+//                until the gap closes.  Near a grazing touch each step 
+//                would close only part of the gap, so no step is shorter
+//                than MINSTEP of the radius.  The center cannot cross the
+//                surface in a step that short, so if the sphere ends up
+//                in the surface, the touch is between where it was clear
+//                and where it is, and bisection finds it.  A touch is
+//                reported only where the gap is within the tolerance.
+//
+
+bool CIntersectionObject::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
 {
+    double speed = ray.Direction().Length3();
+    if(speed <= 0)
+        return false;
+
+    double touch = (p_radius + 1) * 1e-9;
+    double minStep = p_radius * MINSTEP;
+
+    double t = 0;
+    double clear = 0;           // The sphere is clear of the surface here
+    double into = -1;           // and in it here, once a step goes too far
+    for(int i=0;  i<MAXSTEPS;  i++)
+    {
+        CGrVector center = ray.PointOnRay(t);
+        CGrVector closest;
+        if(!ClosestPoint(center, closest))
+            return false;
+
+        double gap = (closest - center).Length3() - p_radius;
+        if(fabs(gap) <= touch || (gap < 0 && t == 0))
+        {
+            p_t = t;
+            p_contact = closest;
+            return true;
+        }
+
+        if(gap < 0)
+            into = t;
+        else
+            clear = t;
+
+        // The gap changes no faster than the center moves, so the gap
+        // at the middle of an interval is within half its length of 0
+        if(into >= 0)
+        {
+            t = (clear + into) / 2;
+            continue;
+        }
+
+        if(t >= p_maxt)
+            return false;
+
+        t += (gap > minStep ? gap : minStep) / speed;
+        if(t > p_maxt)
+            t = p_maxt;
+    }
+
+    return false;
+}
+
+
+//
+// Name :         CIntersectionObject::SweepPoint()
+// Description :  When a sphere on a ray first touches a point, the
+//                smaller root of |o + td - v|^2 = r^2.
+//
+
+bool CIntersectionObject::SweepPoint(const CGrVector &v, const CRayp &ray, double p_radius, double &p_t)
+{
+    CGrVector m = ray.Origin() - v;
+    double a = Dot3(ray.Direction(), ray.Direction());
+    double b = Dot3(m, ray.Direction());
+    double c = Dot3(m, m) - p_radius * p_radius;
+    double disc = b * b - a * c;
+    if(a <= 0 || disc < 0)
+        return false;
+
+    p_t = (-b - sqrt(disc)) / a;
+    return p_t >= 0;
+}
+
+
+//
+// Name :         CIntersectionObject::SweepEdge()
+// Description :  When a sphere on a ray first touches segment pq.  The
+//                center reaches distance r from the line through p and q
+//                at the smaller root of the quadratic in the parts of the
+//                ray across the line, and the touch must be between p 
+//                and q.
+//
+
+bool CIntersectionObject::SweepEdge(const CGrVector &p, const CGrVector &q, const CRayp &ray, double p_radius,
+                   double &p_t, CGrVector &p_contact)
+{
+    CGrVector e = q - p;
+    double ee = Dot3(e, e);
+    if(ee <= 0)
+        return false;
+
+    CGrVector m = ray.Origin() - p;
+    CGrVector dd = ray.Direction() - e * (Dot3(ray.Direction(), e) / ee);
+    CGrVector mm = m - e * (Dot3(m, e) / ee);
+
+    double a = Dot3(dd, dd);
+    double b = Dot3(mm, dd);
+    double c = Dot3(mm, mm) - p_radius * p_radius;
+    double disc = b * b - a * c;
+    if(a <= TINY || disc < 0)
+        return false;           // Moving along the edge, the ends touch first
+
+    double t = (-b - sqrt(disc)) / a;
+    if(t < 0)
+        return false;
+
+    double h = Dot3(m + ray.Direction() * t, e) / ee;
+    if(h < 0 || h > 1)
+        return false;
+
+    p_t = t;
+    p_contact = p + e * h;
+    return true;
+}
+
+
+//
+// Name :         CIntersectionObject::SweepTriangle()
+// Description :  When a sphere on a ray first touches triangle abc.  If
+//                the sphere reaches the plane with the point it touches
+//                inside the triangle, nothing touches sooner.  Otherwise
+//                the first touch is on an edge or at a vertex.
+//
+
+bool CIntersectionObject::SweepTriangle(const CGrVector &a, const CGrVector &b, const CGrVector &c,
+        const CRayp &ray, double p_radius, double p_maxt, double &p_t, CGrVector &p_contact)
+{
+    const CGrVector &o = ray.Origin();
+    const CGrVector &d = ray.Direction();
+
+    // Touching already
+    CGrVector closest = ClosestOnTriangle(a, b, c, o);
+    if((closest - o).LengthSquared3() <= p_radius * p_radius)
+    {
+        p_t = 0;
+        p_contact = closest;
+        return true;
+    }
+
+    CGrVector n = Cross(b - a, c - a);
+    n.W() = 0;
+    if(n.Length3() <= 0)
+        return false;
+    n.Normalize3();
+
+    // The face, reached from the side the sphere starts on
+    double dist = Dot3(o - a, n);
+    double dn = Dot3(d, n);
+    if(dist * dn < 0)
+    {
+        double side = dist > 0 ? 1 : -1;
+        double t = (side * p_radius - dist) / dn;
+        if(t >= 0 && t <= p_maxt)
+        {
+            CGrVector p = o + d * t - n * (side * p_radius);
+            if(Dot3(Cross(b - a, p - a), n) >= 0 && Dot3(Cross(c - b, p - b), n) >= 0 &&
+               Dot3(Cross(a - c, p - c), n) >= 0)
+            {
+                p_t = t;
+                p_contact = p;
+                return true;
+            }
+        }
+    }
+
+    // The edges and vertices
+    const CGrVector *v[3] = {&a, &b, &c};
+    double best = p_maxt;
+    bool found = false;
+    for(int i=0;  i<3;  i++)
+    {
+        double t;
+        CGrVector contact;
+        if(SweepEdge(*v[i], *v[(i + 1) % 3], ray, p_radius, t, contact) && t <= best)
+        {
+            best = t;
+            p_contact = contact;
+            found = true;
+        }
+
+        if(SweepPoint(*v[i], ray, p_radius, t) && t <= best)
+        {
+            best = t;
+            p_contact = *v[i];
+            found = true;
+        }
+    }
+
+    p_t = best;
+    return found;
 }
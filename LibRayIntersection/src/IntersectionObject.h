@@ -19,34 +19,67 @@ public:
     virtual double ComputeT(const CRayp &ray) = 0;   
     virtual bool SurfaceTest(const CGrVector &intersect) = 0;
 
+    // The next crossing of the ray beyond t, or a negative value if
+    // there is none, for queries that want every crossing.  The default
+    // starts the ray over just past t.
+    virtual double ComputeNextT(const CRayp &ray, double t);
+
+    // The point on the surface nearest to p, for distance queries.
+    // Returns false if the object cannot tell.
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const = 0;
+
+    // The first time from 0 to p_maxt a sphere of radius p_radius on the 
+    // ray touches the surface, and the point it touches.  The default
+    // steps the sphere forward by its distance from the surface, with a
+    // floor on the step, and bisects once a step goes into the surface.
+    // Objects that can sweep a sphere exactly override it.
+    virtual bool SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const;
+
     virtual void IntersectInfo(const CGrVector &intersect,  
                    CGrVector &p_normal, CGrVector &p_texcoord) const = 0;
 
+    // The geometric normal at a point and the gradients of the s and t
+    // texture coordinates along the surface, for ray differentials.  The
+    // default has no texture variation.
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+    // Objects that move need the time of the ray as well.  Objects
+    // that do not ignore it.
+    virtual void IntersectInfoAtTime(const CGrVector &intersect, double /*time*/,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+                   {IntersectInfo(intersect, p_normal, p_texcoord);}
+    virtual void TexCoordGradientAtTime(const CGrVector &intersect, double /*time*/, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+                   {TexCoordGradient(intersect, p_normal, p_dsdp, p_dtdp);}
+
     void SetTexture(ITexture *texture) {m_texture = texture;}
     ITexture *GetTexture() const {return m_texture;}
     void SetMaterial(IMaterial *material) {m_material = material;}
     IMaterial *GetMaterial() const {return m_material;}
-
-    bool WasTested(int mark) {return m_markTested == mark;}
-    void SetTested(int mark) {m_markTested = mark;}
-    bool WasVisited(int mark) {return m_markVisited == mark;}
-    void SetVisited(int mark) {m_markVisited = mark;}
-
-    double GetT() {return m_t;}
+    void SetMask(unsigned int mask) {m_mask = mask;}
+    unsigned int GetMask() const {return m_mask;}
 
 protected:
     void SetBoundingBox(const CBoundingBox &box) {mBBox = box;}
-    void SetT(double t) {m_t = t;}
+
+    static void TriangleGradient(const CGrVector &a, const CGrVector &b, const CGrVector &c,
+        const CGrVector &ta, const CGrVector &tb, const CGrVector &tc, 
+        CGrVector &p_dsdp, CGrVector &p_dtdp);
+    static CGrVector ClosestOnTriangle(const CGrVector &a, const CGrVector &b, const CGrVector &c,
+        const CGrVector &p);
+    static bool SweepTriangle(const CGrVector &a, const CGrVector &b, const CGrVector &c,
+        const CRayp &ray, double p_radius, double p_maxt, double &p_t, CGrVector &p_contact);
+    static bool SweepPoint(const CGrVector &v, const CRayp &ray, double p_radius, double &p_t);
+    static bool SweepEdge(const CGrVector &p, const CGrVector &q, const CRayp &ray, double p_radius,
+        double &p_t, CGrVector &p_contact);
 
 private:
     // Associated values
     ITexture            *m_texture;
     IMaterial           *m_material;
-
-    // Intersection assistance
-    int                 m_markVisited;  // Indicates if we computed T in a pass (visited at all)
-    int                 m_markTested;   // Indicates if we did an intersection test in a pass
-    double              m_t;            // t computed for the current ray
+    unsigned int        m_mask;         // Visibility mask
 
     CBoundingBox        mBBox;          // Bounding box for object
 };
@@ -1,6 +1,7 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include <algorithm>
 #include <cassert>
+#include <future>
 
 #include "KdNode.h"
 #include "RayIntersectionD.h"
@@ -13,8 +14,11 @@ inline double AreaCompute(const CGrVector &p)
     return p.X() * p.Y() + p.X() * p.Z() + p.Y() * p.Z();
 }
 
+// Subtrees smaller than this are not worth a thread of their own
+const int PARALLELMIN = 1024;
 
-CKdNode::CKdNode(CRayIntersectionD *user) : mUser(user), m_left(NULL), m_right(NULL), m_splitPoint(0), m_depth(0)
+
+CKdNode::CKdNode(CRayIntersectionD *user) : mUser(user), m_left(NULL), m_right(NULL), m_splitPoint(0), m_depth(0), m_mask(0xffffffff)
 {
 }
 
@@ -339,6 +343,16 @@ void CKdNode::Subdivide()
 
     GetUser()->StatIncNodes(newNodesCount);
 
+    // Near the top of the tree the two children are large and
+    // completely independent, so we build them on separate threads.
+    if(m_left && m_right && m_depth < GetUser()->GetParallelDepth() && nMembers >= PARALLELMIN)
+    {
+        future<void> leftBuild = async(launch::async, &CKdNode::Subdivide, m_left);
+        m_right->Subdivide();
+        leftBuild.get();
+        return;
+    }
+
     if(m_left)
         m_left->Subdivide();
 
@@ -43,6 +43,7 @@ private:
 
     CBoundingBox        m_bbox;         // Bounding box for the node
     int                 m_depth;        // Depth of the node in the tree
+    unsigned int        m_mask;         // Union of the masks of the members below
 
     CKdNode *m_left;     // Left subtree
     CKdNode *m_right;    // Right subtree
@@ -0,0 +1,251 @@
+#include "stdafx.h"
+#include "MovingTriangle.h"
+
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+
+CMovingTriangle::CMovingTriangle(int p_keys)
+{
+    m_keys = p_keys < 2 ? 2 : p_keys;
+    m_vertices.resize(3 * m_keys);
+    m_normals.resize(3 * m_keys);
+
+    m_numVertices = 0;
+    m_numNormals = 0;
+    m_numTVertices = 0;
+}
+
+CMovingTriangle::~CMovingTriangle(void)
+{
+}
+
+
+//
+// Name :         CMovingTriangle::TriangleEnd()
+// Description :  Complete the triangle.  Every key must have three
+//                vertices that are not in a line.  The normals and
+//                texture coordinates are filled in the way CTriangle
+//                does it.
+//
+
+bool CMovingTriangle::TriangleEnd()
+{
+    if(m_numVertices != 3 * m_keys || m_numNormals == 0)
+        return false;
+
+    for(int k=0;  k<m_keys;  k++)
+    {
+        const CGrVector *v = &m_vertices[k * 3];
+        if(Cross(v[1] - v[0], v[2] - v[0]).Length3() < 1e-9)
+            return false;
+    }
+
+    // One normal is for the whole triangle, and the first key's
+    // normals are for any key that has none
+    if(m_numNormals < 3)
+    {
+        m_normals[1] = m_normals[0];
+        m_normals[2] = m_normals[0];
+        m_numNormals = 3;
+    }
+
+    for(int i=m_numNormals - m_numNormals % 3;  i<3 * m_keys;  i++)
+        m_normals[i] = m_normals[i % 3];
+
+    if(m_numTVertices == 0)
+    {
+        for(int i=0;  i<3; i++)
+            m_tvertices[m_numTVertices++] = CGrVector(0, 0, 0);
+    }
+    else
+    {
+        while(m_numTVertices < 3)
+        {
+            m_tvertices[m_numTVertices] = m_tvertices[m_numTVertices-1];
+            m_numTVertices++;
+        }
+    }
+
+    // Protection from negative u,v values
+    double min = 0;
+    for(int i=0;  i<3;  i++)
+    {
+        if(m_tvertices[i].X() < min)
+            min = m_tvertices[i].X();
+        if(m_tvertices[i].Y() < min)
+            min = m_tvertices[i].Y();
+    }
+
+    if(min < 0)
+    {
+        int add = int(-min) + 1;
+        for(int i=0;  i<3;  i++)
+        {
+            m_tvertices[i].X() += add;
+            m_tvertices[i].Y() += add;
+        }
+    }
+
+    // The triangle at any time is inside the box of all of the keys
+    CBoundingBox box;
+    box.Set(m_vertices[0]);
+    for(int i=1;  i<3 * m_keys;  i++)
+        box.Include(m_vertices[i]);
+    SetBoundingBox(box);
+
+    return true;
+}
+
+
+//
+// Name :         CMovingTriangle::At()
+// Description :  The vertices and normals at a time.  Times outside of
+//                0 to 1 are the first or last key.
+//
+
+void CMovingTriangle::At(double time, CGrVector *p_vertices, CGrVector *p_normals) const
+{
+    double x = time <= 0 ? 0 : (time >= 1 ? 1 : time) * (m_keys - 1);
+    int k = int(x);
+    if(k > m_keys - 2)
+        k = m_keys - 2;
+    double f = x - k;
+
+    for(int i=0;  i<3;  i++)
+    {
+        const CGrVector &a = m_vertices[k * 3 + i];
+        p_vertices[i] = a + (m_vertices[k * 3 + 3 + i] - a) * f;
+
+        if(p_normals != NULL)
+        {
+            const CGrVector &n = m_normals[k * 3 + i];
+            p_normals[i] = n + (m_normals[k * 3 + 3 + i] - n) * f;
+        }
+    }
+}
+
+
+//
+// Name :         CMovingTriangle::ComputeT()
+// Description :  The triangle at the time of the ray, tested in one step
+//                with barycentric coordinates, since there is no fixed
+//                plane to test against first.
+//
+
+double CMovingTriangle::ComputeT(const CRayp &ray)
+{
+    CGrVector v[3];
+    At(ray.Time(), v, NULL);
+
+    CGrVector e1 = v[1] - v[0];
+    CGrVector e2 = v[2] - v[0];
+    CGrVector p = Cross(ray.Direction(), e2);
+    double det = Dot3(e1, p);
+    if(det >= -TINY * TINY && det <= TINY * TINY)
+        return -1;
+
+    double inv = 1 / det;
+    CGrVector s = ray.Origin() - v[0];
+    double b1 = Dot3(s, p) * inv;
+    if(b1 < 0 || b1 > 1)
+        return -1;
+
+    CGrVector q = Cross(s, e1);
+    double b2 = Dot3(ray.Direction(), q) * inv;
+    if(b2 < 0 || b1 + b2 > 1)
+        return -1;
+
+    double t = Dot3(e2, q) * inv;
+    return t > TINY ? t : -1;
+}
+
+
+void CMovingTriangle::IntersectInfo(const CGrVector &intersect,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    IntersectInfoAtTime(intersect, 0, p_normal, p_texcoord);
+}
+
+
+void CMovingTriangle::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    TexCoordGradientAtTime(intersect, 0, p_normal, p_dsdp, p_dtdp);
+}
+
+
+//
+// Name :         CMovingTriangle::IntersectInfoAtTime()
+// Description :  The normal and texture coordinate are interpolated
+//                with the barycentric coordinates of the point in the
+//                triangle at that time.
+//
+
+void CMovingTriangle::IntersectInfoAtTime(const CGrVector &intersect, double time,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    CGrVector v[3], n[3];
+    At(time, v, n);
+
+    CGrVector e1 = v[1] - v[0];
+    CGrVector e2 = v[2] - v[0];
+    CGrVector p = intersect - v[0];
+
+    double d00 = Dot3(e1, e1);
+    double d01 = Dot3(e1, e2);
+    double d11 = Dot3(e2, e2);
+    double d20 = Dot3(p, e1);
+    double d21 = Dot3(p, e2);
+    double denom = d00 * d11 - d01 * d01;
+
+    double b1 = denom != 0 ? (d11 * d20 - d01 * d21) / denom : 0;
+    double b2 = denom != 0 ? (d00 * d21 - d01 * d20) / denom : 0;
+    double b0 = 1 - b1 - b2;
+
+    p_normal = n[0] * b0 + n[1] * b1 + n[2] * b2;
+    p_normal.Normalize3();
+
+    p_texcoord = m_tvertices[0] * b0 + m_tvertices[1] * b1 + m_tvertices[2] * b2;
+}
+
+
+void CMovingTriangle::TexCoordGradientAtTime(const CGrVector &/*intersect*/, double time, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    CGrVector v[3];
+    At(time, v, NULL);
+
+    p_normal = Normalize3(Cross(v[1] - v[0], v[2] - v[0]));
+    p_normal.W() = 0;
+
+    TriangleGradient(v[0], v[1], v[2], m_tvertices[0], m_tvertices[1], m_tvertices[2], p_dsdp, p_dtdp);
+}
+
+
+//
+// Name :         CMovingTriangle::ClosestPoint()
+// Description :  Distance queries have no time, so the triangle is where
+//                it is at time 0.
+//
+
+bool CMovingTriangle::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    CGrVector v[3];
+    At(0, v, NULL);
+    p_closest = ClosestOnTriangle(v[0], v[1], v[2], p);
+    return true;
+}
+
+
+//
+// Name :         CMovingTriangle::SweepSphere()
+// Description :  The triangle holds still where it is at the ray's time
+//                while the sphere moves.
+//
+
+bool CMovingTriangle::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
+{
+    CGrVector v[3];
+    At(ray.Time(), v, NULL);
+    return SweepTriangle(v[0], v[1], v[2], ray, p_radius, p_maxt, p_t, p_contact);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include "IntersectionObject.h"
+
+//
+// class CMovingTriangle
+// A triangle with its vertices given at two or more time keys, evenly
+// spaced from time 0 to time 1.  A ray intersects the triangle where it
+// is at the time of the ray, with the vertices interpolated linearly
+// between the keys around that time.  The bounding box is the box
+// swept over all of the keys, so one tree serves every time.
+//
+
+class CMovingTriangle : public CIntersectionObject
+{
+public:
+    CMovingTriangle(int p_keys);
+    virtual ~CMovingTriangle(void);
+
+    virtual CRayIntersection::ObjectType Type() const {return CRayIntersection::Triangle;}
+
+    // The vertices of the first key come first, then those of the next.
+    // Normals are given the same way, and a key without normals of its
+    // own uses those of the first key.
+    virtual void AddVertex(const CGrVector &v) {if(m_numVertices < 3 * m_keys) m_vertices[m_numVertices++] = v;}
+    virtual void AddNormal(const CGrVector &n) {if(m_numNormals < 3 * m_keys) m_normals[m_numNormals++] = n;}
+    virtual void AddTexVertex(const CGrVector &t) {if(m_numTVertices < 3) m_tvertices[m_numTVertices++] = t;}
+
+    virtual double ComputeT(const CRayp &ray);
+    virtual double ComputeNextT(const CRayp &, double) {return -1;}
+    virtual bool SurfaceTest(const CGrVector &/*intersect*/) {return true;}
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+    virtual bool SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const;
+
+    virtual void IntersectInfo(const CGrVector &intersect,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+    virtual void IntersectInfoAtTime(const CGrVector &intersect, double time,
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradientAtTime(const CGrVector &intersect, double time, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+    bool TriangleEnd();
+
+    int GetKeys() const {return m_keys;}
+    const CGrVector &GetVertex(int key, int i) const {return m_vertices[key * 3 + i];}
+
+private:
+    void At(double time, CGrVector *p_vertices, CGrVector *p_normals) const;
+
+    int                     m_keys;
+    std::vector<CGrVector>  m_vertices;     // 3 for each key
+    std::vector<CGrVector>  m_normals;      // 3 for each key
+    CGrVector               m_tvertices[3];
+
+    int m_numVertices;
+    int m_numNormals;
+    int m_numTVertices;
+};
@@ -5,6 +5,7 @@
 #include "stdafx.h"
 
 #include "Nurbs.h"
+#include "graphics/RayIntersection.h"
 
 #include <cmath>
 #include <cassert>
@@ -98,6 +99,36 @@ void CNurbs::DrawSurface()
 }
 
 
+//
+// Name :         CNurbs::LoadIntersection()
+// Description :  Hand the control points and knots to a ray intersection
+//                system, which intersects the surface directly rather
+//                than as the polygons gluNurbsSurface() would draw.  The
+//                texture coordinates there are the surface parameters.
+//
+
+void CNurbs::LoadIntersection(CRayIntersection &p_intersection) const
+{
+   if(m_usize == 0 || m_vsize == 0)
+      return;
+
+   std::vector<CGrVector> points(m_usize * m_vsize);
+   for(int iu=0;  iu<m_usize;  iu++)
+   {
+      for(int iv=0;  iv<m_vsize;  iv++)
+      {
+         const float *p = m_points[iu][iv];
+         points[iu * m_vsize + iv] = CGrVector(p[0], p[1], p[2]);
+      }
+   }
+
+   std::vector<double> uknots(m_uknots.begin(), m_uknots.end());
+   std::vector<double> vknots(m_vknots.begin(), m_vknots.end());
+
+   p_intersection.AddNurbs(m_usize, m_vsize, &points[0], &uknots[0], &vknots[0]);
+}
+
+
 //
 // Name :         CNurbs::DrawControlPoints()
 // Description :  Draw the NURBS control points.  This is a
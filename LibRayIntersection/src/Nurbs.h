@@ -17,6 +17,8 @@
 #include <vector>
 #include "Texture.h"	// Added by ClassView
 
+class CRayIntersection;
+
 class CNurbs  
 {
 public:
@@ -33,6 +35,9 @@ public:
 
 	void DrawSurface();
 
+   // Add the surface to a ray intersection system
+   void LoadIntersection(CRayIntersection &p_intersection) const;
+
    // Example surfaces...
 	void CreateCylinder(double p_radius, double p_height, bool p_seal=false);
 
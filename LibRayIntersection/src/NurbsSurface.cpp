@@ -0,0 +1,281 @@
+#include "stdafx.h"
+#include "NurbsSurface.h"
+#include "BezierPatch.h"
+#include <cmath>
+
+const int MAXSTEPS = 64;            // Most steps across a patch when tessellating
+
+CNurbsSurface::CNurbsSurface()
+{
+    m_uspans = 0;
+    m_vspans = 0;
+    m_tolerance = 0;
+}
+
+CNurbsSurface::~CNurbsSurface()
+{
+}
+
+
+//
+// Name :         CNurbsSurface::Create()
+// Description :  Convert the surface to one Bezier patch for each span
+//                where both knot intervals are not empty.  The
+//                conversion is done in homogeneous coordinates, first
+//                along u for every column of control points, then along
+//                v for the result.
+//
+
+bool CNurbsSurface::Create(int p_usize, int p_vsize, const CGrVector *p_points,
+                const double *p_uknots, const double *p_vknots)
+{
+    m_patches.clear();
+    m_uspans = 0;
+    m_vspans = 0;
+    m_tolerance = 0;
+    m_mesh = Mesh();
+
+    if(p_usize < 4 || p_vsize < 4 || p_points == NULL || p_uknots == NULL || p_vknots == NULL)
+        return false;
+
+    for(int i=1;  i<p_usize + 4;  i++)
+        if(!(p_uknots[i] >= p_uknots[i - 1]))
+            return false;
+
+    for(int i=1;  i<p_vsize + 4;  i++)
+        if(!(p_vknots[i] >= p_vknots[i - 1]))
+            return false;
+
+    // The surface is defined from knot 3 to knot size
+    double u0 = p_uknots[3];
+    double u1 = p_uknots[p_usize];
+    double v0 = p_vknots[3];
+    double v1 = p_vknots[p_vsize];
+    if(!(u1 > u0) || !(v1 > v0))
+        return false;
+
+    std::vector<CGrVector> homogeneous(p_usize * p_vsize);
+    for(int i=0;  i<p_usize * p_vsize;  i++)
+    {
+        const CGrVector &p = p_points[i];
+        if(!(p.W() > 0))
+            return false;
+
+        homogeneous[i] = CGrVector(p.X() * p.W(), p.Y() * p.W(), p.Z() * p.W(), p.W());
+    }
+
+    std::vector<int> uspans, vspans;
+    for(int i=3;  i<p_usize;  i++)
+        if(p_uknots[i] < p_uknots[i + 1])
+            uspans.push_back(i);
+
+    for(int i=3;  i<p_vsize;  i++)
+        if(p_vknots[i] < p_vknots[i + 1])
+            vspans.push_back(i);
+
+    m_uspans = int(uspans.size());
+    m_vspans = int(vspans.size());
+    m_patches.resize(m_uspans * m_vspans);
+
+    std::vector<CGrVector> rows(4 * p_vsize);
+    for(int a=0;  a<m_uspans;  a++)
+    {
+        int ui = uspans[a];
+
+        // rows[k * p_vsize + v] is the k'th Bezier point along u of column v
+        for(int v=0;  v<p_vsize;  v++)
+        {
+            CGrVector bezier[4];
+            ToBezier(&homogeneous[v], p_vsize, p_uknots, ui, bezier);
+            for(int k=0;  k<4;  k++)
+                rows[k * p_vsize + v] = bezier[k];
+        }
+
+        for(int b=0;  b<m_vspans;  b++)
+        {
+            int vi = vspans[b];
+
+            Patch &patch = m_patches[a * m_vspans + b];
+            for(int k=0;  k<4;  k++)
+                ToBezier(&rows[k * p_vsize], 1, p_vknots, vi, patch.m_points + k * 4);
+
+            patch.m_s0 = (p_uknots[ui] - u0) / (u1 - u0);
+            patch.m_s1 = (p_uknots[ui + 1] - u0) / (u1 - u0);
+            patch.m_t0 = (p_vknots[vi] - v0) / (v1 - v0);
+            patch.m_t1 = (p_vknots[vi + 1] - v0) / (v1 - v0);
+        }
+    }
+
+    return true;
+}
+
+
+//
+// Name :         CNurbsSurface::ToBezier()
+// Description :  The Bezier points of one span of a cubic B-spline curve
+//                are its blossom at the span ends, a = knot[span] and
+//                b = knot[span + 1]: f(a, a, a), f(a, a, b), f(a, b, b),
+//                and f(b, b, b).  The blossom is evaluated with de Boor's
+//                algorithm, using a different argument at each level.
+//                The span reads points p_span - 3 to p_span, so the
+//                caller only passes spans with four points under them.
+//
+
+void CNurbsSurface::ToBezier(const CGrVector *p_points, int p_stride,
+                const double *p_knots, int p_span, CGrVector *p_bezier)
+{
+    double a = p_knots[p_span];
+    double b = p_knots[p_span + 1];
+
+    for(int k=0;  k<4;  k++)
+    {
+        CGrVector q[4];
+        for(int m=0;  m<4;  m++)
+            q[m] = p_points[(p_span - 3 + m) * p_stride];
+
+        for(int r=1;  r<=3;  r++)
+        {
+            double x = r <= 3 - k ? a : b;
+            for(int m=3;  m>=r;  m--)
+            {
+                int j = p_span - 3 + m;
+                double alpha = (x - p_knots[j]) / (p_knots[j + 4 - r] - p_knots[j]);
+                q[m] = q[m - 1] * (1 - alpha) + q[m] * alpha;
+            }
+        }
+
+        p_bezier[k] = q[3];
+    }
+}
+
+
+//
+// Name :         CNurbsSurface::Steps()
+// Description :  The number of steps along each direction of a patch so 
+//                the triangles are within the tolerance.  Interpolating
+//                over steps hu and hv is off by at most
+//                (hu^2 Suu + 2 hu hv Suv + hv^2 Svv) / 8, and 2 hu hv is
+//                at most hu^2 + hv^2.  For a cubic patch Suu is at most 6 
+//                times the largest second difference of the control 
+//                points along u and Suv 9 times the largest twist.  Each
+//                direction gets half the tolerance.
+//
+
+void CNurbsSurface::Steps(const CGrVector *p_points, double p_tolerance, int &p_nu, int &p_nv)
+{
+    CGrVector q[16];
+    for(int i=0;  i<16;  i++)
+        q[i] = p_points[i] / p_points[i].W();
+
+    double duu = 0;
+    double dvv = 0;
+    double duv = 0;
+    for(int i=0;  i<4;  i++)
+    {
+        for(int j=0;  j<4;  j++)
+        {
+            double d;
+            if(i < 2)
+            {
+                d = (q[i * 4 + j] - q[(i + 1) * 4 + j] * 2 + q[(i + 2) * 4 + j]).Length3();
+                duu = d > duu ? d : duu;
+            }
+
+            if(j < 2)
+            {
+                d = (q[i * 4 + j] - q[i * 4 + j + 1] * 2 + q[i * 4 + j + 2]).Length3();
+                dvv = d > dvv ? d : dvv;
+            }
+
+            if(i < 3 && j < 3)
+            {
+                d = (q[(i + 1) * 4 + j + 1] - q[(i + 1) * 4 + j] - q[i * 4 + j + 1] + q[i * 4 + j]).Length3();
+                duv = d > duv ? d : duv;
+            }
+        }
+    }
+
+    p_nu = int(ceil(sqrt((6 * duu + 9 * duv) / (4 * p_tolerance))));
+    p_nv = int(ceil(sqrt((6 * dvv + 9 * duv) / (4 * p_tolerance))));
+    p_nu = p_nu < 1 ? 1 : (p_nu > MAXSTEPS ? MAXSTEPS : p_nu);
+    p_nv = p_nv < 1 ? 1 : (p_nv > MAXSTEPS ? MAXSTEPS : p_nv);
+}
+
+
+//
+// Name :         CNurbsSurface::Tessellate()
+// Description :  Each span of u gets the most steps any of its patches
+//                needs along u, and the same for v.  Every patch is then
+//                a grid of points on the surface, split into triangles
+//                counter-clockwise about du x dv.
+//
+
+const CNurbsSurface::Mesh &CNurbsSurface::Tessellate(double p_tolerance)
+{
+    if(p_tolerance == m_tolerance || !(p_tolerance > 0))
+        return m_mesh;
+
+    m_tolerance = p_tolerance;
+    m_mesh = Mesh();
+
+    std::vector<int> usteps(m_uspans, 1);
+    std::vector<int> vsteps(m_vspans, 1);
+    for(int a=0;  a<m_uspans;  a++)
+    {
+        for(int b=0;  b<m_vspans;  b++)
+        {
+            const CGrVector *points = m_patches[a * m_vspans + b].m_points;
+
+            int nu, nv;
+            Steps(points, p_tolerance, nu, nv);
+            usteps[a] = nu > usteps[a] ? nu : usteps[a];
+            vsteps[b] = nv > vsteps[b] ? nv : vsteps[b];
+        }
+    }
+
+    for(int a=0;  a<m_uspans;  a++)
+    {
+        for(int b=0;  b<m_vspans;  b++)
+        {
+            const Patch &patch = m_patches[a * m_vspans + b];
+            int nu = usteps[a];
+            int nv = vsteps[b];
+            int base = int(m_mesh.m_vertices.size());
+
+            for(int i=0;  i<=nu;  i++)
+            {
+                double u = double(i) / nu;
+                for(int j=0;  j<=nv;  j++)
+                {
+                    double v = double(j) / nv;
+
+                    CGrVector point, du, dv;
+                    CBezierPatch::Evaluate(patch.m_points, u, v, point, du, dv);
+                    m_mesh.m_vertices.push_back(point);
+                    m_mesh.m_normals.push_back(CBezierPatch::SurfaceNormal(patch.m_points, u, v));
+                    m_mesh.m_texcoords.push_back(CGrVector(patch.m_s0 + u * (patch.m_s1 - patch.m_s0),
+                        patch.m_t0 + v * (patch.m_t1 - patch.m_t0), 0));
+                }
+            }
+
+            for(int i=0;  i<nu;  i++)
+            {
+                for(int j=0;  j<nv;  j++)
+                {
+                    int v00 = base + i * (nv + 1) + j;
+                    int v10 = v00 + nv + 1;
+
+                    m_mesh.m_triangles.push_back(v00);
+                    m_mesh.m_triangles.push_back(v10);
+                    m_mesh.m_triangles.push_back(v10 + 1);
+
+                    m_mesh.m_triangles.push_back(v00);
+                    m_mesh.m_triangles.push_back(v10 + 1);
+                    m_mesh.m_triangles.push_back(v00 + 1);
+                }
+            }
+        }
+    }
+
+    return m_mesh;
+}
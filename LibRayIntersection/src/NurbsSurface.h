@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include "graphics/GrVector.h"
+
+//
+// class CNurbsSurface
+// A bicubic NURBS surface converted to rational Bezier patches, one for
+// each span of the knot vectors.  The patches are what the intersection
+// system traces.
+//
+// Tessellate() is the fallback when triangles are wanted instead.  The
+// density is chosen from the curvature of the control net for each
+// span, not from any view, so a tessellation is computed once and kept
+// until another tolerance is asked for.  Neighboring patches use the
+// same number of steps along the edge they share, so the mesh has no
+// cracks.
+//
+
+class CNurbsSurface
+{
+public:
+    CNurbsSurface();
+    virtual ~CNurbsSurface();
+
+    // Create from control points p_points[u * p_vsize + v], with the
+    // weight in W, and p_usize + 4 and p_vsize + 4 knots.  Returns false
+    // if the surface is not valid.
+    bool Create(int p_usize, int p_vsize, const CGrVector *p_points,
+                const double *p_uknots, const double *p_vknots);
+
+    // A patch with homogeneous control points and its part of the
+    // 0 to 1 texture coordinate range
+    struct Patch
+    {
+        CGrVector   m_points[16];
+        double      m_s0, m_s1;
+        double      m_t0, m_t1;
+    };
+
+    int PatchCnt() const {return int(m_patches.size());}
+    const Patch &GetPatch(int i) const {return m_patches[i];}
+
+    // Triangles approximating the surface
+    struct Mesh
+    {
+        std::vector<CGrVector>  m_vertices;
+        std::vector<CGrVector>  m_normals;
+        std::vector<CGrVector>  m_texcoords;
+        std::vector<int>        m_triangles;    // Three vertex indices each
+    };
+
+    // Tessellate so no point is farther than about p_tolerance from
+    // the surface
+    const Mesh &Tessellate(double p_tolerance);
+
+private:
+    static void ToBezier(const CGrVector *p_points, int p_stride,
+                const double *p_knots, int p_span, CGrVector *p_bezier);
+    static void Steps(const CGrVector *p_points, double p_tolerance, int &p_nu, int &p_nv);
+
+    std::vector<Patch>  m_patches;      // Spans u-major
+    int                 m_uspans;
+    int                 m_vspans;
+
+    double              m_tolerance;    // Of the cached mesh, 0 if none
+    Mesh                m_mesh;
+};
@@ -1,4 +1,4 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "Polygon.h"
 
 using namespace std;
@@ -169,12 +169,10 @@ double CPolygon::ComputeT(const CRayp &ray)
     double bottom = Dot3(m_normal, ray.Direction());
     if(bottom >= -TINY && bottom <= TINY)
     {
-        SetT(-1);
         return -1;
     }
 
     double t = -(Dot3(m_normal, ray.Origin()) + m_d) / bottom;
-    SetT(t);
 
     return t;
 }
@@ -412,3 +410,90 @@ void CPolygon::IntersectInfo(const CGrVector &intersect,
     }
 }
 
+
+
+//
+// Name :         CPolygon::TexCoordGradient()
+// Description :  The texture coordinate gradients for a ray footprint.
+//                The interpolation over a polygon is not exactly linear,
+//                so we use the largest triangle of the fan from vertex 0.
+//
+
+void CPolygon::TexCoordGradient(const CGrVector &/*intersect*/, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    p_normal = m_normal;
+    p_dsdp = CGrVector(0, 0, 0, 0);
+    p_dtdp = CGrVector(0, 0, 0, 0);
+
+    int cnt = (int)m_vertices.size();
+    if((int)m_tvertices.size() < cnt)
+        return;
+
+    int best = 0;
+    double bestArea = 0;
+    for(int i=1;  i+1<cnt;  i++)
+    {
+        double area = Cross(m_vertices[i] - m_vertices[0], m_vertices[i+1] - m_vertices[0]).Length3();
+        if(area > bestArea)
+        {
+            bestArea = area;
+            best = i;
+        }
+    }
+
+    if(best > 0)
+        TriangleGradient(m_vertices[0], m_vertices[best], m_vertices[best+1],
+            m_tvertices[0], m_tvertices[best], m_tvertices[best+1], p_dsdp, p_dtdp);
+}
+
+
+//
+// Name :         CPolygon::ClosestPoint()
+// Description :  Polygons are convex, so the nearest point of a fan of
+//                triangles from the first vertex is the nearest point.
+//
+
+bool CPolygon::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    double best = 1e300;
+    for(size_t i=2;  i<m_vertices.size();  i++)
+    {
+        CGrVector c = ClosestOnTriangle(m_vertices[0], m_vertices[i - 1], m_vertices[i], p);
+        double d2 = (c - p).LengthSquared3();
+        if(d2 < best)
+        {
+            best = d2;
+            p_closest = c;
+        }
+    }
+
+    return best < 1e300;
+}
+
+
+//
+// Name :         CPolygon::SweepSphere()
+// Description :  The first touch of any triangle of the fan.
+//
+
+bool CPolygon::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
+{
+    bool found = false;
+    for(size_t i=2;  i<m_vertices.size();  i++)
+    {
+        double t;
+        CGrVector contact;
+        if(SweepTriangle(m_vertices[0], m_vertices[i - 1], m_vertices[i], ray, p_radius, p_maxt,
+            t, contact))
+        {
+            p_maxt = t;
+            p_t = t;
+            p_contact = contact;
+            found = true;
+        }
+    }
+
+    return found;
+}
@@ -16,10 +16,16 @@ public:
     bool PolygonEnd();
 
     virtual double ComputeT(const CRayp &ray);
+    virtual double ComputeNextT(const CRayp &, double) {return -1;}
     virtual bool SurfaceTest(const CGrVector &intersect);
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+    virtual bool SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const;
 
     virtual void IntersectInfo(const CGrVector &intersect,  
                        CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
 
     std::vector<CGrVector> &GetVertices() {return m_vertices;}
     const CGrVector &GetVertex(int v) {return m_vertices[v];}
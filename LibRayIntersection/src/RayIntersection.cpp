@@ -9,7 +9,8 @@
 #include "graphics/RayIntersection.h"
 
 #include "RayIntersectionD.h"
-
+#include "SceneBuffer.h"
+#include "Epoch.h"
 
 
 
@@ -38,16 +39,58 @@
 CRayIntersection::CRayIntersection()
 {
     ri = new CRayIntersectionD();
+    m_scene = new CSceneBuffer();
 }
 
 CRayIntersection::~CRayIntersection()
 {
+    delete m_scene;
     delete ri;
 }
 
 
+//
+// Name :         NextLoading()
+// Description :  Create the structure that loading continues into after
+//                the loaded scene has been handed off to be published.
+//
+
+static CRayIntersectionD *NextLoading(const CRayIntersectionD *p_from)
+{
+    CRayIntersectionD *next = new CRayIntersectionD();
+    next->CopyParameters(*p_from);
+    return next;
+}
+
+
 void CRayIntersection::Initialize() {ri->Initialize();}
-void CRayIntersection::LoadingComplete() {ri->LoadingComplete();}
+
+void CRayIntersection::LoadingComplete()
+{
+    // Any background build must be published first so it cannot 
+    // later replace this newer scene.
+    m_scene->Wait();
+
+    CRayIntersectionD *scene = ri;
+    ri = NextLoading(scene);
+
+    scene->LoadingComplete();
+    m_scene->Publish(scene);
+}
+
+void CRayIntersection::BuildAsync()
+{
+    CRayIntersectionD *scene = ri;
+    ri = NextLoading(scene);
+
+    m_scene->BuildAsync(scene);
+}
+
+bool CRayIntersection::IsBuilding() const {return m_scene->IsBuilding();}
+void CRayIntersection::WaitForBuild() {m_scene->Wait();}
+
+CRayIntersection::QueryScope::QueryScope() {CEpoch::Enter();}
+CRayIntersection::QueryScope::~QueryScope() {CEpoch::Leave();}
 
 // Polygon insertion
 void CRayIntersection::PolygonBegin() {ri->PolygonBegin();}
@@ -55,6 +98,7 @@ void CRayIntersection::PolygonEnd() {ri->PolygonEnd();}
 
 // Triangle insertion
 void CRayIntersection::TriangleBegin() {ri->TriangleBegin();}
+void CRayIntersection::TriangleBegin(int p_keys) {ri->TriangleBegin(p_keys);}
 void CRayIntersection::TriangleEnd() {ri->TriangleEnd();}
 
 // Generic insertion routines
@@ -63,6 +107,25 @@ void CRayIntersection::Vertex(const CGrVector &p_vertex) {ri->Vertex(p_vertex);}
 void CRayIntersection::TexVertex(const CGrVector &p_tvertex) {ri->TexVertex(p_tvertex);}
 void CRayIntersection::Normal(const CGrVector &p_normal) {ri->Normal(p_normal);}
 void CRayIntersection::Texture(ITexture *p_texture) {ri->Texture(p_texture);}
+void CRayIntersection::Mask(unsigned int p_mask) {ri->Mask(p_mask);}
+
+// Primitives
+void CRayIntersection::AddSphere(const CGrVector &p_center, double p_radius) {ri->AddSphere(p_center, p_radius);}
+void CRayIntersection::AddBox(const CGrVector &p_min, const CGrVector &p_max) {ri->AddBox(p_min, p_max);}
+void CRayIntersection::AddCylinder(const CGrVector &p_base, const CGrVector &p_top, double p_radius) {ri->AddCylinder(p_base, p_top, p_radius);}
+void CRayIntersection::AddPrimitive(Primitive *p_primitive) {ri->AddPrimitive(p_primitive);}
+void CRayIntersection::AddNurbs(int p_usize, int p_vsize, const CGrVector *p_points, 
+    const double *p_uknots, const double *p_vknots) {ri->AddNurbs(p_usize, p_vsize, p_points, p_uknots, p_vknots);}
+double CRayIntersection::SetNurbsTolerance(double t) {return ri->SetNurbsTolerance(t);}
+double CRayIntersection::GetNurbsTolerance() const {return ri->GetNurbsTolerance();}
+
+CRayIntersection::Primitive *CRayIntersection::GetPrimitive(const Object *p_object)
+{
+    if(p_object == NULL || p_object->Type() != Other)
+        return NULL;
+
+    return static_cast<const CUserPrimitive *>(p_object)->GetPrimitive();
+}
 
 // Parameter routines
 double CRayIntersection::SetIntersectionCost(double c) {return ri->SetIntersectionCost(c);}
@@ -73,18 +136,139 @@ int CRayIntersection::SetMaxDepth(int m) {return ri->SetMaxDepth(m);}
 int CRayIntersection::GetMaxDepth() const {return ri->GetMaxDepth();}
 int CRayIntersection::SetMinLeaf(int m) {return ri->SetMinLeaf(m);}
 int CRayIntersection::GetMinLeaf() const {return ri->GetMinLeaf();}
+int CRayIntersection::SetBuildThreads(int t) {return ri->SetBuildThreads(t);}
+int CRayIntersection::GetBuildThreads() const {return ri->GetBuildThreads();}
+
+// Calibration
+CRayIntersection::Calibration CRayIntersection::Calibrate() {return ri->Calibrate();}
+void CRayIntersection::SetCalibration(const Calibration &c) {ri->SetCalibration(c);}
+CRayIntersection::Calibration CRayIntersection::GetCalibration() const {return ri->GetCalibration();}
+
+//
+// Queries go to the published scene.  The epoch guard keeps it
+// from being deleted by a swap while the query runs.
+//
 
 bool CRayIntersection::Intersect(const CRay &p_ray, double p_maxt, const Object *p_ignore, 
                                  const Object *&p_object, double &p_t, CGrVector &p_intersect)
 {
-    return ri->Intersect(p_ray, p_maxt, p_ignore, p_object, p_t, p_intersect);
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    return scene != NULL && scene->Intersect(p_ray, p_maxt, p_ignore, p_object, p_t, p_intersect);
+}
+
+bool CRayIntersection::Intersect(const CRay &p_ray, double p_maxt, const Object *p_ignore, 
+                                 const Filter *p_filter, const Object *&p_object, double &p_t, CGrVector &p_intersect)
+{
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    return scene != NULL && scene->Intersect(p_ray, p_maxt, p_ignore, p_object, p_t, p_intersect, p_filter);
+}
+
+bool CRayIntersection::ClosestPoint(const CGrVector &p_point, double p_maxd, const Object *&p_object, 
+                                    CGrVector &p_closest, double &p_distance, unsigned int p_mask)
+{
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    return scene != NULL && scene->ClosestPoint(p_point, p_maxd, p_mask, false, p_object, p_closest, p_distance);
+}
+
+bool CRayIntersection::WithinDistance(const CGrVector &p_point, double p_distance, unsigned int p_mask)
+{
+    const Object *object;
+    CGrVector closest;
+    double distance;
+
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    return scene != NULL && scene->ClosestPoint(p_point, p_distance, p_mask, true, object, closest, distance);
+}
+
+int CRayIntersection::QueryBox(const CGrVector &p_min, const CGrVector &p_max, Visitor &p_visitor, unsigned int p_mask)
+{
+    // The six planes of the box
+    CGrVector planes[6] = {
+        CGrVector(1, 0, 0, -p_min.X()), CGrVector(-1, 0, 0, p_max.X()),
+        CGrVector(0, 1, 0, -p_min.Y()), CGrVector(0, -1, 0, p_max.Y()),
+        CGrVector(0, 0, 1, -p_min.Z()), CGrVector(0, 0, -1, p_max.Z())};
+
+    if(p_min.X() > p_max.X() || p_min.Y() > p_max.Y() || p_min.Z() > p_max.Z())
+        return 0;
+
+    return QueryFrustum(planes, 6, p_visitor, p_mask);
+}
+
+int CRayIntersection::QueryFrustum(const CGrVector *p_planes, int p_count, Visitor &p_visitor, unsigned int p_mask)
+{
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    return scene == NULL ? 0 : scene->Query(p_planes, p_count, p_mask, p_visitor);
+}
+
+bool CRayIntersection::SphereCast(const CRay &p_ray, double p_radius, double p_maxt, const Object *&p_object, 
+                                  double &p_t, CGrVector &p_contact, CGrVector &p_normal)
+{
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    return scene != NULL && scene->SphereCast(p_ray, p_radius, p_maxt, p_object, p_t, p_contact, p_normal);
+}
+
+int CRayIntersection::IntersectAll(const CRay &p_ray, double p_maxt, int p_k, std::vector<Hit> &p_hits)
+{
+    p_hits.clear();
+
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    if(scene == NULL)
+        return 0;
+
+    return scene->IntersectAll(p_ray, p_maxt, p_k, p_hits);
 }
 
 void CRayIntersection::IntersectInfo(const CRay &p_ray, const Object *p_object, double p_t, 
                   CGrVector &p_normal, IMaterial *&p_material, 
                   ITexture *&p_texture, CGrVector &p_texcoord) const
 {
-    ri->IntersectInfo(p_ray, p_object, p_t, p_normal, p_material, p_texture, p_texcoord);
+    // This only depends on the object, which the caller keeps alive.
+    // It does not touch the loading scene, which BuildAsync() and
+    // LoadingComplete() replace while queries run.
+    CRayIntersectionD::IntersectInfo(p_ray, p_object, p_t, p_normal, p_material, p_texture, p_texcoord);
 }
 
-void CRayIntersection::SaveStats() {ri->SaveStats();}
+void CRayIntersection::IntersectInfo(const CRay &p_ray, const CRayDifferential &p_differential, 
+                  const Object *p_object, double p_t, 
+                  CGrVector &p_normal, IMaterial *&p_material, 
+                  ITexture *&p_texture, CGrVector &p_texcoord, 
+                  CGrVector &p_dTdx, CGrVector &p_dTdy) const
+{
+    CRayIntersectionD::IntersectInfo(p_ray, p_differential, p_object, p_t, p_normal, p_material, p_texture, 
+        p_texcoord, p_dTdx, p_dTdy);
+}
+
+CRayIntersection::Statistics CRayIntersection::GetStatistics() const
+{
+    Statistics stats;
+
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    if(scene != NULL)
+        scene->GetStatistics(stats);
+
+    return stats;
+}
+
+void CRayIntersection::ResetStatistics()
+{
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    if(scene != NULL)
+        scene->ResetStatistics();
+}
+
+void CRayIntersection::SaveStats()
+{
+    CEpochGuard guard;
+    CRayIntersectionD *scene = m_scene->Active();
+    if(scene != NULL)
+        scene->SaveStats();
+}
@@ -13,9 +13,15 @@
 #include <cassert>
 #include <algorithm>
 #include <fstream>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <unordered_set>
 
 #include "RayIntersectionD.h"
 #include "Rayp.h"
+#include "RayMailbox.h"
+#include "NurbsSurface.h"
 
 using namespace std;
 
@@ -57,6 +63,8 @@ CRayIntersectionD::CRayIntersectionD()
     m_traverseCost = 1;
     m_maxDepth = 100;
     m_minLeaf = 3;
+    SetBuildThreads(thread::hardware_concurrency());
+    m_nurbsTolerance = 0;
 
     // Kd Tree version
     m_root = NULL;          // Root is initially empty
@@ -70,6 +78,58 @@ CRayIntersectionD::~CRayIntersectionD()
     delete m_root;
 }
 
+//
+// Name :         CRayIntersectionD::SetBuildThreads()
+// Description :  Set the number of threads the tree build may use.
+//                Each level of the tree doubles the number of independent
+//                subtrees, so we subdivide in parallel down to the depth
+//                where there is at least one subtree per thread.
+//
+
+int CRayIntersectionD::SetBuildThreads(int t)
+{
+    m_buildThreads = t < 1 ? 1 : t;
+
+    m_parallelDepth = 0;
+    while((1 << m_parallelDepth) < m_buildThreads)
+        m_parallelDepth++;
+
+    return m_buildThreads;
+}
+
+
+//
+// Name :         CRayIntersectionD::CopyParameters()
+// Description :  Copy the algorithm parameterization from another
+//                instance.  Used when a new scene replaces an old one.
+//
+
+void CRayIntersectionD::CopyParameters(const CRayIntersectionD &p_from)
+{
+    m_intersectionCost = p_from.m_intersectionCost;
+    m_traverseCost = p_from.m_traverseCost;
+    m_maxDepth = p_from.m_maxDepth;
+    m_minLeaf = p_from.m_minLeaf;
+    m_calibration = p_from.m_calibration;
+    m_nurbsTolerance = p_from.m_nurbsTolerance;
+    SetBuildThreads(p_from.m_buildThreads);
+}
+
+
+//
+// Name :         CRayIntersectionD::NewDepth()
+// Description :  Record a tree depth for statistics.  Called
+//                concurrently from the parallel tree build.
+//
+
+void CRayIntersectionD::NewDepth(int d)
+{
+    int depth = m_statMaxDepth.load();
+    while(d > depth && !m_statMaxDepth.compare_exchange_weak(depth, d))
+        ;
+}
+
+
 //
 // Name :         CRayIntersectionD::SaveStats()
 // Description :  Function to spit out some statistics to a file named stats.txt
@@ -77,16 +137,53 @@ CRayIntersectionD::~CRayIntersectionD()
 
 void CRayIntersectionD::SaveStats()
 {
+    CRayIntersection::Statistics stats;
+    GetStatistics(stats);
+
     ofstream str("stats.txt");
-    str << "Polygons:  " << m_polys.size() << endl;
-    str << "Triangles:  " << m_triangles.size() << endl;
-    str << "Tree Nodes:  " << m_statNodes << endl;
-    str << "Tree Depth:  " << m_statMaxDepth << endl;
-    str << "Intersection Tests:  " << m_statTests << endl;
-    str << "Object Tests:  " << m_statObjTests << endl;
-    str << "Surface Tests:  " << m_statSurfaceTests << endl;
-    str << "Average:  " << double(m_statSurfaceTests) / m_statTests << endl;
-    str << "One child:  " << m_statOneChild << endl;
+    str << "Polygons:  " << stats.m_polygons << endl;
+    str << "Triangles:  " << stats.m_triangles << endl;
+    str << "Primitives:  " << stats.m_primitives << endl;
+    str << "Memory:  " << stats.m_memory << endl;
+    str << "Tree Nodes:  " << stats.m_nodes << endl;
+    str << "Tree Depth:  " << stats.m_maxDepth << endl;
+    str << "Leaves:  " << stats.m_leaves << endl;
+    str << "Empty Leaves:  " << stats.m_emptyLeaves << endl;
+    str << "Average Leaf Size:  " << stats.m_leafSizes.Mean() << endl;
+    str << "Intersection Tests:  " << stats.m_rays << endl;
+    str << "Object Tests:  " << stats.m_objectTests << endl;
+    str << "Surface Tests:  " << stats.m_surfaceTests << endl;
+    str << "Average:  " << double(stats.m_surfaceTests) / stats.m_rays << endl;
+    str << "Average Nodes Visited:  " << stats.m_nodesVisited.Mean() << endl;
+    str << "One child:  " << stats.m_oneChild << endl;
+}
+
+
+//
+// Name :         CRayIntersectionD::GetStatistics()
+// Description :  Gather the statistics.  The tree statistics are
+//                collected when the tree is built, the query counts 
+//                are summed over the querying threads.
+//
+
+void CRayIntersectionD::GetStatistics(CRayIntersection::Statistics &p_stats) const
+{
+    p_stats.m_polygons = m_polys.size();
+    p_stats.m_triangles = m_triangles.size() + m_moving.size();
+    p_stats.m_primitives = m_spheres.size() + m_boxes.size() + m_cylinders.size() + m_userPrims.size() + m_patches.size();
+    p_stats.m_memory = m_statMemory;
+    p_stats.m_nodes = m_statNodes.load();
+    p_stats.m_maxDepth = m_statMaxDepth.load();
+    p_stats.m_intersectionCost = m_intersectionCost;
+    p_stats.m_traverseCost = m_traverseCost;
+    p_stats.m_oneChild = m_statOneChild;
+    p_stats.m_leaves = m_statLeaves;
+    p_stats.m_emptyLeaves = m_statEmptyLeaves;
+    p_stats.m_leafReferences = m_statLeafRefs;
+    p_stats.m_leafSizes = m_statLeafSizes;
+    p_stats.m_leafDepths = m_statLeafDepths;
+
+    m_counters.AddTo(p_stats);
 }
 
 void CRayIntersectionD::Clear()
@@ -95,18 +192,30 @@ void CRayIntersectionD::Clear()
     m_root = NULL;
     m_polys.clear();
     m_triangles.clear();
-    m_mark = 1;
+    m_moving.clear();
+    m_spheres.clear();
+    m_boxes.clear();
+    m_cylinders.clear();
+    m_userPrims.clear();
+    m_patches.clear();
     m_loading = CRayIntersection::None;
     m_loadingObject = NULL;
+    m_material = NULL;
+    m_texture = NULL;
+    m_mask = 0xffffffff;
     m_sceneBB.SetEmpty();
 
     // Zero the stats
     m_statNodes = 0;
-    m_statTests = 0;
     m_statMaxDepth = 0;
-    m_statObjTests = 0;
-    m_statSurfaceTests = 0;
     m_statOneChild = 0;
+    m_statLeaves = 0;
+    m_statEmptyLeaves = 0;
+    m_statLeafRefs = 0;
+    m_statMemory = 0;
+    m_statLeafSizes = CRayIntersection::Histogram(true);
+    m_statLeafDepths = CRayIntersection::Histogram(false);
+    m_counters.Reset();
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -139,6 +248,9 @@ void CRayIntersectionD::PolygonBegin()
     m_loading = CRayIntersection::Polygon;
     m_polys.push_back(CPolygon()); 
     m_loadingObject = &m_polys.back();
+    m_loadingObject->SetMaterial(m_material);
+    m_loadingObject->SetTexture(m_texture);
+    m_loadingObject->SetMask(m_mask);
 }
 
 
@@ -147,30 +259,73 @@ void CRayIntersectionD::TriangleBegin()
     m_loading = CRayIntersection::Triangle;
     m_triangles.push_back(CTriangle()); 
     m_loadingObject = &m_triangles.back();
+    m_loadingObject->SetMaterial(m_material);
+    m_loadingObject->SetTexture(m_texture);
+    m_loadingObject->SetMask(m_mask);
+}
+
+
+//
+// Name :         CRayIntersectionD::TriangleBegin()
+// Description :  Begin a triangle that moves.  One key is a triangle
+//                that does not.
+//
+
+void CRayIntersectionD::TriangleBegin(int p_keys)
+{
+    if(p_keys < 2)
+    {
+        TriangleBegin();
+        return;
+    }
+
+    m_loading = CRayIntersection::Triangle;
+    m_moving.push_back(CMovingTriangle(p_keys)); 
+    m_loadingObject = &m_moving.back();
+    m_loadingObject->SetMaterial(m_material);
+    m_loadingObject->SetTexture(m_texture);
+    m_loadingObject->SetMask(m_mask);
 }
 
 
 
 //
 // Name :         CRayIntersectionD::Texture()
-// Description :  Assign a texture to the current polygon we are creating.
+// Description :  Set the texture for the polygons and triangles that
+//                follow, including the one we are creating, if any.
 //
 
 void CRayIntersectionD::Texture(ITexture *p_texture)
 {
-    assert(m_loadingObject != NULL);
-    m_loadingObject->SetTexture(p_texture);
+    m_texture = p_texture;
+    if(m_loadingObject != NULL)
+        m_loadingObject->SetTexture(p_texture);
 }
 
 //
 // Name :         CRayIntersectionD::Material()
-// Description :  Set the material for the current polgon we are creating.
+// Description :  Set the material for the polygons and triangles that
+//                follow, including the one we are creating, if any.
 //
 
 void CRayIntersectionD::Material(IMaterial *p_material)
 {
-    assert(m_loadingObject != NULL);
-    m_loadingObject->SetMaterial(p_material);
+    m_material = p_material;
+    if(m_loadingObject != NULL)
+        m_loadingObject->SetMaterial(p_material);
+}
+
+//
+// Name :         CRayIntersectionD::Mask()
+// Description :  Set the visibility mask for the objects that follow,
+//                including the one we are creating, if any.
+//
+
+void CRayIntersectionD::Mask(unsigned int p_mask)
+{
+    m_mask = p_mask;
+    if(m_loadingObject != NULL)
+        m_loadingObject->SetMask(p_mask);
 }
 
 
@@ -214,6 +369,17 @@ void CRayIntersectionD::TriangleEnd()
     if(m_loading != CRayIntersection::Triangle)
         return;
 
+    bool moving = !m_moving.empty() && m_loadingObject == &m_moving.back();
+    m_loading = CRayIntersection::None;
+    m_loadingObject = NULL;
+
+    if(moving)
+    {
+        if(!m_moving.back().TriangleEnd())
+            m_moving.pop_back();
+        return;
+    }
+
     CTriangle &t = m_triangles.back();
     if(!t.TriangleEnd())
     {
@@ -233,6 +399,9 @@ void CRayIntersectionD::PolygonEnd()
     if(m_polys.empty())
         return;
 
+    m_loading = CRayIntersection::None;
+    m_loadingObject = NULL;
+
     CPolygon &p = m_polys.back();
     if(!p.PolygonEnd())
     {
@@ -263,8 +432,9 @@ void CRayIntersectionD::PolygonEnd()
 
         // a, b, c is a triangle
         TriangleBegin();
-        Material(poly.GetMaterial());
-        Texture(poly.GetTexture());
+        m_loadingObject->SetMaterial(poly.GetMaterial());
+        m_loadingObject->SetTexture(poly.GetTexture());
+        m_loadingObject->SetMask(poly.GetMask());
 
         if(at != poly.m_tvertices.end())
             TexVertex(*at);
@@ -314,8 +484,9 @@ void CRayIntersectionD::PolygonEnd()
                 {
                     // a, b, c is a triangle
                     TriangleBegin();
-                    Material(poly.GetMaterial());
-                    Texture(poly.GetTexture());
+                    m_loadingObject->SetMaterial(poly.GetMaterial());
+                    m_loadingObject->SetTexture(poly.GetTexture());
+                    m_loadingObject->SetMask(poly.GetMask());
 
                     if(at != poly.m_tvertices.end())
                         TexVertex(*at);
@@ -359,6 +530,110 @@ void CRayIntersectionD::PolygonEnd()
 
 }
 
+
+//
+// Name :         CRayIntersectionD::AddSphere(), AddBox(), AddCylinder()
+// Description :  Add a primitive with the current material and texture.
+//                These are complete when added, so there is nothing to
+//                end.  Degenerate primitives are not added.
+//
+
+void CRayIntersectionD::AddSphere(const CGrVector &p_center, double p_radius)
+{
+    if(!(p_radius > 0))
+        return;
+
+    m_spheres.push_back(CSphere(p_center, p_radius));
+    m_spheres.back().SetMaterial(m_material);
+    m_spheres.back().SetTexture(m_texture);
+    m_spheres.back().SetMask(m_mask);
+}
+
+void CRayIntersectionD::AddBox(const CGrVector &p_min, const CGrVector &p_max)
+{
+    if(p_min.X() > p_max.X() || p_min.Y() > p_max.Y() || p_min.Z() > p_max.Z())
+        return;
+
+    m_boxes.push_back(CBox(p_min, p_max));
+    m_boxes.back().SetMaterial(m_material);
+    m_boxes.back().SetTexture(m_texture);
+    m_boxes.back().SetMask(m_mask);
+}
+
+void CRayIntersectionD::AddCylinder(const CGrVector &p_base, const CGrVector &p_top, double p_radius)
+{
+    CGrVector axis = p_top - p_base;
+    if(!(p_radius > 0) || axis.Length3() <= TINY)
+        return;
+
+    m_cylinders.push_back(CCylinder(p_base, p_top, p_radius));
+    m_cylinders.back().SetMaterial(m_material);
+    m_cylinders.back().SetTexture(m_texture);
+    m_cylinders.back().SetMask(m_mask);
+}
+
+
+//
+// Name :         CRayIntersectionD::AddPrimitive()
+// Description :  Add a primitive of the application's.  Its bounding 
+//                box is taken now.
+//
+
+void CRayIntersectionD::AddPrimitive(CRayIntersection::Primitive *p_primitive)
+{
+    if(p_primitive == NULL)
+        return;
+
+    m_userPrims.push_back(CUserPrimitive(p_primitive));
+    m_userPrims.back().SetMaterial(m_material);
+    m_userPrims.back().SetTexture(m_texture);
+    m_userPrims.back().SetMask(m_mask);
+}
+
+
+//
+// Name :         CRayIntersectionD::AddNurbs()
+// Description :  Add a NURBS surface as Bezier patches that are 
+//                intersected directly.  With a tessellation tolerance, 
+//                the surface is added as triangles instead.
+//
+
+void CRayIntersectionD::AddNurbs(int p_usize, int p_vsize, const CGrVector *p_points,
+                  const double *p_uknots, const double *p_vknots)
+{
+    CNurbsSurface surface;
+    if(!surface.Create(p_usize, p_vsize, p_points, p_uknots, p_vknots))
+        return;
+
+    if(m_nurbsTolerance > 0)
+    {
+        const CNurbsSurface::Mesh &mesh = surface.Tessellate(m_nurbsTolerance);
+        for(size_t i=0;  i<mesh.m_triangles.size();  i+=3)
+        {
+            TriangleBegin();
+            for(int v=0;  v<3;  v++)
+            {
+                int vertex = mesh.m_triangles[i + v];
+                TexVertex(mesh.m_texcoords[vertex]);
+                Normal(mesh.m_normals[vertex]);
+                Vertex(mesh.m_vertices[vertex]);
+            }
+            TriangleEnd();
+        }
+
+        return;
+    }
+
+    for(int i=0;  i<surface.PatchCnt();  i++)
+    {
+        const CNurbsSurface::Patch &patch = surface.GetPatch(i);
+        m_patches.push_back(CBezierPatch(patch.m_points, patch.m_s0, patch.m_s1, patch.m_t0, patch.m_t1));
+        m_patches.back().SetMaterial(m_material);
+        m_patches.back().SetTexture(m_texture);
+        m_patches.back().SetMask(m_mask);
+    }
+}
+
 /////////////////////////////////////////////////////////////////////
 //
 // Intersection Testing
@@ -375,17 +650,43 @@ void CRayIntersectionD::PolygonEnd()
 //                p_nearest - Location to put a pointer to the object
 //                 we intersected with.
 //                p_t - Location to put the distance to the object.
+//                p_filter - Optional filter that may reject hits.
+//                p_hits - If not NULL, collect the nearest p_k hits 
+//                 here instead, or all of them if p_k is 0.
 // Returns :      true for insertion or false if none.
 //
 
 bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIntersection::Object *p_ignore, 
-                                 const CRayIntersection::Object *&p_nearest, double &p_t, CGrVector &p_intersect)
+                                 const CRayIntersection::Object *&p_nearest, double &p_t, CGrVector &p_intersect,
+                                 const CRayIntersection::Filter *p_filter, 
+                                 std::vector<CRayIntersection::Hit> *p_hits, int p_k)
 {
     // Create a copy of the ray that has support for faster intersection testing
     CRayp ray(p_ray);
 
-    m_statTests++;                  // Count the number of tests
-    NewMark();                      // New mark for this test
+    if(m_root == NULL)
+        return false;               // Nothing loaded
+
+    // Counts the ray when we leave this function, however we leave
+    CRayCounters &counters = m_counters.Local();
+    struct RayTally
+    {
+        RayTally(CRayCounters &c) : counters(c), nodes(0), prims(0) {}
+        ~RayTally() {counters.Ray(nodes, prims);}
+        CRayCounters &counters;
+        unsigned long long nodes;       // Tree nodes visited
+        unsigned long long prims;       // Objects tested
+    } tally(counters);
+
+    // Each thread keeps its own record of the objects this ray has seen
+    static thread_local CRayMailbox mailbox;
+    mailbox.NewRay();
+
+    // Collecting hits, an object pushed out of the mailbox and tested
+    // again must not be collected twice
+    static thread_local std::unordered_set<const CIntersectionObject *> collected;
+    if(p_hits != NULL)
+        collected.clear();
 
     double tNear = TINY;            // Start of the ray, a small value
     double tFar = p_maxt;           // End of the ray
@@ -437,6 +738,7 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
     // Keeping track of the nearest polygon found so far
     double  nearestT = tFar;          
     const CIntersectionObject *nearestP = NULL;
+    const unsigned int rayMask = ray.Mask();
  
     // Items we'll put into our stack
     struct StackItem
@@ -483,6 +785,11 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
             break;
 
         pop = true;
+        tally.nodes++;
+
+        // Nothing below this node is visible to this ray
+        if((pTree->m_mask & rayMask) == 0)
+            continue;
 
         if(pTree->m_left == NULL && pTree->m_right == NULL)
         {
@@ -498,16 +805,20 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
             {
                 CIntersectionObject *p = m->m_object;
 
+                // Objects the ray cannot see are skipped before anything else
+                if((p->GetMask() & rayMask) == 0)
+                    continue;
+
+                CRayMailbox::Entry &box = mailbox.Slot(p);
+                bool seen = mailbox.Seen(box, p);
+
                 // Has this member been tested?  We don't need to test again.
-                if(p->WasTested(m_mark))
+                if(seen && box.m_tested)
                     continue;
 
                 // Is this a member we ignore?
                 if(p == p_ignore)
-                {
-                    p->SetTested(m_mark);
                     continue;
-                }
 
                 // There are two levels of examining a member: 
                 // Visit:  set compute the distance and check if it is in the range we
@@ -519,10 +830,10 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
                 //
 
                 double t;
-                if(p->WasVisited(m_mark))
+                if(seen)
                 {
                     // Already visited before, t is already computed.
-                    t = p->GetT();      // Recover the saved version
+                    t = box.m_t;        // Recover the saved version
                     // Is this farther away than our current 
                     // nearest item? If so, we ignore it.
                     if(t >= nearestT)
@@ -532,13 +843,13 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
                 }
                 else
                 {
-                    p->SetVisited(m_mark);;     // Not visited before, mark as visited
-
-                    m_statObjTests++;
+                    counters.ObjectTest();
+                    tally.prims++;
                     t = p->ComputeT(ray);     // Compute the t value
+                    mailbox.Visit(box, p, t);   // Not visited before, mark as visited
                     if(t < tNear || t >= nearestT)
                     {
-                        p->SetTested(m_mark);    // No reason to test again
+                        box.m_tested = true;    // No reason to test again
                         continue;               // This member is either too near or 
                                                 // we've already found a closer one.
                     }
@@ -550,16 +861,59 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
 
                 // We know the distance to the plane, so let's test the member
                 // to see if the interior point is inside the member.
-                p->SetTested(m_mark);
+                box.m_tested = true;
 
                  // What's the intersection point on the plane?
                 CGrVector intersect = ray.PointOnRay(t);
 
                 // Interior test for this point
-                m_statSurfaceTests++;      // Count number of actual member surface tests
+                counters.SurfaceTest();     // Count number of actual member surface tests
                 if(!p->SurfaceTest(intersect))
                     continue;       // Not on the surface
 
+                // The filter can pass the ray through, and we go on from here.
+                // The object is not tested again, so its later crossings, such 
+                // as the far side of a sphere, are offered now.
+                if(p_filter != NULL && !p_filter->Accept(p_ray, p, t, intersect))
+                {
+                    bool accepted = false;
+                    for(double next=p->ComputeNextT(ray, t);  next > t && next < nearestT;  next=p->ComputeNextT(ray, t))
+                    {
+                        t = next;
+                        intersect = ray.PointOnRay(t);
+                        if(p->SurfaceTest(intersect) && p_filter->Accept(p_ray, p, t, intersect))
+                        {
+                            accepted = true;
+                            break;
+                        }
+                    }
+
+                    if(!accepted)
+                        continue;
+                }
+
+                // Collecting hits, the nearest is the farthest we keep.  Every
+                // crossing of this object goes in now, since it is not tested again.
+                // An object pushed out of the mailbox is tested again, though, 
+                // so an object already collected is passed by.
+                if(p_hits != NULL)
+                {
+                    if(!collected.insert(p).second)
+                        continue;
+
+                    double cutoff = AddHit(*p_hits, p_k, p, t, intersect, tFar);
+                    for(double next=p->ComputeNextT(ray, t);  next > t && next < cutoff;  next=p->ComputeNextT(ray, t))
+                    {
+                        t = next;
+                        intersect = ray.PointOnRay(t);
+                        if(p->SurfaceTest(intersect) && (p_filter == NULL || p_filter->Accept(p_ray, p, t, intersect)))
+                            cutoff = AddHit(*p_hits, p_k, p, t, intersect, tFar);
+                    }
+
+                    nearestT = cutoff;
+                    continue;
+                }
+
                 // We have a new candidate for nearest member intersection
                 nearestT = t;
                 nearestP = p; 
@@ -907,6 +1261,314 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
 }
 
 
+//
+// Name :         CRayIntersectionD::IntersectAll()  
+// Description :  The traversal of Intersect(), keeping the nearest p_k
+//                hits.  The farthest of those limits the search once
+//                there are p_k of them.
+//
+
+int CRayIntersectionD::IntersectAll(const CRay &p_ray, double p_maxt, int p_k, std::vector<CRayIntersection::Hit> &p_hits)
+{
+    p_hits.clear();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    Intersect(p_ray, p_maxt, NULL, object, t, intersect, NULL, &p_hits, p_k < 0 ? 0 : p_k);
+
+    return int(p_hits.size());
+}
+
+
+//
+// Name :         CRayIntersectionD::ClosestPoint()  
+// Description :  Best-first search for the surface nearest to a point.
+//                Nodes come off a queue nearest box first, and the search
+//                ends when the nearest box left is farther than the best
+//                point so far.  Objects whose box is farther than that are
+//                passed by without computing their nearest point.
+// Parameters :   p_point - The point.
+//                p_maxd - Only surfaces within this distance count.
+//                p_mask - Only objects with a mask bit in common count.
+//                p_any - Stop at the first surface within p_maxd.
+//                p_object, p_closest, p_distance - The surface found.
+// Returns :      true if a surface is found.
+//
+
+bool CRayIntersectionD::ClosestPoint(const CGrVector &p_point, double p_maxd, unsigned int p_mask, bool p_any,
+            const CRayIntersection::Object *&p_object, CGrVector &p_closest, double &p_distance)
+{
+    if(m_root == NULL || p_maxd < 0)
+        return false;
+
+    // An object in many leaves is only measured once
+    static thread_local CRayMailbox mailbox;
+    mailbox.NewRay();
+
+    double best = p_maxd * p_maxd;
+    const CIntersectionObject *nearestP = NULL;
+
+    typedef std::pair<double, const CKdNode *> QueueItem;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > queue;
+    queue.push(QueueItem(m_root->m_bbox.Distance2(p_point), m_root));
+
+    while(!queue.empty())
+    {
+        const CKdNode *node = queue.top().second;
+        double d2 = queue.top().first;
+        queue.pop();
+
+        if(d2 > best)
+            break;
+
+        if((node->m_mask & p_mask) == 0)
+            continue;
+
+        if(node->m_left == NULL && node->m_right == NULL)
+        {
+            for(std::vector<CKdNode::Member>::const_iterator m=node->m_members.begin();  m!=node->m_members.end();  m++)
+            {
+                CIntersectionObject *p = m->m_object;
+                if((p->GetMask() & p_mask) == 0)
+                    continue;
+
+                CRayMailbox::Entry &box = mailbox.Slot(p);
+                if(mailbox.Seen(box, p))
+                    continue;
+                mailbox.Visit(box, p, 0);
+
+                if(p->GetBoundingBox().Distance2(p_point) > best)
+                    continue;
+
+                CGrVector closest;
+                if(!p->ClosestPoint(p_point, closest))
+                    continue;
+
+                double pd2 = (closest - p_point).LengthSquared3();
+                if(pd2 <= best)
+                {
+                    best = pd2;
+                    nearestP = p;
+                    p_closest = closest;
+                    if(p_any)
+                        break;
+                }
+            }
+
+            if(p_any && nearestP != NULL)
+                break;
+
+            continue;
+        }
+
+        if(node->m_left != NULL && (d2 = node->m_left->m_bbox.Distance2(p_point)) <= best)
+            queue.push(QueueItem(d2, node->m_left));
+
+        if(node->m_right != NULL && (d2 = node->m_right->m_bbox.Distance2(p_point)) <= best)
+            queue.push(QueueItem(d2, node->m_right));
+    }
+
+    if(nearestP == NULL)
+        return false;
+
+    p_object = nearestP;
+    p_distance = sqrt(best);
+    return true;
+}
+
+
+//
+// Name :         CRayIntersectionD::Query()  
+// Description :  Walk the parts of the tree inside the planes and pass
+//                each object inside them to the visitor.  An object in
+//                many leaves is remembered, so it is passed only once.
+// Returns :      The number of objects passed to the visitor.
+//
+
+int CRayIntersectionD::Query(const CGrVector *p_planes, int p_count, unsigned int p_mask, CRayIntersection::Visitor &p_visitor)
+{
+    if(m_root == NULL)
+        return 0;
+
+    std::unordered_set<const CIntersectionObject *> visited;
+    std::vector<const CKdNode *> stack;
+    stack.push_back(m_root);
+
+    int count = 0;
+    while(!stack.empty())
+    {
+        const CKdNode *node = stack.back();
+        stack.pop_back();
+
+        if((node->m_mask & p_mask) == 0 || node->m_bbox.Outside(p_planes, p_count))
+            continue;
+
+        if(node->m_left != NULL || node->m_right != NULL)
+        {
+            if(node->m_left != NULL)
+                stack.push_back(node->m_left);
+            if(node->m_right != NULL)
+                stack.push_back(node->m_right);
+            continue;
+        }
+
+        for(std::vector<CKdNode::Member>::const_iterator m=node->m_members.begin();  m!=node->m_members.end();  m++)
+        {
+            const CIntersectionObject *p = m->m_object;
+            if((p->GetMask() & p_mask) == 0 || p->GetBoundingBox().Outside(p_planes, p_count))
+                continue;
+
+            if(!visited.insert(p).second)
+                continue;
+
+            count++;
+            if(!p_visitor.Visit(p))
+                return count;
+        }
+    }
+
+    return count;
+}
+
+
+//
+// Name :         CRayIntersectionD::SphereCast()  
+// Description :  Sweep a sphere along a ray to the first surface it
+//                touches.  The sphere can only touch what is in a box 
+//                once it is inside the box grown by the radius, so nodes
+//                come off a queue in the order the ray enters their grown
+//                boxes, and the search ends when the next one is entered
+//                after the first touch so far.
+// Parameters :   p_ray - The ray the center of the sphere moves along.
+//                p_radius - Radius of the sphere.
+//                p_maxt - The sphere stops at this t.
+//                p_object, p_t, p_contact, p_normal - The touch found.
+// Returns :      true if the sphere touches a surface.
+//
+
+bool CRayIntersectionD::SphereCast(const CRay &p_ray, double p_radius, double p_maxt, 
+        const CRayIntersection::Object *&p_object, double &p_t, CGrVector &p_contact, CGrVector &p_normal)
+{
+    if(m_root == NULL || p_radius < 0 || p_maxt < 0)
+        return false;
+
+    CRayp ray(p_ray);
+    unsigned int rayMask = ray.Mask();
+
+    // An object in many leaves is only swept once
+    static thread_local CRayMailbox mailbox;
+    mailbox.NewRay();
+
+    double best = p_maxt;
+    const CIntersectionObject *nearestP = NULL;
+
+    typedef std::pair<double, const CKdNode *> QueueItem;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > queue;
+
+    double t;
+    if(m_root->m_bbox.Entry(ray, p_radius, best, t))
+        queue.push(QueueItem(t, m_root));
+
+    while(!queue.empty())
+    {
+        const CKdNode *node = queue.top().second;
+        double entry = queue.top().first;
+        queue.pop();
+
+        if(entry > best)
+            break;
+
+        if((node->m_mask & rayMask) == 0)
+            continue;
+
+        if(node->m_left == NULL && node->m_right == NULL)
+        {
+            for(std::vector<CKdNode::Member>::const_iterator m=node->m_members.begin();  m!=node->m_members.end();  m++)
+            {
+                CIntersectionObject *p = m->m_object;
+                if((p->GetMask() & rayMask) == 0)
+                    continue;
+
+                CRayMailbox::Entry &box = mailbox.Slot(p);
+                if(mailbox.Seen(box, p))
+                    continue;
+                mailbox.Visit(box, p, 0);
+
+                if(!p->GetBoundingBox().Entry(ray, p_radius, best, t))
+                    continue;
+
+                CGrVector contact;
+                if(p->SweepSphere(ray, p_radius, best, t, contact) && t <= best)
+                {
+                    best = t;
+                    nearestP = p;
+                    p_contact = contact;
+                }
+            }
+
+            continue;
+        }
+
+        if(node->m_left != NULL && node->m_left->m_bbox.Entry(ray, p_radius, best, t))
+            queue.push(QueueItem(t, node->m_left));
+
+        if(node->m_right != NULL && node->m_right->m_bbox.Entry(ray, p_radius, best, t))
+            queue.push(QueueItem(t, node->m_right));
+    }
+
+    if(nearestP == NULL)
+        return false;
+
+    // The normal points from the contact to the center of the sphere.
+    // A sphere of radius 0 is a ray, so it gets the surface normal
+    // turned to face back along the ray.
+    CGrVector normal = ray.PointOnRay(best) - p_contact;
+    normal.W() = 0;
+    if(normal.Length3() > TINY)
+        normal.Normalize3();
+    else
+    {
+        CGrVector texcoord;
+        nearestP->IntersectInfoAtTime(p_contact, ray.Time(), normal, texcoord);
+        normal.W() = 0;
+        if(Dot3(normal, ray.Direction()) > 0)
+            normal = -normal;
+    }
+
+    p_object = nearestP;
+    p_t = best;
+    p_normal = normal;
+    return true;
+}
+
+
+//
+// Name :         CRayIntersectionD::AddHit()  
+// Description :  Insert a hit in order and drop any beyond p_k.
+// Returns :      The t beyond which no more hits are wanted.
+//
+
+double CRayIntersectionD::AddHit(std::vector<CRayIntersection::Hit> &p_hits, int p_k, 
+    const CIntersectionObject *p_object, double p_t, const CGrVector &p_intersect, double p_cutoff)
+{
+    CRayIntersection::Hit hit;
+    hit.m_object = p_object;
+    hit.m_t = p_t;
+    hit.m_intersect = p_intersect;
+
+    std::vector<CRayIntersection::Hit>::iterator i = p_hits.end();
+    while(i != p_hits.begin() && (i - 1)->m_t > p_t)
+        i--;
+    p_hits.insert(i, hit);
+
+    if(p_k > 0 && int(p_hits.size()) > p_k)
+        p_hits.pop_back();
+
+    return p_k > 0 && int(p_hits.size()) == p_k ? p_hits.back().m_t : p_cutoff;
+}
+
+
 
 
 //
@@ -924,7 +1586,7 @@ bool CRayIntersectionD::Intersect(const CRay &p_ray, double p_maxt, const CRayIn
 
 void CRayIntersectionD::IntersectInfo(const CRay &p_ray, const CRayIntersection::Object *p_object, double p_t, 
                       CGrVector &p_normal, IMaterial *&p_material, 
-                      ITexture *&p_texture, CGrVector &p_texcoord) const
+                      ITexture *&p_texture, CGrVector &p_texcoord)
 {
     // Compute intersection point
     CGrVector intersect = p_ray.Origin() + p_ray.Direction() * p_t;
@@ -933,7 +1595,37 @@ void CRayIntersectionD::IntersectInfo(const CRay &p_ray, const CRayIntersection:
     const CIntersectionObject *obj = (const CIntersectionObject *)p_object;
     p_texture = obj->GetTexture();
     p_material = obj->GetMaterial();
-    obj->IntersectInfo(intersect, p_normal, p_texcoord);
+    obj->IntersectInfoAtTime(intersect, p_ray.Time(), p_normal, p_texcoord);
+}
+
+
+//
+// Name :         CRayIntersectionD::IntersectInfo()
+// Description :  Intersection information with the texture footprint.
+//                The ray differentials are carried to the plane of the
+//                object and then through the texture coordinate gradients.
+// Output Parms : p_dTdx, p_dTdy - Change in the texture coordinate per pixel
+//
+
+void CRayIntersectionD::IntersectInfo(const CRay &p_ray, const CRayDifferential &p_differential, 
+                      const CRayIntersection::Object *p_object, double p_t, 
+                      CGrVector &p_normal, IMaterial *&p_material, 
+                      ITexture *&p_texture, CGrVector &p_texcoord, 
+                      CGrVector &p_dTdx, CGrVector &p_dTdy)
+{
+    IntersectInfo(p_ray, p_object, p_t, p_normal, p_material, p_texture, p_texcoord);
+
+    CGrVector intersect = p_ray.Origin() + p_ray.Direction() * p_t;
+    const CIntersectionObject *obj = (const CIntersectionObject *)p_object;
+
+    CGrVector plane, dsdp, dtdp;
+    obj->TexCoordGradientAtTime(intersect, p_ray.Time(), plane, dsdp, dtdp);
+
+    CGrVector dPdx, dPdy;
+    p_differential.Transfer(p_ray, p_t, plane, dPdx, dPdy);
+
+    p_dTdx = CGrVector(Dot3(dsdp, dPdx), Dot3(dtdp, dPdx), 0, 0);
+    p_dTdy = CGrVector(Dot3(dsdp, dPdy), Dot3(dtdp, dPdy), 0, 0);
 }
 
 
@@ -946,11 +1638,15 @@ void CRayIntersectionD::IntersectInfo(const CRay &p_ray, const CRayIntersection:
 
 void CRayIntersectionD::LoadingComplete()
 {
-    assert((m_polys.size() + m_triangles.size()) > 0);
+    assert((m_polys.size() + m_triangles.size() + m_moving.size() + m_spheres.size() + m_boxes.size() + 
+        m_cylinders.size() + m_userPrims.size() + m_patches.size()) > 0);
 
     // Determine the extents in each dimension
     DetermineExtents();
 
+    // Set the costs for this scene from the calibration, if we have one
+    ApplyCalibration();
+
     // Kd Tree Version
     KdTreeBuild();
 }
@@ -994,6 +1690,26 @@ void CRayIntersectionD::KdTreeBuild()
         m_root->Add(t);
     }
 
+    // Moving triangles, by the box they sweep
+    for(list<CMovingTriangle>::iterator mov=m_moving.begin();  mov!=m_moving.end();  mov++)
+        m_root->Add(&(*mov));
+
+    // And the primitives
+    for(list<CSphere>::iterator sphere=m_spheres.begin();  sphere!=m_spheres.end();  sphere++)
+        m_root->Add(&(*sphere));
+
+    for(list<CBox>::iterator box=m_boxes.begin();  box!=m_boxes.end();  box++)
+        m_root->Add(&(*box));
+
+    for(list<CCylinder>::iterator cyl=m_cylinders.begin();  cyl!=m_cylinders.end();  cyl++)
+        m_root->Add(&(*cyl));
+
+    for(list<CUserPrimitive>::iterator user=m_userPrims.begin();  user!=m_userPrims.end();  user++)
+        m_root->Add(&(*user));
+
+    for(list<CBezierPatch>::iterator patch=m_patches.begin();  patch!=m_patches.end();  patch++)
+        m_root->Add(&(*patch));
+
     // Shrink the bounding box around the members
   //  m_root->ShrinkBoundingBox();
     
@@ -1001,24 +1717,83 @@ void CRayIntersectionD::KdTreeBuild()
     // Split into children.
     m_root->Subdivide();
 
-    // For statistics purposes
+    // For statistics purposes and the subtree masks
     Traverse(m_root);
+    ComputeMemory();
 }
 
 
-void CRayIntersectionD::Traverse(CKdNode *node)
+//
+// Name :         CRayIntersectionD::Traverse()
+// Description :  Walk the finished tree collecting statistics.  Each
+//                node gets the union of the masks of the members below
+//                it, so a ray can skip a subtree it can see nothing in.
+// Returns :      The mask of the node.
+//
+
+unsigned int CRayIntersectionD::Traverse(CKdNode *node)
 {
     if(node->m_left == NULL && node->m_right == NULL)
-        return;
+    {
+        unsigned long long size = node->m_members.size();
+        m_statLeaves++;
+        if(size == 0)
+            m_statEmptyLeaves++;
+        m_statLeafRefs += size;
+        m_statLeafSizes.Add(size);
+        m_statLeafDepths.Add(node->m_depth);
+
+        node->m_mask = 0;
+        for(vector<CKdNode::Member>::const_iterator m=node->m_members.begin();  m!=node->m_members.end();  m++)
+            node->m_mask |= m->m_object->GetMask();
+        return node->m_mask;
+    }
 
     if(node->m_left == NULL || node->m_right == NULL)
         m_statOneChild++;
 
+    node->m_mask = 0;
     if(node->m_left)
-        Traverse(node->m_left);
+        node->m_mask |= Traverse(node->m_left);
 
     if(node->m_right)
-        Traverse(node->m_right);
+        node->m_mask |= Traverse(node->m_right);
+
+    return node->m_mask;
+}
+
+
+//
+// Name :         CRayIntersectionD::ComputeMemory()
+// Description :  Estimate the memory used by the objects and the tree.
+//                Allocator overhead is not included.
+//
+
+void CRayIntersectionD::ComputeMemory()
+{
+    const unsigned long long listNode = 2 * sizeof(void *);
+
+    m_statMemory = m_triangles.size() * (sizeof(CTriangle) + listNode);
+
+    for(list<CMovingTriangle>::iterator mov=m_moving.begin();  mov!=m_moving.end();  mov++)
+        m_statMemory += sizeof(CMovingTriangle) + listNode + 6 * mov->GetKeys() * sizeof(CGrVector);
+    m_statMemory += m_spheres.size() * (sizeof(CSphere) + listNode);
+    m_statMemory += m_boxes.size() * (sizeof(CBox) + listNode);
+    m_statMemory += m_cylinders.size() * (sizeof(CCylinder) + listNode);
+    m_statMemory += m_userPrims.size() * (sizeof(CUserPrimitive) + listNode);
+
+    for(list<CBezierPatch>::iterator patch=m_patches.begin();  patch!=m_patches.end();  patch++)
+        m_statMemory += sizeof(CBezierPatch) + listNode + patch->GetNodeMemory();
+
+    for(list<CPolygon>::iterator poly=m_polys.begin();  poly!=m_polys.end();  poly++)
+    {
+        // Vertices and edge normals, plus the supplied normals and texture vertices
+        unsigned long long vectors = 2 * poly->GetNumVertices() + poly->m_normals.size() + poly->m_tvertices.size();
+        m_statMemory += sizeof(CPolygon) + listNode + vectors * sizeof(CGrVector);
+    }
+
+    m_statMemory += m_statNodes.load() * sizeof(CKdNode);
+    m_statMemory += m_statLeafRefs * sizeof(CKdNode::Member);
 }
 
 
@@ -1043,6 +1818,30 @@ void CRayIntersectionD::DetermineExtents()
     {
         m_sceneBB.Set(tri->GetVertex(0));
     }
+    else if(!m_moving.empty())
+    {
+        m_sceneBB.Set(m_moving.front().GetBoundingBox());
+    }
+    else if(!m_spheres.empty())
+    {
+        m_sceneBB.Set(m_spheres.front().GetBoundingBox());
+    }
+    else if(!m_boxes.empty())
+    {
+        m_sceneBB.Set(m_boxes.front().GetBoundingBox());
+    }
+    else if(!m_cylinders.empty())
+    {
+        m_sceneBB.Set(m_cylinders.front().GetBoundingBox());
+    }
+    else if(!m_userPrims.empty())
+    {
+        m_sceneBB.Set(m_userPrims.front().GetBoundingBox());
+    }
+    else if(!m_patches.empty())
+    {
+        m_sceneBB.Set(m_patches.front().GetBoundingBox());
+    }
 
     // Iterate over all polygons and vertices.
     for( ; poly!=m_polys.end();  poly++)
@@ -1061,6 +1860,25 @@ void CRayIntersectionD::DetermineExtents()
         m_sceneBB.Include(tri->GetVertex(1));
         m_sceneBB.Include(tri->GetVertex(2));
     }
+
+    for(list<CMovingTriangle>::iterator mov=m_moving.begin();  mov!=m_moving.end();  mov++)
+        m_sceneBB.Include(mov->GetBoundingBox());
+
+    // And the primitives, by their boxes
+    for(list<CSphere>::iterator sphere=m_spheres.begin();  sphere!=m_spheres.end();  sphere++)
+        m_sceneBB.Include(sphere->GetBoundingBox());
+
+    for(list<CBox>::iterator box=m_boxes.begin();  box!=m_boxes.end();  box++)
+        m_sceneBB.Include(box->GetBoundingBox());
+
+    for(list<CCylinder>::iterator cyl=m_cylinders.begin();  cyl!=m_cylinders.end();  cyl++)
+        m_sceneBB.Include(cyl->GetBoundingBox());
+
+    for(list<CUserPrimitive>::iterator user=m_userPrims.begin();  user!=m_userPrims.end();  user++)
+        m_sceneBB.Include(user->GetBoundingBox());
+
+    for(list<CBezierPatch>::iterator patch=m_patches.begin();  patch!=m_patches.end();  patch++)
+        m_sceneBB.Include(patch->GetBoundingBox());
 }
 
 
@@ -15,13 +15,20 @@
 
 #include <list>
 #include <vector>
-
+#include <atomic>
 
 #include "graphics/RayIntersection.h"
 #include "Polygon.h"
 #include "Triangle.h"
+#include "MovingTriangle.h"
+#include "Sphere.h"
+#include "Box.h"
+#include "Cylinder.h"
+#include "UserPrimitive.h"
+#include "BezierPatch.h"
 #include "BoundingBox.h"
 #include "KdNode.h"
+#include "RayStatistics.h"
 
 class CRayIntersectionD  
 {
@@ -39,6 +46,7 @@ public:
 
     // Triangle insertion
 	void TriangleBegin();
+	void TriangleBegin(int p_keys);
 	void TriangleEnd();
 
     // Generic insertion routines
@@ -47,6 +55,15 @@ public:
 	void TexVertex(const CGrVector &p_tvertex);
 	void Normal(const CGrVector &p_normal);
 	void Texture(ITexture *p_texture);
+    void Mask(unsigned int p_mask);
+
+    // Primitive insertion
+    void AddSphere(const CGrVector &p_center, double p_radius);
+    void AddBox(const CGrVector &p_min, const CGrVector &p_max);
+    void AddCylinder(const CGrVector &p_base, const CGrVector &p_top, double p_radius);
+    void AddPrimitive(CRayIntersection::Primitive *p_primitive);
+    void AddNurbs(int p_usize, int p_vsize, const CGrVector *p_points,
+                  const double *p_uknots, const double *p_vknots);
 
     double SetIntersectionCost(double c) {m_intersectionCost = c;  return c;}
     double GetIntersectionCost() const {return m_intersectionCost;}
@@ -56,51 +73,97 @@ public:
     int GetMaxDepth() const {return m_maxDepth;}
     int SetMinLeaf(int m) {m_minLeaf = m;  return m;}
     int GetMinLeaf() const {return m_minLeaf;}
+    int SetBuildThreads(int t);
+    int GetBuildThreads() const {return m_buildThreads;}
+    double SetNurbsTolerance(double t) {m_nurbsTolerance = t > 0 ? t : 0;  return m_nurbsTolerance;}
+    double GetNurbsTolerance() const {return m_nurbsTolerance;}
+    void CopyParameters(const CRayIntersectionD &p_from);
+
+    // Cost calibration
+    CRayIntersection::Calibration Calibrate();
+    void SetCalibration(const CRayIntersection::Calibration &c) {m_calibration = c;}
+    const CRayIntersection::Calibration &GetCalibration() const {return m_calibration;}
    
    // Intersection testing
    bool Intersect(const CRay &p_ray, double p_maxt, const CRayIntersection::Object *p_ignore, 
-       const CRayIntersection::Object *&p_object, double &p_t, CGrVector &p_intersect);
-   void IntersectInfo(const CRay &p_ray, const CRayIntersection::Object *p_object, double p_t, 
+       const CRayIntersection::Object *&p_object, double &p_t, CGrVector &p_intersect,
+       const CRayIntersection::Filter *p_filter=NULL, std::vector<CRayIntersection::Hit> *p_hits=NULL, int p_k=0);
+   int IntersectAll(const CRay &p_ray, double p_maxt, int p_k, std::vector<CRayIntersection::Hit> &p_hits);
+   bool ClosestPoint(const CGrVector &p_point, double p_maxd, unsigned int p_mask, bool p_any,
+       const CRayIntersection::Object *&p_object, CGrVector &p_closest, double &p_distance);
+   int Query(const CGrVector *p_planes, int p_count, unsigned int p_mask, CRayIntersection::Visitor &p_visitor);
+   bool SphereCast(const CRay &p_ray, double p_radius, double p_maxt, const CRayIntersection::Object *&p_object, 
+       double &p_t, CGrVector &p_contact, CGrVector &p_normal);
+
+   // These only depend on the object, so they need no scene
+   static void IntersectInfo(const CRay &p_ray, const CRayIntersection::Object *p_object, double p_t, 
+                      CGrVector &p_normal, IMaterial *&p_material, 
+                      ITexture *&p_texture, CGrVector &p_texcoord); 
+   static void IntersectInfo(const CRay &p_ray, const CRayDifferential &p_differential, 
+                      const CRayIntersection::Object *p_object, double p_t, 
                       CGrVector &p_normal, IMaterial *&p_material, 
-                      ITexture *&p_texture, CGrVector &p_texcoord) const; 
+                      ITexture *&p_texture, CGrVector &p_texcoord, 
+                      CGrVector &p_dTdx, CGrVector &p_dTdy); 
 
     void SaveStats();
+    void GetStatistics(CRayIntersection::Statistics &p_stats) const;
+    void ResetStatistics() {m_counters.Reset();}
 
     int GetMaxDepth() {return m_maxDepth;}
     int GetMinLeaf() {return m_minLeaf;}
     double GetIntersectionCost() {return m_intersectionCost;}
     double GetTraverseCost() {return m_traverseCost;}
     void StatIncNodes(int c=1) {m_statNodes += c;}
-    void NewDepth(int d) {if(d > m_statMaxDepth) m_statMaxDepth = d;}
-
-    int GetMark() {return m_mark;}
-    int NewMark() {m_mark++;  return m_mark;}
+    void NewDepth(int d);
+    int GetParallelDepth() const {return m_parallelDepth;}
 
 private:
     void KdTreeBuild();
+    void ApplyCalibration();
 	void DetermineExtents();
-    void Traverse(CKdNode *node);
+    unsigned int Traverse(CKdNode *node);
+    static double AddHit(std::vector<CRayIntersection::Hit> &p_hits, int p_k, 
+        const CIntersectionObject *p_object, double p_t, const CGrVector &p_intersect, double p_cutoff);
+    void ComputeMemory();
 
     CRayIntersection::ObjectType m_loading; // Type of object we are loading
     CIntersectionObject *m_loadingObject;   // Object we are loading
+    IMaterial           *m_material;        // Material for objects we load
+    ITexture            *m_texture;         // Texture for objects we load
+    unsigned int        m_mask;             // Visibility mask for objects we load
     std::list<CPolygon>  m_polys;           // List of all polygons
     std::list<CTriangle> m_triangles;       // List of all triangles
-
-    int                 m_mark;
+    std::list<CMovingTriangle> m_moving;    // Triangles with time keys
+    std::list<CSphere>   m_spheres;         // List of all spheres
+    std::list<CBox>      m_boxes;           // List of all boxes
+    std::list<CCylinder> m_cylinders;       // List of all cylinders
+    std::list<CUserPrimitive> m_userPrims;  // Primitives from the application
+    std::list<CBezierPatch> m_patches;      // Patches of NURBS surfaces
 
     // Some basic parameters
     double              m_intersectionCost; // Cost to compute an intersection
     double              m_traverseCost;     // Cost to traverse a child node
     int                 m_maxDepth;         // Maximum allowed tree depth
     int                 m_minLeaf;          // Leaves below this will not split
+    int                 m_buildThreads;     // Threads to use for the tree build
+    int                 m_parallelDepth;    // Nodes above this depth subdivide in parallel
+    double              m_nurbsTolerance;   // Tessellate NURBS surfaces to this if not 0
+    CRayIntersection::Calibration m_calibration;    // Measured costs, if any
 
     // Statistics gathering
-    int                 m_statNodes;
-    int                 m_statTests;
-    int                 m_statObjTests;
-    int                 m_statSurfaceTests;
-    int                 m_statMaxDepth;
-    int                 m_statOneChild;
+    // Nodes and depth are updated from the parallel build
+    std::atomic<int>    m_statNodes;
+    std::atomic<int>    m_statMaxDepth;
+    unsigned long long  m_statOneChild;
+    unsigned long long  m_statLeaves;
+    unsigned long long  m_statEmptyLeaves;
+    unsigned long long  m_statLeafRefs;
+    unsigned long long  m_statMemory;
+    CRayIntersection::Histogram m_statLeafSizes;
+    CRayIntersection::Histogram m_statLeafDepths;
+
+    // Query counters, one block per querying thread
+    CRayCounterSet      m_counters;
 
     // The scene bounding box
     CBoundingBox        m_sceneBB;
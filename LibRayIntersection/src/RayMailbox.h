@@ -0,0 +1,67 @@
+//
+// Name :         RayMailbox.h
+// Description :  Header file for CRayMailbox, the record of which objects
+//                a ray has already visited or tested.  An object can be in
+//                many leaves of the kd-tree, and the mailbox keeps us from
+//                testing it again in each one.  Each querying thread has its
+//                own mailbox, so queries can run on many threads at once.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+class CIntersectionObject;
+
+//
+// class CRayMailbox
+// A small direct mapped table keyed by object.  An object that is
+// pushed out by another one is simply visited again, so a collision
+// costs a repeated test, never a wrong answer.  Entries are valid
+// only for the current mark, so starting a new ray does not clear
+// the table.
+//
+
+class CRayMailbox
+{
+public:
+    CRayMailbox() : m_mark(0) {memset(m_entries, 0, sizeof(m_entries));}
+
+    struct Entry
+    {
+        const CIntersectionObject *m_object;
+        unsigned    m_mark;
+        bool        m_tested;       // Interior test done or not needed
+        double      m_t;            // t computed for the current ray
+    };
+
+    // Start a new ray
+    void NewRay()
+    {
+        if(++m_mark == 0)
+        {
+            memset(m_entries, 0, sizeof(m_entries));
+            m_mark = 1;
+        }
+    }
+
+    // The entry for an object.  Check Seen() before using the values.
+    Entry &Slot(const CIntersectionObject *p)
+    {
+        std::uintptr_t h = reinterpret_cast<std::uintptr_t>(p) >> 4;
+        return m_entries[(h ^ (h >> 9)) & (SIZE - 1)];
+    }
+
+    // Has this ray already visited the object?
+    bool Seen(const Entry &e, const CIntersectionObject *p) const {return e.m_object == p && e.m_mark == m_mark;}
+
+    // Record a visit to the object
+    void Visit(Entry &e, const CIntersectionObject *p, double t) {e.m_object = p;  e.m_mark = m_mark;  e.m_tested = false;  e.m_t = t;}
+
+private:
+    enum {SIZE = 512};
+
+    unsigned    m_mark;
+    Entry       m_entries[SIZE];
+};
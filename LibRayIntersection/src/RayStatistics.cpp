@@ -0,0 +1,258 @@
+//
+// Name :         RayStatistics.cpp
+// Description :  Implementation of the query statistics counters and
+//                of CRayIntersection::Statistics.
+//
+
+#include "stdafx.h"
+#include <sstream>
+
+#include "RayStatistics.h"
+
+using namespace std;
+
+namespace
+{
+    // Source of unique counter set ids.  0 is never used.
+    atomic<unsigned long long> g_nextId(1);
+
+    // The counters this thread used last
+    struct LocalCache
+    {
+        unsigned long long  m_id;
+        CRayCounters       *m_counters;
+    };
+
+    thread_local LocalCache t_cache = {0, NULL};
+
+    // Add the bins of a counter array to a histogram
+    void AddBins(CRayIntersection::Histogram &hist, const atomic<unsigned long long> *bins)
+    {
+        for(int b=0;  b<STATLOGBINS;  b++)
+        {
+            unsigned long long n = bins[b].load(memory_order_relaxed);
+            if(n == 0)
+                continue;
+
+            if(hist.m_bins.size() <= size_t(b))
+                hist.m_bins.resize(b + 1, 0);
+            hist.m_bins[b] += n;
+            hist.m_count += n;
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// CRayCounters
+//////////////////////////////////////////////////////////////////////
+
+void CRayCounters::Reset()
+{
+    m_rays.store(0);
+    m_objectTests.store(0);
+    m_surfaceTests.store(0);
+    for(int b=0;  b<STATLOGBINS;  b++)
+    {
+        m_nodesVisited[b].store(0);
+        m_primsTested[b].store(0);
+    }
+
+    m_nodesSum.store(0);
+    m_nodesMax.store(0);
+    m_primsSum.store(0);
+    m_primsMax.store(0);
+}
+
+
+void CRayCounters::AddTo(CRayIntersection::Statistics &p_stats) const
+{
+    p_stats.m_rays += m_rays.load(memory_order_relaxed);
+    p_stats.m_objectTests += m_objectTests.load(memory_order_relaxed);
+    p_stats.m_surfaceTests += m_surfaceTests.load(memory_order_relaxed);
+
+    CRayIntersection::Histogram &nodes = p_stats.m_nodesVisited;
+    AddBins(nodes, m_nodesVisited);
+    nodes.m_sum += m_nodesSum.load(memory_order_relaxed);
+    if(m_nodesMax.load(memory_order_relaxed) > nodes.m_max)
+        nodes.m_max = m_nodesMax.load(memory_order_relaxed);
+
+    CRayIntersection::Histogram &prims = p_stats.m_primsTested;
+    AddBins(prims, m_primsTested);
+    prims.m_sum += m_primsSum.load(memory_order_relaxed);
+    if(m_primsMax.load(memory_order_relaxed) > prims.m_max)
+        prims.m_max = m_primsMax.load(memory_order_relaxed);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// CRayCounterSet
+//////////////////////////////////////////////////////////////////////
+
+CRayCounterSet::CRayCounterSet() : m_id(g_nextId.fetch_add(1))
+{
+}
+
+
+//
+// Name :         CRayCounterSet::Local()
+// Description :  The calling thread's counters.  The common case, a
+//                thread querying the same scene as last time, is a
+//                thread local compare.  Ids are never reused, so a cache
+//                entry for a deleted set can never match a new one.
+//
+
+CRayCounters &CRayCounterSet::Local()
+{
+    if(t_cache.m_id == m_id)
+        return *t_cache.m_counters;
+
+    CRayCounters &counters = Find();
+    t_cache.m_id = m_id;
+    t_cache.m_counters = &counters;
+    return counters;
+}
+
+
+//
+// Name :         CRayCounterSet::Find()
+// Description :  Find or create the counters for the calling thread.
+//
+
+CRayCounters &CRayCounterSet::Find()
+{
+    lock_guard<mutex> lock(m_lock);
+
+    map<thread::id, CRayCounters *>::iterator t = m_threads.find(this_thread::get_id());
+    if(t != m_threads.end())
+        return *t->second;
+
+    m_counters.emplace_back();
+    m_threads[this_thread::get_id()] = &m_counters.back();
+    return m_counters.back();
+}
+
+
+void CRayCounterSet::Reset()
+{
+    lock_guard<mutex> lock(m_lock);
+    for(deque<CRayCounters>::iterator c=m_counters.begin();  c!=m_counters.end();  c++)
+        c->Reset();
+}
+
+
+void CRayCounterSet::AddTo(CRayIntersection::Statistics &p_stats) const
+{
+    lock_guard<mutex> lock(m_lock);
+    for(deque<CRayCounters>::const_iterator c=m_counters.begin();  c!=m_counters.end();  c++)
+        c->AddTo(p_stats);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// CRayIntersection::Histogram
+//////////////////////////////////////////////////////////////////////
+
+void CRayIntersection::Histogram::Add(unsigned long long v, unsigned long long n)
+{
+    size_t bin = m_logarithmic ? CRayCounters::LogBin(v) : size_t(v);
+    if(m_bins.size() <= bin)
+        m_bins.resize(bin + 1, 0);
+
+    m_bins[bin] += n;
+    m_count += n;
+    m_sum += v * n;
+    if(n > 0 && v > m_max)
+        m_max = v;
+}
+
+
+unsigned long long CRayIntersection::Histogram::BinMin(int bin) const
+{
+    if(!m_logarithmic || bin == 0)
+        return bin;
+
+    return 1ULL << (bin - 1);
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// CRayIntersection::Statistics
+//////////////////////////////////////////////////////////////////////
+
+CRayIntersection::Statistics::Statistics() :
+    m_polygons(0), m_triangles(0), m_primitives(0), m_memory(0),
+    m_nodes(0), m_leaves(0), m_emptyLeaves(0), m_oneChild(0), m_leafReferences(0), m_maxDepth(0),
+    m_intersectionCost(0), m_traverseCost(0),
+    m_leafSizes(true), m_leafDepths(false),
+    m_rays(0), m_objectTests(0), m_surfaceTests(0),
+    m_nodesVisited(true), m_primsTested(true)
+{
+}
+
+
+static void HistogramJSON(ostream &str, const CRayIntersection::Histogram &hist)
+{
+    str << "{\"scale\": \"" << (hist.m_logarithmic ? "log2" : "linear") << "\", ";
+    str << "\"count\": " << hist.m_count << ", ";
+    str << "\"sum\": " << hist.m_sum << ", ";
+    str << "\"max\": " << hist.m_max << ", ";
+    str << "\"mean\": " << hist.Mean() << ", ";
+    str << "\"bins\": [";
+    for(size_t b=0;  b<hist.m_bins.size();  b++)
+    {
+        if(b > 0)
+            str << ", ";
+        str << hist.m_bins[b];
+    }
+
+    str << "]}";
+}
+
+
+//
+// Name :         CRayIntersection::Statistics::ToJSON()
+// Description :  Format the statistics as a JSON object.
+//
+
+std::string CRayIntersection::Statistics::ToJSON() const
+{
+    ostringstream str;
+    str.precision(10);
+
+    str << "{" << endl;
+    str << "  \"polygons\": " << m_polygons << "," << endl;
+    str << "  \"triangles\": " << m_triangles << "," << endl;
+    str << "  \"primitives\": " << m_primitives << "," << endl;
+    str << "  \"memoryBytes\": " << m_memory << "," << endl;
+
+    str << "  \"tree\": {" << endl;
+    str << "    \"nodes\": " << m_nodes << "," << endl;
+    str << "    \"leaves\": " << m_leaves << "," << endl;
+    str << "    \"emptyLeaves\": " << m_emptyLeaves << "," << endl;
+    str << "    \"oneChild\": " << m_oneChild << "," << endl;
+    str << "    \"leafReferences\": " << m_leafReferences << "," << endl;
+    str << "    \"maxDepth\": " << m_maxDepth << "," << endl;
+    str << "    \"intersectionCost\": " << m_intersectionCost << "," << endl;
+    str << "    \"traverseCost\": " << m_traverseCost << "," << endl;
+    str << "    \"leafSizes\": ";
+    HistogramJSON(str, m_leafSizes);
+    str << "," << endl;
+    str << "    \"leafDepths\": ";
+    HistogramJSON(str, m_leafDepths);
+    str << endl << "  }," << endl;
+
+    str << "  \"queries\": {" << endl;
+    str << "    \"rays\": " << m_rays << "," << endl;
+    str << "    \"objectTests\": " << m_objectTests << "," << endl;
+    str << "    \"surfaceTests\": " << m_surfaceTests << "," << endl;
+    str << "    \"nodesVisited\": ";
+    HistogramJSON(str, m_nodesVisited);
+    str << "," << endl;
+    str << "    \"primsTested\": ";
+    HistogramJSON(str, m_primsTested);
+    str << endl << "  }" << endl;
+    str << "}" << endl;
+
+    return str.str();
+}
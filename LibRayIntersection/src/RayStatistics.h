@@ -0,0 +1,113 @@
+#pragma once
+
+//
+// Name :         RayStatistics.h
+// Description :  Header for CRayCounters and CRayCounterSet, the query
+//                statistics counters.  Each thread that queries a scene
+//                gets its own block of counters, so counting needs no
+//                locked instructions and cannot race.  The blocks are
+//                summed when statistics are requested.
+//
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "graphics/RayIntersection.h"
+
+// Number of bins in a logarithmic histogram of 64-bit values
+const int STATLOGBINS = 65;
+
+//
+// class CRayCounters
+// One thread's query counters.  Only the owning thread writes them.
+// Other threads may read them at any time, so they are atomic, but
+// updates are a relaxed load and store, not a read-modify-write.
+//
+
+class CRayCounters
+{
+public:
+    CRayCounters() {Reset();}
+
+    void ObjectTest() {Inc(m_objectTests);}
+    void SurfaceTest() {Inc(m_surfaceTests);}
+
+    // Record a completed ray
+    void Ray(unsigned long long nodes, unsigned long long prims)
+    {
+        Inc(m_rays);
+        Inc(m_nodesVisited[LogBin(nodes)]);
+        Inc(m_nodesSum, nodes);
+        Max(m_nodesMax, nodes);
+        Inc(m_primsTested[LogBin(prims)]);
+        Inc(m_primsSum, prims);
+        Max(m_primsMax, prims);
+    }
+
+    void Reset();
+    void AddTo(CRayIntersection::Statistics &p_stats) const;
+
+    // Bin for a value in a logarithmic histogram
+    static int LogBin(unsigned long long v)
+    {
+        int bin = 0;
+        for( ;  v != 0;  v >>= 1)
+            bin++;
+        return bin;
+    }
+
+private:
+    typedef std::atomic<unsigned long long> Counter;
+
+    static void Inc(Counter &c, unsigned long long n=1)
+    {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static void Max(Counter &c, unsigned long long n)
+    {
+        if(n > c.load(std::memory_order_relaxed))
+            c.store(n, std::memory_order_relaxed);
+    }
+
+    Counter     m_rays;             // Rays tested
+    Counter     m_objectTests;      // Ray/plane distance computations
+    Counter     m_surfaceTests;     // Interior tests
+    Counter     m_nodesVisited[STATLOGBINS];
+    Counter     m_nodesSum;
+    Counter     m_nodesMax;
+    Counter     m_primsTested[STATLOGBINS];
+    Counter     m_primsSum;
+    Counter     m_primsMax;
+};
+
+//
+// class CRayCounterSet
+// The counters for one scene, one block per querying thread.
+//
+
+class CRayCounterSet
+{
+public:
+    CRayCounterSet();
+
+    // The calling thread's counters
+    CRayCounters &Local();
+
+    void Reset();
+    void AddTo(CRayIntersection::Statistics &p_stats) const;
+
+private:
+    CRayCounterSet(const CRayCounterSet &);
+    CRayCounterSet &operator=(const CRayCounterSet &);
+
+    CRayCounters &Find();
+
+    unsigned long long          m_id;       // Unique over the life of the process
+    mutable std::mutex          m_lock;     // Protects m_counters and m_threads
+    std::deque<CRayCounters>    m_counters; // deque keeps addresses stable
+    std::map<std::thread::id, CRayCounters *> m_threads;
+};
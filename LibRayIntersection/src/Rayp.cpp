@@ -1,10 +1,12 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "Rayp.h"
 
 CRayp::CRayp(const CRay &r)
 {
     m_o = r.Origin(); 
     m_d = r.Direction();
+    m_time = r.Time();
+    m_mask = r.Mask();
 
     // Preparation for modified Smit's bounding box intersection test
     // This works even if the direction component is zero because of
@@ -19,7 +19,9 @@ public:
     const double Origin(int d) const {return m_o[d];}
     const CGrVector &Direction() const {return m_d;}
     const double Direction(int d) const {return m_d[d];}
-    CRayp &operator=(const CRay &r) {m_o = r.Origin(); m_d = r.Direction(); return *this;}
+    double Time() const {return m_time;}
+    unsigned int Mask() const {return m_mask;}
+    CRayp &operator=(const CRay &r) {m_o = r.Origin(); m_d = r.Direction(); m_time = r.Time(); m_mask = r.Mask(); return *this;}
     CGrVector PointOnRay(double t) const {return m_o + m_d * t;}
 
     // Bounding box intersection support
@@ -30,6 +32,8 @@ private:
 
     CGrVector    m_o;
     CGrVector    m_d;
+    double       m_time;
+    unsigned int m_mask;
 
     // Box intersection support
     CGrVector   m_invDirection;
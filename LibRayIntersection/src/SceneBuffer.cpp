@@ -0,0 +1,132 @@
+//
+// Name :         SceneBuffer.cpp
+// Description :  Implementation of CSceneBuffer, double buffered scene swap.
+//
+
+#include "stdafx.h"
+
+#include "SceneBuffer.h"
+#include "RayIntersectionD.h"
+#include "Epoch.h"
+
+using namespace std;
+
+CSceneBuffer::CSceneBuffer() : m_active(NULL), m_building(false)
+{
+}
+
+CSceneBuffer::~CSceneBuffer()
+{
+    Wait();
+
+    // Nobody may query a CRayIntersection that is being destroyed,
+    // so everything can go now.
+    unsigned long long tag;
+    delete Swap(NULL, tag);
+    Reclaim(true);
+}
+
+
+//
+// Name :         CSceneBuffer::Swap()
+// Description :  Replace the active scene.  Returns the old scene
+//                and the epoch tag it was retired with.
+//
+
+CRayIntersectionD *CSceneBuffer::Swap(CRayIntersectionD *scene, unsigned long long &tag)
+{
+    CRayIntersectionD *old = m_active.exchange(scene);
+    tag = CEpoch::Advance();
+    return old;
+}
+
+
+//
+// Name :         CSceneBuffer::Publish()
+// Description :  Make a built scene the active one.  The old scene
+//                is reclaimed now if no reader can see it, otherwise
+//                on a later publish or in the destructor.
+//
+
+void CSceneBuffer::Publish(CRayIntersectionD *scene)
+{
+    unsigned long long tag;
+    CRayIntersectionD *old = Swap(scene, tag);
+
+    if(old != NULL)
+    {
+        lock_guard<mutex> lock(m_lock);
+        Retired r;
+        r.m_scene = old;
+        r.m_tag = tag;
+        m_retired.push_back(r);
+    }
+
+    Reclaim(false);
+}
+
+
+//
+// Name :         CSceneBuffer::BuildAsync()
+// Description :  Build the kd tree for a loaded scene on a worker
+//                thread.  The current scene keeps answering queries
+//                until the new one is published.  The builder thread
+//                then waits out the readers of the old scene and deletes
+//                it, so the caller never pays for the teardown.
+//
+
+void CSceneBuffer::BuildAsync(CRayIntersectionD *scene)
+{
+    // Only one build at a time so publications stay in order
+    Wait();
+
+    m_building = true;
+    m_builder = thread([this, scene]()
+    {
+        scene->LoadingComplete();
+        Publish(scene);
+        m_building = false;
+        Reclaim(true);
+    });
+}
+
+
+void CSceneBuffer::Wait()
+{
+    if(m_builder.joinable())
+        m_builder.join();
+}
+
+
+//
+// Name :         CSceneBuffer::Reclaim()
+// Description :  Delete retired scenes no reader can still see.
+//                If wait is true, block until all are deleted.
+//
+
+void CSceneBuffer::Reclaim(bool wait)
+{
+    vector<Retired> retired;
+    {
+        lock_guard<mutex> lock(m_lock);
+        retired.swap(m_retired);
+    }
+
+    vector<Retired> keep;
+    for(vector<Retired>::iterator r=retired.begin();  r!=retired.end();  r++)
+    {
+        if(wait)
+            CEpoch::WaitQuiescent(r->m_tag);
+
+        if(CEpoch::Quiescent(r->m_tag))
+            delete r->m_scene;
+        else
+            keep.push_back(*r);
+    }
+
+    if(!keep.empty())
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_retired.insert(m_retired.end(), keep.begin(), keep.end());
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+//
+// Name :         SceneBuffer.h
+// Description :  Header for CSceneBuffer, the double buffer that holds the
+//                intersection structure that is currently answering queries
+//                while a replacement is built in the background.
+//
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CRayIntersectionD;
+
+//
+// class CSceneBuffer
+// Owns the published CRayIntersectionD.  Queries read Active() inside
+// a CEpochGuard.  A newly published scene replaces the old one atomically
+// and the old one is deleted once all read sections that could see it
+// have been left.
+//
+
+class CSceneBuffer
+{
+public:
+    CSceneBuffer();
+    ~CSceneBuffer();
+
+    // The published scene or NULL.  Only valid inside a CEpochGuard.
+    CRayIntersectionD *Active() const {return m_active.load();}
+
+    // Publish a scene that is already built.  Takes ownership.
+    void Publish(CRayIntersectionD *scene);
+
+    // Build a loaded scene on a worker thread, then publish it.  Takes ownership.
+    void BuildAsync(CRayIntersectionD *scene);
+
+    bool IsBuilding() const {return m_building.load();}
+    void Wait();
+
+private:
+    CSceneBuffer(const CSceneBuffer &);
+    CSceneBuffer &operator=(const CSceneBuffer &);
+
+    CRayIntersectionD *Swap(CRayIntersectionD *scene, unsigned long long &tag);
+    void Reclaim(bool wait);
+
+    std::atomic<CRayIntersectionD *>    m_active;       // Scene answering queries
+    std::atomic<bool>                   m_building;     // True while the builder runs
+    std::thread                         m_builder;      // Background build thread
+
+    // Scenes replaced but possibly still in use by a reader
+    struct Retired
+    {
+        CRayIntersectionD  *m_scene;
+        unsigned long long  m_tag;
+    };
+
+    std::mutex              m_lock;         // Protects m_retired
+    std::vector<Retired>    m_retired;
+};
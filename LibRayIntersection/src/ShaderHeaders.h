@@ -1,7 +1,9 @@
 #pragma once
 
 // C Libraries
+#ifndef NOMFC
 #include <afxwin.h>
+#endif
 #include <stdio.h>
 
 #include <cmath>
@@ -15,6 +17,7 @@
 
 using namespace std;
 
+#ifndef NOOPENGL
 #define GLEW_STATIC
 #include <glew.h>
 #include <glext.h>
@@ -27,6 +30,7 @@ using namespace std;
 #include <type_ptr.hpp>
 
 using namespace glm;
+#endif // NOOPENGL
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
@@ -0,0 +1,169 @@
+#include "stdafx.h"
+#include "Sphere.h"
+#include <cmath>
+
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+const double PI = 3.1415926535897932384626433832795;
+
+CSphere::CSphere(const CGrVector &p_center, double p_radius)
+{
+    m_center = p_center;
+    m_radius = p_radius;
+
+    CGrVector r(p_radius, p_radius, p_radius, 0);
+    CBoundingBox box(p_center - r);
+    box.Include(p_center + r);
+    SetBoundingBox(box);
+}
+
+CSphere::~CSphere(void)
+{
+}
+
+
+//
+// Name :         CSphere::ComputeT()
+// Description :  The nearest root of |o + td - c|^2 = r^2 in front of 
+//                the ray origin.  A ray that starts inside gets the far
+//                root.
+//
+
+double CSphere::ComputeT(const CRayp &ray)
+{
+    CGrVector oc = ray.Origin() - m_center;
+    double a = Dot3(ray.Direction(), ray.Direction());
+    double b = Dot3(oc, ray.Direction());
+    double c = Dot3(oc, oc) - m_radius * m_radius;
+
+    double disc = b * b - a * c;
+    if(disc < 0 || a <= 0)
+        return -1;
+
+    double root = sqrt(disc);
+    double t = (-b - root) / a;
+    if(t > TINY)
+        return t;
+
+    t = (-b + root) / a;
+    return t > TINY ? t : -1;
+}
+
+
+//
+// Name :         CSphere::ComputeNextT()
+// Description :  The far root, if it is beyond t.
+//
+
+double CSphere::ComputeNextT(const CRayp &ray, double t)
+{
+    CGrVector oc = ray.Origin() - m_center;
+    double a = Dot3(ray.Direction(), ray.Direction());
+    double b = Dot3(oc, ray.Direction());
+    double c = Dot3(oc, oc) - m_radius * m_radius;
+
+    double disc = b * b - a * c;
+    if(disc < 0 || a <= 0)
+        return -1;
+
+    double t1 = (-b + sqrt(disc)) / a;
+    return t1 > t + TINY ? t1 : -1;
+}
+
+
+bool CSphere::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    CGrVector d = p - m_center;
+    d.W() = 0;
+    double len = d.Length3();
+    p_closest = m_center + (len > 0 ? d * (m_radius / len) : CGrVector(0, m_radius, 0, 0));
+    return true;
+}
+
+
+//
+// Name :         CSphere::SweepSphere()
+// Description :  The centers are r + R apart when the moving sphere 
+//                touches from outside, and R - r apart when it touches
+//                the shell from inside.
+//
+
+bool CSphere::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
+{
+    CGrVector m = ray.Origin() - m_center;
+    m.W() = 0;
+    double dist = m.Length3();
+
+    double t;
+    if(fabs(dist - m_radius) <= p_radius)
+        t = 0;
+    else
+    {
+        bool inside = dist < m_radius;
+        double reach = inside ? m_radius - p_radius : m_radius + p_radius;
+        double a = Dot3(ray.Direction(), ray.Direction());
+        double b = Dot3(m, ray.Direction());
+        double c = Dot3(m, m) - reach * reach;
+        double disc = b * b - a * c;
+        if(a <= 0 || disc < 0)
+            return false;
+
+        t = inside ? (-b + sqrt(disc)) / a : (-b - sqrt(disc)) / a;
+        if(t < 0 || t > p_maxt)
+            return false;
+    }
+
+    p_t = t;
+    return ClosestPoint(ray.PointOnRay(t), p_contact);
+}
+
+
+//
+// Name :         CSphere::IntersectInfo()
+// Description :  The normal is the direction from the center.  The 
+//                texture coordinate is s = atan2(x, z) / 2pi + 0.5 and
+//                t = asin(y) / pi + 0.5 on the unit normal.
+//
+
+void CSphere::IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    CGrVector n = intersect - m_center;
+    n.W() = 0;
+    n.Normalize3();
+    p_normal = n;
+
+    double y = n.Y() < -1 ? -1 : (n.Y() > 1 ? 1 : n.Y());
+    p_texcoord = CGrVector(atan2(n.X(), n.Z()) / (2 * PI) + 0.5, asin(y) / PI + 0.5, 0);
+}
+
+
+//
+// Name :         CSphere::TexCoordGradient()
+// Description :  Differentiating the mapping above.  With p the point 
+//                relative to the center, ds/dp = (z, 0, -x) / 2pi(x^2 + z^2)
+//                and dt/dp = (y_axis - y p / |p|^2) / pi sqrt(x^2 + z^2).
+//                Both are tangent to the sphere.  At the poles s is
+//                undefined and the gradients are zero.
+//
+
+void CSphere::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    CGrVector p = intersect - m_center;
+    p.W() = 0;
+    p_normal = Normalize3(p);
+
+    double xz2 = p.X() * p.X() + p.Z() * p.Z();
+    double len2 = xz2 + p.Y() * p.Y();
+    if(xz2 <= TINY * len2)
+    {
+        p_dsdp = CGrVector(0, 0, 0, 0);
+        p_dtdp = CGrVector(0, 0, 0, 0);
+        return;
+    }
+
+    double xz = sqrt(xz2);
+    p_dsdp = CGrVector(p.Z(), 0, -p.X(), 0) / (2 * PI * xz2);
+    p_dtdp = (CGrVector(0, 1, 0, 0) - p * (p.Y() / len2)) / (PI * xz);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "IntersectionObject.h"
+
+//
+// class CSphere
+// A sphere intersected exactly.  The texture coordinates are the
+// longitude and latitude of the surface point, s = 0.5 facing +z and
+// t = 0 at the bottom, the same mapping CGrComposite::Sphere() gives
+// its facets.
+//
+
+class CSphere : public CIntersectionObject
+{
+public:
+    CSphere(const CGrVector &p_center, double p_radius);
+    virtual ~CSphere(void);
+
+    virtual CRayIntersection::ObjectType Type() const {return CRayIntersection::Sphere;}
+
+    // The sphere is not built from vertices
+    virtual void AddVertex(const CGrVector &/*v*/) {}
+    virtual void AddNormal(const CGrVector &/*n*/) {}
+    virtual void AddTexVertex(const CGrVector &/*t*/) {}
+
+    virtual double ComputeT(const CRayp &ray);
+    virtual double ComputeNextT(const CRayp &ray, double t);
+    virtual bool SurfaceTest(const CGrVector &/*intersect*/) {return true;}
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+    virtual bool SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const;
+
+    virtual void IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+    const CGrVector &GetCenter() const {return m_center;}
+    double GetRadius() const {return m_radius;}
+
+private:
+    CGrVector  m_center;
+    double     m_radius;
+};
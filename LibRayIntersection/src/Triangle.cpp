@@ -1,4 +1,4 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include "Triangle.h"
 #include <cassert>
 
@@ -26,12 +26,10 @@ double CTriangle::ComputeT(const CRayp &ray)
     double bottom = Dot3(m_normal, ray.Direction());
     if(bottom >= -TINY && bottom <= TINY)
     {
-        SetT(-1);
         return -1;
     }
 
     double t = -(Dot3(m_normal, ray.Origin()) + m_d) / bottom;
-    SetT(t);
 
     return t;
 }
@@ -163,3 +161,34 @@ void CTriangle::IntersectInfo(const CGrVector &intersect,
     
     p_texcoord = m_tvertices[0] * b[0] + m_tvertices[1] * b[1] + m_tvertices[2] * b[2];
 }
+
+
+void CTriangle::TexCoordGradient(const CGrVector &/*intersect*/, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    p_normal = m_normal;
+    if(m_numTVertices < 3)
+    {
+        p_dsdp = CGrVector(0, 0, 0, 0);
+        p_dtdp = CGrVector(0, 0, 0, 0);
+        return;
+    }
+
+    TriangleGradient(m_vertices[0], m_vertices[1], m_vertices[2], 
+        m_tvertices[0], m_tvertices[1], m_tvertices[2], p_dsdp, p_dtdp);
+}
+
+
+bool CTriangle::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    p_closest = ClosestOnTriangle(m_vertices[0], m_vertices[1], m_vertices[2], p);
+    return true;
+}
+
+
+bool CTriangle::SweepSphere(const CRayp &ray, double p_radius, double p_maxt,
+                   double &p_t, CGrVector &p_contact) const
+{
+    return SweepTriangle(m_vertices[0], m_vertices[1], m_vertices[2], ray, p_radius, p_maxt,
+        p_t, p_contact);
+}
@@ -0,0 +1,56 @@
+#include "stdafx.h"
+#include "UserPrimitive.h"
+
+const double TINY = 1e-10;          // A small value to avoid roundoff errors
+
+CUserPrimitive::CUserPrimitive(CRayIntersection::Primitive *p_primitive)
+{
+    m_primitive = p_primitive;
+
+    CGrVector min, max;
+    p_primitive->Bounds(min, max);
+
+    CBoundingBox box(min);
+    box.Include(max);
+    SetBoundingBox(box);
+}
+
+CUserPrimitive::~CUserPrimitive(void)
+{
+}
+
+
+//
+// Name :         CUserPrimitive::ComputeT()
+// Description :  The primitive tests the ray itself, with its time and
+//                mask.  Hits at the ray origin are misses, as they are
+//                for the other objects.
+//
+
+double CUserPrimitive::ComputeT(const CRayp &ray)
+{
+    CRay r(ray.Origin(), ray.Direction(), ray.Time());
+    r.SetMask(ray.Mask());
+    double t = m_primitive->Intersect(r);
+    return t > TINY ? t : -1;
+}
+
+
+bool CUserPrimitive::ClosestPoint(const CGrVector &p, CGrVector &p_closest) const
+{
+    return m_primitive->ClosestPoint(p, p_closest);
+}
+
+
+void CUserPrimitive::IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const
+{
+    m_primitive->IntersectInfo(intersect, p_normal, p_texcoord);
+}
+
+
+void CUserPrimitive::TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const
+{
+    m_primitive->TexCoordGradient(intersect, p_normal, p_dsdp, p_dtdp);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "IntersectionObject.h"
+
+//
+// class CUserPrimitive
+// Holds a CRayIntersection::Primitive supplied by the application and
+// passes the tests on to it.
+//
+
+class CUserPrimitive : public CIntersectionObject
+{
+public:
+    CUserPrimitive(CRayIntersection::Primitive *p_primitive);
+    virtual ~CUserPrimitive(void);
+
+    virtual CRayIntersection::ObjectType Type() const {return CRayIntersection::Other;}
+
+    // The primitive is not built from vertices
+    virtual void AddVertex(const CGrVector &/*v*/) {}
+    virtual void AddNormal(const CGrVector &/*n*/) {}
+    virtual void AddTexVertex(const CGrVector &/*t*/) {}
+
+    virtual double ComputeT(const CRayp &ray);
+    virtual bool SurfaceTest(const CGrVector &/*intersect*/) {return true;}
+    virtual bool ClosestPoint(const CGrVector &p, CGrVector &p_closest) const;
+
+    virtual void IntersectInfo(const CGrVector &intersect,  
+                   CGrVector &p_normal, CGrVector &p_texcoord) const;
+    virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &p_normal,
+                   CGrVector &p_dsdp, CGrVector &p_dtdp) const;
+
+    CRayIntersection::Primitive *GetPrimitive() const {return m_primitive;}
+
+private:
+    CRayIntersection::Primitive *m_primitive;
+};
@@ -0,0 +1,149 @@
+//
+// Name :         WorkStealingPool.cpp
+// Description :  Implementation of CWorkStealingPool, a pool of threads
+//                that runs numbered tasks with work stealing.
+//
+
+#include "stdafx.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+CWorkStealingPool::CWorkStealingPool(int p_threads)
+{
+    if(p_threads <= 0)
+        p_threads = int(thread::hardware_concurrency());
+    if(p_threads <= 0)
+        p_threads = 1;
+
+    m_task = NULL;
+    m_remaining = 0;
+    m_generation = 0;
+    m_exit = false;
+
+    for(int i=0;  i<p_threads;  i++)
+        m_queues.push_back(unique_ptr<Queue>(new Queue));
+
+    for(int i=1;  i<p_threads;  i++)
+        m_threads.push_back(thread(&CWorkStealingPool::Worker, this, i));
+}
+
+
+CWorkStealingPool::~CWorkStealingPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_exit = true;
+    }
+
+    m_start.notify_all();
+    for(vector<thread>::iterator t=m_threads.begin();  t!=m_threads.end();  t++)
+        t->join();
+}
+
+
+//
+// Name :         CWorkStealingPool::Run()
+// Description :  Deal the tasks out to the workers in contiguous blocks,
+//                start them, and work along with them until all are done.
+//
+
+void CWorkStealingPool::Run(int p_count, const Task &p_task)
+{
+    if(p_count <= 0)
+        return;
+
+    // The task must be in place before any worker can find work
+    m_task = &p_task;
+    m_remaining = p_count;
+
+    int workers = ThreadCnt();
+    for(int w=0;  w<workers;  w++)
+    {
+        Queue &queue = *m_queues[w];
+        lock_guard<mutex> lock(queue.m_mutex);
+        for(int t = p_count * w / workers;  t < p_count * (w + 1) / workers;  t++)
+            queue.m_tasks.push_back(t);
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_generation++;
+    }
+
+    m_start.notify_all();
+
+    Work(0);
+
+    unique_lock<mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() {return m_remaining.load() == 0;});
+}
+
+
+void CWorkStealingPool::Worker(int p_worker)
+{
+    int generation = 0;
+    while(true)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_start.wait(lock, [&]() {return m_exit || m_generation != generation;});
+            if(m_exit)
+                return;
+
+            generation = m_generation;
+        }
+
+        Work(p_worker);
+    }
+}
+
+
+void CWorkStealingPool::Work(int p_worker)
+{
+    int task;
+    while(Next(p_worker, task))
+    {
+        (*m_task)(task, p_worker);
+
+        if(m_remaining.fetch_sub(1) == 1)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_done.notify_all();
+        }
+    }
+}
+
+
+//
+// Name :         CWorkStealingPool::Next()
+// Description :  Get the next task for a worker, first from the front
+//                of its own queue, then from the back of the others.
+//
+
+bool CWorkStealingPool::Next(int p_worker, int &p_task)
+{
+    int workers = ThreadCnt();
+    for(int i=0;  i<workers;  i++)
+    {
+        Queue &queue = *m_queues[(p_worker + i) % workers];
+        lock_guard<mutex> lock(queue.m_mutex);
+        if(queue.m_tasks.empty())
+            continue;
+
+        if(i == 0)
+        {
+            p_task = queue.m_tasks.front();
+            queue.m_tasks.pop_front();
+        }
+        else
+        {
+            p_task = queue.m_tasks.back();
+            queue.m_tasks.pop_back();
+        }
+
+        return true;
+    }
+
+    return false;
+}
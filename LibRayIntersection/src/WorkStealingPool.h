@@ -0,0 +1,66 @@
+//
+// Name :         WorkStealingPool.h
+// Description :  Header file for CWorkStealingPool, a pool of threads that
+//                runs numbered tasks.  Each worker starts with a contiguous
+//                block of the tasks and takes from the front of its own
+//                queue.  A worker that runs out steals from the back of
+//                another worker's queue, so uneven tasks still keep every
+//                thread busy.
+//                See WorkStealingPool.cpp
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CWorkStealingPool
+{
+public:
+    // A task is called with its number and the worker running it.
+    // Workers are numbered from 0 to ThreadCnt() - 1.
+    typedef std::function<void(int p_task, int p_worker)> Task;
+
+    // p_threads is the number of threads including the caller of Run(),
+    // 0 for one per hardware thread.
+    CWorkStealingPool(int p_threads=0);
+    ~CWorkStealingPool();
+
+    int ThreadCnt() const {return int(m_queues.size());}
+
+    // Run tasks 0 to p_count - 1 and return when they are all done.
+    // The calling thread is worker 0.  Run() is not reentrant.
+    void Run(int p_count, const Task &p_task);
+
+private:
+    CWorkStealingPool(const CWorkStealingPool &);
+    CWorkStealingPool &operator=(const CWorkStealingPool &);
+
+    struct Queue
+    {
+        std::mutex      m_mutex;
+        std::deque<int> m_tasks;
+    };
+
+    void Worker(int p_worker);
+    void Work(int p_worker);
+    bool Next(int p_worker, int &p_task);
+
+    std::vector<std::unique_ptr<Queue> > m_queues;     // One per worker
+    std::vector<std::thread> m_threads;                 // Workers 1 and up
+
+    const Task         *m_task;         // What we are running
+    std::atomic<int>    m_remaining;    // Tasks not yet finished
+
+    std::mutex          m_mutex;
+    std::condition_variable m_start;    // Signals a new Run() or exit
+    std::condition_variable m_done;     // Signals the last task finished
+    int                 m_generation;   // Counts calls to Run()
+    bool                m_exit;
+};
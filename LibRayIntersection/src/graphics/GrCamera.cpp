@@ -166,6 +166,38 @@ void CGrCamera::Apply(int width, int height, bool noidentity)
 }
 
 
+//
+// Name :         CGrCamera::PrimaryRay()
+// Description :  The ray from the eye through a point on the image plane.
+//                The direction is d / |d| for d = forward + x right + y up,
+//                so its change per pixel is (dd |d|^2 - d (d . dd)) / |d|^3.
+//
+
+void CGrCamera::PrimaryRay(double x, double y, int width, int height, CRay &ray, CRayDifferential &differential) const
+{
+    CGrVector eye(m_eye[0], m_eye[1], m_eye[2]);
+    CGrVector forward = Normalize3(CGrVector(m_center[0], m_center[1], m_center[2]) - eye);
+    CGrVector right = Normalize3(Cross(forward, CGrVector(m_up[0], m_up[1], m_up[2], 0)));
+    CGrVector up = Cross(right, forward);
+
+    double halfY = tan(m_fieldofview * 0.5 * GR_DTOR);
+    double halfX = halfY * width / height;
+
+    CGrVector d = forward + right * ((x / width * 2 - 1) * halfX) + up * ((y / height * 2 - 1) * halfY);
+    CGrVector ddx = right * (2 * halfX / width);
+    CGrVector ddy = up * (2 * halfY / height);
+
+    double dd = Dot3(d, d);
+    double len = sqrt(dd);
+    ray = CRay(eye, d / len);
+
+    CGrVector zero(0, 0, 0, 0);
+    differential = CRayDifferential(zero, zero, 
+        (ddx * dd - d * Dot3(d, ddx)) / (dd * len),
+        (ddy * dd - d * Dot3(d, ddy)) / (dd * len));
+}
+
+
 void CGrCamera::Set(double p_eyex, double p_eyey, double p_eyez, double p_centerx, double p_centery, double p_centerz, double p_upx, double p_upy, double p_upz)
 {
     m_eye[0] = p_eyex;              m_eye[1] = p_eyey;              m_eye[2] = p_eyez;      m_eye[3] = 1;
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <GL/glu.h>
+#include "RayIntersection.h"
 
 //! Class that defines a simple camera model we can use with the mouse.
 /*! The CGrCamera class can be used in application to allow the mouse to
@@ -16,6 +17,7 @@ common camera operations.
 \version 02-02-2008 1.02 Changes to allow multiple mouse options.
 \version 01-29-2011 1.03 More flexible system for multiple mouse support
 \version 01-30-2012 1.04 Added documentation. A few new functions.
+\version 10-18-2026 1.05 PrimaryRay() with ray differentials for ray tracing.
 
 The documentation on this class is under development and is not yet complete */
 class CGrCamera  
@@ -346,6 +348,18 @@ void CGrCamera::Apply(int width, int height, bool noidentity)
     */
     void Apply(int width, int height, bool noidentity=false);
 
+    //! The ray through a pixel for ray tracing
+    /*! The ray matches the view that Apply() sets for OpenGL. The differentials
+        are the change in the ray per pixel, which gives the footprint of the 
+        pixel on what the ray hits for texture filtering.
+        \param x Pixel x, 0 at the left edge. Use x + 0.5 for the pixel center.
+        \param y Pixel y, 0 at the bottom edge. Use y + 0.5 for the pixel center.
+        \param width The image width
+        \param height The image height
+        \param ray [out] The ray, with a unit direction
+        \param differential [out] The ray differentials */
+    void PrimaryRay(double x, double y, int width, int height, CRay &ray, CRayDifferential &differential) const;
+
 private:
 	void DollyHelper(double m[4][4], double x, double y, double z);
 	void ComputeFrame();
@@ -0,0 +1,443 @@
+//
+// Name :         GrCompiledMesh.cpp
+// Description :  Implementation of CGrCompiledMesh, a scene graph flattened
+//                into world space vertex and index buffers.
+//
+
+#include "stdafx.h"
+#include "GrCompiledMesh.h"
+#include "GrRenderer.h"
+#include "GrTexture.h"
+#include "RayIntersection.h"
+
+#include <map>
+
+using namespace std;
+
+//
+// class CGrCompiledMesh::CCompiler
+// The renderer Compile() walks the graph with.  It keeps the current
+// matrix the way CGrRayLoader does and files each finished polygon
+// under its material and texture.
+//
+
+class CGrCompiledMesh::CCompiler : public CGrRenderer
+{
+public:
+    CCompiler();
+
+    virtual void RendererEndPolygon();
+    virtual void RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt);
+    virtual void RendererPushMatrix();
+    virtual void RendererPopMatrix();
+    virtual void RendererRotate(double a, double x, double y, double z);
+    virtual void RendererTranslate(double x, double y, double z);
+    virtual void RendererTransform(const CGrTransform *p_transform);
+    virtual void RendererMaterial(CGrMaterial *p_material) {m_material = p_material;}
+
+    // The polygons of one material and texture, in the order they came
+    struct Group
+    {
+        CGrMaterial    *m_material;
+        CGrTexture     *m_texture;
+        vector<Vertex>  m_vertices;
+        vector<int>     m_counts;
+    };
+
+    vector<Group>       m_groups;
+
+private:
+    void Compose(const CGrTransform &p_transform);
+
+    CGrTransform        m_matrix;
+    CGrTransform        m_normalMatrix;
+    vector<CGrTransform> m_stack;
+
+    CGrMaterial        *m_material;
+    map<pair<CGrMaterial *, CGrTexture *>, int> m_groupIndex;
+};
+
+
+CGrCompiledMesh::CCompiler::CCompiler()
+{
+    m_matrix.SetIdentity();
+    m_normalMatrix.SetIdentity();
+    m_material = NULL;
+}
+
+
+void CGrCompiledMesh::CCompiler::RendererEndPolygon()
+{
+    CGrPolygonSpan polygon;
+    PolySpan(polygon);
+    RendererPolygons(&polygon, 1);
+}
+
+
+//
+// Name :         CGrCompiledMesh::CCompiler::RendererPolygons()
+// Description :  Transform the polygons to world coordinates and give
+//                every vertex a normal and a texture coordinate.  A
+//                polygon with no normals gets its face normal, and
+//                missing ones repeat the last one given.
+//
+
+void CGrCompiledMesh::CCompiler::RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt)
+{
+    for(int p=0;  p<p_cnt;  p++)
+    {
+        const CGrPolygonSpan &polygon = p_polygons[p];
+        if(polygon.m_vertexCnt < 3)
+            continue;
+
+        pair<CGrMaterial *, CGrTexture *> key(m_material, polygon.m_texture);
+        map<pair<CGrMaterial *, CGrTexture *>, int>::iterator found = m_groupIndex.find(key);
+        if(found == m_groupIndex.end())
+        {
+            found = m_groupIndex.insert(make_pair(key, int(m_groups.size()))).first;
+            m_groups.push_back(Group());
+            m_groups.back().m_material = key.first;
+            m_groups.back().m_texture = key.second;
+        }
+
+        Group &group = m_groups[found->second];
+        group.m_counts.push_back(polygon.m_vertexCnt);
+
+        const CGrPoint *v = polygon.m_vertices;
+        CGrPoint normal;
+        if(polygon.m_normalCnt == 0)
+        {
+            normal = m_normalMatrix * Cross3(v[1] - v[0], v[2] - v[0]);
+            normal.Normalize3();
+        }
+
+        CGrPoint tvertex(0, 0, 0);
+        for(int i=0;  i<polygon.m_vertexCnt;  i++)
+        {
+            if(i < polygon.m_normalCnt)
+            {
+                const CGrPoint &n = polygon.m_normals[i];
+                normal = m_normalMatrix * CGrPoint(n.X(), n.Y(), n.Z(), 0);
+                normal.Normalize3();
+            }
+
+            if(i < polygon.m_tvertexCnt)
+                tvertex = polygon.m_tvertices[i];
+
+            CGrPoint w = m_matrix * v[i];
+            w /= w.W();
+
+            Vertex vertex;
+            for(int c=0;  c<3;  c++)
+            {
+                vertex.m_position[c] = w[c];
+                vertex.m_normal[c] = normal[c];
+            }
+
+            vertex.m_texcoord[0] = tvertex.X();
+            vertex.m_texcoord[1] = tvertex.Y();
+            group.m_vertices.push_back(vertex);
+        }
+    }
+}
+
+
+//
+// The transformation stack
+//
+
+void CGrCompiledMesh::CCompiler::RendererPushMatrix()
+{
+    m_stack.push_back(m_matrix);
+}
+
+void CGrCompiledMesh::CCompiler::RendererPopMatrix()
+{
+    if(m_stack.empty())
+        return;
+
+    m_matrix = m_stack.back();
+    m_stack.pop_back();
+
+    m_normalMatrix.SetAffineInverse(m_matrix);
+    m_normalMatrix.Transpose();
+}
+
+void CGrCompiledMesh::CCompiler::RendererRotate(double a, double x, double y, double z)
+{
+    CGrTransform r;
+    r.SetRotate(a, CGrPoint(x, y, z));
+    Compose(r);
+}
+
+void CGrCompiledMesh::CCompiler::RendererTranslate(double x, double y, double z)
+{
+    CGrTransform t;
+    t.SetTranslate(x, y, z);
+    Compose(t);
+}
+
+void CGrCompiledMesh::CCompiler::RendererTransform(const CGrTransform *p_transform)
+{
+    Compose(*p_transform);
+}
+
+void CGrCompiledMesh::CCompiler::Compose(const CGrTransform &p_transform)
+{
+    m_matrix *= p_transform;
+
+    m_normalMatrix.SetAffineInverse(m_matrix);
+    m_normalMatrix.Transpose();
+}
+
+
+
+CGrCompiledMesh::CGrCompiledMesh()
+{
+}
+
+CGrCompiledMesh::CGrCompiledMesh(CGrObject *p_root)
+{
+    Compile(p_root);
+}
+
+CGrCompiledMesh::~CGrCompiledMesh()
+{
+}
+
+
+void CGrCompiledMesh::Clear()
+{
+    m_vertices.clear();
+    m_indices.clear();
+    m_polygons.clear();
+    m_batches.clear();
+    m_materials.clear();
+    m_textures.clear();
+}
+
+
+//
+// Name :         CGrCompiledMesh::Compile()
+// Description :  Render the graph into a compiler once, then lay the
+//                groups out one after the other.  The batches are in
+//                the order their material and texture first appear,
+//                so polygons drawn before any material come first.
+//
+
+void CGrCompiledMesh::Compile(CGrObject *p_root)
+{
+    Clear();
+    if(p_root == NULL)
+        return;
+
+    // Not through CGrRenderer::Render(), which needs a reference to
+    // the root the caller may not have taken
+    CCompiler compiler;
+    compiler.RendererStart();
+    p_root->Render(&compiler);
+    compiler.RendererEnd();
+
+    size_t vertexCnt = 0;
+    size_t polygonCnt = 0;
+    for(vector<CCompiler::Group>::iterator g=compiler.m_groups.begin();  g!=compiler.m_groups.end();  g++)
+    {
+        vertexCnt += g->m_vertices.size();
+        polygonCnt += g->m_counts.size();
+    }
+
+    m_vertices.reserve(vertexCnt);
+    m_polygons.reserve(polygonCnt);
+    m_indices.reserve((vertexCnt - 2 * polygonCnt) * 3);
+
+    // The batches point to copies of the materials with no children
+    map<CGrMaterial *, CGrMaterial *> materials;
+    materials[NULL] = NULL;
+
+    for(vector<CCompiler::Group>::iterator g=compiler.m_groups.begin();  g!=compiler.m_groups.end();  g++)
+    {
+        map<CGrMaterial *, CGrMaterial *>::iterator material = materials.find(g->m_material);
+        if(material == materials.end())
+        {
+            CGrPtr<CGrMaterial> copy = new CGrMaterial;
+            copy->AmbientDiffuseSpecularShininess(g->m_material->Ambient(), g->m_material->Diffuse(),
+                g->m_material->Specular(), g->m_material->Shininess());
+            copy->Emissive(g->m_material->Emission());
+            copy->SpecularOther(g->m_material->SpecularOther(0), g->m_material->SpecularOther(1),
+                g->m_material->SpecularOther(2), g->m_material->SpecularOther(3));
+
+            m_materials.push_back(copy);
+            material = materials.insert(make_pair(g->m_material, (CGrMaterial *)copy)).first;
+        }
+
+        if(g->m_texture != NULL)
+            m_textures.push_back(g->m_texture);
+
+        Batch batch;
+        batch.m_material = material->second;
+        batch.m_texture = g->m_texture;
+        batch.m_firstPolygon = int(m_polygons.size());
+        batch.m_polygonCnt = int(g->m_counts.size());
+        batch.m_firstIndex = int(m_indices.size());
+
+        int first = int(m_vertices.size());
+        m_vertices.insert(m_vertices.end(), g->m_vertices.begin(), g->m_vertices.end());
+
+        for(vector<int>::iterator c=g->m_counts.begin();  c!=g->m_counts.end();  c++)
+        {
+            Polygon polygon;
+            polygon.m_first = first;
+            polygon.m_count = *c;
+            m_polygons.push_back(polygon);
+
+            // The polygons are convex, so a fan of triangles covers them
+            for(int i=1;  i+1<*c;  i++)
+            {
+                m_indices.push_back(unsigned(first));
+                m_indices.push_back(unsigned(first + i));
+                m_indices.push_back(unsigned(first + i + 1));
+            }
+
+            first += *c;
+        }
+
+        batch.m_indexCnt = int(m_indices.size()) - batch.m_firstIndex;
+        m_batches.push_back(batch);
+    }
+}
+
+
+//
+// Name :         CGrCompiledMesh::glRender()
+// Description :  The arrays are the vertex arrays, so each batch is
+//                one draw call.
+//
+
+void CGrCompiledMesh::glRender()
+{
+    if(m_vertices.empty())
+        return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_DOUBLE, sizeof(Vertex), m_vertices[0].m_position);
+    glNormalPointer(GL_DOUBLE, sizeof(Vertex), m_vertices[0].m_normal);
+    glTexCoordPointer(2, GL_DOUBLE, sizeof(Vertex), m_vertices[0].m_texcoord);
+
+    for(vector<Batch>::iterator b=m_batches.begin();  b!=m_batches.end();  b++)
+    {
+        if(b->m_material != NULL)
+            b->m_material->glMaterial();
+
+        if(b->m_texture != NULL)
+        {
+            glEnable(GL_TEXTURE_2D);
+            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+            glBindTexture(GL_TEXTURE_2D, b->m_texture->TexName());
+        }
+
+        glDrawElements(GL_TRIANGLES, b->m_indexCnt, GL_UNSIGNED_INT, &m_indices[b->m_firstIndex]);
+
+        if(b->m_texture != NULL)
+            glDisable(GL_TEXTURE_2D);
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+
+//
+// Name :         CGrCompiledMesh::Render()
+// Description :  Hand the polygons to a renderer as spans, with the
+//                material set once and one RendererPolygons() call
+//                for each batch.
+//
+
+void CGrCompiledMesh::Render(CGrRenderer *p_renderer)
+{
+    vector<CGrPoint> vertices;
+    vector<CGrPoint> normals;
+    vector<CGrPoint> tvertices;
+    vector<CGrPolygonSpan> spans;
+
+    for(vector<Batch>::iterator b=m_batches.begin();  b!=m_batches.end();  b++)
+    {
+        if(b->m_material != NULL)
+            p_renderer->RendererMaterial(b->m_material);
+
+        // The vertices of a batch are consecutive
+        int first = m_polygons[b->m_firstPolygon].m_first;
+        const Polygon &last = m_polygons[b->m_firstPolygon + b->m_polygonCnt - 1];
+        int cnt = last.m_first + last.m_count - first;
+
+        vertices.resize(cnt);
+        normals.resize(cnt);
+        tvertices.resize(cnt);
+        for(int i=0;  i<cnt;  i++)
+        {
+            const Vertex &v = m_vertices[first + i];
+            vertices[i].Set(v.m_position[0], v.m_position[1], v.m_position[2]);
+            normals[i].Set(v.m_normal[0], v.m_normal[1], v.m_normal[2], 0);
+            tvertices[i].Set(v.m_texcoord[0], v.m_texcoord[1], 0);
+        }
+
+        spans.resize(b->m_polygonCnt);
+        for(int p=0;  p<b->m_polygonCnt;  p++)
+        {
+            const Polygon &polygon = m_polygons[b->m_firstPolygon + p];
+            CGrPolygonSpan &span = spans[p];
+            span.m_texture = b->m_texture;
+            span.m_vertexCnt = span.m_normalCnt = span.m_tvertexCnt = polygon.m_count;
+            span.m_vertices = &vertices[polygon.m_first - first];
+            span.m_normals = &normals[polygon.m_first - first];
+            span.m_tvertices = &tvertices[polygon.m_first - first];
+        }
+
+        p_renderer->RendererPolygons(&spans[0], b->m_polygonCnt);
+    }
+}
+
+
+//
+// Name :         CGrCompiledMesh::Load()
+// Description :  The vertices are in world coordinates already, so
+//                they go straight to the intersection system.
+//                Triangles take its triangle path.
+//
+
+void CGrCompiledMesh::Load(CRayIntersection &p_intersection) const
+{
+    for(vector<Batch>::const_iterator b=m_batches.begin();  b!=m_batches.end();  b++)
+    {
+        p_intersection.Material(b->m_material);
+        p_intersection.Texture(b->m_texture);
+
+        for(int p=b->m_firstPolygon;  p<b->m_firstPolygon + b->m_polygonCnt;  p++)
+        {
+            int cnt = m_polygons[p].m_count;
+            if(cnt == 3)
+                p_intersection.TriangleBegin();
+            else
+                p_intersection.PolygonBegin();
+
+            const Vertex *v = &m_vertices[m_polygons[p].m_first];
+            for(int i=0;  i<cnt;  i++, v++)
+            {
+                p_intersection.Normal(CGrVector(v->m_normal[0], v->m_normal[1], v->m_normal[2], 0));
+                p_intersection.TexVertex(CGrVector(v->m_texcoord[0], v->m_texcoord[1], 0));
+                p_intersection.Vertex(CGrVector(v->m_position[0], v->m_position[1], v->m_position[2]));
+            }
+
+            if(cnt == 3)
+                p_intersection.TriangleEnd();
+            else
+                p_intersection.PolygonEnd();
+        }
+    }
+
+    p_intersection.Material(NULL);
+    p_intersection.Texture(NULL);
+}
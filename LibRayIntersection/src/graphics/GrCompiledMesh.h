@@ -0,0 +1,107 @@
+//
+// Name :         GrCompiledMesh.h
+// Description :  Header file for CGrCompiledMesh, a scene graph flattened
+//                into world space vertex and index buffers.
+//                See GrCompiledMesh.cpp
+//
+
+#ifndef _GRCOMPILEDMESH_H
+#define _GRCOMPILEDMESH_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <vector>
+#include "GrObject.h"
+
+class CGrTexture;
+class CRayIntersection;
+
+//
+// class CGrCompiledMesh
+// Compile() walks a scene graph once.  Every polygon is transformed by
+// the matrices above it and its vertices are copied into one array,
+// with a normal and a texture coordinate for every vertex.  Polygons
+// are sorted by the material and texture they are drawn with, so each
+// combination is one batch of consecutive vertices and triangle
+// indices.
+//
+// The result is a CGrObject in the coordinates of the graph root.
+// glRender() draws a batch with one glDrawElements() call.  Render()
+// hands the polygons to any CGrRenderer, and Load() hands them to a
+// CRayIntersection, with no transformation or material nodes to walk.
+//
+// The mesh keeps copies of the materials and references to the
+// textures, so the graph can be released after compiling.  Spheres,
+// boxes, and cylinders are compiled as their polygons.  Colors are
+// not compiled.
+//
+
+class CGrCompiledMesh : public CGrObject
+{
+public:
+    CGrCompiledMesh();
+    CGrCompiledMesh(CGrObject *p_root);
+    virtual ~CGrCompiledMesh();
+
+    // Replace what the mesh holds with a compiled copy of p_root
+    void Compile(CGrObject *p_root);
+    void Clear();
+
+    virtual void glRender();
+    virtual void Render(CGrRenderer *p_renderer);
+
+    // Load the polygons into an intersection system between its
+    // Initialize() and LoadingComplete() calls
+    void Load(CRayIntersection &p_intersection) const;
+
+    // A vertex with everything it needs
+    struct Vertex
+    {
+        double  m_position[3];
+        double  m_normal[3];
+        double  m_texcoord[2];
+    };
+
+    // One polygon, as a range of the vertex array
+    struct Polygon
+    {
+        int     m_first;
+        int     m_count;
+    };
+
+    // Polygons with the same material and texture.  Their vertices,
+    // polygons, and triangle indices are consecutive.
+    struct Batch
+    {
+        CGrMaterial *m_material;
+        CGrTexture  *m_texture;
+        int     m_firstPolygon;
+        int     m_polygonCnt;
+        int     m_firstIndex;
+        int     m_indexCnt;
+    };
+
+    int VertexCnt() const {return int(m_vertices.size());}
+    const Vertex *Vertices() const {return m_vertices.empty() ? NULL : &m_vertices[0];}
+    int IndexCnt() const {return int(m_indices.size());}
+    const unsigned *Indices() const {return m_indices.empty() ? NULL : &m_indices[0];}
+    int PolygonCnt() const {return int(m_polygons.size());}
+    const Polygon &GetPolygon(int i) const {return m_polygons[i];}
+    int BatchCnt() const {return int(m_batches.size());}
+    const Batch &GetBatch(int i) const {return m_batches[i];}
+
+private:
+    class CCompiler;
+
+    std::vector<Vertex>     m_vertices;
+    std::vector<unsigned>   m_indices;      // Triangle fans of the polygons
+    std::vector<Polygon>    m_polygons;
+    std::vector<Batch>      m_batches;
+
+    std::vector<CGrPtr<CGrMaterial> > m_materials;
+    std::vector<CGrPtr<CGrTexture> >  m_textures;
+};
+
+#endif
@@ -0,0 +1,284 @@
+//
+// Name :         GrImageFile.cpp
+// Description :  Implementation of CGrImageFile, an uncompressed PPM or
+//                BMP file decoded straight from a memory mapping.
+//
+
+#include "stdafx.h"
+#include "GrImageFile.h"
+
+#include <cctype>
+#include <climits>
+#include <cstring>
+
+// BMP pixels are blue, green, red.  On x86 the swap to red, green,
+// blue is a byte shuffle of 16 bytes at a time, if the processor has
+// SSSE3.  We ask it at run time, so the library runs anywhere.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define GRIMAGE_SHUFFLE
+#define SSSE3_TARGET
+
+static bool HasShuffle()
+{
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+}
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define GRIMAGE_SHUFFLE
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+
+static bool HasShuffle()
+{
+    return __builtin_cpu_supports("ssse3") != 0;
+}
+#endif
+
+#ifdef GRIMAGE_SHUFFLE
+
+static const bool s_shuffle = HasShuffle();
+
+//
+// Name :         ShuffleBGR(), ShuffleBGRA()
+// Description :  Swap pixels to RGB while at least 16 bytes can be read
+//                and written, and return how many were done.  Each
+//                store writes a few bytes past the pixels it finishes,
+//                which the next store or the caller overwrites.
+//
+
+SSSE3_TARGET static int ShuffleBGR(const BYTE *p_src, BYTE *p_dst, int p_count)
+{
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+
+    // Five pixels in each 16 bytes
+    int c = 0;
+    for( ;  c + 6 <= p_count;  c += 5)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(p_src + c * 3));
+        _mm_storeu_si128((__m128i *)(p_dst + c * 3), _mm_shuffle_epi8(pixels, order));
+    }
+
+    return c;
+}
+
+SSSE3_TARGET static int ShuffleBGRA(const BYTE *p_src, BYTE *p_dst, int p_count)
+{
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    // Four pixels in, twelve bytes out
+    int c = 0;
+    for( ;  c + 6 <= p_count;  c += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(p_src + c * 4));
+        _mm_storeu_si128((__m128i *)(p_dst + c * 3), _mm_shuffle_epi8(pixels, order));
+    }
+
+    return c;
+}
+
+#endif
+
+static unsigned LittleEndian(const BYTE *p, int p_bytes)
+{
+    unsigned value = 0;
+    for(int i=p_bytes-1;  i>=0;  i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+
+CGrImageFile::CGrImageFile()
+{
+    m_width = 0;
+    m_height = 0;
+    m_bottom = NULL;
+    m_pitch = 0;
+    m_bytes = 0;
+    m_bgr = false;
+    m_palette = NULL;
+}
+
+
+bool CGrImageFile::Open(const _TCHAR *p_filename)
+{
+    Close();
+    if(!m_file.Open(p_filename) || m_file.Size() < 2)
+        return false;
+
+    const BYTE *data = m_file.Data();
+    bool ok = false;
+    if(data[0] == 'P' && data[1] == '6')
+        ok = OpenPPM();
+    else if(data[0] == 'B' && data[1] == 'M')
+        ok = OpenBMP();
+
+    if(!ok)
+        Close();
+
+    return ok;
+}
+
+
+//
+// Name :         CGrImageFile::OpenPPM()
+// Description :  The header is P6, the width, height, and largest
+//                value, with comments anywhere, then one white space
+//                character.  The rows are stored top row first.
+//
+
+bool CGrImageFile::OpenPPM()
+{
+    const BYTE *data = m_file.Data();
+    size_t size = m_file.Size();
+    size_t pos = 2;
+
+    long long values[3];
+    for(int i=0;  i<3;  i++)
+    {
+        while(pos < size && (isspace(data[pos]) || data[pos] == '#'))
+        {
+            if(data[pos] == '#')
+            {
+                while(pos < size && data[pos] != '\n')
+                    pos++;
+            }
+            else
+                pos++;
+        }
+
+        if(pos >= size || !isdigit(data[pos]))
+            return false;
+
+        values[i] = 0;
+        while(pos < size && isdigit(data[pos]) && values[i] <= INT_MAX)
+            values[i] = values[i] * 10 + (data[pos++] - '0');
+
+        // A number too long to be a size
+        if(values[i] > INT_MAX)
+            return false;
+    }
+
+    // The white space after the largest value
+    pos++;
+
+    // Compare the pixel bytes to what is left by dividing, since the
+    // product of the sizes can overflow
+    long long width = values[0];
+    long long height = values[1];
+    if(width <= 0 || height <= 0 || values[2] <= 0 || values[2] > 255 ||
+        pos > size || (unsigned long long)(width * 3) > (size - pos) / (unsigned long long)height)
+        return false;
+
+    m_width = int(width);
+    m_height = int(height);
+    m_pitch = -ptrdiff_t(width * 3);
+    m_bottom = data + pos + (height - 1) * width * 3;
+    m_bytes = 3;
+    m_bgr = false;
+    m_palette = NULL;
+    return true;
+}
+
+
+//
+// Name :         CGrImageFile::OpenBMP()
+// Description :  Rows are padded to 4 bytes and stored bottom row
+//                first unless the height is negative.
+//
+
+bool CGrImageFile::OpenBMP()
+{
+    const BYTE *data = m_file.Data();
+    size_t size = m_file.Size();
+    if(size < 54)
+        return false;
+
+    size_t offBits = LittleEndian(data + 10, 4);
+    size_t infoSize = LittleEndian(data + 14, 4);
+    int width = int(LittleEndian(data + 18, 4));
+    int height = int(LittleEndian(data + 22, 4));
+    int bitCount = int(LittleEndian(data + 28, 2));
+    unsigned compression = LittleEndian(data + 30, 4);
+
+    if(compression != 0 || width <= 0 || height == 0 || height == INT_MIN ||
+        (bitCount != 8 && bitCount != 24 && bitCount != 32))
+        return false;
+
+    bool topDown = height < 0;
+    if(topDown)
+        height = -height;
+
+    size_t pitch = (size_t(width) * (bitCount / 8) + 3) & ~size_t(3);
+    if(offBits > size || pitch > (size - offBits) / height)
+        return false;
+
+    m_palette = NULL;
+    if(bitCount == 8)
+    {
+        if(infoSize > size || 14 + 256 * 4 > size - infoSize)
+            return false;
+        m_palette = data + 14 + infoSize;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_pitch = topDown ? -ptrdiff_t(pitch) : ptrdiff_t(pitch);
+    m_bottom = data + offBits + (topDown ? (height - 1) * pitch : 0);
+    m_bytes = bitCount / 8;
+    m_bgr = true;
+    return true;
+}
+
+
+void CGrImageFile::ReadRGB(int r, int c, int p_count, BYTE *p_rgb) const
+{
+    const BYTE *src = m_bottom + r * m_pitch + c * m_bytes;
+    if(!m_bgr)
+    {
+        memcpy(p_rgb, src, p_count * 3);
+        return;
+    }
+
+    int done = 0;
+#ifdef GRIMAGE_SHUFFLE
+    if(s_shuffle && m_palette == NULL)
+        done = m_bytes == 3 ? ShuffleBGR(src, p_rgb, p_count) : ShuffleBGRA(src, p_rgb, p_count);
+#endif
+
+    src += done * m_bytes;
+    p_rgb += done * 3;
+    for(int i=done;  i<p_count;  i++, src += m_bytes, p_rgb += 3)
+    {
+        // RGBQUAD is blue, green, red as well
+        const BYTE *color = m_palette != NULL ? m_palette + src[0] * 4 : src;
+        p_rgb[0] = color[2];
+        p_rgb[1] = color[1];
+        p_rgb[2] = color[0];
+    }
+}
+
+
+void CGrImageFile::ReadRGBA(int r, int c, int p_count, BYTE *p_rgba) const
+{
+    const BYTE *src = m_bottom + r * m_pitch + c * m_bytes;
+    for(int i=0;  i<p_count;  i++, src += m_bytes, p_rgba += 4)
+    {
+        if(!m_bgr)
+        {
+            p_rgba[0] = src[0];
+            p_rgba[1] = src[1];
+            p_rgba[2] = src[2];
+        }
+        else
+        {
+            const BYTE *color = m_palette != NULL ? m_palette + src[0] * 4 : src;
+            p_rgba[0] = color[2];
+            p_rgba[1] = color[1];
+            p_rgba[2] = color[0];
+        }
+
+        p_rgba[3] = 255;
+    }
+}
@@ -0,0 +1,63 @@
+//
+// Name :         GrImageFile.h
+// Description :  Header file for CGrImageFile, an uncompressed PPM or
+//                BMP file decoded straight from a memory mapping.
+//                See GrImageFile.cpp
+//
+
+#ifndef _GRIMAGEFILE_H
+#define _GRIMAGEFILE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "GrMappedFile.h"
+
+//
+// class CGrImageFile
+// Open() maps the file and reads the header.  The pixels are decoded
+// from the mapping only when a row is read, straight into the caller's
+// memory, with no intermediate buffer.  Reads only look at the mapping,
+// so several threads may read rows of one file at once.
+//
+// The formats are the ones CGrTexture reads: binary PPM with at most
+// 8 bits per channel, and uncompressed BMP with 8, 24, or 32 bits per
+// pixel.
+//
+
+class CGrImageFile
+{
+public:
+    CGrImageFile();
+
+    bool Open(const _TCHAR *p_filename);
+    void Close() {m_file.Close();  m_width = m_height = 0;}
+    bool IsOpen() const {return m_width > 0;}
+
+    int Width() const {return m_width;}
+    int Height() const {return m_height;}
+
+    // Decode p_count pixels of row r, row 0 at the bottom, starting
+    // at column c.  RGBA sets alpha to 255.
+    void ReadRGB(int r, int c, int p_count, BYTE *p_rgb) const;
+    void ReadRGBA(int r, int c, int p_count, BYTE *p_rgba) const;
+
+private:
+    CGrImageFile(const CGrImageFile &);
+    CGrImageFile &operator=(const CGrImageFile &);
+
+    bool OpenPPM();
+    bool OpenBMP();
+
+    CGrMappedFile   m_file;
+    int             m_width;
+    int             m_height;
+    const BYTE     *m_bottom;       // Start of the bottom row
+    ptrdiff_t       m_pitch;        // Bytes from a row to the one above it
+    int             m_bytes;        // Bytes per pixel
+    bool            m_bgr;
+    const BYTE     *m_palette;      // 8 bit BMP
+};
+
+#endif
@@ -0,0 +1,122 @@
+//
+// Name :         GrMappedFile.cpp
+// Description :  Implementation of CGrMappedFile, a read only memory
+//                mapping of a file.
+//
+
+#include "stdafx.h"
+#include "GrMappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CGrMappedFile::CGrMappedFile()
+{
+    m_data = NULL;
+    m_size = 0;
+
+#ifdef _WIN32
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+#endif
+}
+
+
+CGrMappedFile::~CGrMappedFile()
+{
+    Close();
+}
+
+
+//
+// Name :         CGrMappedFile::Open()
+// Description :  Map a file, closing any file we had mapped.  An
+//                empty file cannot be mapped.
+//
+
+bool CGrMappedFile::Open(const _TCHAR *p_filename)
+{
+    Close();
+
+#ifdef _WIN32
+    m_file = CreateFile(p_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if(m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(m_mapping == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    m_data = (const BYTE *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if(m_data == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    m_size = size_t(size.QuadPart);
+#else
+    int file = open(p_filename, O_RDONLY);
+    if(file < 0)
+        return false;
+
+    struct stat status;
+    if(fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        close(file);
+        return false;
+    }
+
+    // The mapping keeps the file open
+    void *data = mmap(NULL, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if(data == MAP_FAILED)
+        return false;
+
+    m_data = (const BYTE *)data;
+    m_size = size_t(status.st_size);
+#endif
+
+    return true;
+}
+
+
+void CGrMappedFile::Close()
+{
+#ifdef _WIN32
+    if(m_data != NULL)
+        UnmapViewOfFile(m_data);
+
+    if(m_mapping != NULL)
+        CloseHandle(m_mapping);
+
+    if(m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+#else
+    if(m_data != NULL)
+        munmap((void *)m_data, m_size);
+#endif
+
+    m_data = NULL;
+    m_size = 0;
+}
@@ -0,0 +1,51 @@
+//
+// Name :         GrMappedFile.h
+// Description :  Header file for CGrMappedFile, a read only memory
+//                mapping of a file.
+//                See GrMappedFile.cpp
+//
+
+#ifndef _GRMAPPEDFILE_H
+#define _GRMAPPEDFILE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <cstddef>
+
+//
+// class CGrMappedFile
+// Maps a whole file into memory for reading.  Pages are read from
+// disk when they are first touched and the system may drop them again
+// under memory pressure, so a large file costs address space rather
+// than memory.  The mapping may be read from any thread.
+//
+
+class CGrMappedFile
+{
+public:
+    CGrMappedFile();
+    ~CGrMappedFile();
+
+    bool Open(const _TCHAR *p_filename);
+    void Close();
+
+    bool IsOpen() const {return m_data != NULL;}
+    const BYTE *Data() const {return m_data;}
+    size_t Size() const {return m_size;}
+
+private:
+    CGrMappedFile(const CGrMappedFile &);
+    CGrMappedFile &operator=(const CGrMappedFile &);
+
+    const BYTE *m_data;
+    size_t      m_size;
+
+#ifdef _WIN32
+    void       *m_file;
+    void       *m_mapping;
+#endif
+};
+
+#endif
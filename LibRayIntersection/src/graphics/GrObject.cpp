@@ -8,6 +8,7 @@
 
 #include "GrRenderer.h"
 #include <GL/gl.h>
+#include <typeinfo>
 
 using namespace std;
 
@@ -72,10 +73,10 @@ void CGrPolygon::ComputeNormal()
     m_normals.clear();
 
     CGrPoint normal(0, 0, 0, 0);        // Zero the normal we are computing
-    std::list<CGrPoint>::iterator coord = m_vertices.begin();
+    std::vector<CGrPoint>::iterator coord = m_vertices.begin();
     for( ; coord != m_vertices.end();  coord++)
     {
-        std::list<CGrPoint>::iterator coordnext = coord; 
+        std::vector<CGrPoint>::iterator coordnext = coord; 
         coordnext++;
 
         if(coordnext == m_vertices.end())
@@ -146,11 +147,11 @@ void CGrPolygon::glRender()
         glBindTexture(GL_TEXTURE_2D, m_texture->TexName());
     }
 
-    list<CGrPoint>::iterator normals = m_normals.begin();
-    list<CGrPoint>::iterator tvertices = m_tvertices.begin();
+    vector<CGrPoint>::iterator normals = m_normals.begin();
+    vector<CGrPoint>::iterator tvertices = m_tvertices.begin();
 
     glBegin(GL_POLYGON);
-    for(list<CGrPoint>::iterator i=m_vertices.begin();  i!=m_vertices.end();  i++)
+    for(vector<CGrPoint>::iterator i=m_vertices.begin();  i!=m_vertices.end();  i++)
     {
         if(normals != m_normals.end())
         {
@@ -179,32 +180,21 @@ void CGrPolygon::glRender()
 
 void CGrPolygon::Render(CGrRenderer *p_renderer)
 {
-    p_renderer->RendererBeginPolygon();
-
-    if(m_texture)
-        p_renderer->RendererTexture(m_texture);
-
-    list<CGrPoint>::iterator normals = m_normals.begin();
-    list<CGrPoint>::iterator tvertices = m_tvertices.begin();
-
-    for(list<CGrPoint>::iterator i=m_vertices.begin();  i!=m_vertices.end();  i++)
-    {
-        if(normals != m_normals.end())
-        {
-            p_renderer->RendererNormal(*normals);
-            normals++;
-        }
-
-        if(tvertices != m_tvertices.end())
-        {
-            p_renderer->RendererTexVertex(*tvertices);
-            tvertices++;
-        }
+    CGrPolygonSpan span;
+    Span(span);
+    p_renderer->RendererPolygons(&span, 1);
+}
 
-        p_renderer->RendererVertex(*i);
-    }
 
-    p_renderer->RendererEndPolygon();
+void CGrPolygon::Span(CGrPolygonSpan &p_span) const
+{
+    p_span.m_texture = m_texture;
+    p_span.m_vertexCnt = int(m_vertices.size());
+    p_span.m_vertices = m_vertices.empty() ? NULL : &m_vertices[0];
+    p_span.m_normalCnt = int(m_normals.size());
+    p_span.m_normals = m_normals.empty() ? NULL : &m_normals[0];
+    p_span.m_tvertexCnt = int(m_tvertices.size());
+    p_span.m_tvertices = m_tvertices.empty() ? NULL : &m_tvertices[0];
 }
 
 
@@ -301,10 +291,46 @@ void CGrComposite::glRender()
 }
 
 
+//
+// Name :         CGrComposite::Render()
+// Description :  Polygon children that come one after the other go to
+//                the renderer in one RendererPolygons() call, up to
+//                MAXSPANS at a time.  Only CGrPolygon itself, since a
+//                subclass may render differently.
+//
+
 void CGrComposite::Render(CGrRenderer *p_renderer)
 {
+    const int MAXSPANS = 64;
+    CGrPolygonSpan spans[MAXSPANS];
+    int cnt = 0;
+
     for(list<CGrPtr<CGrObject> >::iterator i=m_children.begin();  i!=m_children.end();  i++)
-        (*i)->Render(p_renderer);
+    {
+        CGrObject *child = *i;
+        const CGrPolygon *polygon = NULL;
+        if(typeid(*child) == typeid(CGrPolygon))
+            polygon = static_cast<const CGrPolygon *>(child);
+
+        if(polygon != NULL)
+        {
+            polygon->Span(spans[cnt++]);
+            if(cnt < MAXSPANS)
+                continue;
+        }
+
+        if(cnt > 0)
+        {
+            p_renderer->RendererPolygons(spans, cnt);
+            cnt = 0;
+        }
+
+        if(polygon == NULL)
+            child->Render(p_renderer);
+    }
+
+    if(cnt > 0)
+        p_renderer->RendererPolygons(spans, cnt);
 }
 
 
@@ -932,7 +958,31 @@ void CGrComposite::Pyramid(double x, double y, double z, double dx, double dy, d
 }
 
 
+//
+// Name :         CGrComposite::Sphere(), CGrComposite::Cylinder()
+// Description :  Add a sphere or a cylinder as one object.  The ray 
+//                tracer intersects it exactly.  Other renderers get
+//                the polygons below.
+//
+
 void CGrComposite::Sphere(double x, double y, double z, double r, CGrTexture* p_texture)
+{
+    Child(new CGrSphere(x, y, z, r, p_texture));
+}
+
+void CGrComposite::Cylinder(const CGrPoint &p_base, const CGrPoint &p_top, double r, CGrTexture *p_texture)
+{
+    Child(new CGrCylinder(p_base, p_top, r, p_texture));
+}
+
+
+//
+// Name :         CGrComposite::SpherePolygons()
+// Description :  A sphere as 32768 triangles, subdividing the faces of
+//                an octahedron.
+//
+
+void CGrComposite::SpherePolygons(double x, double y, double z, double r, CGrTexture* p_texture)
 {
     CGrPtr<CGrPolygon> poly;
 
@@ -956,6 +1006,15 @@ void CGrComposite::Sphere(double x, double y, double z, double r, CGrTexture* p_
 }
 
 
+// Normalize a 3 element vector in place
+inline void Normalize3(double *p)
+{
+    double l = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    p[0] /= l;
+    p[1] /= l;
+    p[2] /= l;
+}
+
 void CGrComposite::SphereFace(int p_recurse, CGrPtr<CGrPolygon> &poly, CGrTexture* p_texture, double p_radius, double x, double y, double z, double* a, double* b, double* c)
 {
     if (p_recurse > 1)
@@ -1015,6 +1074,175 @@ void CGrComposite::SphereFace(int p_recurse, CGrPtr<CGrPolygon> &poly, CGrTextur
             poly->AddTex2d(tx1, ty1);
             poly->AddTex2d(tx3, ty3);
     	}
-        
+
+        Child(poly);
+    }
+}
+
+
+//
+// Name :         CGrComposite::CylinderPolygons()
+// Description :  A capped cylinder as 32 side faces and two caps.  The
+//                angle around the axis is measured from directions u and
+//                v across it, v = ref x axis and u = axis x v, where ref
+//                is the x axis unless the cylinder is near it.  A point
+//                at angle a is u sin a + v cos a, so a cylinder along y
+//                has the texture coordinates of a sphere on its side.
+//
+
+void CGrComposite::CylinderPolygons(const CGrPoint &p_base, const CGrPoint &p_top, double r, CGrTexture *p_texture)
+{
+    const int SLICES = 32;
+
+    CGrPoint axis = p_top - p_base;
+    axis.W() = 0;
+    if(axis.Length3() <= 0)
+        return;
+    axis.Normalize3();
+
+    CGrPoint ref = fabs(axis.X()) < 0.9 ? CGrPoint(1, 0, 0, 0) : CGrPoint(0, 1, 0, 0);
+    CGrPoint v = Normalize3(Cross3(ref, axis));
+    CGrPoint u = Cross3(axis, v);
+
+    // The directions out from the axis around the cylinder, the
+    // first and last the same with s = 0 and s = 1
+    CGrPoint around[SLICES + 1];
+    for(int i=0;  i<=SLICES;  i++)
+    {
+        double a = GR_PI2 * (double(i) / SLICES - 0.5);
+        around[i] = u * sin(a) + v * cos(a);
+    }
+
+    CGrPtr<CGrPolygon> poly;
+    for(int i=0;  i<SLICES;  i++)
+    {
+        const CGrPoint &n1 = around[i];
+        const CGrPoint &n2 = around[i + 1];
+
+        poly = new CGrPolygon;
+        poly->AddNormal3d(n1.X(), n1.Y(), n1.Z());
+        poly->AddVertex3dv(p_base + n1 * r);
+        poly->AddNormal3d(n2.X(), n2.Y(), n2.Z());
+        poly->AddVertex3dv(p_base + n2 * r);
+        poly->AddNormal3d(n2.X(), n2.Y(), n2.Z());
+        poly->AddVertex3dv(p_top + n2 * r);
+        poly->AddNormal3d(n1.X(), n1.Y(), n1.Z());
+        poly->AddVertex3dv(p_top + n1 * r);
+        if(p_texture)
+        {
+            poly->Texture(p_texture);
+            poly->AddTex2d(double(i) / SLICES, 0);
+            poly->AddTex2d(double(i + 1) / SLICES, 0);
+            poly->AddTex2d(double(i + 1) / SLICES, 1);
+            poly->AddTex2d(double(i) / SLICES, 1);
+        }
+        Child(poly);
+    }
+
+    // The caps are mapped flat, the top counterclockwise seen from 
+    // above it and the base seen from below
+    for(int c=0;  c<2;  c++)
+    {
+        const CGrPoint &center = c == 0 ? p_top : p_base;
+        CGrPoint n = c == 0 ? axis : -axis;
+
+        poly = new CGrPolygon;
+        poly->AddNormal3d(n.X(), n.Y(), n.Z());
+        if(p_texture)
+            poly->Texture(p_texture);
+
+        for(int i=0;  i<SLICES;  i++)
+        {
+            const CGrPoint &d = around[c == 0 ? i : SLICES - i];
+            poly->AddVertex3dv(center + d * r);
+            if(p_texture)
+                poly->AddTex2d(0.5 + Dot3(d, u) / 2, 0.5 + Dot3(d, v) / 2);
+        }
+        Child(poly);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// CGrSphere, CGrBox, CGrCylinder:  Primitives handed to the renderer
+// whole.  OpenGL draws them as polygons.
+//////////////////////////////////////////////////////////////////////
+
+CGrSphere::CGrSphere(double x, double y, double z, double r, CGrTexture *p_texture) : m_center(x, y, z)
+{
+    m_radius = r;
+    m_texture = p_texture;
+}
+
+CGrSphere::~CGrSphere() {}
+
+void CGrSphere::glRender()
+{
+    if(!m_polygons)
+    {
+        m_polygons = new CGrComposite;
+        m_polygons->SpherePolygons(m_center.X(), m_center.Y(), m_center.Z(), m_radius, m_texture);
+    }
+
+    m_polygons->glRender();
+}
+
+void CGrSphere::Render(CGrRenderer *p_renderer)
+{
+    p_renderer->RendererTexture(m_texture);
+    p_renderer->RendererSphere(m_center, m_radius);
+}
+
+
+CGrBox::CGrBox(double x, double y, double z, double dx, double dy, double dz, CGrTexture *p_texture) :
+    m_min(x, y, z), m_max(x + dx, y + dy, z + dz)
+{
+    m_texture = p_texture;
+}
+
+CGrBox::~CGrBox() {}
+
+void CGrBox::glRender()
+{
+    if(!m_polygons)
+    {
+        m_polygons = new CGrComposite;
+        m_polygons->Box(m_min.X(), m_min.Y(), m_min.Z(), m_max.X() - m_min.X(), 
+            m_max.Y() - m_min.Y(), m_max.Z() - m_min.Z(), m_texture);
     }
-}
\ No newline at end of file
+
+    m_polygons->glRender();
+}
+
+void CGrBox::Render(CGrRenderer *p_renderer)
+{
+    p_renderer->RendererTexture(m_texture);
+    p_renderer->RendererBox(m_min, m_max);
+}
+
+
+CGrCylinder::CGrCylinder(const CGrPoint &p_base, const CGrPoint &p_top, double r, CGrTexture *p_texture) :
+    m_base(p_base), m_top(p_top)
+{
+    m_radius = r;
+    m_texture = p_texture;
+}
+
+CGrCylinder::~CGrCylinder() {}
+
+void CGrCylinder::glRender()
+{
+    if(!m_polygons)
+    {
+        m_polygons = new CGrComposite;
+        m_polygons->CylinderPolygons(m_base, m_top, m_radius, m_texture);
+    }
+
+    m_polygons->glRender();
+}
+
+void CGrCylinder::Render(CGrRenderer *p_renderer)
+{
+    p_renderer->RendererTexture(m_texture);
+    p_renderer->RendererCylinder(m_base, m_top, m_radius);
+}
@@ -14,11 +14,14 @@
 
 #include "GrPoint.h"
 #include "GrTransform.h"
+#include "RayInterfaces.h"
 #include <list>
+#include <vector>
 
 // This allows for forward references
 class CGrTexture;
 class CGrRenderer;
+struct CGrPolygonSpan;
 
 // class CGrObject
 // Superclass for all graphics objects
@@ -95,13 +98,16 @@ public:
     void ClearNormals() {m_normals.clear();}
 
     // Access functions
-    const std::list<CGrPoint> Normals() const {return m_normals;}
+    const std::list<CGrPoint> Normals() const {return std::list<CGrPoint>(m_normals.begin(), m_normals.end());}
+
+    // The polygon as arrays for CGrRenderer::RendererPolygons()
+    void Span(CGrPolygonSpan &p_span) const;
 
 private:
-    // A polygon is a list of vertices
-    std::list<CGrPoint> m_vertices;     // The polygon vertices
-    std::list<CGrPoint> m_tvertices;    // The texture vertices
-    std::list<CGrPoint> m_normals;      // Vertex normals
+    // A polygon is an array of vertices
+    std::vector<CGrPoint> m_vertices;   // The polygon vertices
+    std::vector<CGrPoint> m_tvertices;  // The texture vertices
+    std::vector<CGrPoint> m_normals;    // Vertex normals
 
     // Do we have an associated texture?
     CGrPtr<CGrTexture>  m_texture;
@@ -155,7 +161,13 @@ public:
 
     void Pyramid(double x, double y, double z, double dx, double dy, double dz, CGrTexture* p_texture=NULL);
 
+    // A sphere or cylinder the ray tracer intersects exactly
     void Sphere(double x, double y, double z, double r, CGrTexture* p_texture);
+    void Cylinder(const CGrPoint &p_base, const CGrPoint &p_top, double r, CGrTexture *p_texture=NULL);
+
+    // The same as polygons
+    void SpherePolygons(double x, double y, double z, double r, CGrTexture* p_texture);
+    void CylinderPolygons(const CGrPoint &p_base, const CGrPoint &p_top, double r, CGrTexture *p_texture=NULL);
 
     void SphereFace(int p_recurse, CGrPtr<CGrPolygon>& poly, CGrTexture* p_texture, double p_radius, double x, double y, double z,double* a, double* b, double* c);
 
@@ -163,6 +175,67 @@ private:
     std::list<CGrPtr<CGrObject> > m_children;
 };
 
+// class CGrSphere
+// A sphere.  Render() hands it to the renderer with RendererSphere(),
+// so a ray tracer can intersect it exactly rather than as polygons.
+// glRender() draws the polygons of CGrComposite::SpherePolygons().
+
+class CGrSphere : public CGrObject
+{
+public:
+    CGrSphere(double x, double y, double z, double r, CGrTexture *p_texture=NULL);
+    ~CGrSphere();
+
+    virtual void glRender();
+    virtual void Render(CGrRenderer *p_renderer);
+
+private:
+    CGrPoint m_center;
+    double m_radius;
+    CGrPtr<CGrTexture> m_texture;
+    CGrPtr<CGrComposite> m_polygons;    // Made by the first glRender()
+};
+
+// class CGrBox
+// An axis-aligned box handed over with RendererBox().  It has the
+// faces and texture coordinates of CGrComposite::Box().
+
+class CGrBox : public CGrObject
+{
+public:
+    CGrBox(double x, double y, double z, double dx, double dy, double dz, CGrTexture *p_texture=NULL);
+    ~CGrBox();
+
+    virtual void glRender();
+    virtual void Render(CGrRenderer *p_renderer);
+
+private:
+    CGrPoint m_min;
+    CGrPoint m_max;
+    CGrPtr<CGrTexture> m_texture;
+    CGrPtr<CGrComposite> m_polygons;
+};
+
+// class CGrCylinder
+// A capped cylinder handed over with RendererCylinder()
+
+class CGrCylinder : public CGrObject
+{
+public:
+    CGrCylinder(const CGrPoint &p_base, const CGrPoint &p_top, double r, CGrTexture *p_texture=NULL);
+    ~CGrCylinder();
+
+    virtual void glRender();
+    virtual void Render(CGrRenderer *p_renderer);
+
+private:
+    CGrPoint m_base;
+    CGrPoint m_top;
+    double m_radius;
+    CGrPtr<CGrTexture> m_texture;
+    CGrPtr<CGrComposite> m_polygons;
+};
+
 // class CGrTranslate
 // Class for a translation object
 
@@ -233,9 +306,10 @@ private:
 };
 
 // class CGrMaterial
-// Class for a material object
+// Class for a material object.  It is also the material
+// the ray intersection system hands back for a hit.
 
-class CGrMaterial : public CGrObject
+class CGrMaterial : public CGrObject, public IMaterial
 {
 public:
     void Clear();
@@ -283,6 +357,7 @@ public:
     float Specular(int i) const {return m_specular[i];}
     const float *Specular() const {return m_specular;}
     float Shininess() const {return m_shininess;}
+    const float *Emission() const {return m_emission;}
     float SpecularOther(int i) const {return m_specularother[i];}
 
 private:
@@ -80,7 +80,9 @@ public:
     void WeightedAdd3(const CGrPoint &p, double w) {m[0] += p.m[0] * w;  m[1] += p.m[1] * w;  m[2] += p.m[2] * w;} 
     CGrPoint &MemberMultiply3(const CGrPoint &p) {m[0] *= p.m[0];  m[1] *= p.m[1];  m[2] *= p.m[2];  return *this;}
 
+#ifndef NOOPENGL
     vec3 ToVec3() { return vec3(double(m[0]), double(m[1]), double(m[2])); }
+#endif
 
 private:
     double m[4];
@@ -130,6 +132,9 @@ inline ostream& operator<<(ostream& str, const CGrPoint &p)
 	str << p.X() << " " << p.Y() << " " << p.Z() << " " << p.W(); return str;
 }
 
+// Texture lookup on Windows BYTE images.  CGrTexture::SampleBilinear()
+// does this without allocating.
+#ifndef NOMFC
 inline shared_ptr<CGrPoint> BilinearInterpolation(BYTE** const img, int width, int height, int c, int r)
 {
     // Invalid Input
@@ -163,3 +168,4 @@ inline shared_ptr<CGrPoint> BilinearInterpolation(BYTE** const img, int width, i
 
     return make_shared<CGrPoint>(pixel);
 }
+#endif
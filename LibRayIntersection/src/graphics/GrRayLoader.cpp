@@ -0,0 +1,373 @@
+//
+// Name :         GrRayLoader.cpp
+// Description :  Implementation of CGrRayLoader, a renderer that loads
+//                a scene graph into a CRayIntersection so it can be
+//                ray traced.
+//
+
+#include "stdafx.h"
+#include "GrRayLoader.h"
+#include "GrTexture.h"
+#include "GrTiledTexture.h"
+
+using namespace std;
+
+CGrRayLoader::CGrRayLoader(CRayIntersection &p_intersection) : m_intersection(p_intersection)
+{
+    m_matrix.SetIdentity();
+    m_normalMatrix.SetIdentity();
+    m_polygons = 0;
+    m_primitives = 0;
+}
+
+CGrRayLoader::~CGrRayLoader() = default;
+
+
+bool CGrRayLoader::RendererStart()
+{
+    m_matrix.SetIdentity();
+    m_normalMatrix.SetIdentity();
+    m_stack.clear();
+
+    m_polygons = 0;
+    m_primitives = 0;
+    m_min.Set(0, 0, 0);
+    m_max.Set(0, 0, 0);
+
+    m_intersection.Material(NULL);
+    return true;
+}
+
+
+//
+// Name :         CGrRayLoader::RendererEndPolygon()
+// Description :  A polygon from the per vertex functions is complete.
+//
+
+void CGrRayLoader::RendererEndPolygon()
+{
+    CGrPolygonSpan polygon;
+    PolySpan(polygon);
+    RendererPolygons(&polygon, 1);
+}
+
+
+//
+// Name :         CGrRayLoader::RendererPolygons()
+// Description :  Transform the polygons to world coordinates and hand
+//                them to the intersection system.
+//
+
+void CGrRayLoader::RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt)
+{
+    for(int p=0;  p<p_cnt;  p++)
+    {
+        const CGrPolygonSpan &polygon = p_polygons[p];
+        if(polygon.m_vertexCnt < 3)
+            continue;
+
+        Texture(polygon.m_texture);
+        m_intersection.PolygonBegin();
+
+        // A polygon without normals gets its face normal
+        const CGrPoint *v = polygon.m_vertices;
+        if(polygon.m_normalCnt == 0)
+        {
+            CGrPoint n = m_normalMatrix * Cross3(v[1] - v[0], v[2] - v[0]);
+            n.Normalize3();
+            m_intersection.Normal(CGrVector(n.X(), n.Y(), n.Z(), 0));
+        }
+
+        for(int i=0;  i<polygon.m_vertexCnt;  i++)
+        {
+            if(i < polygon.m_normalCnt)
+            {
+                const CGrPoint &n = polygon.m_normals[i];
+                CGrPoint nw = m_normalMatrix * CGrPoint(n.X(), n.Y(), n.Z(), 0);
+                nw.Normalize3();
+                m_intersection.Normal(CGrVector(nw.X(), nw.Y(), nw.Z(), 0));
+            }
+
+            if(i < polygon.m_tvertexCnt)
+            {
+                const CGrPoint &t = polygon.m_tvertices[i];
+                m_intersection.TexVertex(CGrVector(t.X(), t.Y(), t.Z(), t.W()));
+            }
+
+            CGrPoint w = m_matrix * v[i];
+            w /= w.W();
+            m_intersection.Vertex(CGrVector(w.X(), w.Y(), w.Z()));
+
+            if(m_polygons == 0 && m_primitives == 0 && i == 0)
+            {
+                m_min = w;
+                m_max = w;
+            }
+            else
+            {
+                m_min.Minimize(w);
+                m_max.Maximize(w);
+            }
+        }
+
+        m_intersection.PolygonEnd();
+        m_polygons++;
+    }
+}
+
+
+//
+// Name :         CGrRayLoader::RendererMaterial()
+// Description :  The material applies to the polygons that follow, 
+//                the way glMaterial does.
+//
+
+void CGrRayLoader::RendererMaterial(CGrMaterial *p_material)
+{
+    m_intersection.Material(p_material);
+}
+
+
+//
+// Name :         CGrRayLoader::RendererSphere()
+// Description :  A sphere is still a sphere after a similarity 
+//                transformation, with the radius scaled.
+//
+
+void CGrRayLoader::RendererSphere(const CGrPoint &p_center, double p_radius)
+{
+    double scale;
+    bool rotates;
+    if(!Similarity(scale, rotates) || (rotates && PolyTexture() != NULL))
+    {
+        CGrRenderer::RendererSphere(p_center, p_radius);
+        return;
+    }
+
+    CGrVector center = World(p_center);
+    double radius = p_radius * scale;
+
+    Texture(PolyTexture());
+    m_intersection.AddSphere(center, radius);
+
+    CGrVector r(radius, radius, radius, 0);
+    Extend(center - r, center + r);
+}
+
+
+//
+// Name :         CGrRayLoader::RendererBox()
+// Description :  A box stays axis-aligned and keeps its faces where 
+//                the matrix only moves and scales by positive amounts.
+//
+
+void CGrRayLoader::RendererBox(const CGrPoint &p_min, const CGrPoint &p_max)
+{
+    bool aligned = m_matrix[3][0] == 0 && m_matrix[3][1] == 0 && m_matrix[3][2] == 0 && m_matrix[3][3] == 1;
+    for(int r=0;  r<3 && aligned;  r++)
+    {
+        for(int c=0;  c<3;  c++)
+        {
+            if(r == c ? m_matrix[r][c] <= 0 : m_matrix[r][c] != 0)
+                aligned = false;
+        }
+    }
+
+    if(!aligned)
+    {
+        CGrRenderer::RendererBox(p_min, p_max);
+        return;
+    }
+
+    CGrVector lo = World(p_min);
+    CGrVector hi = World(p_max);
+
+    Texture(PolyTexture());
+    m_intersection.AddBox(lo, hi);
+    Extend(lo, hi);
+}
+
+
+void CGrRayLoader::RendererCylinder(const CGrPoint &p_base, const CGrPoint &p_top, double p_radius)
+{
+    double scale;
+    bool rotates;
+    if(!Similarity(scale, rotates) || (rotates && PolyTexture() != NULL))
+    {
+        CGrRenderer::RendererCylinder(p_base, p_top, p_radius);
+        return;
+    }
+
+    CGrVector base = World(p_base);
+    CGrVector top = World(p_top);
+    double radius = p_radius * scale;
+
+    Texture(PolyTexture());
+    m_intersection.AddCylinder(base, top, radius);
+
+    // The box around spheres at the two ends holds it
+    CGrVector lo, hi;
+    for(int d=0;  d<3;  d++)
+    {
+        lo[d] = (base[d] < top[d] ? base[d] : top[d]) - radius;
+        hi[d] = (base[d] > top[d] ? base[d] : top[d]) + radius;
+    }
+    Extend(lo, hi);
+}
+
+
+//
+// Name :         CGrRayLoader::Similarity()
+// Description :  Is the current matrix a similarity, a rotation with
+//                the same scale in every direction and a translation?
+// Output Parms : p_scale - The scale
+//                p_rotates - True if it rotates or mirrors
+//
+
+bool CGrRayLoader::Similarity(double &p_scale, bool &p_rotates) const
+{
+    const CGrTransform &m = m_matrix;
+    if(m[3][0] != 0 || m[3][1] != 0 || m[3][2] != 0 || m[3][3] != 1)
+        return false;
+
+    // The columns must be perpendicular and the same length
+    p_scale = sqrt(m[0][0] * m[0][0] + m[1][0] * m[1][0] + m[2][0] * m[2][0]);
+    if(p_scale <= 0)
+        return false;
+
+    const double tolerance = 1e-9 * p_scale * p_scale;
+    for(int i=0;  i<3;  i++)
+    {
+        for(int j=i;  j<3;  j++)
+        {
+            double dot = m[0][i] * m[0][j] + m[1][i] * m[1][j] + m[2][i] * m[2][j];
+            double expect = i == j ? p_scale * p_scale : 0;
+            if(fabs(dot - expect) > tolerance)
+                return false;
+        }
+    }
+
+    p_rotates = false;
+    for(int r=0;  r<3;  r++)
+    {
+        for(int c=0;  c<3;  c++)
+        {
+            if(r == c ? m[r][c] <= 0 : fabs(m[r][c]) > 1e-12 * p_scale)
+                p_rotates = true;
+        }
+    }
+
+    return true;
+}
+
+
+CGrVector CGrRayLoader::World(const CGrPoint &p) const
+{
+    CGrPoint w = m_matrix * CGrPoint(p.X(), p.Y(), p.Z());
+    return CGrVector(w.X(), w.Y(), w.Z());
+}
+
+
+//
+// Name :         CGrRayLoader::Texture()
+// Description :  Set the texture of what we load next, or the tiled 
+//                texture streamed in its place.
+//
+
+void CGrRayLoader::Texture(CGrTexture *p_texture)
+{
+    map<CGrTexture *, CGrPtr<CGrTiledTexture> >::iterator streamed = m_streamed.find(p_texture);
+    if(streamed != m_streamed.end())
+        m_intersection.Texture(streamed->second);
+    else
+        m_intersection.Texture(p_texture);
+}
+
+
+//
+// Name :         CGrRayLoader::Extend()
+// Description :  Extend what we loaded by a primitive inside a box.
+//
+
+void CGrRayLoader::Extend(const CGrVector &p_min, const CGrVector &p_max)
+{
+    CGrPoint lo(p_min.X(), p_min.Y(), p_min.Z());
+    CGrPoint hi(p_max.X(), p_max.Y(), p_max.Z());
+    if(m_polygons == 0 && m_primitives == 0)
+    {
+        m_min = lo;
+        m_max = hi;
+    }
+    else
+    {
+        m_min.Minimize(lo);
+        m_max.Maximize(hi);
+    }
+
+    m_primitives++;
+}
+
+
+void CGrRayLoader::StreamTexture(CGrTexture *p_texture, CGrTiledTexture *p_tiled)
+{
+    if(p_tiled != NULL)
+        m_streamed[p_texture] = p_tiled;
+    else
+        m_streamed.erase(p_texture);
+}
+
+
+//
+// The transformation stack
+//
+
+void CGrRayLoader::RendererPushMatrix()
+{
+    m_stack.push_back(m_matrix);
+}
+
+void CGrRayLoader::RendererPopMatrix()
+{
+    if(m_stack.empty())
+        return;
+
+    m_matrix = m_stack.back();
+    m_stack.pop_back();
+
+    m_normalMatrix.SetAffineInverse(m_matrix);
+    m_normalMatrix.Transpose();
+}
+
+void CGrRayLoader::RendererRotate(double a, double x, double y, double z)
+{
+    CGrTransform r;
+    r.SetRotate(a, CGrPoint(x, y, z));
+    Compose(r);
+}
+
+void CGrRayLoader::RendererTranslate(double x, double y, double z)
+{
+    CGrTransform t;
+    t.SetTranslate(x, y, z);
+    Compose(t);
+}
+
+void CGrRayLoader::RendererTransform(const CGrTransform *p_transform)
+{
+    Compose(*p_transform);
+}
+
+
+//
+// Name :         CGrRayLoader::Compose()
+// Description :  Multiply a transformation onto the current matrix
+//                the way OpenGL does.
+//
+
+void CGrRayLoader::Compose(const CGrTransform &p_transform)
+{
+    m_matrix *= p_transform;
+
+    m_normalMatrix.SetAffineInverse(m_matrix);
+    m_normalMatrix.Transpose();
+}
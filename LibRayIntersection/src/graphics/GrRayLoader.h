@@ -0,0 +1,91 @@
+//
+// Name :         GrRayLoader.h
+// Description :  Header file for CGrRayLoader, a renderer that loads
+//                a scene graph into a CRayIntersection.
+//                See GrRayLoader.cpp
+//
+
+#ifndef _GRRAYLOADER_H
+#define _GRRAYLOADER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "GrRenderer.h"
+#include "RayIntersection.h"
+#include <map>
+#include <vector>
+
+class CGrTiledTexture;
+
+//
+// class CGrRayLoader
+// Renders a scene graph into a CRayIntersection.  Polygons are
+// transformed to world coordinates by the current matrix and carry
+// the current CGrMaterial and their CGrTexture.  The
+// caller still calls Initialize() before and LoadingComplete()
+// or BuildAsync() after.
+//
+// Spheres, boxes, and cylinders become primitives of the intersection
+// system when the current matrix keeps their shape.  A sphere or a
+// cylinder may be moved, rotated, and scaled the same in every
+// direction, but a textured one may not be rotated, since its texture
+// is mapped in world coordinates.  A box may be moved and scaled.
+// Anything else is loaded as polygons.
+//
+
+class CGrRayLoader : public CGrRenderer
+{
+public:
+    CGrRayLoader(CRayIntersection &p_intersection);
+    virtual ~CGrRayLoader();
+
+    virtual bool RendererStart();
+    virtual void RendererEndPolygon();
+    virtual void RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt);
+    virtual void RendererPushMatrix();
+    virtual void RendererPopMatrix();
+    virtual void RendererRotate(double a, double x, double y, double z);
+    virtual void RendererTranslate(double x, double y, double z);
+    virtual void RendererTransform(const CGrTransform *p_transform);
+    virtual void RendererMaterial(CGrMaterial *p_material);
+    virtual void RendererSphere(const CGrPoint &p_center, double p_radius);
+    virtual void RendererBox(const CGrPoint &p_min, const CGrPoint &p_max);
+    virtual void RendererCylinder(const CGrPoint &p_base, const CGrPoint &p_top, double p_radius);
+
+    // Polygons with the texture p_texture get p_tiled instead, so the
+    // scene graph can carry a small texture for OpenGL while the ray
+    // tracer streams the full size one.  NULL stops streaming it.
+    void StreamTexture(CGrTexture *p_texture, CGrTiledTexture *p_tiled);
+
+    // What was loaded by the last Render()
+    int PolygonCnt() const {return m_polygons;}
+    int PrimitiveCnt() const {return m_primitives;}
+    const CGrPoint &Min() const {return m_min;}
+    const CGrPoint &Max() const {return m_max;}
+
+private:
+    void Compose(const CGrTransform &p_transform);
+    bool Similarity(double &p_scale, bool &p_rotates) const;
+    CGrVector World(const CGrPoint &p) const;
+    void Texture(CGrTexture *p_texture);
+    void Extend(const CGrVector &p_min, const CGrVector &p_max);
+
+    CRayIntersection   &m_intersection;
+
+    // Current transformation and its inverse transpose for normals
+    CGrTransform        m_matrix;
+    CGrTransform        m_normalMatrix;
+    std::vector<CGrTransform> m_stack;
+
+    std::map<CGrTexture *, CGrPtr<CGrTiledTexture> > m_streamed;
+
+    // Statistics about what we loaded
+    int                 m_polygons;
+    int                 m_primitives;
+    CGrPoint            m_min;
+    CGrPoint            m_max;
+};
+
+#endif
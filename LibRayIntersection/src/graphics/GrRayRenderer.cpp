@@ -0,0 +1,281 @@
+//
+// Name :         GrRayRenderer.cpp
+// Description :  Implementation of CGrRayRenderer, a multithreaded ray
+//                tracing renderer for scene graphs.
+//
+
+#include "stdafx.h"
+#include "GrRayRenderer.h"
+#include "GrTexture.h"
+#include "GrTiledTexture.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+// Initialize the loader base with a member that is constructed after
+// it.  That is fine since the base only keeps the reference.
+CGrRayRenderer::CGrRayRenderer() : CGrRayLoader(m_intersection)
+{
+    m_threads = 0;
+    m_tileSize = 16;
+    m_maxAniso = 8;
+
+    m_image = NULL;
+    m_width = 0;
+    m_height = 0;
+    m_tilesAcross = 0;
+    SetBackground(0, 0, 0);
+}
+
+CGrRayRenderer::~CGrRayRenderer() = default;
+
+
+void CGrRayRenderer::SetImage(BYTE **p_image, int p_width, int p_height)
+{
+    m_image = p_image;
+    m_width = p_width;
+    m_height = p_height;
+}
+
+
+bool CGrRayRenderer::RendererStart()
+{
+    m_intersection.Initialize();
+    return CGrRayLoader::RendererStart();
+}
+
+
+//
+// Name :         CGrRayRenderer::RendererPolygons(), RendererTexture()
+// Description :  Build the tiled mip pyramid of each texture as we load,
+//                since loading is the only time we are on one thread.
+//                Primitives get their texture from RendererTexture().
+//
+
+static void MipMap(CGrTexture *p_texture)
+{
+    if(p_texture != NULL && !p_texture->Empty() && p_texture->MipLevels() == 1)
+    {
+        p_texture->SetLayout(CGrTexture::TILED);
+        p_texture->GenerateMipmaps();
+    }
+}
+
+void CGrRayRenderer::RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt)
+{
+    for(int p=0;  p<p_cnt;  p++)
+        MipMap(p_polygons[p].m_texture);
+
+    CGrRayLoader::RendererPolygons(p_polygons, p_cnt);
+}
+
+void CGrRayRenderer::RendererTexture(CGrTexture *p_texture)
+{
+    MipMap(p_texture);
+    CGrRayLoader::RendererTexture(p_texture);
+}
+
+
+//
+// Name :         CGrRayRenderer::RendererEnd()
+// Description :  The scene graph is loaded.  Build the intersection
+//                structure and trace the image.
+//
+
+bool CGrRayRenderer::RendererEnd()
+{
+    m_intersection.LoadingComplete();
+    return Trace();
+}
+
+
+//
+// Name :         CGrRayRenderer::Trace()
+// Description :  Trace the image one tile per task.
+//
+
+bool CGrRayRenderer::Trace()
+{
+    if(m_image == NULL || m_width <= 0 || m_height <= 0)
+        return false;
+
+    // The view
+    m_eye = CGrVector(Eye().X(), Eye().Y(), Eye().Z());
+    CGrVector center(Center().X(), Center().Y(), Center().Z());
+    CGrVector up(Up().X(), Up().Y(), Up().Z(), 0);
+
+    m_forward = Normalize3(center - m_eye);
+    m_right = Normalize3(Cross(m_forward, up));
+    m_up = Cross(m_right, m_forward);
+
+    // The pool is kept between frames
+    if(m_pool == NULL || (m_threads > 0 && m_pool->ThreadCnt() != m_threads))
+        m_pool.reset(new CWorkStealingPool(m_threads));
+
+    m_tilesAcross = (m_width + m_tileSize - 1) / m_tileSize;
+    int tilesDown = (m_height + m_tileSize - 1) / m_tileSize;
+
+    m_pool->Run(m_tilesAcross * tilesDown, [this](int p_tile, int /*p_worker*/) {RenderTile(p_tile);});
+    return true;
+}
+
+
+//
+// Name :         CGrRayRenderer::RenderTile()
+// Description :  Trace the pixels of one tile.  Row 0 is the bottom
+//                of the image.  The differentials of a primary ray are
+//                the change in its normalized direction d / |d| from one
+//                pixel to the next, (dd |d|^2 - d (d . dd)) / |d|^3.
+//
+
+void CGrRayRenderer::RenderTile(int p_tile)
+{
+    int c0 = (p_tile % m_tilesAcross) * m_tileSize;
+    int r0 = (p_tile / m_tilesAcross) * m_tileSize;
+    int c1 = c0 + m_tileSize < m_width ? c0 + m_tileSize : m_width;
+    int r1 = r0 + m_tileSize < m_height ? r0 + m_tileSize : m_height;
+
+    double halfY = tan(ProjectionAngle() * 0.5 * GR_DTOR);
+    double halfX = halfY * ProjectionAspect();
+
+    // Change in the unnormalized direction per pixel
+    CGrVector ddx = m_right * (2 * halfX / m_width);
+    CGrVector ddy = m_up * (2 * halfY / m_height);
+    CGrVector zero(0, 0, 0, 0);
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    float color[3];
+
+    for(int r=r0;  r<r1;  r++)
+    {
+        BYTE *row = m_image[r];
+        double y = ((r + 0.5) / m_height * 2 - 1) * halfY;
+
+        for(int c=c0;  c<c1;  c++)
+        {
+            double x = ((c + 0.5) / m_width * 2 - 1) * halfX;
+            CGrVector d = m_forward + m_right * x + m_up * y;
+            double dd = Dot3(d, d);
+            double len = sqrt(dd);
+            CRay ray(m_eye, d / len);
+
+            CRayDifferential differential(zero, zero, 
+                (ddx * dd - d * Dot3(d, ddx)) / (dd * len),
+                (ddy * dd - d * Dot3(d, ddy)) / (dd * len));
+
+            if(m_intersection.Intersect(ray, 1e20, NULL, object, t, intersect))
+                Shade(ray, differential, object, t, intersect, color);
+            else
+            {
+                color[0] = m_background[0];
+                color[1] = m_background[1];
+                color[2] = m_background[2];
+            }
+
+            for(int i=0;  i<3;  i++)
+            {
+                float v = color[i] < 0 ? 0 : (color[i] > 1 ? 1 : color[i]);
+                row[c * 3 + i] = BYTE(v * 255.f + 0.5f);
+            }
+        }
+    }
+}
+
+
+//
+// Name :         CGrRayRenderer::Shade()
+// Description :  The OpenGL lighting equation at a hit, with a shadow
+//                ray to each light.  Lights with w=0 are directional.
+//
+
+void CGrRayRenderer::Shade(const CRay &p_ray, const CRayDifferential &p_differential, 
+                           const CRayIntersection::Object *p_object, double p_t,
+                           const CGrVector &p_intersect, float *p_color)
+{
+    CGrVector normal, texcoord, dTdx, dTdy;
+    IMaterial *imaterial;
+    ITexture *itexture;
+    m_intersection.IntersectInfo(p_ray, p_differential, p_object, p_t, normal, imaterial, itexture, 
+        texcoord, dTdx, dTdy);
+
+    // The OpenGL default material if there is none
+    static const float defAmbient[4] = {0.2f, 0.2f, 0.2f, 1.f};
+    static const float defDiffuse[4] = {0.8f, 0.8f, 0.8f, 1.f};
+    static const float defBlack[4] = {0.f, 0.f, 0.f, 1.f};
+
+    const CGrMaterial *material = dynamic_cast<const CGrMaterial *>(imaterial);
+    const float *ambient = material ? material->Ambient() : defAmbient;
+    const float *diffuse = material ? material->Diffuse() : defDiffuse;
+    const float *specular = material ? material->Specular() : defBlack;
+    const float *emission = material ? material->Emission() : defBlack;
+    double shininess = material ? material->Shininess() : 0;
+
+    // The texture modulates the ambient and diffuse color
+    float texel[3] = {1.f, 1.f, 1.f};
+    const CGrTexture *texture = dynamic_cast<const CGrTexture *>(itexture);
+    const CGrTiledTexture *tiled = dynamic_cast<const CGrTiledTexture *>(itexture);
+    if(texture != NULL && !texture->Empty())
+        texture->SampleAnisotropic(texcoord.X(), texcoord.Y(), dTdx.X(), dTdx.Y(), 
+            dTdy.X(), dTdy.Y(), texel, m_maxAniso);
+    else if(tiled != NULL && tiled->IsOpen())
+        tiled->SampleAnisotropic(texcoord.X(), texcoord.Y(), dTdx.X(), dTdx.Y(), 
+            dTdy.X(), dTdy.Y(), texel, m_maxAniso);
+
+    // Light the side facing the viewer
+    CGrVector view = Normalize3(p_ray.Direction() * -1.);
+    normal.W() = 0;
+    normal = Normalize3(normal);
+    if(Dot3(normal, view) < 0)
+        normal = normal * -1.;
+
+    for(int i=0;  i<3;  i++)
+        p_color[i] = emission[i];
+
+    const CRayIntersection::Object *blocker;
+    double t;
+    CGrVector intersect;
+
+    for(int l=0;  l<LightCnt();  l++)
+    {
+        const Light &light = GetLight(l);
+
+        for(int i=0;  i<3;  i++)
+            p_color[i] += light.m_ambient[i] * ambient[i] * texel[i];
+
+        // Direction to the light, which a shadow ray reaches at t=1 for a point light
+        CGrVector toLight;
+        double maxt;
+        if(light.m_pos.W() == 0)
+        {
+            toLight = Normalize3(CGrVector(light.m_pos.X(), light.m_pos.Y(), light.m_pos.Z(), 0));
+            maxt = 1e20;
+        }
+        else
+        {
+            toLight = CGrVector(light.m_pos.X() / light.m_pos.W(), light.m_pos.Y() / light.m_pos.W(),
+                light.m_pos.Z() / light.m_pos.W()) - p_intersect;
+            toLight.W() = 0;
+            maxt = 1;
+        }
+
+        CGrVector dir = Normalize3(toLight);
+        double diffuseF = Dot3(normal, dir);
+        if(diffuseF <= 0)
+            continue;
+
+        if(m_intersection.Intersect(CRay(p_intersect, toLight, p_ray.Time()), maxt, p_object, blocker, t, intersect))
+            continue;       // In shadow
+
+        CGrVector half = Normalize3(dir + view);
+        double nh = Dot3(normal, half);
+        double specularF = nh > 0 ? pow(nh, shininess) : 0;
+
+        for(int i=0;  i<3;  i++)
+        {
+            p_color[i] += float(light.m_diffuse[i] * diffuse[i] * texel[i] * diffuseF);
+            p_color[i] += float(light.m_specular[i] * specular[i] * specularF);
+        }
+    }
+}
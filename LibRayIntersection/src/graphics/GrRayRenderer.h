@@ -0,0 +1,98 @@
+//
+// Name :         GrRayRenderer.h
+// Description :  Header file for CGrRayRenderer, a multithreaded ray
+//                tracing renderer for scene graphs.
+//                See GrRayRenderer.cpp
+//
+
+#ifndef _GRRAYRENDERER_H
+#define _GRRAYRENDERER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "GrRayLoader.h"
+#include "RayIntersection.h"
+#include <memory>
+
+class CWorkStealingPool;
+
+//
+// class CGrRayRenderer
+// Render() loads the scene graph into a CRayIntersection, then ray
+// traces it into the image set with SetImage().  The image is split
+// into square tiles that are traced on a work-stealing thread pool.
+// The view comes from Perspective() and LookAt(), the lights from
+// AddLight() in world coordinates.  Shading is the OpenGL lighting
+// model with shadows: ambient, diffuse, and specular terms from each
+// light, the texture modulating the ambient and diffuse color.
+// Textures are mip mapped and filtered over the footprint of the
+// pixel, which ray differentials carry from the eye to the surface.
+//
+
+class CGrRayRenderer : public CGrRayLoader
+{
+public:
+    CGrRayRenderer();
+    virtual ~CGrRayRenderer();
+
+    // The image is an array of rows of RGB bytes, row 0 at the bottom
+    void SetImage(BYTE **p_image, int p_width, int p_height);
+
+    void SetTileSize(int s) {m_tileSize = s > 0 ? s : 1;}
+    int GetTileSize() const {return m_tileSize;}
+
+    // Threads to trace with, 0 for one per hardware thread
+    void SetThreads(int t) {m_threads = t;}
+    int GetThreads() const {return m_threads;}
+
+    // Most samples per anisotropic texture lookup, 1 for trilinear
+    void SetMaxAnisotropy(int a) {m_maxAniso = a > 0 ? a : 1;}
+    int GetMaxAnisotropy() const {return m_maxAniso;}
+
+    void SetBackground(float r, float g, float b) {m_background[0] = r;  m_background[1] = g;  m_background[2] = b;}
+
+    virtual bool RendererStart();
+    virtual bool RendererEnd();
+    virtual void RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt);
+    virtual void RendererTexture(CGrTexture *p_texture);
+
+    // Trace Intersection() into the image.  Render() does this once the
+    // scene graph is loaded.  A scene loaded some other way, such as by
+    // CGrVRMLRayLoader, is traced by calling LoadingComplete() and then
+    // this, with the view set by Perspective() and LookAt().
+    bool Trace();
+
+    // The scene of the last Render()
+    CRayIntersection &Intersection() {return m_intersection;}
+
+private:
+    void RenderTile(int p_tile);
+    void Shade(const CRay &p_ray, const CRayDifferential &p_differential, 
+               const CRayIntersection::Object *p_object, double p_t,
+               const CGrVector &p_intersect, float *p_color);
+
+    // The loader base keeps a reference to this.  It is not used
+    // until Render() is called.
+    CRayIntersection    m_intersection;
+
+    std::unique_ptr<CWorkStealingPool> m_pool;
+    int                 m_threads;
+    int                 m_tileSize;
+    int                 m_maxAniso;
+
+    BYTE              **m_image;
+    int                 m_width;
+    int                 m_height;
+    float               m_background[3];
+
+    // The view, set up by RendererEnd() for the tiles
+    CGrVector           m_eye;
+    CGrVector           m_forward;
+    CGrVector           m_right;
+    CGrVector           m_up;
+    int                 m_tilesAcross;
+};
+
+#endif
@@ -177,6 +177,90 @@ void CGrRenderer::RendererMaterial(CGrMaterial* p_material) {}
 
 void CGrRenderer::RendererTransform(const CGrTransform* p_transform) {}
 
-void CGrRenderer::RendererSphere(const CGrPoint& center, double radius) {}
-
 void CGrRenderer::RendererNormalize(bool) {}
+
+
+//
+// Name :         CGrRenderer::RendererSphere(), RendererBox(), 
+//                RendererCylinder()
+// Description :  Default behavior for primitives.  They are made into
+//                polygons and rendered like any others.
+//
+
+void CGrRenderer::RendererSphere(const CGrPoint& center, double radius)
+{
+    CGrPtr<CGrComposite> polygons = new CGrComposite;
+    polygons->SpherePolygons(center.X(), center.Y(), center.Z(), radius, m_texture);
+    polygons->Render(this);
+}
+
+void CGrRenderer::RendererBox(const CGrPoint &p_min, const CGrPoint &p_max)
+{
+    CGrPtr<CGrComposite> polygons = new CGrComposite;
+    polygons->Box(p_min.X(), p_min.Y(), p_min.Z(), p_max.X() - p_min.X(), 
+        p_max.Y() - p_min.Y(), p_max.Z() - p_min.Z(), m_texture);
+    polygons->Render(this);
+}
+
+void CGrRenderer::RendererCylinder(const CGrPoint &p_base, const CGrPoint &p_top, double p_radius)
+{
+    CGrPtr<CGrComposite> polygons = new CGrComposite;
+    polygons->CylinderPolygons(p_base, p_top, p_radius, m_texture);
+    polygons->Render(this);
+}
+
+
+//
+// Name :         CGrRenderer::RendererPolygons()
+// Description :  Default behavior for polygons handed over whole.  They
+//                go through the per vertex functions one at a time.
+//
+
+void CGrRenderer::RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt)
+{
+    for(int p=0;  p<p_cnt;  p++)
+    {
+        const CGrPolygonSpan &polygon = p_polygons[p];
+
+        RendererBeginPolygon();
+
+        if(polygon.m_texture != NULL)
+            RendererTexture(polygon.m_texture);
+
+        for(int i=0;  i<polygon.m_vertexCnt;  i++)
+        {
+            if(i < polygon.m_normalCnt)
+                RendererNormal(polygon.m_normals[i]);
+
+            if(i < polygon.m_tvertexCnt)
+                RendererTexVertex(polygon.m_tvertices[i]);
+
+            RendererVertex(polygon.m_vertices[i]);
+        }
+
+        RendererEndPolygon();
+    }
+}
+
+
+//
+// Name :         CGrRenderer::PolySpan()
+// Description :  Copy the polygon the per vertex functions built into
+//                arrays.  They are kept, so this only allocates when a
+//                polygon is bigger than any before it.
+//
+
+void CGrRenderer::PolySpan(CGrPolygonSpan &p_polygon)
+{
+    m_spanvertex.assign(m_polyvertex.begin(), m_polyvertex.end());
+    m_spannormal.assign(m_polynormal.begin(), m_polynormal.end());
+    m_spantexture.assign(m_polytexture.begin(), m_polytexture.end());
+
+    p_polygon.m_texture = m_texture;
+    p_polygon.m_vertexCnt = int(m_spanvertex.size());
+    p_polygon.m_vertices = m_spanvertex.empty() ? NULL : &m_spanvertex[0];
+    p_polygon.m_normalCnt = int(m_spannormal.size());
+    p_polygon.m_normals = m_spannormal.empty() ? NULL : &m_spannormal[0];
+    p_polygon.m_tvertexCnt = int(m_spantexture.size());
+    p_polygon.m_tvertices = m_spantexture.empty() ? NULL : &m_spantexture[0];
+}
@@ -16,6 +16,25 @@
 #include "GrObject.h"
 #include <vector>
 
+//
+// struct CGrPolygonSpan
+// A polygon handed to a renderer whole.  The arrays belong to whoever
+// hands it over and are only good during the call.  There may be fewer
+// normals and texture vertices than vertices, the same as with
+// RendererNormal() and RendererTexVertex().
+//
+
+struct CGrPolygonSpan
+{
+    CGrTexture      *m_texture;
+    int              m_vertexCnt;
+    const CGrPoint  *m_vertices;
+    int              m_normalCnt;
+    const CGrPoint  *m_normals;
+    int              m_tvertexCnt;
+    const CGrPoint  *m_tvertices;
+};
+
 class CGrRenderer  
 {
 public:
@@ -52,9 +71,21 @@ public:
     virtual void RendererTransform(const CGrTransform *p_transform);
     virtual void RendererMaterial(CGrMaterial *p_material);
     virtual void RendererColor(double *c);
-    virtual void RendererSphere(const CGrPoint &center, double radius);
     virtual void RendererNormalize(bool);
 
+    // Primitives handed over whole, with the texture last given to
+    // RendererTexture().  The defaults make them polygons, so a renderer
+    // only overrides these if it can draw them some better way.
+    virtual void RendererSphere(const CGrPoint &center, double radius);
+    virtual void RendererBox(const CGrPoint &p_min, const CGrPoint &p_max);
+    virtual void RendererCylinder(const CGrPoint &p_base, const CGrPoint &p_top, double p_radius);
+
+    // Polygons that come one after the other, as arrays.  CGrPolygon
+    // and CGrComposite hand polygons over this way.  The default feeds
+    // each one through the per vertex functions above, so a renderer
+    // that only has RendererEndPolygon() still works.
+    virtual void RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt);
+
     // Information necessary to describe a light
     struct Light
     {
@@ -81,6 +112,11 @@ public:
     const std::list<CGrPoint> &PolyNormals() const {return m_polynormal;}
     const std::list<CGrPoint> &PolyTexVertices() const {return m_polytexture;}
 
+protected:
+    // The polygon from the per vertex functions as a span, so a
+    // RendererEndPolygon() can pass it to RendererPolygons()
+    void PolySpan(CGrPolygonSpan &p_polygon);
+
 private:
     double   m_angle;       // Projection angle (vertical)
     double   m_aspect;      // Aspect ratio
@@ -100,6 +136,10 @@ private:
     std::list<CGrPoint>  m_polynormal;
     std::list<CGrPoint>  m_polytexture;
 
+    // Arrays PolySpan() copies the lists to
+    std::vector<CGrPoint> m_spanvertex;
+    std::vector<CGrPoint> m_spannormal;
+    std::vector<CGrPoint> m_spantexture;
 };
 
 #endif // !defined(AFX_GRRENDERER_H__CFA4660A_883B_405D_B8D2_8DA9D471E66C__INCLUDED_)
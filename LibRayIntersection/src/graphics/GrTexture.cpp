@@ -9,6 +9,10 @@
 //                  3-06-01 1.03 Changed to store image in native RGB format.
 //                  2-25-03 1.04 Better error messages
 //                  4-02-07 1.05 Unicode support (will work both ways, now)
+//                 10-18-26 1.06 Allocation free sampling
+//                          1.07 Mip pyramid with trilinear and anisotropic lookups
+//                          1.08 Optional tiled RGBA layout for sampling
+//                          1.09 Memory mapped loading of PPM and BMP files
 //
 
 #include "stdafx.h"
@@ -16,6 +20,9 @@
 #include "ShaderHeaders.h"
 
 #include "GrTexture.h"
+#include "GrImageFile.h"
+#include "GrTextureSampling.h"
+#include <cstdint>
 
 using namespace std;
 
@@ -44,6 +51,8 @@ CGrTexture::CGrTexture()
     m_image = NULL;
     m_texname = 0;
     m_mipmap = true;
+    m_layout = ROWS;
+    m_mipmapped = false;
 
     m_initialized = false;
 }
@@ -54,6 +63,8 @@ CGrTexture::CGrTexture(const CGrTexture &p_img)
     m_width = 0;
     m_image = NULL;
     m_initialized = false;
+    m_layout = ROWS;
+    m_mipmapped = false;
 
     Copy(p_img);
 }
@@ -160,7 +171,9 @@ void CGrTexture::SameSize(const CGrTexture &p_img)
 
 void CGrTexture::SetSize(int p_x, int p_y)
 {
-    if(p_x == m_width || m_height == p_y)
+    Invalidate();
+
+    if(p_x == m_width && m_height == p_y)
         return;
 
     if(m_image)
@@ -191,8 +204,23 @@ void CGrTexture::SetSize(int p_x, int p_y)
     }
 }
 
+size_t CGrTexture::MemorySize() const
+{
+    size_t bytes = 0;
+    if(m_image != NULL)
+        bytes = size_t((m_width * 3 + (PADSIZE - 1)) / PADSIZE * PADSIZE) * m_height + m_height * sizeof(BYTE *);
+
+    for(vector<unique_ptr<Level> >::const_iterator level=m_levels.begin();  level!=m_levels.end();  level++)
+        bytes += (*level)->m_texels.size() + (*level)->m_rows.size() * sizeof(BYTE *);
+
+    return bytes;
+}
+
+
 void CGrTexture::Set(int x, int y, int r, int g, int b)
 {
+    Invalidate();
+
     if(x >= 0 && x < m_width && y >= 0 && y < m_height)
     {
         BYTE *img = m_image[y] + x * 3;
@@ -205,6 +233,8 @@ void CGrTexture::Set(int x, int y, int r, int g, int b)
 
 void CGrTexture::Fill(int r, int g, int b)
 {
+    Invalidate();
+
     for(int i=0;  i<m_height;  i++)
     {
         BYTE *img = m_image[i];
@@ -219,6 +249,222 @@ void CGrTexture::Fill(int r, int g, int b)
 
 }
 
+//////////////////////////////////////////////////////////////////////
+// Sampling
+//////////////////////////////////////////////////////////////////////
+
+void CGrTexture::SampleNearest(double u, double v, float *p_rgb) const
+{
+    if(Tiled())
+        Nearest(TileView(*m_levels[0]), u, v, p_rgb);
+    else
+        Nearest(RowView(m_image, m_width, m_height), u, v, p_rgb);
+}
+
+
+void CGrTexture::SampleBilinear(double u, double v, float *p_rgb) const
+{
+    if(Tiled())
+        Bilinear(TileView(*m_levels[0]), u, v, p_rgb);
+    else
+        Bilinear(RowView(m_image, m_width, m_height), u, v, p_rgb);
+}
+
+
+void CGrTexture::SampleBatch(int p_count, const double *p_uv, float *p_rgb, bool p_bilinear) const
+{
+    for(int i=0;  i<p_count;  i++, p_uv += 2, p_rgb += 3)
+    {
+        if(p_bilinear)
+            SampleBilinear(p_uv[0], p_uv[1], p_rgb);
+        else
+            SampleNearest(p_uv[0], p_uv[1], p_rgb);
+    }
+}
+
+
+void CGrTexture::SetLayout(Layout p_layout)
+{
+    m_layout = p_layout;
+    BuildLevels();
+}
+
+
+void CGrTexture::GenerateMipmaps()
+{
+    m_mipmapped = true;
+    BuildLevels();
+}
+
+
+//
+// Name :         CGrTexture::Level::Texel()
+// Description :  Texel (c, r) of a level in either layout.  The sampling
+//                code uses a view instead, so the layout is decided once
+//                per lookup rather than once per texel.
+//
+
+BYTE *CGrTexture::Level::Texel(int c, int r) const
+{
+    return m_rows.empty() ? m_tiles + TileView::Offset(c, r, m_tilesAcross) : m_rows[r] + c * 3;
+}
+
+
+//
+// Name :         CGrTexture::NewLevel()
+// Description :  Allocate a sampling level in the current layout.
+//
+
+CGrTexture::Level *CGrTexture::NewLevel(int p_width, int p_height) const
+{
+    Level *level = new Level;
+    level->m_width = p_width;
+    level->m_height = p_height;
+    level->m_tilesAcross = TileView::TilesAcross(p_width);
+    level->m_tiles = NULL;
+
+    if(m_layout == TILED)
+    {
+        // Whole tiles, with room to align the first one to a cache line
+        int tilesDown = (p_height + TileView::MASK) >> TileView::SHIFT;
+        level->m_texels.resize(level->m_tilesAcross * tilesDown * TileView::SIZE * TileView::SIZE * 4 + 63);
+        uintptr_t base = reinterpret_cast<uintptr_t>(&level->m_texels[0]);
+        level->m_tiles = &level->m_texels[0] + ((64 - (base & 63)) & 63);
+    }
+    else
+    {
+        level->m_texels.resize(p_width * p_height * 3);
+        for(int r=0;  r<p_height;  r++)
+            level->m_rows.push_back(&level->m_texels[r * p_width * 3]);
+    }
+
+    return level;
+}
+
+
+//
+// Name :         CGrTexture::BuildLevels()
+// Description :  Build what sampling reads.  In the ROWS layout the top
+//                level is the image rows themselves.  Each mip level is
+//                the average of the 2x2 blocks of the level above.  An 
+//                odd last row or column is dropped, as in the OpenGL box
+//                filter.
+//
+
+void CGrTexture::BuildLevels()
+{
+    m_levels.clear();
+    if(Empty() || (m_layout == ROWS && !m_mipmapped))
+        return;
+
+    Level *top = NewLevel(m_width, m_height);
+    m_levels.push_back(unique_ptr<Level>(top));
+    if(m_layout == ROWS)
+    {
+        top->m_texels.clear();
+        top->m_rows.assign(m_image, m_image + m_height);
+    }
+    else
+    {
+        for(int r=0;  r<m_height;  r++)
+        {
+            for(int c=0;  c<m_width;  c++)
+            {
+                BYTE *texel = top->Texel(c, r);
+                texel[0] = m_image[r][c * 3];
+                texel[1] = m_image[r][c * 3 + 1];
+                texel[2] = m_image[r][c * 3 + 2];
+                texel[3] = 255;
+            }
+        }
+    }
+
+    if(!m_mipmapped)
+        return;
+
+    const Level *src = top;
+    while(src->m_width > 1 || src->m_height > 1)
+    {
+        int width = src->m_width > 1 ? src->m_width / 2 : 1;
+        int height = src->m_height > 1 ? src->m_height / 2 : 1;
+        Level *level = NewLevel(width, height);
+
+        for(int r=0;  r<height;  r++)
+        {
+            int r0 = r * 2 < src->m_height ? r * 2 : src->m_height - 1;
+            int r1 = r * 2 + 1 < src->m_height ? r * 2 + 1 : src->m_height - 1;
+            for(int c=0;  c<width;  c++)
+            {
+                int c0 = c * 2 < src->m_width ? c * 2 : src->m_width - 1;
+                int c1 = c * 2 + 1 < src->m_width ? c * 2 + 1 : src->m_width - 1;
+
+                const BYTE *a = src->Texel(c0, r0);
+                const BYTE *b = src->Texel(c1, r0);
+                const BYTE *d = src->Texel(c0, r1);
+                const BYTE *e = src->Texel(c1, r1);
+
+                BYTE *texel = level->Texel(c, r);
+                for(int i=0;  i<3;  i++)
+                    texel[i] = BYTE((a[i] + b[i] + d[i] + e[i] + 2) / 4);
+                if(m_layout == TILED)
+                    texel[3] = 255;
+            }
+        }
+
+        m_levels.push_back(unique_ptr<Level>(level));
+        src = level;
+    }
+}
+
+
+//
+// Name :         CGrTexture::SampleLevel()
+// Description :  Lookup at a fractional level of detail, blending the
+//                bilinear lookups of the levels on either side.
+//
+
+void CGrTexture::SampleLevel(double p_lod, double u, double v, float *p_rgb) const
+{
+    int last = MipLevels() - 1;
+    if(p_lod <= 0 || last == 0)
+    {
+        SampleBilinear(u, v, p_rgb);
+        return;
+    }
+
+    int l = p_lod < last ? int(p_lod) : last;
+    if(l == last)
+    {
+        if(m_layout == TILED)
+            Bilinear(TileView(*m_levels[l]), u, v, p_rgb);
+        else
+            Bilinear(RowView(&m_levels[l]->m_rows[0], MipWidth(l), MipHeight(l)), u, v, p_rgb);
+        return;
+    }
+
+    float f = float(p_lod - l);
+    if(m_layout == TILED)
+        Trilinear(TileView(*m_levels[l]), TileView(*m_levels[l + 1]), f, u, v, p_rgb);
+    else
+        Trilinear(RowView(&m_levels[l]->m_rows[0], MipWidth(l), MipHeight(l)), 
+            RowView(&m_levels[l + 1]->m_rows[0], MipWidth(l + 1), MipHeight(l + 1)), f, u, v, p_rgb);
+}
+
+
+void CGrTexture::SampleTrilinear(double u, double v, double dudx, double dvdx, 
+        double dudy, double dvdy, float *p_rgb) const
+{
+    SampleLevel(TrilinearLod(m_width, m_height, dudx, dvdx, dudy, dvdy), u, v, p_rgb);
+}
+
+
+void CGrTexture::SampleAnisotropic(double u, double v, double dudx, double dvdx, 
+        double dudy, double dvdy, float *p_rgb, int p_maxAniso) const
+{
+    Anisotropic([this](double p_lod, double s, double t, float *p_sample) {SampleLevel(p_lod, s, t, p_sample);},
+        m_width, m_height, u, v, dudx, dvdx, dudy, dvdy, p_rgb, p_maxAniso);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Generic file and memory reading operations
 //////////////////////////////////////////////////////////////////////
@@ -307,6 +553,17 @@ bool CGrTexture::LoadMemory(const BYTE *image,
 
 bool CGrTexture::LoadFile(const _TCHAR *pFilename)
 {
+    // The usual case is decoded straight from a mapping of the file.
+    // Anything it cannot read goes the long way, which explains why.
+    CGrImageFile image;
+    if(image.Open(pFilename))
+    {
+        SetSize(image.Width(), image.Height());
+        for(int r=0;  r<m_height;  r++)
+            image.ReadRGB(r, 0, m_width, m_image[r]);
+        return true;
+    }
+
     string filename;
 
 #ifdef UNICODE
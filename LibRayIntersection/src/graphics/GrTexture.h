@@ -16,9 +16,11 @@
 #include "GrObject.h"
 #include <fstream>
 #include <GL/gl.h>
+#include <memory>
 #include <valarray>
+#include <vector>
 
-class CGrTexture : public CGrObject
+class CGrTexture : public CGrObject, public ITexture
 {
 public:
     CGrTexture();
@@ -51,6 +53,65 @@ public:
     int Height() const {return m_height;}
     BYTE *ImageBits() const {return m_image[0];}
 
+    // Bytes held for the image and what sampling reads
+    size_t MemorySize() const;
+
+    // Texture lookup with the texture repeated in u and v.  These
+    // return the RGB color in the range 0 to 1 by value and never 
+    // allocate.  They read the sampling levels described below, or 
+    // the image rows if there are none.
+    CGrPoint SampleNearest(double u, double v) const
+    {
+        float rgb[3];
+        SampleNearest(u, v, rgb);
+        return CGrPoint(rgb[0], rgb[1], rgb[2]);
+    }
+
+    CGrPoint SampleBilinear(double u, double v) const
+    {
+        float rgb[3];
+        SampleBilinear(u, v, rgb);
+        return CGrPoint(rgb[0], rgb[1], rgb[2]);
+    }
+
+    void SampleNearest(double u, double v, float *p_rgb) const;
+    void SampleBilinear(double u, double v, float *p_rgb) const;
+
+    // Sample p_count (u, v) pairs from p_uv into p_count RGB triples
+    // in p_rgb.
+    void SampleBatch(int p_count, const double *p_uv, float *p_rgb, bool p_bilinear=true) const;
+
+    // The layout of the copy of the image that sampling reads.  ROWS
+    // reads the image rows.  TILED keeps a copy in 4x4 tiles of RGBA 
+    // texels, 64 bytes to a tile, so a lookup that moves in v stays in
+    // the same cache line.  Row() and operator[] always address the 
+    // rows, whatever the layout.
+    enum Layout {ROWS, TILED};
+    void SetLayout(Layout p_layout);
+    Layout GetLayout() const {return m_layout;}
+
+    // Mip mapping on the CPU.  GenerateMipmaps() builds a pyramid where
+    // each level is a 2x2 box filter of the one above it, in the current
+    // layout.  Anything that resizes, reloads, or sets the image discards
+    // the pyramid and the tiled copy, and writes through Row() need 
+    // another GenerateMipmaps() or SetLayout().
+    void GenerateMipmaps();
+    int MipLevels() const {return m_levels.empty() ? 1 : int(m_levels.size());}
+    int MipWidth(int p_level) const {return m_levels.empty() ? m_width : m_levels[p_level]->m_width;}
+    int MipHeight(int p_level) const {return m_levels.empty() ? m_height : m_levels[p_level]->m_height;}
+
+    // Lookups over a pixel footprint, given as the change in (u, v) per
+    // pixel in x and y.  Trilinear blends the two levels nearest the
+    // footprint size.  Anisotropic takes up to p_maxAniso trilinear
+    // samples along the long axis of the footprint at the level of the
+    // short axis.  Without a pyramid both are bilinear lookups.
+    void SampleTrilinear(double u, double v, double dudx, double dvdx, 
+        double dudy, double dvdy, float *p_rgb) const;
+    void SampleAnisotropic(double u, double v, double dudx, double dvdx, 
+        double dudy, double dvdy, float *p_rgb, int p_maxAniso=8) const;
+
+    // The original lookups, which return nullptr outside the texture.
+    // Prefer the functions above in anything called per pixel.
     shared_ptr<CGrPoint> Sample(double u, double v, bool smoothResult = false)
     {
         auto c = int(u * Width());
@@ -77,6 +138,27 @@ public:
     }
 
 private:
+    // A level that sampling reads, either as rows of RGB texels or as
+    // tiles of RGBA texels.  RowView and TileView in GrTextureSampling.h
+    // address the two layouts.
+    struct Level
+    {
+        int                 m_width;
+        int                 m_height;
+        int                 m_tilesAcross;
+        std::vector<BYTE>   m_texels;
+        std::vector<BYTE *> m_rows;         // ROWS layout
+        BYTE               *m_tiles;        // TILED layout, 64 byte aligned
+
+        BYTE *Texel(int c, int r) const;
+    };
+
+    void Invalidate() {if(!m_levels.empty()) {m_levels.clear();}  m_mipmapped = false;}
+    void BuildLevels();
+    Level *NewLevel(int p_width, int p_height) const;
+    bool Tiled() const {return m_layout == TILED && !m_levels.empty();}
+    void SampleLevel(double p_lod, double u, double v, float *p_rgb) const;
+
     bool ReadDIBFile(std::istream &file);
     bool ReadPPMFile(std::istream &file);
 
@@ -86,6 +168,10 @@ private:
     int     m_height;
     int     m_width;
     BYTE  **m_image;
+
+    Layout  m_layout;
+    bool    m_mipmapped;
+    std::vector<std::unique_ptr<Level> > m_levels;    // What sampling reads
 };
 
 #endif 
@@ -0,0 +1,302 @@
+//
+// Name :         GrTextureCache.cpp
+// Description :  Implementation of CGrTextureCache, a process-wide cache
+//                of loaded texture images.
+//
+
+#include "stdafx.h"
+#include "GrTextureCache.h"
+#include "WorkStealingPool.h"
+
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+CGrTextureCache::CGrTextureCache()
+{
+    m_budget = 0;
+    m_bytes = 0;
+}
+
+
+CGrTextureCache &CGrTextureCache::Instance()
+{
+    static CGrTextureCache cache;
+    return cache;
+}
+
+
+//
+// Name :         CGrTextureCache::FileKey()
+// Description :  The key and modification time of an image file, false
+//                if we cannot tell what file it is.
+//
+
+bool CGrTextureCache::FileKey(const _TCHAR *p_filename, string &p_key, fs::file_time_type &p_modified)
+{
+    error_code error;
+    fs::path path = fs::canonical(fs::path(p_filename), error);
+    if(!error)
+        p_modified = fs::last_write_time(path, error);
+
+    if(error)
+        return false;
+
+    p_key = "file:" + path.u8string();
+    return true;
+}
+
+
+//
+// Name :         CGrTextureCache::Load()
+// Description :  Load an image file, or return the texture we already
+//                loaded from it if the file has not changed since.
+//
+
+CGrPtr<CGrTexture> CGrTextureCache::Load(const _TCHAR *p_filename)
+{
+    string key;
+    fs::file_time_type modified;
+
+    // LoadFile() reports the files it cannot open
+    if(!FileKey(p_filename, key, modified))
+    {
+        CGrPtr<CGrTexture> texture = new CGrTexture;
+        if(!texture->LoadFile(p_filename))
+            texture.Clear();
+        return texture;
+    }
+
+    CGrPtr<CGrTexture> texture = Find(key, modified);
+    if(texture != NULL)
+        return texture;
+
+    // Decode without holding the lock, so other images can load meanwhile
+    texture = new CGrTexture;
+    if(!texture->LoadFile(p_filename))
+        return CGrPtr<CGrTexture>();
+
+    return Add(key, modified, texture);
+}
+
+
+//
+// Name :         CGrTextureCache::LoadFiles()
+// Description :  Only the decoding runs on the pool.  Each task has its
+//                own texture, and the textures are found and added to
+//                the cache on this thread, because reference counts 
+//                are not atomic.
+//
+
+void CGrTextureCache::LoadFiles(int p_count, const _TCHAR * const *p_filenames, 
+                                CGrPtr<CGrTexture> *p_textures, int p_threads)
+{
+    vector<string> keys(p_count);
+    vector<fs::file_time_type> modified(p_count);
+    vector<bool> known(p_count);
+    vector<int> decode;
+
+    for(int i=0;  i<p_count;  i++)
+    {
+        known[i] = FileKey(p_filenames[i], keys[i], modified[i]);
+        p_textures[i] = known[i] ? Find(keys[i], modified[i]) : CGrPtr<CGrTexture>();
+        if(p_textures[i] == NULL)
+            decode.push_back(i);
+    }
+
+    vector<CGrTexture *> decoded(decode.size(), NULL);
+    vector<char> loaded(decode.size(), false);
+    if(!decode.empty())
+    {
+        CWorkStealingPool pool(p_threads);
+        pool.Run(int(decode.size()), [&](int p_task, int /*p_worker*/) {
+            decoded[p_task] = new CGrTexture;
+            loaded[p_task] = decoded[p_task]->LoadFile(p_filenames[decode[p_task]]);
+        });
+    }
+
+    for(size_t d=0;  d<decode.size();  d++)
+    {
+        int i = decode[d];
+        CGrPtr<CGrTexture> texture = decoded[d];
+        if(!loaded[d])
+            p_textures[i].Clear();
+        else if(known[i])
+            p_textures[i] = Add(keys[i], modified[i], texture);
+        else
+            p_textures[i] = texture;
+    }
+}
+
+
+//
+// Name :         CGrTextureCache::LoadMemory()
+// Description :  Images in memory have no file to name them, so they
+//                are keyed by a hash of their texels and compared in
+//                full when the hash matches.
+//
+
+CGrPtr<CGrTexture> CGrTextureCache::LoadMemory(const BYTE *image, int width, int height,
+                    int colpitch, int rowpitch, bool repeatS, bool repeatT, bool transparency)
+{
+    CGrPtr<CGrTexture> texture = new CGrTexture;
+    texture->LoadMemory(image, width, height, colpitch, rowpitch, repeatS, repeatT, transparency);
+
+    // FNV-1a
+    unsigned long long hash = 14695981039346656037ULL;
+    for(int r=0;  r<height;  r++)
+    {
+        const BYTE *row = texture->Row(r);
+        for(int i=0;  i<width * 3;  i++)
+            hash = (hash ^ row[i]) * 1099511628211ULL;
+    }
+
+    ostringstream key;
+    key << "memory:" << width << "x" << height << ":" << hex << hash;
+
+    // A key is only reused for identical texels
+    for(int n=0;  ;  n++)
+    {
+        ostringstream probe;
+        probe << key.str() << ":" << n;
+
+        CGrPtr<CGrTexture> cached = Find(probe.str(), fs::file_time_type());
+        if(cached == NULL)
+            return Add(probe.str(), fs::file_time_type(), texture);
+
+        bool same = true;
+        for(int r=0;  r<height && same;  r++)
+            same = memcmp(cached->Row(r), texture->Row(r), width * 3) == 0;
+
+        if(same)
+            return cached;
+    }
+}
+
+
+CGrPtr<CGrTexture> CGrTextureCache::Find(const string &p_key, fs::file_time_type p_modified)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    map<string, Entries::iterator>::iterator found = m_index.find(p_key);
+    if(found == m_index.end())
+        return CGrPtr<CGrTexture>();
+
+    // A file that changed is loaded again
+    if(found->second->m_modified != p_modified)
+    {
+        Remove(found->second);
+        return CGrPtr<CGrTexture>();
+    }
+
+    // Most recently used
+    m_entries.splice(m_entries.begin(), m_entries, found->second);
+    return found->second->m_texture;
+}
+
+
+//
+// Name :         CGrTextureCache::Add()
+// Description :  Add a texture we loaded.  If another thread loaded the
+//                same key while we were decoding, we use its texture.
+//
+
+CGrPtr<CGrTexture> CGrTextureCache::Add(const string &p_key, fs::file_time_type p_modified, CGrTexture *p_texture)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    map<string, Entries::iterator>::iterator found = m_index.find(p_key);
+    if(found != m_index.end())
+    {
+        if(found->second->m_modified == p_modified)
+            return found->second->m_texture;
+
+        Remove(found->second);
+    }
+
+    Entry entry;
+    entry.m_key = p_key;
+    entry.m_modified = p_modified;
+    entry.m_texture = p_texture;
+    entry.m_bytes = p_texture->MemorySize();
+
+    m_entries.push_front(entry);
+    m_index[p_key] = m_entries.begin();
+    m_bytes += entry.m_bytes;
+
+    CGrPtr<CGrTexture> texture = p_texture;
+    Evict(m_budget);
+    return texture;
+}
+
+
+void CGrTextureCache::Remove(Entries::iterator p_entry)
+{
+    m_bytes -= p_entry->m_bytes;
+    m_index.erase(p_entry->m_key);
+    m_entries.erase(p_entry);
+}
+
+
+//
+// Name :         CGrTextureCache::Evict()
+// Description :  Remove the least recently used textures until we are
+//                within the budget.  Textures that something else holds
+//                stay, since removing them would not free any memory.
+//
+
+void CGrTextureCache::Evict(size_t p_budget)
+{
+    if(p_budget == 0)
+        return;
+
+    Entries::iterator entry = m_entries.end();
+    while(entry != m_entries.begin() && m_bytes > p_budget)
+    {
+        Entries::iterator previous = entry;
+        previous--;
+
+        if(previous->m_texture->RefCnt() == 1)
+            Remove(previous);
+        else
+            entry = previous;
+    }
+}
+
+
+void CGrTextureCache::SetBudget(size_t p_bytes)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_budget = p_bytes;
+    Evict(m_budget);
+}
+
+
+void CGrTextureCache::Purge()
+{
+    lock_guard<mutex> lock(m_mutex);
+    for(Entries::iterator entry=m_entries.begin();  entry!=m_entries.end();  )
+    {
+        Entries::iterator next = entry;
+        next++;
+        if(entry->m_texture->RefCnt() == 1)
+            Remove(entry);
+        entry = next;
+    }
+}
+
+
+size_t CGrTextureCache::MemoryUsed() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+
+int CGrTextureCache::Count() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return int(m_entries.size());
+}
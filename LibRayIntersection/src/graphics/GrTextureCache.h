@@ -0,0 +1,95 @@
+//
+// Name :         GrTextureCache.h
+// Description :  Header file for CGrTextureCache, a process-wide cache
+//                of loaded texture images.
+//                See GrTextureCache.cpp
+//
+
+#ifndef _GRTEXTURECACHE_H
+#define _GRTEXTURECACHE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "GrObject.h"
+#include "GrTexture.h"
+#include <filesystem>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+//
+// class CGrTextureCache
+// Loading the same image file twice returns the same CGrTexture,
+// so each image is decoded and held in memory only once.  Files are
+// keyed by canonical path and modification time, so an edited file
+// is loaded again.  Images from memory, such as the textures of a
+// VRML file, are keyed by their contents.
+//
+// The textures are shared, so treat them as read only.  Setting a
+// memory budget evicts the least recently used textures that nothing
+// else holds.  The cache may be used from any thread, but CGrPtr
+// reference counts are not atomic, so each texture should only be
+// held by one thread at a time.
+//
+
+class CGrTextureCache
+{
+public:
+    static CGrTextureCache &Instance();
+
+    // Load an image file, NULL if it cannot be loaded
+    CGrPtr<CGrTexture> Load(const _TCHAR *p_filename);
+
+    // Load p_count image files into p_textures, decoding the ones that
+    // are not cached on p_threads threads at once, 0 for one per 
+    // hardware thread.  For loading the textures of a scene up front.
+    void LoadFiles(int p_count, const _TCHAR * const *p_filenames, 
+                   CGrPtr<CGrTexture> *p_textures, int p_threads=0);
+
+    // The same arguments as CGrTexture::LoadMemory()
+    CGrPtr<CGrTexture> LoadMemory(const BYTE *image, int width, int height,
+                    int colpitch, int rowpitch, bool repeatS, bool repeatT, bool transparency);
+
+    // Memory budget in bytes, 0 for no limit.  Textures are counted at
+    // their size when they were loaded.
+    void SetBudget(size_t p_bytes);
+    size_t GetBudget() const {return m_budget;}
+
+    size_t MemoryUsed() const;
+    int Count() const;
+
+    // Remove everything that nothing else holds
+    void Purge();
+
+private:
+    CGrTextureCache();
+    CGrTextureCache(const CGrTextureCache &);
+    CGrTextureCache &operator=(const CGrTextureCache &);
+
+    struct Entry
+    {
+        std::string         m_key;
+        std::filesystem::file_time_type m_modified;
+        CGrPtr<CGrTexture>  m_texture;
+        size_t              m_bytes;
+    };
+
+    typedef std::list<Entry> Entries;
+
+    bool FileKey(const _TCHAR *p_filename, std::string &p_key, std::filesystem::file_time_type &p_modified);
+    CGrPtr<CGrTexture> Find(const std::string &p_key, std::filesystem::file_time_type p_modified);
+    CGrPtr<CGrTexture> Add(const std::string &p_key, std::filesystem::file_time_type p_modified, CGrTexture *p_texture);
+    void Remove(Entries::iterator p_entry);
+    void Evict(size_t p_budget);
+
+    mutable std::mutex  m_mutex;
+    Entries             m_entries;      // Most recently used first
+    std::map<std::string, Entries::iterator> m_index;
+    size_t              m_budget;
+    size_t              m_bytes;
+};
+
+#endif
@@ -0,0 +1,181 @@
+//
+// Name :         GrTextureSampling.h
+// Description :  Texture lookups shared by CGrTexture and CGrTiledTexture.
+//                A view is anything with m_width, m_height, and a
+//                Texel(c, r) that returns the RGB bytes of a texel.
+//                Not part of the public interface.
+//
+
+#ifndef _GRTEXTURESAMPLING_H
+#define _GRTEXTURESAMPLING_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <cmath>
+
+const float TOUNIT = 1.f / 255.f;
+
+// A level stored as rows of RGB texels
+struct RowView
+{
+    RowView(const BYTE * const *p_rows, int p_width, int p_height) : m_rows(p_rows), m_width(p_width), m_height(p_height) {}
+    const BYTE *Texel(int c, int r) const {return m_rows[r] + c * 3;}
+
+    const BYTE * const *m_rows;
+    int m_width;
+    int m_height;
+};
+
+// A level stored as 4x4 tiles of RGBA texels, 64 bytes to a tile, row
+// of tiles after row of tiles.  Partial tiles at the edges are whole
+// tiles in memory.
+struct TileView
+{
+    enum {SHIFT = 2, SIZE = 1 << SHIFT, MASK = SIZE - 1};
+
+    // Byte offset of texel (c, r)
+    static int Offset(int c, int r, int p_tilesAcross)
+    {
+        return ((((r >> SHIFT) * p_tilesAcross + (c >> SHIFT)) << (2 * SHIFT)) 
+            + ((r & MASK) << SHIFT) + (c & MASK)) * 4;
+    }
+
+    static int TilesAcross(int p_width) {return (p_width + MASK) >> SHIFT;}
+
+    TileView(const BYTE *p_tiles, int p_width, int p_height) : m_tiles(p_tiles), m_tilesAcross(TilesAcross(p_width)), 
+        m_width(p_width), m_height(p_height) {}
+    template<class Level> explicit TileView(const Level &p_level) : m_tiles(p_level.m_tiles), 
+        m_tilesAcross(p_level.m_tilesAcross), m_width(p_level.m_width), m_height(p_level.m_height) {}
+    const BYTE *Texel(int c, int r) const {return m_tiles + Offset(c, r, m_tilesAcross);}
+
+    const BYTE *m_tiles;
+    int m_tilesAcross;
+    int m_width;
+    int m_height;
+};
+
+// The texel index for a repeating texture coordinate
+inline int WrapIndex(double t, int p_size)
+{
+    int i = int((t - floor(t)) * p_size);
+    return i < p_size ? i : p_size - 1;
+}
+
+//
+// Name :         Nearest(), Bilinear()
+// Description :  Lookups in one level, for any view of a level.
+//                Texel centers are at (i + 0.5) / size and the texture
+//                repeats, so the edges blend with the opposite side.
+//
+
+template<class View> void Nearest(const View &p_view, double u, double v, float *p_rgb)
+{
+    const BYTE *texel = p_view.Texel(WrapIndex(u, p_view.m_width), WrapIndex(v, p_view.m_height));
+    p_rgb[0] = texel[0] * TOUNIT;
+    p_rgb[1] = texel[1] * TOUNIT;
+    p_rgb[2] = texel[2] * TOUNIT;
+}
+
+template<class View> void Bilinear(const View &p_view, double u, double v, float *p_rgb)
+{
+    double x = (u - floor(u)) * p_view.m_width - 0.5;
+    double y = (v - floor(v)) * p_view.m_height - 0.5;
+    double x0 = floor(x);
+    double y0 = floor(y);
+    float fx = float(x - x0);
+    float fy = float(y - y0);
+
+    // x0 and y0 are at least -1 and at most size - 1
+    int c0 = x0 < 0 ? p_view.m_width - 1 : int(x0);
+    int c1 = c0 + 1 < p_view.m_width ? c0 + 1 : 0;
+    int r0 = y0 < 0 ? p_view.m_height - 1 : int(y0);
+    int r1 = r0 + 1 < p_view.m_height ? r0 + 1 : 0;
+
+    const BYTE *a = p_view.Texel(c0, r0);
+    const BYTE *b = p_view.Texel(c1, r0);
+    const BYTE *c = p_view.Texel(c0, r1);
+    const BYTE *d = p_view.Texel(c1, r1);
+
+    for(int i=0;  i<3;  i++)
+    {
+        float bottom = a[i] + (b[i] - a[i]) * fx;
+        float top = c[i] + (d[i] - c[i]) * fx;
+        p_rgb[i] = (bottom + (top - bottom) * fy) * TOUNIT;
+    }
+}
+
+template<class View> void Trilinear(const View &p_fine, const View &p_coarse, float f,
+                                    double u, double v, float *p_rgb)
+{
+    float coarse[3];
+    Bilinear(p_fine, u, v, p_rgb);
+    Bilinear(p_coarse, u, v, coarse);
+    for(int i=0;  i<3;  i++)
+        p_rgb[i] += (coarse[i] - p_rgb[i]) * f;
+}
+
+//
+// Name :         TrilinearLod()
+// Description :  The level of detail is where the longer side of the
+//                footprint is one texel.
+//
+
+inline double TrilinearLod(int p_width, int p_height, double dudx, double dvdx,
+                           double dudy, double dvdy)
+{
+    double lx = sqrt(dudx * dudx * p_width * p_width + dvdx * dvdx * p_height * p_height);
+    double ly = sqrt(dudy * dudy * p_width * p_width + dvdy * dvdy * p_height * p_height);
+    double rho = lx > ly ? lx : ly;
+    return rho > 1 ? log2(rho) : 0;
+}
+
+//
+// Name :         Anisotropic()
+// Description :  A long thin footprint is covered with several samples
+//                along its long axis, each at the level of detail of the
+//                short axis, instead of one blurry sample.  p_level is
+//                called as p_level(lod, u, v, rgb) for each sample.
+//
+
+template<class Level> void Anisotropic(const Level &p_level, int p_width, int p_height,
+        double u, double v, double dudx, double dvdx, double dudy, double dvdy,
+        float *p_rgb, int p_maxAniso)
+{
+    double lx = sqrt(dudx * dudx * p_width * p_width + dvdx * dvdx * p_height * p_height);
+    double ly = sqrt(dudy * dudy * p_width * p_width + dvdy * dvdy * p_height * p_height);
+
+    double major = lx > ly ? lx : ly;
+    double minor = lx > ly ? ly : lx;
+    double du = lx > ly ? dudx : dudy;
+    double dv = lx > ly ? dvdx : dvdy;
+
+    int n = 1;
+    if(major > 1)
+    {
+        double ratio = minor > 0 ? major / minor : p_maxAniso;
+        n = ratio < p_maxAniso ? int(ceil(ratio)) : p_maxAniso;
+        if(n < 1)
+            n = 1;
+    }
+
+    double rho = major / n;
+    double lod = rho > 1 ? log2(rho) : 0;
+
+    p_rgb[0] = p_rgb[1] = p_rgb[2] = 0;
+    for(int s=0;  s<n;  s++)
+    {
+        double f = (s + 0.5) / n - 0.5;
+
+        float rgb[3];
+        p_level(lod, u + du * f, v + dv * f, rgb);
+        for(int i=0;  i<3;  i++)
+            p_rgb[i] += rgb[i];
+    }
+
+    for(int i=0;  i<3;  i++)
+        p_rgb[i] /= n;
+}
+
+#endif
@@ -0,0 +1,778 @@
+//
+// Name :         GrTiledTexture.cpp
+// Description :  Implementation of CGrTiledTexture, a texture streamed
+//                from disk in tiles, and CGrTilePool, the memory the
+//                tiles share.
+//
+
+#include "stdafx.h"
+#include "GrTiledTexture.h"
+#include "GrImageFile.h"
+#include "GrTextureSampling.h"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+const int TILESHIFT = CGrTiledTexture::TILESHIFT;
+const int TILESIZE = CGrTiledTexture::TILESIZE;
+const int TILEMASK = CGrTiledTexture::TILEMASK;
+const int TILEBYTES = CGrTiledTexture::TILEBYTES;
+
+// A tile file starts with this, the tile size, the level count, and
+// the size of the top level, padded to 64 bytes so the tiles that
+// follow are aligned to cache lines
+const char TILEMAGIC[8] = {'G', 'R', 'T', 'I', 'L', 'E', 'S', '1'};
+const int TILEHEADER = 64;
+
+// Texel (c, r) of a tile of RGBA rows
+inline int TexelOffset(int c, int r)
+{
+    return (((r & TILEMASK) << TILESHIFT) + (c & TILEMASK)) * 4;
+}
+
+inline int TilesAcross(int p_width)
+{
+    return (p_width + TILEMASK) >> TILESHIFT;
+}
+
+// The size of each mip level, the same as CGrTexture::BuildLevels()
+static void LevelSizes(int p_width, int p_height, vector<int> &p_widths, vector<int> &p_heights)
+{
+    p_widths.assign(1, p_width);
+    p_heights.assign(1, p_height);
+    while(p_widths.back() > 1 || p_heights.back() > 1)
+    {
+        p_widths.push_back(p_widths.back() > 1 ? p_widths.back() / 2 : 1);
+        p_heights.push_back(p_heights.back() > 1 ? p_heights.back() / 2 : 1);
+    }
+}
+
+static unsigned LittleEndian(const BYTE *p, int p_bytes)
+{
+    unsigned value = 0;
+    for(int i=p_bytes-1;  i>=0;  i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Tile sources
+//////////////////////////////////////////////////////////////////////
+
+//
+// class CGrTileSource
+// Reads tiles from a mapped file.  Tiles are RGBA rows, bottom row
+// first, and the part of a tile past the edge of the level is zero.
+// Reading does not change the source, so any thread may read.
+//
+
+class CGrTileSource
+{
+public:
+    virtual ~CGrTileSource() {}
+
+    virtual void ReadTile(int p_level, int p_tx, int p_ty, BYTE *p_tile) const = 0;
+
+    vector<int>     m_widths;
+    vector<int>     m_heights;
+};
+
+
+//
+// class CGrImageTileSource
+// The single level of a PPM or BMP file, converted to RGBA as it is
+// read.
+//
+
+class CGrImageTileSource : public CGrTileSource
+{
+public:
+    bool Open(const _TCHAR *p_filename);
+    virtual void ReadTile(int p_level, int p_tx, int p_ty, BYTE *p_tile) const;
+
+private:
+    CGrImageFile    m_image;
+};
+
+
+bool CGrImageTileSource::Open(const _TCHAR *p_filename)
+{
+    if(!m_image.Open(p_filename))
+        return false;
+
+    m_widths.assign(1, m_image.Width());
+    m_heights.assign(1, m_image.Height());
+    return true;
+}
+
+
+void CGrImageTileSource::ReadTile(int /*p_level*/, int p_tx, int p_ty, BYTE *p_tile) const
+{
+    int c0 = p_tx * TILESIZE;
+    int r0 = p_ty * TILESIZE;
+    int cols = m_widths[0] - c0 < TILESIZE ? m_widths[0] - c0 : TILESIZE;
+    int rows = m_heights[0] - r0 < TILESIZE ? m_heights[0] - r0 : TILESIZE;
+
+    if(cols < TILESIZE || rows < TILESIZE)
+        memset(p_tile, 0, TILEBYTES);
+
+    for(int r=0;  r<rows;  r++)
+        m_image.ReadRGBA(r0 + r, c0, cols, p_tile + TexelOffset(0, r));
+}
+
+
+//
+// class CGrTileFileSource
+// A file from CGrTiledTexture::WriteTileFile().  Every level is stored
+// as whole tiles in the order they are read, so a tile is a copy.
+//
+
+class CGrTileFileSource : public CGrTileSource
+{
+public:
+    bool Open(const _TCHAR *p_filename);
+    virtual void ReadTile(int p_level, int p_tx, int p_ty, BYTE *p_tile) const;
+
+private:
+    CGrMappedFile   m_file;
+    vector<size_t>  m_offsets;      // Of each level
+};
+
+
+bool CGrTileFileSource::Open(const _TCHAR *p_filename)
+{
+    if(!m_file.Open(p_filename) || m_file.Size() < TILEHEADER)
+        return false;
+
+    const BYTE *data = m_file.Data();
+    if(memcmp(data, TILEMAGIC, sizeof(TILEMAGIC)) != 0)
+        return false;
+
+    int tileSize = int(LittleEndian(data + 8, 4));
+    int levels = int(LittleEndian(data + 12, 4));
+    int width = int(LittleEndian(data + 16, 4));
+    int height = int(LittleEndian(data + 20, 4));
+    if(tileSize != TILESIZE || width <= 0 || height <= 0)
+        return false;
+
+    LevelSizes(width, height, m_widths, m_heights);
+    if(levels != int(m_widths.size()))
+        return false;
+
+    size_t offset = TILEHEADER;
+    for(int l=0;  l<levels;  l++)
+    {
+        m_offsets.push_back(offset);
+        offset += size_t(TilesAcross(m_widths[l])) * TilesAcross(m_heights[l]) * TILEBYTES;
+    }
+
+    return offset <= m_file.Size();
+}
+
+
+void CGrTileFileSource::ReadTile(int p_level, int p_tx, int p_ty, BYTE *p_tile) const
+{
+    size_t tile = size_t(p_ty) * TilesAcross(m_widths[p_level]) + p_tx;
+    memcpy(p_tile, m_file.Data() + m_offsets[p_level] + tile * TILEBYTES, TILEBYTES);
+}
+
+//////////////////////////////////////////////////////////////////////
+// CGrTilePool
+//////////////////////////////////////////////////////////////////////
+
+CGrTilePool::CGrTilePool()
+{
+    m_capacity = 64 << 20;
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+    m_loading = false;
+    m_stop = false;
+}
+
+
+CGrTilePool::~CGrTilePool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_wake.notify_all();
+    if(m_loader.joinable())
+        m_loader.join();
+}
+
+
+CGrTilePool &CGrTilePool::Instance()
+{
+    static CGrTilePool pool;
+    return pool;
+}
+
+
+void CGrTilePool::SetCapacity(size_t p_bytes)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_capacity = p_bytes > size_t(TILEBYTES) ? p_bytes : size_t(TILEBYTES);
+    Evict();
+}
+
+
+size_t CGrTilePool::GetCapacity() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_capacity;
+}
+
+
+size_t CGrTilePool::MemoryUsed() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_entries.size() * TILEBYTES;
+}
+
+
+int CGrTilePool::Resident() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return int(m_entries.size());
+}
+
+
+long long CGrTilePool::Hits() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_hits;
+}
+
+
+long long CGrTilePool::Misses() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_misses;
+}
+
+
+long long CGrTilePool::Evictions() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_evictions;
+}
+
+
+void CGrTilePool::ResetStatistics()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+
+CGrTilePool::Tile CGrTilePool::Find(const Key &p_key)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    map<Key, Entries::iterator>::iterator found = m_index.find(p_key);
+    if(found == m_index.end())
+    {
+        m_misses++;
+        return Tile();
+    }
+
+    // Most recently used
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, found->second);
+    return found->second->m_tile;
+}
+
+
+//
+// Name :         CGrTilePool::Load()
+// Description :  Read a tile without holding the lock, so other
+//                threads keep sampling meanwhile.  If another thread
+//                read the same tile first, we use its copy.
+//
+
+CGrTilePool::Tile CGrTilePool::Load(const Key &p_key, const CGrTileSource &p_source)
+{
+    shared_ptr<vector<BYTE> > tile = make_shared<vector<BYTE> >(TILEBYTES);
+    p_source.ReadTile(p_key.m_level, p_key.m_tx, p_key.m_ty, &(*tile)[0]);
+
+    lock_guard<mutex> lock(m_mutex);
+    return Add(p_key, tile);
+}
+
+
+void CGrTilePool::Request(const Key &p_key, const shared_ptr<const CGrTileSource> &p_source)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if(m_index.find(p_key) != m_index.end() || !m_pending.insert(p_key).second)
+            return;
+
+        LoadRequest request;
+        request.m_key = p_key;
+        request.m_source = p_source;
+        m_requests.push_back(request);
+
+        if(!m_loader.joinable())
+            m_loader = thread(&CGrTilePool::Loader, this);
+    }
+
+    m_wake.notify_one();
+}
+
+
+//
+// Name :         CGrTilePool::Remove()
+// Description :  Drop the tiles of a texture that is closing, and any
+//                it asked for that have not loaded yet.
+//
+
+void CGrTilePool::Remove(unsigned p_texture)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    Key first = {p_texture, -1, 0, 0};
+    Key last = {p_texture + 1, -1, 0, 0};
+
+    map<Key, Entries::iterator>::iterator begin = m_index.lower_bound(first);
+    map<Key, Entries::iterator>::iterator end = m_index.lower_bound(last);
+    for(map<Key, Entries::iterator>::iterator i=begin;  i!=end;  i++)
+        m_entries.erase(i->second);
+    m_index.erase(begin, end);
+
+    m_pending.erase(m_pending.lower_bound(first), m_pending.lower_bound(last));
+    for(deque<LoadRequest>::iterator r=m_requests.begin();  r!=m_requests.end();  )
+    {
+        if(r->m_key.m_texture == p_texture)
+            r = m_requests.erase(r);
+        else
+            r++;
+    }
+}
+
+
+// Called with the lock held
+CGrTilePool::Tile CGrTilePool::Add(const Key &p_key, const Tile &p_tile)
+{
+    map<Key, Entries::iterator>::iterator found = m_index.find(p_key);
+    if(found != m_index.end())
+    {
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        return found->second->m_tile;
+    }
+
+    Entry entry;
+    entry.m_key = p_key;
+    entry.m_tile = p_tile;
+    m_entries.push_front(entry);
+    m_index[p_key] = m_entries.begin();
+
+    Evict();
+    return p_tile;
+}
+
+
+// Called with the lock held.  The most recent tile always stays.
+void CGrTilePool::Evict()
+{
+    while(m_entries.size() > 1 && m_entries.size() * TILEBYTES > m_capacity)
+    {
+        m_index.erase(m_entries.back().m_key);
+        m_entries.pop_back();
+        m_evictions++;
+    }
+}
+
+
+//
+// Name :         CGrTilePool::Loader()
+// Description :  The background thread that reads requested tiles.
+//
+
+void CGrTilePool::Loader()
+{
+    unique_lock<mutex> lock(m_mutex);
+    for(;;)
+    {
+        while(!m_stop && m_requests.empty())
+            m_wake.wait(lock);
+
+        if(m_stop)
+            return;
+
+        LoadRequest request = m_requests.front();
+        m_requests.pop_front();
+        m_loading = true;
+        lock.unlock();
+
+        shared_ptr<vector<BYTE> > tile = make_shared<vector<BYTE> >(TILEBYTES);
+        request.m_source->ReadTile(request.m_key.m_level, request.m_key.m_tx, request.m_key.m_ty, &(*tile)[0]);
+
+        lock.lock();
+        m_loading = false;
+
+        // Unless the texture closed while we read
+        if(m_pending.erase(request.m_key) > 0)
+            Add(request.m_key, tile);
+
+        if(m_requests.empty())
+            m_idle.notify_all();
+    }
+}
+
+
+void CGrTilePool::Flush()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while(!m_requests.empty() || m_loading)
+        m_idle.wait(lock);
+}
+
+//////////////////////////////////////////////////////////////////////
+// CGrTiledTexture
+//////////////////////////////////////////////////////////////////////
+
+// Texture names are never reused, so a tile left in a per thread
+// cache by a texture that closed is never mistaken for a new one
+static atomic<unsigned> s_textureIds(0);
+
+// Tiles each thread keeps, a power of two
+const int THREADTILES = 16;
+
+CGrTiledTexture::CGrTiledTexture()
+{
+    m_id = 0;
+    m_missPolicy = LOAD;
+}
+
+
+CGrTiledTexture::~CGrTiledTexture()
+{
+    Close();
+}
+
+
+// Tiled textures do not render...
+void CGrTiledTexture::glRender()
+{
+}
+
+void CGrTiledTexture::Render(CGrRenderer * /*p_renderer*/)
+{
+}
+
+
+//
+// Name :         CGrTiledTexture::Open()
+// Description :  Map a tile file, or an image file if it is not one.
+//
+
+bool CGrTiledTexture::Open(const _TCHAR *p_filename)
+{
+    Close();
+
+    shared_ptr<CGrTileSource> source;
+    shared_ptr<CGrTileFileSource> tiles = make_shared<CGrTileFileSource>();
+    if(tiles->Open(p_filename))
+        source = tiles;
+    else
+    {
+        shared_ptr<CGrImageTileSource> image = make_shared<CGrImageTileSource>();
+        if(!image->Open(p_filename))
+            return false;
+        source = image;
+    }
+
+    m_id = ++s_textureIds;
+    m_source = source;
+    m_widths = source->m_widths;
+    m_heights = source->m_heights;
+
+    int last = MipLevels() - 1;
+    if(m_widths[last] <= TILESIZE && m_heights[last] <= TILESIZE)
+    {
+        shared_ptr<vector<BYTE> > tile = make_shared<vector<BYTE> >(TILEBYTES);
+        source->ReadTile(last, 0, 0, &(*tile)[0]);
+        m_coarsest = tile;
+    }
+
+    return true;
+}
+
+
+void CGrTiledTexture::Close()
+{
+    if(m_source != NULL)
+        CGrTilePool::Instance().Remove(m_id);
+
+    m_source.reset();
+    m_coarsest.reset();
+    m_widths.clear();
+    m_heights.clear();
+}
+
+
+//
+// Name :         CGrTiledTexture::Lookup()
+// Description :  A tile of ours, from this thread's tiles if we can.
+//                If it is not resident it is read now if p_wait is
+//                true, or else in the background and we return NULL.
+//                The pointer is good until this thread's next lookup.
+//
+
+const vector<BYTE> *CGrTiledTexture::Lookup(int p_level, int p_tx, int p_ty, bool p_wait) const
+{
+    static thread_local CGrTilePool::Entry tiles[THREADTILES];
+
+    CGrTilePool::Key key = {m_id, p_level, p_tx, p_ty};
+    CGrTilePool::Entry &slot = tiles[(p_tx * 7 + p_ty * 13 + p_level * 31) & (THREADTILES - 1)];
+    if(slot.m_tile != NULL && slot.m_key == key)
+        return slot.m_tile.get();
+
+    CGrTilePool &pool = CGrTilePool::Instance();
+    CGrTilePool::Tile tile = pool.Find(key);
+    if(tile == NULL)
+    {
+        if(!p_wait)
+        {
+            pool.Request(key, m_source);
+            return NULL;
+        }
+
+        tile = pool.Load(key, *m_source);
+    }
+
+    slot.m_key = key;
+    slot.m_tile = tile;
+    return slot.m_tile.get();
+}
+
+
+//
+// Name :         CGrTiledTexture::Texel()
+// Description :  Copy the RGB of a texel into p_texel.  When a tile is
+//                missing and we may not wait, the texel of the next
+//                coarser level that covers it stands in.
+//
+
+void CGrTiledTexture::Texel(int p_level, int c, int r, BYTE *p_texel) const
+{
+    int last = MipLevels() - 1;
+    const vector<BYTE> *tile = NULL;
+
+    for(int l=p_level;  ;  l++)
+    {
+        if(l == last && m_coarsest != NULL)
+        {
+            tile = m_coarsest.get();
+            break;
+        }
+
+        tile = Lookup(l, c >> TILESHIFT, r >> TILESHIFT, m_missPolicy == LOAD || l == last);
+        if(tile != NULL)
+            break;
+
+        c = c / 2 < m_widths[l + 1] ? c / 2 : m_widths[l + 1] - 1;
+        r = r / 2 < m_heights[l + 1] ? r / 2 : m_heights[l + 1] - 1;
+    }
+
+    const BYTE *texel = &(*tile)[TexelOffset(c, r)];
+    p_texel[0] = texel[0];
+    p_texel[1] = texel[1];
+    p_texel[2] = texel[2];
+}
+
+//
+// struct CGrTiledTexture::StreamView
+// A level for the sampling code.  Each texel is copied out of its tile,
+// so a lookup does not depend on the tile staying resident.  Bilinear()
+// uses four texels at once.
+//
+
+struct CGrTiledTexture::StreamView
+{
+    StreamView(const CGrTiledTexture &p_texture, int p_level) : m_texture(p_texture), m_level(p_level),
+        m_width(p_texture.MipWidth(p_level)), m_height(p_texture.MipHeight(p_level)), m_next(0) {}
+
+    const BYTE *Texel(int c, int r) const
+    {
+        BYTE *texel = m_texels[m_next++ & 3];
+        m_texture.Texel(m_level, c, r, texel);
+        return texel;
+    }
+
+    const CGrTiledTexture &m_texture;
+    int m_level;
+    int m_width;
+    int m_height;
+
+    mutable BYTE m_texels[4][3];
+    mutable int m_next;
+};
+
+
+void CGrTiledTexture::SampleNearest(double u, double v, float *p_rgb) const
+{
+    Nearest(StreamView(*this, 0), u, v, p_rgb);
+}
+
+
+void CGrTiledTexture::SampleBilinear(double u, double v, float *p_rgb) const
+{
+    Bilinear(StreamView(*this, 0), u, v, p_rgb);
+}
+
+
+void CGrTiledTexture::SampleLevel(double p_lod, double u, double v, float *p_rgb) const
+{
+    int last = MipLevels() - 1;
+    if(p_lod <= 0 || last == 0)
+    {
+        SampleBilinear(u, v, p_rgb);
+        return;
+    }
+
+    int l = p_lod < last ? int(p_lod) : last;
+    if(l == last)
+    {
+        Bilinear(StreamView(*this, l), u, v, p_rgb);
+        return;
+    }
+
+    Trilinear(StreamView(*this, l), StreamView(*this, l + 1), float(p_lod - l), u, v, p_rgb);
+}
+
+
+void CGrTiledTexture::SampleTrilinear(double u, double v, double dudx, double dvdx,
+        double dudy, double dvdy, float *p_rgb) const
+{
+    SampleLevel(TrilinearLod(Width(), Height(), dudx, dvdx, dudy, dvdy), u, v, p_rgb);
+}
+
+
+void CGrTiledTexture::SampleAnisotropic(double u, double v, double dudx, double dvdx,
+        double dudy, double dvdy, float *p_rgb, int p_maxAniso) const
+{
+    Anisotropic([this](double p_lod, double s, double t, float *p_sample) {SampleLevel(p_lod, s, t, p_sample);},
+        Width(), Height(), u, v, dudx, dvdx, dudy, dvdy, p_rgb, p_maxAniso);
+}
+
+
+//
+// Name :         CGrTiledTexture::WriteTileFile()
+// Description :  Write the tile file for an image.  The top level is
+//                the tiles of the image.  Each tile of a mip level is
+//                the 2x2 box filter of at most four tiles of the level
+//                above, which we read back from the file, so only a
+//                few tiles are ever in memory.
+//
+
+bool CGrTiledTexture::WriteTileFile(const _TCHAR *p_image, const _TCHAR *p_tiled)
+{
+    CGrImageTileSource image;
+    if(!image.Open(p_image))
+        return false;
+
+    vector<int> widths, heights;
+    LevelSizes(image.m_widths[0], image.m_heights[0], widths, heights);
+
+    fstream file(filesystem::path(p_tiled), ios::in | ios::out | ios::binary | ios::trunc);
+    if(!file)
+        return false;
+
+    BYTE header[TILEHEADER];
+    memset(header, 0, sizeof(header));
+    memcpy(header, TILEMAGIC, sizeof(TILEMAGIC));
+    unsigned fields[4] = {unsigned(TILESIZE), unsigned(widths.size()), unsigned(widths[0]), unsigned(heights[0])};
+    for(int f=0;  f<4;  f++)
+    {
+        for(int b=0;  b<4;  b++)
+            header[8 + f * 4 + b] = BYTE(fields[f] >> (b * 8));
+    }
+    file.write((const char *)header, sizeof(header));
+
+    vector<BYTE> tile(TILEBYTES);
+    for(int ty=0;  ty<TilesAcross(heights[0]);  ty++)
+    {
+        for(int tx=0;  tx<TilesAcross(widths[0]);  tx++)
+        {
+            image.ReadTile(0, tx, ty, &tile[0]);
+            file.write((const char *)&tile[0], TILEBYTES);
+        }
+    }
+
+    vector<BYTE> above[2][2];
+    for(int i=0;  i<2;  i++)
+    {
+        above[i][0].resize(TILEBYTES);
+        above[i][1].resize(TILEBYTES);
+    }
+
+    streamoff offset = TILEHEADER;
+    for(size_t l=1;  l<widths.size() && file;  l++)
+    {
+        int srcWidth = widths[l - 1];
+        int srcHeight = heights[l - 1];
+        int srcAcross = TilesAcross(srcWidth);
+        int srcDown = TilesAcross(srcHeight);
+        streamoff end = offset + streamoff(srcAcross) * srcDown * TILEBYTES;
+
+        for(int ty=0;  ty<TilesAcross(heights[l]);  ty++)
+        {
+            for(int tx=0;  tx<TilesAcross(widths[l]);  tx++)
+            {
+                // The tiles of the level above this tile covers
+                for(int j=0;  j<2;  j++)
+                {
+                    for(int i=0;  i<2;  i++)
+                    {
+                        int sx = tx * 2 + i;
+                        int sy = ty * 2 + j;
+                        if(sx < srcAcross && sy < srcDown)
+                        {
+                            file.seekg(offset + (streamoff(sy) * srcAcross + sx) * TILEBYTES);
+                            file.read((char *)&above[j][i][0], TILEBYTES);
+                        }
+                    }
+                }
+
+                memset(&tile[0], 0, TILEBYTES);
+                for(int r=ty * TILESIZE;  r<heights[l] && r<(ty + 1) * TILESIZE;  r++)
+                {
+                    int r0 = r * 2 < srcHeight ? r * 2 : srcHeight - 1;
+                    int r1 = r * 2 + 1 < srcHeight ? r * 2 + 1 : srcHeight - 1;
+                    for(int c=tx * TILESIZE;  c<widths[l] && c<(tx + 1) * TILESIZE;  c++)
+                    {
+                        int c0 = c * 2 < srcWidth ? c * 2 : srcWidth - 1;
+                        int c1 = c * 2 + 1 < srcWidth ? c * 2 + 1 : srcWidth - 1;
+
+                        const BYTE *a = &above[(r0 >> TILESHIFT) - ty * 2][(c0 >> TILESHIFT) - tx * 2][TexelOffset(c0, r0)];
+                        const BYTE *b = &above[(r0 >> TILESHIFT) - ty * 2][(c1 >> TILESHIFT) - tx * 2][TexelOffset(c1, r0)];
+                        const BYTE *d = &above[(r1 >> TILESHIFT) - ty * 2][(c0 >> TILESHIFT) - tx * 2][TexelOffset(c0, r1)];
+                        const BYTE *e = &above[(r1 >> TILESHIFT) - ty * 2][(c1 >> TILESHIFT) - tx * 2][TexelOffset(c1, r1)];
+
+                        BYTE *texel = &tile[TexelOffset(c, r)];
+                        for(int i=0;  i<3;  i++)
+                            texel[i] = BYTE((a[i] + b[i] + d[i] + e[i] + 2) / 4);
+                        texel[3] = 255;
+                    }
+                }
+
+                file.seekp(0, ios::end);
+                file.write((const char *)&tile[0], TILEBYTES);
+            }
+        }
+
+        offset = end;
+    }
+
+    return bool(file);
+}
@@ -0,0 +1,214 @@
+//
+// Name :         GrTiledTexture.h
+// Description :  Header file for CGrTiledTexture, a texture streamed
+//                from disk in tiles, and CGrTilePool, the memory the
+//                tiles share.
+//                See GrTiledTexture.cpp
+//
+
+#ifndef _GRTILEDTEXTURE_H
+#define _GRTILEDTEXTURE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "GrObject.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+class CGrTileSource;
+
+//
+// class CGrTilePool
+// A fixed amount of memory for the tiles of all CGrTiledTexture
+// objects.  Tiles are read on demand and the least recently used
+// tile is dropped when the pool is full, so textures of any size
+// render within the capacity.  Each thread also keeps the last few
+// tiles it sampled, which may briefly hold a tile the pool dropped.
+// The pool may be used from any thread.
+//
+
+class CGrTilePool
+{
+public:
+    static CGrTilePool &Instance();
+    ~CGrTilePool();
+
+    // Bytes of tiles to hold, at least one tile.  Shrinking the pool
+    // drops tiles right away.
+    void SetCapacity(size_t p_bytes);
+    size_t GetCapacity() const;
+
+    size_t MemoryUsed() const;
+    int Resident() const;
+
+    // Lookups that reached the pool since the last ResetStatistics().
+    // Lookups the per thread tiles answer are not counted.
+    long long Hits() const;
+    long long Misses() const;
+    long long Evictions() const;
+    void ResetStatistics();
+
+    // Wait for the tiles requested in the background to load
+    void Flush();
+
+private:
+    friend class CGrTiledTexture;
+
+    CGrTilePool();
+    CGrTilePool(const CGrTilePool &);
+    CGrTilePool &operator=(const CGrTilePool &);
+
+    typedef std::shared_ptr<const std::vector<BYTE> > Tile;
+
+    struct Key
+    {
+        unsigned    m_texture;
+        int         m_level;
+        int         m_tx;
+        int         m_ty;
+
+        bool operator<(const Key &k) const
+        {
+            if(m_texture != k.m_texture) return m_texture < k.m_texture;
+            if(m_level != k.m_level) return m_level < k.m_level;
+            if(m_ty != k.m_ty) return m_ty < k.m_ty;
+            return m_tx < k.m_tx;
+        }
+
+        bool operator==(const Key &k) const
+        {
+            return m_texture == k.m_texture && m_level == k.m_level && m_tx == k.m_tx && m_ty == k.m_ty;
+        }
+    };
+
+    struct Entry
+    {
+        Key     m_key;
+        Tile    m_tile;
+    };
+
+    struct LoadRequest
+    {
+        Key     m_key;
+        std::shared_ptr<const CGrTileSource> m_source;
+    };
+
+    typedef std::list<Entry> Entries;
+
+    // For CGrTiledTexture.  Find() returns NULL for a tile that is not
+    // resident, Load() reads it now, and Request() reads it in the
+    // background.
+    Tile Find(const Key &p_key);
+    Tile Load(const Key &p_key, const CGrTileSource &p_source);
+    void Request(const Key &p_key, const std::shared_ptr<const CGrTileSource> &p_source);
+    void Remove(unsigned p_texture);
+
+    Tile Add(const Key &p_key, const Tile &p_tile);
+    void Evict();
+    void Loader();
+
+    mutable std::mutex  m_mutex;
+    Entries             m_entries;      // Most recently used first
+    std::map<Key, Entries::iterator> m_index;
+    size_t              m_capacity;
+    long long           m_hits;
+    long long           m_misses;
+    long long           m_evictions;
+
+    // Background loading
+    std::deque<LoadRequest> m_requests;
+    std::set<Key>       m_pending;
+    bool                m_loading;
+    bool                m_stop;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::thread         m_loader;
+};
+
+//
+// class CGrTiledTexture
+// A texture that is not loaded.  Open() maps the file and sampling
+// reads 64x64 texel tiles into the CGrTilePool as it needs them.
+// A tile file from WriteTileFile() holds every mip level in tiles, so
+// a tile is one read.  A PPM or BMP file may also be opened directly,
+// with no mip levels and tiles converted as they are read.
+//
+// A sample that needs a tile that is not resident reads it before it
+// returns.  With the COARSER miss policy the sample uses the nearest
+// coarser level that is resident instead and the tile loads in the
+// background, so a frame never waits on the disk.  The coarsest level
+// of a tile file is a single tile that is always resident.
+//
+// The texture may be sampled from any number of threads.  There is no
+// image for OpenGL.  To ray trace a scene graph with it, give the scene
+// graph a small CGrTexture in its place and tell CGrRayLoader to
+// stream that texture with StreamTexture().
+//
+
+class CGrTiledTexture : public CGrObject, public ITexture
+{
+public:
+    CGrTiledTexture();
+    virtual ~CGrTiledTexture();
+
+    void glRender();
+    virtual void Render(CGrRenderer *p_renderer);
+
+    // Open a tile file, PPM, or BMP
+    bool Open(const _TCHAR *p_filename);
+    void Close();
+    bool IsOpen() const {return m_source != NULL;}
+
+    // Write a tile file for an image file, building the mip levels a
+    // few tiles at a time
+    static bool WriteTileFile(const _TCHAR *p_image, const _TCHAR *p_tiled);
+
+    int Width() const {return m_widths.empty() ? 0 : m_widths[0];}
+    int Height() const {return m_heights.empty() ? 0 : m_heights[0];}
+    int MipLevels() const {return int(m_widths.size());}
+    int MipWidth(int p_level) const {return m_widths[p_level];}
+    int MipHeight(int p_level) const {return m_heights[p_level];}
+
+    enum MissPolicy {LOAD, COARSER};
+    void SetMissPolicy(MissPolicy p_policy) {m_missPolicy = p_policy;}
+    MissPolicy GetMissPolicy() const {return m_missPolicy;}
+
+    // The lookups of CGrTexture
+    void SampleNearest(double u, double v, float *p_rgb) const;
+    void SampleBilinear(double u, double v, float *p_rgb) const;
+    void SampleTrilinear(double u, double v, double dudx, double dvdx,
+        double dudy, double dvdy, float *p_rgb) const;
+    void SampleAnisotropic(double u, double v, double dudx, double dvdx,
+        double dudy, double dvdy, float *p_rgb, int p_maxAniso=8) const;
+
+    enum {TILESHIFT = 6, TILESIZE = 1 << TILESHIFT, TILEMASK = TILESIZE - 1,
+        TILEBYTES = TILESIZE * TILESIZE * 4};
+
+private:
+    CGrTiledTexture(const CGrTiledTexture &);
+    CGrTiledTexture &operator=(const CGrTiledTexture &);
+
+    struct StreamView;
+
+    void Texel(int p_level, int c, int r, BYTE *p_texel) const;
+    const std::vector<BYTE> *Lookup(int p_level, int p_tx, int p_ty, bool p_wait) const;
+    void SampleLevel(double p_lod, double u, double v, float *p_rgb) const;
+
+    unsigned            m_id;           // Names our tiles in the pool
+    std::shared_ptr<const CGrTileSource> m_source;
+    std::vector<int>    m_widths;
+    std::vector<int>    m_heights;
+    CGrTilePool::Tile   m_coarsest;     // The last level if it is one tile
+    MissPolicy          m_missPolicy;
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include "GrVRMLFactory.h"
 #include "GrRenderer.h"
 #include "GrTexture.h"
+#include "GrTextureCache.h"
 
 using namespace std;
 
@@ -69,6 +70,7 @@ CGrVRML::~CGrVRML() {}
 
 bool CGrVRML::Load(const char *p_file)
 {
+    m_textureCache.clear();
     return m_vrml.FileLoad(p_file);
 }
 
@@ -93,11 +95,11 @@ void CGrVRML::Render(CGrRenderer *p_renderer)
     // Clear the list of materials
     m_materials.clear();
 
-    // Before we render, we create a texture cache that 
-    // makes a local texture object from those in the 
-    // VRML object.
-    m_textureCache.clear();
-    for(int i=0;  i<m_vrml.GetTextureCount();  i++)
+    // The first time we render, we create a texture cache that 
+    // makes a local texture object from those in the VRML object.
+    // Nodes that use the same image share one texture from the
+    // process-wide cache.
+    for(int i=int(m_textureCache.size());  i<m_vrml.GetTextureCount();  i++)
     {
         // Obtain information about the texture
         const BYTE *image;
@@ -106,11 +108,9 @@ void CGrVRML::Render(CGrRenderer *p_renderer)
         bool repeatS, repeatT, transparency;
         m_vrml.GetTexture(i, image, width, height, colpitch, rowpitch, repeatS, repeatT, transparency);
 
-        // Create the local scene graph node for the texture
-        CGrPtr<CGrTexture> texture = new CGrTexture;
-        texture->LoadMemory(image, width, height, colpitch, rowpitch, repeatS, repeatT, transparency);
-
-        m_textureCache.push_back(texture);
+        // Find or create the scene graph node for the texture
+        m_textureCache.push_back(CGrTextureCache::Instance().LoadMemory(image, width, height, 
+            colpitch, rowpitch, repeatS, repeatT, transparency));
     }
 
     m_vrml.Render(this);
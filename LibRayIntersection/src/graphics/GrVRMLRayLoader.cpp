@@ -0,0 +1,270 @@
+//
+// Name :         GrVRMLRayLoader.cpp
+// Description :  Implementation of CGrVRMLRayLoader, which loads a VRML
+//                file straight into a CRayIntersection.
+//
+
+#include "stdafx.h"
+#include "GrVRMLRayLoader.h"
+#include "GrTexture.h"
+#include "GrTextureCache.h"
+
+using namespace std;
+
+CGrVRMLRayLoader::CGrVRMLRayLoader(CRayIntersection &p_intersection) : m_intersection(p_intersection)
+{
+    m_matrix.SetIdentity();
+    m_normalMatrix.SetIdentity();
+    m_hasNormal = false;
+    m_hasTexCoord = false;
+    m_texture = -1;
+    m_textureBase = 0;
+    m_polygons = 0;
+}
+
+CGrVRMLRayLoader::~CGrVRMLRayLoader() = default;
+
+
+//
+// Name :         CGrVRMLRayLoader::Load()
+// Description :  Parse the file and render it into the intersection
+//                system once.  The textures go through the texture
+//                cache and get the tiled mip pyramid the ray tracer
+//                samples.
+//
+
+bool CGrVRMLRayLoader::Load(const char *p_file)
+{
+    CVRML vrml;
+    if(!vrml.FileLoad(p_file))
+    {
+        m_error = vrml.Error() != NULL ? vrml.Error() : "";
+        return false;
+    }
+
+    m_error.clear();
+
+    m_textureBase = int(m_textures.size());
+    for(int i=0;  i<vrml.GetTextureCount();  i++)
+    {
+        const BYTE *image;
+        int width, height;
+        int colpitch, rowpitch;
+        bool repeatS, repeatT, transparency;
+        vrml.GetTexture(i, image, width, height, colpitch, rowpitch, repeatS, repeatT, transparency);
+
+        CGrPtr<CGrTexture> texture = CGrTextureCache::Instance().LoadMemory(image, width, height,
+            colpitch, rowpitch, repeatS, repeatT, transparency);
+        if(!texture->Empty() && texture->MipLevels() == 1)
+        {
+            texture->SetLayout(CGrTexture::TILED);
+            texture->GenerateMipmaps();
+        }
+
+        m_textures.push_back(texture);
+    }
+
+    m_matrix.SetIdentity();
+    m_normalMatrix.SetIdentity();
+    m_stack.clear();
+    m_texture = -1;
+
+    m_intersection.Material(NULL);
+    vrml.Render(this);
+    m_intersection.Material(NULL);
+    m_intersection.Texture(NULL);
+    return true;
+}
+
+
+void CGrVRMLRayLoader::Texture(int index)
+{
+    m_texture = index;
+}
+
+
+void CGrVRMLRayLoader::Material(const float *ambient, const float *diffuse, const float *specular,
+              const float *emissive, float shininess)
+{
+    // The intersection system only points to the material
+    CGrPtr<CGrMaterial> mat = new CGrMaterial;
+    m_materials.push_back(mat);
+
+    mat->AmbientDiffuseSpecularShininess(ambient, diffuse, specular, shininess);
+    m_intersection.Material(mat);
+}
+
+
+void CGrVRMLRayLoader::PolygonBegin()
+{
+    m_vertices.clear();
+    m_normals.clear();
+    m_texcoords.clear();
+    m_hasNormal = false;
+    m_hasTexCoord = false;
+}
+
+
+//
+// Name :         CGrVRMLRayLoader::Vertex(), Normal(), TexCoord()
+// Description :  A vertex takes the normal and texture coordinate given
+//                last, the way OpenGL does.  VRML normals are not unit
+//                length once the model is scaled, so they are normalized
+//                after the transformation.
+//
+
+void CGrVRMLRayLoader::Vertex(float x, float y, float z)
+{
+    CGrPoint w = m_matrix * CGrPoint(x, y, z);
+    w /= w.W();
+    m_vertices.push_back(CGrVector(w.X(), w.Y(), w.Z()));
+    m_normals.push_back(m_normal);
+    m_texcoords.push_back(m_texcoord);
+
+    if(m_polygons == 0 && m_vertices.size() == 1)
+    {
+        m_min = w;
+        m_max = w;
+    }
+    else
+    {
+        m_min.Minimize(w);
+        m_max.Maximize(w);
+    }
+}
+
+
+void CGrVRMLRayLoader::Normal(float x, float y, float z)
+{
+    CGrPoint n = m_normalMatrix * CGrPoint(x, y, z, 0);
+    n.Normalize3();
+    m_normal = CGrVector(n.X(), n.Y(), n.Z(), 0);
+
+    // Vertices before the first normal take it as well
+    if(!m_hasNormal)
+        m_normals.assign(m_vertices.size(), m_normal);
+    m_hasNormal = true;
+}
+
+
+void CGrVRMLRayLoader::TexCoord(float s, float t)
+{
+    m_texcoord = CGrVector(s, t, 0);
+
+    if(!m_hasTexCoord)
+        m_texcoords.assign(m_vertices.size(), m_texcoord);
+    m_hasTexCoord = true;
+}
+
+
+//
+// Name :         CGrVRMLRayLoader::PolygonEnd()
+// Description :  Hand the polygon to the intersection system.
+//
+
+void CGrVRMLRayLoader::PolygonEnd()
+{
+    int cnt = int(m_vertices.size());
+    if(cnt < 3)
+        return;
+
+    m_intersection.Texture(m_texture >= 0 ? m_textures[m_textureBase + m_texture] : NULL);
+    if(cnt == 3)
+        m_intersection.TriangleBegin();
+    else
+        m_intersection.PolygonBegin();
+
+    // A polygon without normals gets its face normal
+    if(!m_hasNormal)
+        m_intersection.Normal(Normalize3(Cross(m_vertices[1] - m_vertices[0], m_vertices[2] - m_vertices[0])));
+
+    for(int i=0;  i<cnt;  i++)
+    {
+        if(m_hasNormal)
+            m_intersection.Normal(m_normals[i]);
+
+        if(m_hasTexCoord)
+            m_intersection.TexVertex(m_texcoords[i]);
+
+        m_intersection.Vertex(m_vertices[i]);
+    }
+
+    if(cnt == 3)
+        m_intersection.TriangleEnd();
+    else
+        m_intersection.PolygonEnd();
+
+    m_polygons++;
+}
+
+
+//
+// The transformation stack
+//
+
+void CGrVRMLRayLoader::PushMatrix()
+{
+    m_stack.push_back(m_matrix);
+}
+
+void CGrVRMLRayLoader::PopMatrix()
+{
+    if(m_stack.empty())
+        return;
+
+    m_matrix = m_stack.back();
+    m_stack.pop_back();
+
+    m_normalMatrix.SetAffineInverse(m_matrix);
+    m_normalMatrix.Transpose();
+}
+
+void CGrVRMLRayLoader::Translate(float x, float y, float z)
+{
+    CGrTransform t;
+    t.SetTranslate(x, y, z);
+    Compose(t);
+}
+
+void CGrVRMLRayLoader::Rotate(float a, float x, float y, float z)
+{
+    CGrTransform r;
+    r.SetRotate(a, CGrPoint(x, y, z));
+    Compose(r);
+}
+
+void CGrVRMLRayLoader::Scale(float x, float y, float z)
+{
+    CGrTransform s;
+    s.SetScale(x, y, z);
+    Compose(s);
+}
+
+void CGrVRMLRayLoader::MultMatrix(const double *m)
+{
+    CGrTransform t;
+    for(int c=0;  c<4;  c++)
+    {
+        for(int r=0;  r<4;  r++)
+        {
+            t[r][c] = *m++;
+        }
+    }
+
+    Compose(t);
+}
+
+
+//
+// Name :         CGrVRMLRayLoader::Compose()
+// Description :  Multiply a transformation onto the current matrix
+//                the way OpenGL does.
+//
+
+void CGrVRMLRayLoader::Compose(const CGrTransform &p_transform)
+{
+    m_matrix *= p_transform;
+
+    m_normalMatrix.SetAffineInverse(m_matrix);
+    m_normalMatrix.Transpose();
+}
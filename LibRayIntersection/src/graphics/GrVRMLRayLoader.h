@@ -0,0 +1,100 @@
+//
+// Name :         GrVRMLRayLoader.h
+// Description :  Header file for CGrVRMLRayLoader, which loads a VRML
+//                file straight into a CRayIntersection.
+//                See GrVRMLRayLoader.cpp
+//
+
+#ifndef _GRVRMLRAYLOADER_H
+#define _GRVRMLRAYLOADER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <vector>
+#include "GrObject.h"
+#include "RayIntersection.h"
+#include "libvrml.h"
+
+class CGrTexture;
+
+//
+// class CGrVRMLRayLoader
+// Loading a VRML file through CGrVRMLFactory and CGrRayLoader keeps the
+// VRML object and passes every polygon through the lists of a
+// CGrRenderer.  This loader is the VRML renderer itself.  It applies
+// the transformations as they come and hands each polygon straight to
+// the intersection system, and the VRML object is gone when Load()
+// returns.  Triangles take the triangle path of the intersection
+// system.
+//
+// The caller still calls Initialize() before and LoadingComplete() or
+// BuildAsync() after.  The loader holds the materials and textures the
+// intersection system points to, so keep it while the scene is used.
+//
+
+class CGrVRMLRayLoader : public CVRML::Renderer
+{
+public:
+    CGrVRMLRayLoader(CRayIntersection &p_intersection);
+    virtual ~CGrVRMLRayLoader();
+
+    // Load a file, adding its polygons to what is loaded already
+    bool Load(const char *p_file);
+    const char *Error() const {return m_error.c_str();}
+
+    // What has been loaded
+    int PolygonCnt() const {return m_polygons;}
+    const CGrPoint &Min() const {return m_min;}
+    const CGrPoint &Max() const {return m_max;}
+
+private:
+    // These are the renderer callback functions from the VRML library
+    virtual void PolygonBegin();
+    virtual void PolygonEnd();
+    virtual void Vertex(float x, float y, float z);
+    virtual void Normal(float x, float y, float z);
+    virtual void TexCoord(float s, float t);
+    virtual void PushMatrix();
+    virtual void PopMatrix();
+    virtual void Translate(float x, float y, float z);
+    virtual void Rotate(float a, float x, float y, float z);
+    virtual void Scale(float x, float y, float z);
+    virtual void MultMatrix(const double *m);
+    virtual void Material(const float *ambient, const float *diffuse, const float *specular, const float *emissive, float shininess);
+    virtual void Texture(int index);
+
+    void Compose(const CGrTransform &p_transform);
+
+    CRayIntersection   &m_intersection;
+    std::string         m_error;
+
+    // Current transformation and its inverse transpose for normals
+    CGrTransform        m_matrix;
+    CGrTransform        m_normalMatrix;
+    std::vector<CGrTransform> m_stack;
+
+    // The polygon being loaded, in world coordinates.  The arrays are
+    // kept between polygons so loading does not allocate.
+    std::vector<CGrVector> m_vertices;
+    std::vector<CGrVector> m_normals;
+    std::vector<CGrVector> m_texcoords;
+    bool                m_hasNormal;
+    bool                m_hasTexCoord;
+    CGrVector           m_normal;
+    CGrVector           m_texcoord;
+
+    int                 m_texture;      // Current texture
+    int                 m_textureBase;  // Of the file being loaded
+    std::vector<CGrPtr<CGrTexture> > m_textures;
+    std::vector<CGrPtr<CGrMaterial> > m_materials;
+
+    // Statistics about what we loaded
+    int                 m_polygons;
+    CGrPoint            m_min;
+    CGrPoint            m_max;
+};
+
+#endif
@@ -109,46 +109,48 @@ bool COpenGLRenderer::RendererEnd()
 //
 void COpenGLRenderer::RendererEndPolygon()
 {
-   const list<CGrPoint> &vertices = PolyVertices();
-   const list<CGrPoint> &normals = PolyNormals();
-   const list<CGrPoint> &tvertices = PolyTexVertices();
-
-   if(PolyTexture())
-   {
-      glEnable(GL_TEXTURE_2D);
-      glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-      glBindTexture(GL_TEXTURE_2D, PolyTexture()->TexName());
-   }
+   CGrPolygonSpan polygon;
+   PolySpan(polygon);
+   RendererPolygons(&polygon, 1);
+}
 
-   list<CGrPoint>::const_iterator normal = normals.begin();
-   list<CGrPoint>::const_iterator tvertex = tvertices.begin();
 
-   glBegin(GL_POLYGON);
-   for(list<CGrPoint>::const_iterator i=vertices.begin();  i!=vertices.end();  i++)
+//
+// Name :         COpenGLRenderer::RendererPolygons()
+// Description :  Draw polygons handed over as arrays.
+//
+void COpenGLRenderer::RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt)
+{
+   for(int p=0;  p<p_cnt;  p++)
    {
-      if(normal != normals.end())
+      const CGrPolygonSpan &polygon = p_polygons[p];
+
+      if(polygon.m_texture)
       {
-         normal->glNormal();
-         normal++;
+         glEnable(GL_TEXTURE_2D);
+         glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+         glBindTexture(GL_TEXTURE_2D, polygon.m_texture->TexName());
       }
 
-      if(tvertex != tvertices.end())
+      glBegin(GL_POLYGON);
+      for(int i=0;  i<polygon.m_vertexCnt;  i++)
       {
-         tvertex->glTexVertex();
-         tvertex++;
-      }
-      
-      i->glVertex();
-   }
+         if(i < polygon.m_normalCnt)
+            polygon.m_normals[i].glNormal();
 
-   glEnd();
+         if(i < polygon.m_tvertexCnt)
+            polygon.m_tvertices[i].glTexVertex();
 
-   if(PolyTexture())
-   {
-      glDisable(GL_TEXTURE_2D);
-   }
+         polygon.m_vertices[i].glVertex();
+      }
 
+      glEnd();
 
+      if(polygon.m_texture)
+      {
+         glDisable(GL_TEXTURE_2D);
+      }
+   }
 }
 
 
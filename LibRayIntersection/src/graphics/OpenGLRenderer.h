@@ -24,6 +24,7 @@ public:
     virtual bool RendererStart();
     virtual bool RendererEnd();
     virtual void RendererEndPolygon();
+    virtual void RendererPolygons(const CGrPolygonSpan *p_polygons, int p_cnt);
     virtual void RendererColor(double *c);
     virtual void RendererMaterial(CGrMaterial *p_material);
     virtual void RendererTranslate(double x, double y, double z);
@@ -10,7 +10,9 @@
 //
 
 #ifndef LIBRIEXPORT
-#ifdef LIBRIDLL
+#ifndef _WIN32
+#define LIBRIEXPORT
+#elif defined(LIBRIDLL)
 #define LIBRIEXPORT  __declspec( dllexport )
 #else
 #define LIBRIEXPORT  __declspec( dllimport )
@@ -10,13 +10,30 @@
 //                 4-11-2007 2.01 Fixed problems related to coincident vertices
 //                 2-27-2011 2.02 CGrPoint changes to CGrVector
 //                                New IMaterial and ITexture interfaces
+//                10-18-2026 2.03 Background build with double-buffered scene swap
+//                10-18-2026 2.04 GetStatistics() with per-thread counters and histograms
+//                10-18-2026 2.05 Calibration of the tree build costs
+//                10-18-2026 2.06 Queries may run on many threads at once
+//                10-18-2026 2.07 Ray differentials for texture filtering
+//                10-19-2026 2.08 Analytic sphere, box, and cylinder primitives
+//                10-19-2026 2.09 Application primitives with AddPrimitive()
+//                10-19-2026 2.10 NURBS surfaces intersected directly
+//                10-19-2026 2.11 Moving triangles and ray time for motion blur
+//                10-19-2026 2.12 Visibility masks on objects and rays
+//                10-19-2026 2.13 Any-hit filters for cut-out geometry
+//                10-19-2026 2.14 IntersectAll() for every hit along a ray
+//                10-19-2026 2.15 ClosestPoint() and WithinDistance() queries
+//                10-19-2026 2.16 QueryBox() and QueryFrustum() region queries
+//                10-19-2026 2.17 SphereCast() swept sphere queries
 //
 
 #ifndef _RAYINTERSECTION_H
 #define _RAYINTERSECTION_H
 
 #ifndef LIBRIEXPORT
-#ifdef LIBRIDLL
+#ifndef _WIN32
+#define LIBRIEXPORT
+#elif defined(LIBRIDLL)
 #define LIBRIEXPORT  __declspec( dllexport )
 #else
 #define LIBRIEXPORT  __declspec( dllimport )
@@ -25,6 +42,7 @@
 
 #include <list>
 #include <vector>
+#include <string>
 
 #include "GrVector.h"
 #include "RayInterfaces.h"
@@ -43,23 +61,32 @@
 //! -# Call Initialize() to initialize the system.
 //! -# Call Material() to set a pointer to the current material property
 //! -# Call Texture() to set a pointer to the current texture (optional)
+//! -# Call Mask() to set the visibility mask of the objects (optional)
 //! -# Add polygons or triangles to the system:
-//!     -# Call PolygonBegin() or TriangleBegin()
+//!     -# Call PolygonBegin() or TriangleBegin(), or TriangleBegin(keys) 
+//!        for a triangle that moves
 //!     -# Call Vertex() to add vertices for the polygon
 //!     -# Call Normal() to specify a normal for the polygon
 //!     -# Call TexVertex() to specify a vertex for the polygon
 //!     -# Call PolygonEnd() or TriangleEnd()
-//! -# Call LoadingComplete()
+//! -# Add spheres, boxes, and cylinders with AddSphere(), AddBox(), 
+//!    and AddCylinder() (optional)
+//! -# Add primitives of your own with AddPrimitive() (optional)
+//! -# Add NURBS surfaces with AddNurbs() (optional)
+//! -# Call LoadingComplete() or BuildAsync()
 //! -# Call Intersect() to test for intersections
 //! -# Call IntersectInfo() to get intersection information for rendering
 //!
-//! Notice:  CRayIntersection is NOT thread safe. Do not use with more than one
-//! thread. An easy way to support multithreading is to create a separate copy of
-//! the class for each thread.
+//! Notice:  Loading is NOT thread safe. Do not load from more than one thread.
+//! Intersect() and IntersectInfo() may be called from any number of threads at
+//! once, since each thread keeps its own record of what a ray has tested.
+//! BuildAsync() builds the newly loaded scene on worker threads while the 
+//! previous scene keeps answering Intersect() calls.
 
 
 // Anonymous reference to the class that does all of the actual work
 class CRayIntersectionD;
+class CSceneBuffer;
 
 //
 // class CRay
@@ -72,15 +99,16 @@ class LIBRIEXPORT CRay
 public:
     //! Constructor that initializes the ray.
     /*! \param o Ray origin.
-        \param d Ray direction. */
-    CRay(const CGrVector &o, const CGrVector &d) {m_o=o;  m_d=d;}
+        \param d Ray direction. 
+        \param time Time of the ray for moving objects, 0 to 1. */
+    CRay(const CGrVector &o, const CGrVector &d, double time=0) {m_o=o;  m_d=d;  m_time=time;  m_mask=0xffffffff;}
 
-    //! Default constructor. Does not initialize the ray.
-    CRay() {}
+    //! Default constructor. Does not initialize the origin and direction.
+    CRay() : m_time(0), m_mask(0xffffffff) {}
 
     //! Copy constructor.
     /*! \param r Ray to copy */
-    CRay(const CRay &r) {m_o = r.m_o; m_d = r.m_d;}
+    CRay(const CRay &r) {m_o = r.m_o; m_d = r.m_d; m_time = r.m_time; m_mask = r.m_mask;}
 
     //! Ray origin.
     /*! Allows access to the origin of the ray as a CGrVector object.
@@ -106,8 +134,30 @@ public:
         \return Component of the direction of the ray */
     const double Direction(int d) const {return m_d[d];}
 
+    //! Ray time.
+    /*! The time within the shutter interval, from 0 to 1, at which the 
+        ray sees the scene. Moving triangles are where they are at this 
+        time, and everything else is the same at all times.
+        \return The time of the ray */
+    double Time() const {return m_time;}
+
+    //! Set the ray time.
+    /*! \param time The time, from 0 to 1. */
+    void SetTime(double time) {m_time = time;}
+
+    //! Ray visibility mask.
+    /*! The ray sees only objects whose mask has a bit in common with
+        this one. The default has every bit set, so every object is seen.
+        \return The mask of the ray */
+    unsigned int Mask() const {return m_mask;}
+
+    //! Set the ray visibility mask.
+    /*! \param mask The mask. Shadow rays might clear a bit that is set 
+        only for glass, for example. */
+    void SetMask(unsigned int mask) {m_mask = mask;}
+
     //! Assignment operator.
-    CRay &operator=(const CRay &r) {m_o = r.m_o; m_d = r.m_d; return *this;}
+    CRay &operator=(const CRay &r) {m_o = r.m_o; m_d = r.m_d; m_time = r.m_time; m_mask = r.m_mask; return *this;}
 
     //! Determine a point on a ray given the t value.
     /*! Given a t value, this function computes a point on the ray.
@@ -118,6 +168,64 @@ public:
 private:
     CGrVector    m_o;
     CGrVector    m_d;
+    double       m_time;
+    unsigned int m_mask;
+};
+
+//
+// class CRayDifferential
+// How a ray changes from one pixel to the next.
+//
+
+//! Ray differentials for a ray
+/*! The rates of change of a ray's origin and direction per pixel in
+    the image x and y directions. Carried along with a ray, they give
+    the footprint of the pixel on the surface that the ray hits, which
+    is what a texture filter needs. */
+class LIBRIEXPORT CRayDifferential
+{
+public:
+    //! Default constructor. A ray that does not change between pixels.
+    CRayDifferential() : m_dOdx(0, 0, 0, 0), m_dOdy(0, 0, 0, 0), m_dDdx(0, 0, 0, 0), m_dDdy(0, 0, 0, 0) {}
+
+    //! Constructor
+    /*! \param dOdx Change in the origin per pixel in x.
+        \param dOdy Change in the origin per pixel in y.
+        \param dDdx Change in the direction per pixel in x.
+        \param dDdy Change in the direction per pixel in y. */
+    CRayDifferential(const CGrVector &dOdx, const CGrVector &dOdy, const CGrVector &dDdx, const CGrVector &dDdy)
+        : m_dOdx(dOdx), m_dOdy(dOdy), m_dDdx(dDdx), m_dDdy(dDdy) {}
+
+    const CGrVector &dOdx() const {return m_dOdx;}
+    const CGrVector &dOdy() const {return m_dOdy;}
+    const CGrVector &dDdx() const {return m_dDdx;}
+    const CGrVector &dDdy() const {return m_dDdy;}
+
+    //! Differentials of the point where a ray hits a plane.
+    /*! \param ray The ray.
+        \param t The t value of the hit.
+        \param normal The normal of the plane.
+        \param dPdx [out] Change in the hit point per pixel in x.
+        \param dPdy [out] Change in the hit point per pixel in y. */
+    void Transfer(const CRay &ray, double t, const CGrVector &normal, CGrVector &dPdx, CGrVector &dPdy) const
+    {
+        double dn = Dot3(ray.Direction(), normal);
+        dPdx = m_dOdx + m_dDdx * t;
+        dPdy = m_dOdy + m_dDdy * t;
+        if(dn != 0)
+        {
+            dPdx = dPdx - ray.Direction() * (Dot3(dPdx, normal) / dn);
+            dPdy = dPdy - ray.Direction() * (Dot3(dPdy, normal) / dn);
+        }
+        dPdx.W() = 0;
+        dPdy.W() = 0;
+    }
+
+private:
+    CGrVector    m_dOdx;
+    CGrVector    m_dOdy;
+    CGrVector    m_dDdx;
+    CGrVector    m_dDdy;
 };
 
 //! The Ray Intersection class
@@ -134,8 +242,50 @@ public:
     void Initialize();
 
     //! Indication that all polygons or triangles have been loaded.
+    /*! The intersection structure is built before this function returns
+        and replaces any previously built scene. Loading can then start over
+        with Initialize() without affecting the scene being queried. */
 	void LoadingComplete();
 
+    //! Indication that all polygons or triangles have been loaded, build in the background.
+    /*! This works like LoadingComplete(), except the intersection structure is
+        built on worker threads and the function returns immediately. Until the
+        build finishes, Intersect() keeps answering from the previously built
+        scene (or finds nothing if there is none). When the build is done the new
+        scene is swapped in atomically and the old one is deleted once no query
+        can still be using it.
+
+        Objects returned by Intersect() belong to the scene that answered the
+        query. Hold a QueryScope across an Intersect() and the IntersectInfo()
+        calls that use its result so that scene cannot be deleted in between. */
+    void BuildAsync();
+
+    //! Is a BuildAsync() build still running?
+    bool IsBuilding() const;
+
+    //! Wait for any BuildAsync() build to finish and be swapped in.
+    /*! Do not call this, LoadingComplete(), or BuildAsync() while holding
+        a QueryScope on the same thread. */
+    void WaitForBuild();
+
+    //! Keeps the scene answering queries alive.
+    /*! While a QueryScope exists, no scene that a query on this thread could
+        have used is deleted, so object pointers returned by Intersect() stay valid.
+        Scopes are cheap and may be nested. */
+    class LIBRIEXPORT QueryScope
+    {
+    public:
+        //! Constructor. Enters the scope.
+        QueryScope();
+
+        //! Destructor. Leaves the scope.
+        ~QueryScope();
+
+    private:
+        QueryScope(const QueryScope &);
+        QueryScope &operator=(const QueryScope &);
+    };
+
     //! Begin polygon insertion.
     /*! Begin insertion of a polygon into the system. 
         
@@ -154,6 +304,21 @@ public:
         to the call to TriangleEnd(). */
     void TriangleBegin();
 
+    //! Begin insertion of a moving triangle.
+    /*! A moving triangle has its vertices at two or more time keys, 
+        evenly spaced over the times 0 to 1 of CRay::Time(). Call Vertex()
+        3 * keys times, the three vertices at the first key, then the three
+        at the next, and so on. Normals are given the same way: one normal,
+        three for the first key, or three for every key. A key without 
+        normals uses those of the first key. The texture coordinates do 
+        not move. End the triangle with TriangleEnd().
+
+        Rays see the triangle where it is at their time, between the keys
+        around that time. The tree is built over the space the triangle 
+        sweeps, so one tree serves every time.
+        \param keys Number of time keys, at least 2. */
+    void TriangleBegin(int keys);
+
     //! End triangle insertion.
     /*! This function indicates the end of a triangle. Subsequent calls to
         set vertices, normals, or texture coordinates are ignored until the 
@@ -181,6 +346,15 @@ public:
         \param texture The texture pointer to set. */
     void Texture(ITexture *texture);
 
+    //! Set the current visibility mask.
+    /*! Sets a 32 bit mask that will be associated with subsequent objects,
+        the same way as Material() and Texture(). A ray only intersects 
+        objects whose mask has a bit in common with the mask of the ray, 
+        so one scene can hide lights from camera rays or glass from 
+        shadow rays. The mask is all bits set after Initialize().
+        \param mask The mask to set. */
+    void Mask(unsigned int mask);
+
     //! Specifies a vertex for a polygon or triangle.
     /*! This call specifies a vertex for a polygon or a triangle. Vertices are 
         supplied in counter-clockwise order. At least 3 vertices must be supplied 
@@ -202,6 +376,67 @@ public:
         \param tvertex The texture coordinate. */
 	void TexVertex(const CGrVector &tvertex);
 
+    //! Add a sphere.
+    /*! The sphere is intersected exactly rather than as polygons, with 
+        the current material and texture. The normal is the exact surface
+        normal. The texture coordinates are s = atan2(x, z) / 2pi + 0.5 and
+        t = asin(y) / pi + 0.5 on the unit normal, as CGrComposite::Sphere()
+        gives its facets. Call between polygons, not inside one.
+        \param center Center of the sphere.
+        \param radius Radius of the sphere. */
+    void AddSphere(const CGrVector &center, double radius);
+
+    //! Add an axis-aligned box.
+    /*! The box is intersected exactly, with the current material and 
+        texture. Each face has texture coordinates from 0 to 1 across it, 
+        oriented as CGrComposite::Box() gives its polygons.
+        \param min The minimum corner.
+        \param max The maximum corner. */
+    void AddBox(const CGrVector &min, const CGrVector &max);
+
+    //! Add a capped cylinder.
+    /*! The cylinder is intersected exactly, with the current material and 
+        texture. On the side s goes around the axis and t goes from 0 at 
+        the base to 1 at the top. The caps are mapped flat across the diameter.
+        \param base Center of the base cap.
+        \param top Center of the top cap.
+        \param radius Radius of the cylinder. */
+    void AddCylinder(const CGrVector &base, const CGrVector &top, double radius);
+
+    //! Add a bicubic NURBS surface.
+    /*! The surface is split into a Bezier patch for each span of the knots,
+        and rays are intersected with the patches directly, with the current
+        material and texture. The object hit has the type Nurbs. The normal
+        is the exact surface normal, du x dv. The texture coordinates are the
+        surface parameters, scaled to go from 0 to 1 over the surface.
+
+        The control points are in the order CNurbs keeps them, points[u * vsize + v],
+        with the weight of each point in W. CGrVector(x, y, z) has a weight of 1,
+        so a surface with all weights 1 is a non-rational B-spline surface. The
+        knot vectors have usize + 4 and vsize + 4 knots, the order 4 that 
+        gluNurbsSurface() is given by CNurbs. The surface is not added if the 
+        knots decrease or a weight is not positive.
+        \param usize Number of control points in u, at least 4.
+        \param vsize Number of control points in v, at least 4.
+        \param points The control points.
+        \param uknots The knots in u.
+        \param vknots The knots in v. */
+    void AddNurbs(int usize, int vsize, const CGrVector *points, 
+                  const double *uknots, const double *vknots);
+
+    //! Set a tolerance for tessellating NURBS surfaces.
+    /*! With a tolerance greater than 0, AddNurbs() adds triangles that are
+        within about that distance of the surface instead of patches. The 
+        density is chosen for each span from the curvature of the control
+        points, so it does not depend on the view. The default is 0, which
+        intersects the surface directly.
+        \param tolerance The tolerance, in scene units.
+        \return The tolerance set. */
+    double SetNurbsTolerance(double tolerance);
+
+    //! Get the tolerance for tessellating NURBS surfaces.
+    double GetNurbsTolerance() const;
+
     //! \cond INTERNAL
     // Parameter routines
     double SetIntersectionCost(double c);
@@ -212,11 +447,62 @@ public:
     int GetMaxDepth() const;
     int SetMinLeaf(int m);
     int GetMinLeaf() const;
+    int SetBuildThreads(int t);
+    int GetBuildThreads() const;
 
     //! \endcond
 
+    //! Measured costs of the basic operations of an intersection test.
+    /*! The kd-tree build weighs the cost of testing objects against the cost 
+        of traversing the tree. Those costs depend on the processor, so they 
+        can be measured with Calibrate() and saved as a profile that is reused
+        on later runs. Times are in nanoseconds. */
+    struct LIBRIEXPORT Calibration
+    {
+        //! Constructor. Creates an empty calibration.
+        Calibration() : m_traverse(0), m_polygon(0), m_triangle(0) {}
+
+        //! Does this calibration have measurements?
+        bool IsValid() const {return m_traverse > 0 && m_polygon > 0 && m_triangle > 0;}
+
+        //! Save the calibration as a profile file.
+        /*! \param path File to write.
+            \return true if successful. */
+        bool Save(const char *path) const;
+
+        //! Load a calibration profile saved with Save().
+        /*! A profile measured on a processor with a different number of 
+            hardware threads is rejected, since it is likely another machine.
+            \param path File to read.
+            \return true if a valid profile was loaded. */
+        bool Load(const char *path);
+
+        double  m_traverse;     //!< One traversal step of an interior node
+        double  m_polygon;      //!< Distance computation and interior test of a polygon
+        double  m_triangle;     //!< Distance computation and interior test of a triangle
+    };
+
+    //! Measure the intersection costs on this machine.
+    /*! Times the polygon and triangle tests on a sample of the objects loaded
+        so far (or on stand-in objects if none of a kind is loaded) against one 
+        step of tree traversal. The result is set as the calibration, as with
+        SetCalibration(). This takes about a tenth of a second. 
+        \return The measured calibration. */
+    Calibration Calibrate();
+
+    //! Set the calibration used to build the tree.
+    /*! With a valid calibration, LoadingComplete() and BuildAsync() set the 
+        intersection cost from the measured times and the mix of polygons and 
+        triangles in the scene before the tree is built. Set an invalid 
+        (default constructed) calibration to go back to fixed costs.
+        \param calibration The calibration to use. */
+    void SetCalibration(const Calibration &calibration);
+
+    //! Get the calibration used to build the tree.
+    Calibration GetCalibration() const;
+
     //! An identifier for the type of object.
-    enum ObjectType {Polygon, Triangle, Other, None};
+    enum ObjectType {Polygon, Triangle, Other, None, Sphere, Box, Cylinder, Nurbs};
 
     //! Base class for objects in the ray intersection system.
     /*! This class is the base class for objects internal to
@@ -225,10 +511,83 @@ public:
     class Object
     {
     public:
-        //! Get the type of object (polygon or triangle or other)
+        //! Get the type of object (polygon, triangle, primitive, or other)
         virtual ObjectType Type() const = 0;
     };
 
+    //! Interface for a primitive supplied by the application.
+    /*! Procedural geometry, such as a height field or an implicit surface,
+        can be added with AddPrimitive() rather than as polygons. The tree
+        is built over its bounding box and a ray that reaches it calls 
+        Intersect(). The object hit has the type Other, and GetPrimitive()
+        returns the primitive.
+
+        The system keeps a pointer to the primitive, so it must stay valid
+        while the scene is used. Queries run on many threads at once, so 
+        Intersect() and IntersectInfo() must not change the primitive. */
+    class Primitive
+    {
+    public:
+        //! Destructor.
+        virtual ~Primitive() {}
+
+        //! Get the bounding box of the primitive.
+        /*! This is called once, when the primitive is added.
+            \param min [out] The minimum corner.
+            \param max [out] The maximum corner. */
+        virtual void Bounds(CGrVector &min, CGrVector &max) const = 0;
+
+        //! The intersection test.
+        /*! \param ray Ray to test. The direction may not be unit length.
+            \return The t value of the nearest intersection with t greater 
+            than zero, or a negative value if the ray misses. */
+        virtual double Intersect(const CRay &ray) const = 0;
+
+        //! Information about an intersection.
+        /*! \param intersect The point of intersection.
+            \param normal [out] The unit surface normal at the point.
+            \param texcoord [out] The texture coordinate at the point. */
+        virtual void IntersectInfo(const CGrVector &intersect, 
+                    CGrVector &normal, CGrVector &texcoord) const = 0;
+
+        //! The point on the primitive nearest to a point.
+        /*! This is used by ClosestPoint() and WithinDistance(). The 
+            default cannot tell, and those queries pass the primitive by.
+            \param point The point.
+            \param closest [out] The nearest point on the surface.
+            \return true if closest was found. */
+        virtual bool ClosestPoint(const CGrVector & /*point*/, CGrVector & /*closest*/) const {return false;}
+
+        //! The change in the texture coordinate along the surface.
+        /*! This is used to filter textures with ray differentials. The 
+            default has no texture variation.
+            \param intersect The point of intersection.
+            \param normal [out] The normal of the surface at the point.
+            \param dsdp [out] The gradient of s at the point.
+            \param dtdp [out] The gradient of t at the point. */
+        virtual void TexCoordGradient(const CGrVector &intersect, CGrVector &normal,
+                    CGrVector &dsdp, CGrVector &dtdp) const
+        {
+            CGrVector texcoord;
+            IntersectInfo(intersect, normal, texcoord);
+            dsdp = CGrVector(0, 0, 0, 0);
+            dtdp = CGrVector(0, 0, 0, 0);
+        }
+    };
+
+    //! Add a primitive supplied by the application.
+    /*! The primitive is added with the current material and texture. 
+        Call between polygons, not inside one.
+        \param primitive The primitive. It must stay valid while the 
+        scene is used. */
+    void AddPrimitive(Primitive *primitive);
+
+    //! Get the application primitive of an object.
+    /*! \param object An object returned by Intersect().
+        \return The primitive added with AddPrimitive(), or NULL if the 
+        object is not one. */
+    static Primitive *GetPrimitive(const Object *object);
+
     //! The intersection test.
     /*! This function is called to determine any intersections with 
         objects. 
@@ -244,6 +603,158 @@ public:
     bool Intersect(const CRay &ray, double maxt, const Object *ignore, 
        const Object *&object, double &t, CGrVector &intersect);
 
+    //! Interface for a filter on candidate hits.
+    /*! A filter decides whether a hit counts, for geometry such as leaves
+        or fences that is cut out by the alpha of a texture. It is called
+        during the traversal for each hit that would be the nearest so far,
+        and a rejected hit lets the traversal go on from where it is rather
+        than starting over from the far side of the hit.
+
+        A filter may be called for hits that a nearer one replaces later,
+        and the same filter is called from every thread that uses it. When
+        a hit is rejected, the later crossings of the same object, such as
+        the far side of a sphere, are offered to the filter in order. */
+    class Filter
+    {
+    public:
+        //! Destructor.
+        virtual ~Filter() {}
+
+        //! Accept or reject a hit.
+        /*! IntersectInfo() may be called with the object and t to get the 
+            texture coordinate of the hit.
+            \param ray The ray being tested.
+            \param object The object hit.
+            \param t The t value of the hit.
+            \param intersect The point of the hit.
+            \return true if the hit counts. */
+        virtual bool Accept(const CRay &ray, const Object *object, double t, 
+                    const CGrVector &intersect) const = 0;
+    };
+
+    //! The intersection test with a filter.
+    /*! The same as the Intersect() above, except hits the filter rejects
+        are passed through.
+        \param ray Ray to test.
+        \param maxt A maximum allowable t value.
+        \param ignore An object to ignore or NULL if nothing is to be ignored.
+        \param filter The filter for hits, or NULL to accept all of them.
+        \param object [out] The object hit if any.
+        \param t [out] The t value for the intersection point.
+        \param intersect [out] The intersection point.
+        \return true if an intersection occurs. */
+    bool Intersect(const CRay &ray, double maxt, const Object *ignore, const Filter *filter,
+       const Object *&object, double &t, CGrVector &intersect);
+
+    //! A hit found by IntersectAll().
+    struct Hit
+    {
+        const Object   *m_object;       //!< The object hit
+        double          m_t;            //!< The t value of the hit
+        CGrVector       m_intersect;    //!< The intersection point
+    };
+
+    //! Find the nearest hits along a ray.
+    /*! Collects up to k hits nearest first, in one traversal of the tree.
+        Surfaces that lie in the same plane are all found, and spheres, 
+        boxes, cylinders, NURBS patches, and application primitives give 
+        every place the ray crosses them, so counting hits tells inside 
+        from outside.
+        \param ray Ray to test.
+        \param maxt A maximum allowable t value.
+        \param k The most hits to find, or 0 to find all of them.
+        \param hits [out] The hits, sorted by t.
+        \return The number of hits. */
+    int IntersectAll(const CRay &ray, double maxt, int k, std::vector<Hit> &hits);
+
+    //! Find the surface nearest to a point.
+    /*! The tree is searched nearest node first, so only the objects near
+        the point are measured. NURBS patches give the nearest point found
+        from the middle of each of their flat pieces, which is very nearly
+        the nearest, and moving triangles are where they are at time 0.
+        \param point The point.
+        \param maxd Only surfaces within this distance are found.
+        \param object [out] The object nearest to the point.
+        \param closest [out] The nearest point on its surface.
+        \param distance [out] The distance from point to closest.
+        \param mask Only objects with a mask bit in common are found.
+        \return true if a surface is within maxd. */
+    bool ClosestPoint(const CGrVector &point, double maxd, const Object *&object, 
+        CGrVector &closest, double &distance, unsigned int mask=0xffffffff);
+
+    //! Is any surface within a distance of a point?
+    /*! This stops at the first surface it finds within the distance, 
+        so it is faster than ClosestPoint().
+        \param point The point.
+        \param distance The distance.
+        \param mask Only objects with a mask bit in common are found.
+        \return true if a surface is within distance of point. */
+    bool WithinDistance(const CGrVector &point, double distance, unsigned int mask=0xffffffff);
+
+    //! Interface for receiving the objects a region query finds.
+    class Visitor
+    {
+    public:
+        //! Destructor.
+        virtual ~Visitor() {}
+
+        //! Receive an object.
+        /*! \param object An object in the region.
+            \return true to go on, false to end the query. */
+        virtual bool Visit(const Object *object) = 0;
+    };
+
+    //! Find the objects in an axis aligned box.
+    /*! Every object whose bounding box overlaps the box is passed to the
+        visitor once, in no particular order. Only the parts of the tree 
+        that overlap the box are visited, so the time depends on how much
+        is in the box rather than on the size of the scene.
+        \param min The minimum corner of the box.
+        \param max The maximum corner of the box.
+        \param visitor Receives the objects.
+        \param mask Only objects with a mask bit in common are found.
+        \return The number of objects passed to the visitor. */
+    int QueryBox(const CGrVector &min, const CGrVector &max, Visitor &visitor, unsigned int mask=0xffffffff);
+
+    //! Find the objects in a frustum.
+    /*! The same as QueryBox(), for the region inside a set of planes, such
+        as the six planes of a view frustum. Plane (a, b, c, d) has 
+        ax + by + cz + d >= 0 on the inside. An object is found unless its
+        bounding box is entirely outside one of the planes, so an object 
+        near a corner of the region may be found when it is outside.
+        \param planes The planes.
+        \param count The number of planes.
+        \param visitor Receives the objects.
+        \param mask Only objects with a mask bit in common are found.
+        \return The number of objects passed to the visitor. */
+    int QueryFrustum(const CGrVector *planes, int count, Visitor &visitor, unsigned int mask=0xffffffff);
+
+    //! Sweep a sphere along a ray.
+    /*! Finds the first surface a sphere touches as its center moves from
+        the ray origin along the ray, as for collision detection or a ray
+        with thickness. The touch is exact for triangles, polygons, 
+        spheres, boxes, and cylinders. NURBS patches and application 
+        primitives step the sphere forward by its distance from them, but
+        never less than a sixteenth of its radius, and find the touch by
+        bisection once a step goes into one. The gap at the touch found is
+        within about 1e-9. A sphere that only grazes an edge of one, going
+        less than about 1/2000 of its radius into it, may be taken to miss
+        it, as may a sphere that slides along one at a very small gap for
+        more than 1000 steps. Moving triangles are where they are at the
+        time of the ray, and only objects with a mask bit in common with
+        the ray are found. 
+        \param ray The ray the center of the sphere moves along.
+        \param radius The radius of the sphere.
+        \param maxt The sphere stops at this t along the ray.
+        \param object [out] The object the sphere touches first.
+        \param t [out] Where the center is on the ray at the touch. It is 0
+        if the sphere touches a surface where it starts.
+        \param contact [out] The point the sphere touches.
+        \param normal [out] Unit normal from the contact toward the center.
+        \return true if the sphere touches a surface before maxt. */
+    bool SphereCast(const CRay &ray, double radius, double maxt, const Object *&object,
+        double &t, CGrVector &contact, CGrVector &normal);
+
     //! Determine information about the intersection
     /*! Given an intersection object and a ray, this funciton determines the
         normal and the texture coordinate at the point and any associated 
@@ -259,18 +770,116 @@ public:
                       CGrVector &normal, IMaterial *&material, 
                       ITexture *&texture, CGrVector &texcoord) const; 
 
+    //! Determine information about the intersection, including the texture footprint
+    /*! The same as the IntersectInfo() above, plus the change in the texture
+        coordinate per pixel, found by carrying the ray differentials to the
+        surface. 
+        \param ray The ray that hit the object.
+        \param differential The differentials of the ray.
+        \param object The object hit by the ray.
+        \param t The t value at the intersection.
+        \param normal [out] A computed (interpolated) normal at the intersection point.
+        \param material [out] A material pointer associated with the object.
+        \param texture [out] A texture pointer associated with the object.
+        \param textcoord [out] An interpolated texture coordinate at the intersection. 
+        \param dTdx [out] Change in the texture coordinate per pixel in x.
+        \param dTdy [out] Change in the texture coordinate per pixel in y. */
+    void IntersectInfo(const CRay &ray, const CRayDifferential &differential, const Object *object, double t, 
+                      CGrVector &normal, IMaterial *&material, 
+                      ITexture *&texture, CGrVector &texcoord, 
+                      CGrVector &dTdx, CGrVector &dTdy) const; 
+
+    //! A histogram of non-negative integer values.
+    /*! Bin 0 counts the value 0. In a logarithmic histogram bin i > 0 counts
+        the values from 2<sup>i-1</sup> to 2<sup>i</sup>-1, otherwise bin i 
+        counts the value i. Trailing empty bins are not stored. */
+    struct LIBRIEXPORT Histogram
+    {
+        //! Constructor. Creates an empty histogram.
+        /*! \param logarithmic true for power of two bins */
+        Histogram(bool logarithmic=false) : m_logarithmic(logarithmic), m_count(0), m_sum(0), m_max(0) {}
+
+        //! Add values to the histogram.
+        /*! \param v The value.
+            \param n How many times to add it. */
+        void Add(unsigned long long v, unsigned long long n=1);
+
+        //! The smallest value counted in a bin.
+        unsigned long long BinMin(int bin) const;
+
+        //! Mean of the values or 0 if there are none.
+        double Mean() const {return m_count > 0 ? double(m_sum) / m_count : 0;}
+
+        std::vector<unsigned long long> m_bins;     //!< Count for each bin
+        bool                m_logarithmic;          //!< Power of two bins?
+        unsigned long long  m_count;                //!< Number of values
+        unsigned long long  m_sum;                  //!< Sum of the values
+        unsigned long long  m_max;                  //!< Largest value
+    };
+
+    //! Statistics about the scene, its kd-tree, and the queries made.
+    /*! Query counts are kept per thread and summed when the statistics 
+        are requested, so they are exact even with many threads querying. */
+    struct LIBRIEXPORT Statistics
+    {
+        //! Constructor. All counts are zero.
+        Statistics();
+
+        //! The statistics as a JSON object.
+        std::string ToJSON() const;
+
+        // The scene
+        unsigned long long  m_polygons;         //!< Polygons loaded
+        unsigned long long  m_triangles;        //!< Triangles loaded
+        unsigned long long  m_primitives;       //!< Spheres, boxes, cylinders, application primitives, and NURBS patches loaded
+        unsigned long long  m_memory;           //!< Approximate bytes used by the objects and the tree
+
+        // The kd-tree
+        unsigned long long  m_nodes;            //!< Tree nodes
+        unsigned long long  m_leaves;           //!< Leaf nodes
+        unsigned long long  m_emptyLeaves;      //!< Leaf nodes with no members
+        unsigned long long  m_oneChild;         //!< Interior nodes with only one child
+        unsigned long long  m_leafReferences;   //!< Object references over all leaves
+        int                 m_maxDepth;         //!< Number of levels in the tree
+        double              m_intersectionCost; //!< Intersection cost the tree was built with
+        double              m_traverseCost;     //!< Traverse cost the tree was built with
+        Histogram           m_leafSizes;        //!< Members per leaf (logarithmic)
+        Histogram           m_leafDepths;       //!< Depth of each leaf, the root is 0
+
+        // The queries
+        unsigned long long  m_rays;             //!< Rays tested
+        unsigned long long  m_objectTests;      //!< Ray to object distance computations
+        unsigned long long  m_surfaceTests;     //!< Object interior tests
+        Histogram           m_nodesVisited;     //!< Tree nodes visited per ray (logarithmic)
+        Histogram           m_primsTested;      //!< Objects tested per ray (logarithmic)
+    };
+
+    //! Get statistics about the intersection session
+    /*! Returns statistics about the scene answering queries: the objects loaded, 
+        the shape of the kd-tree, and counts and histograms for the queries made
+        since it was built or since ResetStatistics(). This does not touch the 
+        file system and may be called while other threads are querying.
+        \return The statistics. */
+    Statistics GetStatistics() const;
+
+    //! Reset the query counts.
+    /*! Counts made by queries running during the reset may be lost. */
+    void ResetStatistics();
+
     //! Save statistics about the intersection session
     /*! When called, this function creates a file called stats.txt in the current
         directory that contains statistics about the intersection system such as the
         number of rays tested, number of objects tested, and statistics about the kd-tree 
-        that stores the objects. */
+        that stores the objects. See GetStatistics() to get the statistics without
+        writing a file. */
     void SaveStats();
 
 private:
     CRayIntersection(const CRayIntersection &);     // No copy constructor
     CRayIntersection &operator=(const CRayIntersection &);     // No assignment operator
 
-    CRayIntersectionD *ri;
+    CRayIntersectionD *ri;          // The scene being loaded
+    CSceneBuffer      *m_scene;     // The scene answering queries
 };
 
 #endif
@@ -4,6 +4,23 @@
 
 #pragma once
 
+#ifdef NOMFC
+
+// The headless core (RayCore in premake5.lua) builds without MFC or Windows
+#include <cstddef>
+#include <cmath>
+
+// Windows types the portable graphics files use
+typedef unsigned char BYTE;
+
+#ifdef _WIN32
+#include <tchar.h>
+#else
+typedef char _TCHAR;
+#endif
+
+#else
+
 #ifndef VC_EXTRALEAN
 #define VC_EXTRALEAN		// Exclude rarely-used stuff from Windows headers
 #endif
@@ -52,4 +69,4 @@
 #include <afxcmn.h>			// MFC support for Windows Common Controls
 #endif // _AFX_NO_AFXCMN_SUPPORT
 
-
+#endif // NOMFC
@@ -0,0 +1,197 @@
+//
+// Name :         BenchScenes.cpp
+// Description :  Procedural scenes for the ray intersection benchmark.
+//
+
+#include <random>
+
+#include "BenchScenes.h"
+
+using namespace std;
+
+typedef mt19937 Random;
+
+static double Uniform(Random &r, double a, double b)
+{
+    return uniform_real_distribution<double>(a, b)(r);
+}
+
+
+//
+// Name :         Spheres()
+// Description :  A grid of tessellated spheres from 
+//                CGrComposite::SpherePolygons.  Each sphere is 32768 
+//                triangles.  Size is the number of spheres.
+//
+
+static CGrPtr<CGrObject> Spheres(int p_size, unsigned p_seed)
+{
+    Random random(p_seed);
+    CGrComposite *scene = new CGrComposite;
+
+    int across = int(ceil(sqrt(double(p_size))));
+    for(int i=0;  i<p_size;  i++)
+    {
+        double x = (i % across) * 3.;
+        double z = (i / across) * 3.;
+        scene->SpherePolygons(x, Uniform(random, 0, 0.5), z, Uniform(random, 0.75, 1.25), NULL);
+    }
+
+    return scene;
+}
+
+
+//
+// Name :         Molecule()
+// Description :  Atoms and bonds, analytic spheres joined by cylinders
+//                in a random walk that stays in a cube.  Size is the 
+//                number of atoms.
+//
+
+static CGrPtr<CGrObject> Molecule(int p_size, unsigned p_seed)
+{
+    Random random(p_seed);
+    CGrComposite *scene = new CGrComposite;
+
+    double extent = 10. * cbrt(p_size / 1000.);
+    CGrPoint atom(extent / 2, extent / 2, extent / 2);
+    for(int i=0;  i<p_size;  i++)
+    {
+        scene->Sphere(atom.X(), atom.Y(), atom.Z(), Uniform(random, 0.3, 0.5), NULL);
+
+        CGrPoint step(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        step.Normalize3();
+        CGrPoint next = atom + step * 1.2;
+        for(int d=0;  d<3;  d++)
+        {
+            if(next[d] < 0 || next[d] > extent)
+                next[d] = atom[d] - step[d] * 1.2;
+        }
+
+        if(i + 1 < p_size)
+            scene->Cylinder(atom, next, 0.1);
+        atom = next;
+    }
+
+    return scene;
+}
+
+
+//
+// Name :         Soup()
+// Description :  Random triangles of random orientation in a cube.
+//                Size is the number of triangles.
+//
+
+static CGrPtr<CGrObject> Soup(int p_size, unsigned p_seed)
+{
+    Random random(p_seed);
+    CGrComposite *scene = new CGrComposite;
+
+    // Keep the density about the same as the size changes
+    double extent = 10. * cbrt(p_size / 10000.);
+    for(int i=0;  i<p_size;  i++)
+    {
+        CGrPoint a(Uniform(random, 0, extent), Uniform(random, 0, extent), Uniform(random, 0, extent));
+        CGrPoint b = a + CGrPoint(Uniform(random, -0.5, 0.5), Uniform(random, -0.5, 0.5), Uniform(random, -0.5, 0.5), 0);
+        CGrPoint c = a + CGrPoint(Uniform(random, -0.5, 0.5), Uniform(random, -0.5, 0.5), Uniform(random, -0.5, 0.5), 0);
+        scene->Poly3(a, b, c);
+    }
+
+    return scene;
+}
+
+
+//
+// Name :         Building()
+// Description :  An architectural grid.  Floors of rooms, each room a
+//                box of axis aligned planar polygons with some furniture.
+//                Size is the number of rooms along each side of a floor.
+//
+
+static CGrPtr<CGrObject> Building(int p_size, unsigned p_seed)
+{
+    Random random(p_seed);
+    CGrComposite *scene = new CGrComposite;
+
+    const double room = 4.;
+    const double height = 3.;
+    int floors = p_size / 4 + 1;
+
+    for(int f=0;  f<floors;  f++)
+    {
+        for(int i=0;  i<p_size;  i++)
+        {
+            for(int j=0;  j<p_size;  j++)
+            {
+                double x = i * room;
+                double y = f * height;
+                double z = j * room;
+
+                // Floor slab and two walls.  The neighbors supply the others.
+                scene->Box(x, y, z, room, 0.1, room);
+                scene->Box(x, y, z, 0.1, height, room);
+                scene->Box(x, y, z, room, height, 0.1);
+
+                // A table and a couple of cabinets
+                scene->Box(x + Uniform(random, 0.5, 2.5), y, z + Uniform(random, 0.5, 2.5), 1., 0.8, 1.);
+                for(int c=0;  c<2;  c++)
+                    scene->Box(x + Uniform(random, 0.2, 3.4), y, z + 0.1, 0.5, Uniform(random, 1, 2.5), 0.4);
+            }
+        }
+    }
+
+    return scene;
+}
+
+
+//
+// Name :         Slivers()
+// Description :  Long thin triangles at random orientations.  Their
+//                bounding boxes are large and overlap everything, the
+//                worst case for a kd-tree.  Size is the number of triangles.
+//
+
+static CGrPtr<CGrObject> Slivers(int p_size, unsigned p_seed)
+{
+    Random random(p_seed);
+    CGrComposite *scene = new CGrComposite;
+
+    const double extent = 10.;
+    for(int i=0;  i<p_size;  i++)
+    {
+        CGrPoint a(Uniform(random, 0, extent), Uniform(random, 0, extent), Uniform(random, 0, extent));
+        CGrPoint b(Uniform(random, 0, extent), Uniform(random, 0, extent), Uniform(random, 0, extent));
+        CGrPoint w(Uniform(random, -0.01, 0.01), Uniform(random, -0.01, 0.01), Uniform(random, -0.01, 0.01), 0);
+        scene->Poly3(a, b, b + w);
+    }
+
+    return scene;
+}
+
+
+const std::vector<BenchScene> &BenchScenes()
+{
+    static const vector<BenchScene> scenes = {
+        {"spheres", "Tessellated spheres from CGrComposite::SpherePolygons", 4, Spheres},
+        {"soup", "Random triangle soup", 100000, Soup},
+        {"building", "Architectural grid of axis aligned planar polygons", 12, Building},
+        {"slivers", "Long thin triangles", 10000, Slivers},
+        {"molecule", "Analytic spheres and cylinders", 20000, Molecule},
+    };
+
+    return scenes;
+}
+
+
+const BenchScene *FindBenchScene(const std::string &p_name)
+{
+    const vector<BenchScene> &scenes = BenchScenes();
+    for(vector<BenchScene>::const_iterator s=scenes.begin();  s!=scenes.end();  s++)
+    {
+        if(p_name == s->m_name)
+            return &(*s);
+    }
+
+    return NULL;
+}
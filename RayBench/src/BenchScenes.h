@@ -0,0 +1,34 @@
+//
+// Name :         BenchScenes.h
+// Description :  Procedural scenes for the ray intersection benchmark.
+//                Every scene is a function of its size and seed only,
+//                so results are reproducible across versions.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "GrObject.h"
+
+//
+// struct BenchScene
+// A named scene generator
+//
+
+struct BenchScene
+{
+    const char *m_name;         // Name used on the command line and in the output
+    const char *m_description;
+    int         m_defaultSize;  // Size used when none is given
+
+    // Build the scene graph
+    CGrPtr<CGrObject> (*m_build)(int p_size, unsigned p_seed);
+};
+
+// All of the benchmark scenes
+const std::vector<BenchScene> &BenchScenes();
+
+// Find a scene by name or NULL
+const BenchScene *FindBenchScene(const std::string &p_name);
@@ -0,0 +1,362 @@
+//
+// Name :         RayBench.cpp
+// Description :  Headless benchmark for the ray intersection library.
+//                Builds the procedural scenes in BenchScenes.cpp and
+//                reports build time, tree statistics, memory, and ray
+//                throughput as a JSON array on standard output.
+//
+// Usage :        RayBench [options] [scene ...]
+//                  --size n              Scene size (see BenchScenes.cpp)
+//                  --rays n              Rays per ray type (default 1000000)
+//                  --seed n              Random seed (default 1)
+//                  --intersection-cost c SAH intersection cost
+//                  --traverse-cost c     SAH traversal cost
+//                  --max-depth n         Maximum tree depth
+//                  --min-leaf n          Leaves below this will not split
+//                  --build-threads n     Threads for the tree build
+//                  --calibrate           Calibrate the costs on each scene
+//                  --calibration file    Use a calibration profile, creating
+//                                        it if it is missing or out of date
+//                  --list                List the scenes
+//                With no scenes named, all scenes are run.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "graphics/RayIntersection.h"
+#include "graphics/GrRayLoader.h"
+#include "BenchScenes.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point p_start)
+{
+    return chrono::duration<double>(Clock::now() - p_start).count();
+}
+
+// Command line options.  Negative values leave the library default.
+struct Options
+{
+    int         m_size = -1;
+    int         m_rays = 1000000;
+    unsigned    m_seed = 1;
+    double      m_intersectionCost = -1;
+    double      m_traverseCost = -1;
+    int         m_maxDepth = -1;
+    int         m_minLeaf = -1;
+    int         m_buildThreads = -1;
+    bool        m_calibrate = false;
+    string      m_calibrationFile;
+    CRayIntersection::Calibration m_calibration;    // Loaded profile
+    vector<string> m_scenes;
+};
+
+// A batch of rays and the time to trace them
+struct RayBatch
+{
+    vector<CRay>    m_rays;
+    vector<double>  m_maxt;
+    vector<const CRayIntersection::Object *> m_ignore;
+    int             m_hits = 0;
+    double          m_seconds = 0;
+};
+
+
+//
+// Name :         Trace()
+// Description :  Trace a batch of rays, timing only the queries.
+//                Hit points go to p_hits if supplied.
+//
+
+static void Trace(CRayIntersection &p_ri, RayBatch &p_batch,
+                  vector<pair<CGrVector, const CRayIntersection::Object *> > *p_hits)
+{
+    p_batch.m_hits = 0;
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+
+    Clock::time_point start = Clock::now();
+    for(size_t i=0;  i<p_batch.m_rays.size();  i++)
+    {
+        if(p_ri.Intersect(p_batch.m_rays[i], p_batch.m_maxt[i], p_batch.m_ignore[i], object, t, intersect))
+        {
+            p_batch.m_hits++;
+            if(p_hits != NULL)
+                p_hits->push_back(make_pair(intersect, object));
+        }
+    }
+
+    p_batch.m_seconds = Seconds(start);
+}
+
+
+static void BatchJSON(ostream &p_str, const char *p_name, const RayBatch &p_batch)
+{
+    double mrays = p_batch.m_seconds > 0 ? p_batch.m_rays.size() / p_batch.m_seconds / 1e6 : 0;
+    p_str << "  \"" << p_name << "\": {\"rays\": " << p_batch.m_rays.size()
+        << ", \"hits\": " << p_batch.m_hits
+        << ", \"seconds\": " << p_batch.m_seconds
+        << ", \"mraysPerSecond\": " << mrays << "}," << endl;
+}
+
+
+//
+// Name :         RunScene()
+// Description :  Build one scene, trace primary, shadow, and random
+//                direction rays, and write the JSON result.
+//
+
+static void RunScene(const BenchScene &p_scene, const Options &p_options, ostream &p_str)
+{
+    int size = p_options.m_size > 0 ? p_options.m_size : p_scene.m_defaultSize;
+    CGrPtr<CGrObject> graph = p_scene.m_build(size, p_options.m_seed);
+
+    CRayIntersection ri;
+    if(p_options.m_intersectionCost > 0)
+        ri.SetIntersectionCost(p_options.m_intersectionCost);
+    if(p_options.m_traverseCost > 0)
+        ri.SetTraverseCost(p_options.m_traverseCost);
+    if(p_options.m_maxDepth > 0)
+        ri.SetMaxDepth(p_options.m_maxDepth);
+    if(p_options.m_minLeaf > 0)
+        ri.SetMinLeaf(p_options.m_minLeaf);
+    if(p_options.m_buildThreads > 0)
+        ri.SetBuildThreads(p_options.m_buildThreads);
+
+    //
+    // Load and build
+    //
+
+    Clock::time_point start = Clock::now();
+    ri.Initialize();
+    CGrRayLoader loader(ri);
+    loader.Render(graph);
+    double loadSeconds = Seconds(start);
+
+    start = Clock::now();
+    double calibrateSeconds = 0;
+    if(p_options.m_calibration.IsValid())
+        ri.SetCalibration(p_options.m_calibration);
+    else if(p_options.m_calibrate)
+    {
+        ri.Calibrate();
+        calibrateSeconds = Seconds(start);
+        start = Clock::now();
+    }
+
+    ri.LoadingComplete();
+    double buildSeconds = Seconds(start);
+
+    // Scene bounds and a camera looking at the center from outside a corner
+    CGrVector lo(loader.Min().X(), loader.Min().Y(), loader.Min().Z());
+    CGrVector hi(loader.Max().X(), loader.Max().Y(), loader.Max().Z());
+    CGrVector center = (lo + hi) * 0.5;
+    CGrVector diagonal = hi - lo;
+    double radius = diagonal.Length3() * 0.5;
+
+    CGrVector eye = center + CGrVector(0.6, 0.5, 0.8, 0) * (radius * 2);
+    CGrVector light = center + CGrVector(-0.5, 1.0, 0.3, 0) * (radius * 3);
+
+    mt19937 random(p_options.m_seed);
+    uniform_real_distribution<double> unit(0, 1);
+
+    //
+    // Primary rays.  A square image through a 40 degree field of view.
+    //
+
+    RayBatch primary;
+    int width = int(sqrt(double(p_options.m_rays)));
+    CGrVector forward = Normalize3(center - eye);
+    CGrVector right = Normalize3(Cross(forward, CGrVector(0, 1, 0, 0)));
+    CGrVector up = Cross(right, forward);
+    double half = tan(20. * GR_DTOR);
+    for(int r=0;  r<width;  r++)
+    {
+        for(int c=0;  c<width;  c++)
+        {
+            double x = ((c + 0.5) / width * 2 - 1) * half;
+            double y = ((r + 0.5) / width * 2 - 1) * half;
+            primary.m_rays.push_back(CRay(eye, Normalize3(forward + right * x + up * y)));
+            primary.m_maxt.push_back(1e20);
+            primary.m_ignore.push_back(NULL);
+        }
+    }
+
+    vector<pair<CGrVector, const CRayIntersection::Object *> > hits;
+    Trace(ri, primary, &hits);
+
+    //
+    // Shadow rays from each primary hit to the light.  The direction
+    // reaches the light at t=1.
+    //
+
+    RayBatch shadow;
+    for(size_t i=0;  i<hits.size();  i++)
+    {
+        shadow.m_rays.push_back(CRay(hits[i].first, light - hits[i].first));
+        shadow.m_maxt.push_back(1);
+        shadow.m_ignore.push_back(hits[i].second);
+    }
+
+    Trace(ri, shadow, NULL);
+
+    //
+    // Random rays.  Origins uniform in the scene box, directions
+    // uniform on the sphere.
+    //
+
+    RayBatch randomRays;
+    for(int i=0;  i<p_options.m_rays;  i++)
+    {
+        CGrVector o(lo.X() + unit(random) * diagonal.X(),
+                    lo.Y() + unit(random) * diagonal.Y(),
+                    lo.Z() + unit(random) * diagonal.Z());
+
+        double z = unit(random) * 2 - 1;
+        double a = unit(random) * GR_PI2;
+        double s = sqrt(1 - z * z);
+        randomRays.m_rays.push_back(CRay(o, CGrVector(s * cos(a), s * sin(a), z, 0)));
+        randomRays.m_maxt.push_back(1e20);
+        randomRays.m_ignore.push_back(NULL);
+    }
+
+    Trace(ri, randomRays, NULL);
+
+    //
+    // Report
+    //
+
+    p_str << "{" << endl;
+    p_str << "  \"scene\": \"" << p_scene.m_name << "\"," << endl;
+    p_str << "  \"size\": " << size << "," << endl;
+    p_str << "  \"seed\": " << p_options.m_seed << "," << endl;
+    // The costs the tree was built with, after any calibration
+    CRayIntersection::Statistics built = ri.GetStatistics();
+    p_str << "  \"parameters\": {\"intersectionCost\": " << built.m_intersectionCost
+        << ", \"traverseCost\": " << built.m_traverseCost
+        << ", \"maxDepth\": " << ri.GetMaxDepth()
+        << ", \"minLeaf\": " << ri.GetMinLeaf()
+        << ", \"buildThreads\": " << ri.GetBuildThreads() << "}," << endl;
+    p_str << "  \"polygonsRendered\": " << loader.PolygonCnt() << "," << endl;
+    p_str << "  \"loadSeconds\": " << loadSeconds << "," << endl;
+    CRayIntersection::Calibration calibration = ri.GetCalibration();
+    if(calibration.IsValid())
+    {
+        p_str << "  \"calibration\": {\"traverse\": " << calibration.m_traverse
+            << ", \"polygon\": " << calibration.m_polygon
+            << ", \"triangle\": " << calibration.m_triangle
+            << ", \"seconds\": " << calibrateSeconds << "}," << endl;
+    }
+    p_str << "  \"buildSeconds\": " << buildSeconds << "," << endl;
+    BatchJSON(p_str, "primary", primary);
+    BatchJSON(p_str, "shadow", shadow);
+    BatchJSON(p_str, "random", randomRays);
+    p_str << "  \"statistics\": " << ri.GetStatistics().ToJSON();
+    p_str << "}";
+}
+
+
+static void Usage()
+{
+    cerr << "Usage: RayBench [--size n] [--rays n] [--seed n] [--intersection-cost c]" << endl;
+    cerr << "                [--traverse-cost c] [--max-depth n] [--min-leaf n]" << endl;
+    cerr << "                [--build-threads n] [--calibrate] [--calibration file]" << endl;
+    cerr << "                [--list] [scene ...]" << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    for(int a=1;  a<argc;  a++)
+    {
+        string arg = argv[a];
+        bool hasValue = a + 1 < argc;
+
+        if(arg == "--list")
+        {
+            const vector<BenchScene> &scenes = BenchScenes();
+            for(vector<BenchScene>::const_iterator s=scenes.begin();  s!=scenes.end();  s++)
+                cout << s->m_name << "\t" << s->m_defaultSize << "\t" << s->m_description << endl;
+            return 0;
+        }
+        else if(arg == "--size" && hasValue)
+            options.m_size = atoi(argv[++a]);
+        else if(arg == "--rays" && hasValue)
+            options.m_rays = atoi(argv[++a]);
+        else if(arg == "--seed" && hasValue)
+            options.m_seed = unsigned(strtoul(argv[++a], NULL, 10));
+        else if(arg == "--intersection-cost" && hasValue)
+            options.m_intersectionCost = atof(argv[++a]);
+        else if(arg == "--traverse-cost" && hasValue)
+            options.m_traverseCost = atof(argv[++a]);
+        else if(arg == "--max-depth" && hasValue)
+            options.m_maxDepth = atoi(argv[++a]);
+        else if(arg == "--min-leaf" && hasValue)
+            options.m_minLeaf = atoi(argv[++a]);
+        else if(arg == "--build-threads" && hasValue)
+            options.m_buildThreads = atoi(argv[++a]);
+        else if(arg == "--calibrate")
+            options.m_calibrate = true;
+        else if(arg == "--calibration" && hasValue)
+            options.m_calibrationFile = argv[++a];
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            Usage();
+            return 1;
+        }
+        else if(FindBenchScene(arg) == NULL)
+        {
+            cerr << "Unknown scene " << arg << endl;
+            return 1;
+        }
+        else
+            options.m_scenes.push_back(arg);
+    }
+
+    if(options.m_scenes.empty())
+    {
+        const vector<BenchScene> &scenes = BenchScenes();
+        for(vector<BenchScene>::const_iterator s=scenes.begin();  s!=scenes.end();  s++)
+            options.m_scenes.push_back(s->m_name);
+    }
+
+    //
+    // A calibration profile is measured once on an empty scene
+    // and reused by later runs on this machine.
+    //
+
+    if(!options.m_calibrationFile.empty() && !options.m_calibration.Load(options.m_calibrationFile.c_str()))
+    {
+        CRayIntersection ri;
+        options.m_calibration = ri.Calibrate();
+        if(!options.m_calibration.Save(options.m_calibrationFile.c_str()))
+            cerr << "Unable to write " << options.m_calibrationFile << endl;
+    }
+
+    cout.precision(10);
+    cout << "[" << endl;
+    for(size_t s=0;  s<options.m_scenes.size();  s++)
+    {
+        if(s > 0)
+            cout << "," << endl;
+
+        RunScene(*FindBenchScene(options.m_scenes[s]), options, cout);
+        cout.flush();
+    }
+
+    cout << endl << "]" << endl;
+    return 0;
+}
@@ -0,0 +1,308 @@
+//
+// Name :         RayCoreBench.cpp
+// Description :  Benchmark for the headless ray intersection core.  The
+//                scenes are generated directly through the CRayIntersection
+//                loading calls, so nothing from the graphics layer is
+//                needed.  Results are a JSON array on standard output in
+//                the same form as RayBench.
+//
+// Usage :        RayCoreBench [options] [scene ...]
+//                  --size n              Scene size
+//                  --rays n              Rays to trace (default 1000000)
+//                  --seed n              Random seed (default 1)
+//                  --build-threads n     Threads for the tree build
+//                  --calibration file    Use a calibration profile, creating
+//                                        it if it is missing or out of date
+//                With no scenes named, all scenes are run.
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "graphics/RayIntersection.h"
+#include "graphics/GrTransform.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+typedef mt19937 Random;
+
+static double Seconds(Clock::time_point p_start)
+{
+    return chrono::duration<double>(Clock::now() - p_start).count();
+}
+
+static double Uniform(Random &r, double a, double b)
+{
+    return uniform_real_distribution<double>(a, b)(r);
+}
+
+static void AddTriangle(CRayIntersection &p_ri, const CGrVector &a, const CGrVector &b, const CGrVector &c)
+{
+    p_ri.TriangleBegin();
+    p_ri.Normal(Normalize3(Cross(b - a, c - a)));
+    p_ri.Vertex(a);
+    p_ri.Vertex(b);
+    p_ri.Vertex(c);
+    p_ri.TriangleEnd();
+}
+
+
+//
+// Scenes.  Each loads its objects, sets the upper corner of the
+// scene box, and returns the number loaded.
+//
+
+// Random triangles in a cube, size is the number of triangles
+static int Soup(CRayIntersection &p_ri, int p_size, Random &p_random, CGrVector &p_hi)
+{
+    double extent = 10. * cbrt(p_size / 10000.);
+    p_hi.Set(extent, extent, extent);
+    for(int i=0;  i<p_size;  i++)
+    {
+        CGrVector a(Uniform(p_random, 0, extent), Uniform(p_random, 0, extent), Uniform(p_random, 0, extent));
+        CGrVector b = a + CGrVector(Uniform(p_random, -0.5, 0.5), Uniform(p_random, -0.5, 0.5), Uniform(p_random, -0.5, 0.5), 0);
+        CGrVector c = a + CGrVector(Uniform(p_random, -0.5, 0.5), Uniform(p_random, -0.5, 0.5), Uniform(p_random, -0.5, 0.5), 0);
+        AddTriangle(p_ri, a, b, c);
+    }
+
+    return p_size;
+}
+
+// A grid of spheres, 128 by 64 quadrilaterals each, size is the number of spheres
+static int Spheres(CRayIntersection &p_ri, int p_size, Random &p_random, CGrVector &p_hi)
+{
+    const int slices = 128;
+    const int stacks = 64;
+    int across = int(ceil(sqrt(double(p_size))));
+    p_hi.Set(across * 3., 2., across * 3.);
+    int cnt = 0;
+
+    for(int s=0;  s<p_size;  s++)
+    {
+        CGrVector center((s % across) * 3., Uniform(p_random, 0, 0.5), (s / across) * 3.);
+        double radius = Uniform(p_random, 0.75, 1.25);
+
+        for(int j=0;  j<stacks;  j++)
+        {
+            for(int i=0;  i<slices;  i++)
+            {
+                p_ri.PolygonBegin();
+                int corners[4][2] = {{i, j}, {i, j + 1}, {i + 1, j + 1}, {i + 1, j}};
+                for(int c=0;  c<4;  c++)
+                {
+                    double a = corners[c][0] * GR_PI2 / slices;
+                    double b = corners[c][1] * GR_PI / stacks;
+                    CGrVector n(sin(b) * cos(a), cos(b), sin(b) * sin(a), 0);
+                    p_ri.Normal(n);
+                    p_ri.Vertex(center + n * radius);
+                }
+
+                p_ri.PolygonEnd();
+                cnt++;
+            }
+        }
+    }
+
+    return cnt;
+}
+
+// Long thin triangles, size is the number of triangles
+static int Slivers(CRayIntersection &p_ri, int p_size, Random &p_random, CGrVector &p_hi)
+{
+    const double extent = 10.;
+    p_hi.Set(extent, extent, extent);
+    for(int i=0;  i<p_size;  i++)
+    {
+        CGrVector a(Uniform(p_random, 0, extent), Uniform(p_random, 0, extent), Uniform(p_random, 0, extent));
+        CGrVector b(Uniform(p_random, 0, extent), Uniform(p_random, 0, extent), Uniform(p_random, 0, extent));
+        CGrVector w(Uniform(p_random, -0.01, 0.01), Uniform(p_random, -0.01, 0.01), Uniform(p_random, -0.01, 0.01), 0);
+        AddTriangle(p_ri, a, b, b + w);
+    }
+
+    return p_size;
+}
+
+struct CoreScene
+{
+    const char *m_name;
+    int         m_defaultSize;
+    int (*m_load)(CRayIntersection &p_ri, int p_size, Random &p_random, CGrVector &p_hi);
+};
+
+static const CoreScene g_scenes[] = {
+    {"soup", 100000, Soup},
+    {"spheres", 16, Spheres},
+    {"slivers", 10000, Slivers},
+};
+
+static const CoreScene *FindScene(const string &p_name)
+{
+    for(const CoreScene &scene : g_scenes)
+    {
+        if(p_name == scene.m_name)
+            return &scene;
+    }
+
+    return NULL;
+}
+
+
+// Command line options.  Negative values leave the library default.
+struct Options
+{
+    int         m_size = -1;
+    int         m_rays = 1000000;
+    unsigned    m_seed = 1;
+    int         m_buildThreads = -1;
+    CRayIntersection::Calibration m_calibration;
+    vector<string> m_scenes;
+};
+
+
+//
+// Name :         TraceRandom()
+// Description :  Trace rays from random points in the scene box in
+//                random directions.  Returns the number of hits.
+//
+
+static int TraceRandom(CRayIntersection &p_ri, int p_rays, unsigned p_seed, const CGrVector &p_lo, const CGrVector &p_hi)
+{
+    Random random(p_seed);
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    int hits = 0;
+
+    for(int i=0;  i<p_rays;  i++)
+    {
+        CGrVector o(Uniform(random, p_lo.X(), p_hi.X()), Uniform(random, p_lo.Y(), p_hi.Y()), Uniform(random, p_lo.Z(), p_hi.Z()));
+        double z = Uniform(random, -1, 1);
+        double a = Uniform(random, 0, GR_PI2);
+        double s = sqrt(1 - z * z);
+
+        if(p_ri.Intersect(CRay(o, CGrVector(s * cos(a), s * sin(a), z, 0)), 1e20, NULL, object, t, intersect))
+            hits++;
+    }
+
+    return hits;
+}
+
+
+static void RunScene(const CoreScene &p_scene, const Options &p_options, ostream &p_str)
+{
+    int size = p_options.m_size > 0 ? p_options.m_size : p_scene.m_defaultSize;
+    Random random(p_options.m_seed);
+
+    CRayIntersection ri;
+    if(p_options.m_buildThreads > 0)
+        ri.SetBuildThreads(p_options.m_buildThreads);
+    if(p_options.m_calibration.IsValid())
+        ri.SetCalibration(p_options.m_calibration);
+
+    Clock::time_point start = Clock::now();
+    ri.Initialize();
+    CGrVector lo(-1, -1, -1);
+    CGrVector hi;
+    int objects = p_scene.m_load(ri, size, random, hi);
+    double loadSeconds = Seconds(start);
+
+    start = Clock::now();
+    ri.LoadingComplete();
+    double buildSeconds = Seconds(start);
+
+    start = Clock::now();
+    int hits = TraceRandom(ri, p_options.m_rays, p_options.m_seed + 1, lo, hi);
+    double traceSeconds = Seconds(start);
+    double rays = p_options.m_rays;
+
+    p_str << "{" << endl;
+    p_str << "  \"scene\": \"" << p_scene.m_name << "\"," << endl;
+    p_str << "  \"size\": " << size << "," << endl;
+    p_str << "  \"seed\": " << p_options.m_seed << "," << endl;
+    p_str << "  \"objectsLoaded\": " << objects << "," << endl;
+    p_str << "  \"loadSeconds\": " << loadSeconds << "," << endl;
+    p_str << "  \"buildSeconds\": " << buildSeconds << "," << endl;
+    p_str << "  \"random\": {\"rays\": " << rays
+        << ", \"hits\": " << hits
+        << ", \"seconds\": " << traceSeconds
+        << ", \"mraysPerSecond\": " << (traceSeconds > 0 ? rays / traceSeconds / 1e6 : 0) << "}," << endl;
+    p_str << "  \"statistics\": " << ri.GetStatistics().ToJSON();
+    p_str << "}";
+}
+
+
+static void Usage()
+{
+    cerr << "Usage: RayCoreBench [--size n] [--rays n] [--seed n] [--build-threads n]" << endl;
+    cerr << "                     [--calibration file] [scene ...]" << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    string calibrationFile;
+
+    for(int a=1;  a<argc;  a++)
+    {
+        string arg = argv[a];
+        bool hasValue = a + 1 < argc;
+
+        if(arg == "--size" && hasValue)
+            options.m_size = atoi(argv[++a]);
+        else if(arg == "--rays" && hasValue)
+            options.m_rays = atoi(argv[++a]);
+        else if(arg == "--seed" && hasValue)
+            options.m_seed = unsigned(strtoul(argv[++a], NULL, 10));
+        else if(arg == "--build-threads" && hasValue)
+            options.m_buildThreads = atoi(argv[++a]);
+        else if(arg == "--calibration" && hasValue)
+            calibrationFile = argv[++a];
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            Usage();
+            return 1;
+        }
+        else if(FindScene(arg) == NULL)
+        {
+            cerr << "Unknown scene " << arg << endl;
+            return 1;
+        }
+        else
+            options.m_scenes.push_back(arg);
+    }
+
+    if(options.m_scenes.empty())
+    {
+        for(const CoreScene &scene : g_scenes)
+            options.m_scenes.push_back(scene.m_name);
+    }
+
+    if(!calibrationFile.empty() && !options.m_calibration.Load(calibrationFile.c_str()))
+    {
+        CRayIntersection ri;
+        options.m_calibration = ri.Calibrate();
+        if(!options.m_calibration.Save(calibrationFile.c_str()))
+            cerr << "Unable to write " << calibrationFile << endl;
+    }
+
+    cout.precision(10);
+    cout << "[" << endl;
+    for(size_t s=0;  s<options.m_scenes.size();  s++)
+    {
+        if(s > 0)
+            cout << "," << endl;
+
+        RunScene(*FindScene(options.m_scenes[s]), options, cout);
+        cout.flush();
+    }
+
+    cout << endl << "]" << endl;
+    return 0;
+}
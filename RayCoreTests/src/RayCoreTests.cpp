@@ -0,0 +1,2209 @@
+//
+// Name :         RayCoreTests.cpp
+// Description :  Unit tests for the headless ray intersection core.
+//                Each test is a function registered in main().  Failures
+//                are reported on standard error and the exit status is
+//                the number of failed tests.
+//
+// Usage :        RayCoreTests [test ...]
+//                With no tests named, all tests are run.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stdafx.h"
+#include "graphics/RayIntersection.h"
+#include "graphics/GrTransform.h"
+#include "graphics/GrTextureSampling.h"
+#include "graphics/GrImageFile.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+
+static int g_failures = 0;
+
+#define CHECK(c) Check((c), #c, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b) Check(fabs((a) - (b)) < 1e-9, #a " == " #b, __FILE__, __LINE__)
+
+static void Check(bool p_ok, const char *p_what, const char *p_file, int p_line)
+{
+    if(!p_ok)
+    {
+        cerr << p_file << "(" << p_line << "): CHECK(" << p_what << ") failed" << endl;
+        g_failures++;
+    }
+}
+
+static bool Near(const CGrVector &a, const CGrVector &b)
+{
+    return fabs(a.X() - b.X()) < 1e-9 && fabs(a.Y() - b.Y()) < 1e-9 && fabs(a.Z() - b.Z()) < 1e-9;
+}
+
+typedef mt19937 Random;
+
+static double Uniform(Random &r, double a, double b)
+{
+    return uniform_real_distribution<double>(a, b)(r);
+}
+
+static CGrVector RandomPoint(Random &r, double p_extent)
+{
+    return CGrVector(Uniform(r, 0, p_extent), Uniform(r, 0, p_extent), Uniform(r, 0, p_extent));
+}
+
+// Add a triangle with its face normal
+static void AddTriangle(CRayIntersection &p_ri, const CGrVector &a, const CGrVector &b, const CGrVector &c)
+{
+    p_ri.TriangleBegin();
+    p_ri.Normal(Normalize3(Cross(b - a, c - a)));
+    p_ri.Vertex(a);
+    p_ri.Vertex(b);
+    p_ri.Vertex(c);
+    p_ri.TriangleEnd();
+}
+
+// Add an axis aligned square at height z, x and y from 0 to s
+static void AddSquare(CRayIntersection &p_ri, double z, double s)
+{
+    p_ri.PolygonBegin();
+    p_ri.Normal(CGrVector(0, 0, 1, 0));
+    p_ri.TexVertex(CGrVector(0, 0));
+    p_ri.Vertex(CGrVector(0, 0, z));
+    p_ri.TexVertex(CGrVector(1, 0));
+    p_ri.Vertex(CGrVector(s, 0, z));
+    p_ri.TexVertex(CGrVector(1, 1));
+    p_ri.Vertex(CGrVector(s, s, z));
+    p_ri.TexVertex(CGrVector(0, 1));
+    p_ri.Vertex(CGrVector(0, s, z));
+    p_ri.PolygonEnd();
+}
+
+
+//
+// The vector and transform classes
+//
+
+static void TestVector()
+{
+    CGrVector a(1, 2, 3, 0);
+    CGrVector b(4, 5, 6, 0);
+
+    CHECK_NEAR(Dot3(a, b), 32.);
+    CHECK(Near(Cross(CGrVector(1, 0, 0, 0), CGrVector(0, 1, 0, 0)), CGrVector(0, 0, 1, 0)));
+    CHECK(Near(a + b, CGrVector(5, 7, 9)));
+    CHECK(Near(b - a, CGrVector(3, 3, 3)));
+    CHECK_NEAR(Normalize3(b).Length3(), 1.);
+    CHECK_NEAR(CGrVector(3, 4, 0, 0).Length3(), 5.);
+}
+
+static void TestTransform()
+{
+    CGrTransform r;
+    r.SetRotate(90, CGrPoint(0, 0, 1, 0));
+
+    CGrPoint p = r * CGrPoint(1, 0, 0);
+    CHECK_NEAR(p.X(), 0.);
+    CHECK_NEAR(p.Y(), 1.);
+    CHECK_NEAR(p.Z(), 0.);
+
+    CGrTransform t;
+    t.SetTranslate(1, 2, 3);
+    CGrTransform m = t * r;
+
+    CGrTransform inverse;
+    inverse.SetAffineInverse(m);
+    CGrTransform identity = m * inverse;
+    for(int i=0;  i<4;  i++)
+        for(int j=0;  j<4;  j++)
+            CHECK_NEAR(identity[i][j], i == j ? 1. : 0.);
+}
+
+
+//
+// Intersection with single objects
+//
+
+static void TestTriangle()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    AddTriangle(ri, CGrVector(0, 0, 0), CGrVector(1, 0, 0), CGrVector(0, 1, 0));
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+
+    // Straight down through the triangle
+    CHECK(ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 2.);
+    CHECK(Near(intersect, CGrVector(0.25, 0.25, 0)));
+    CHECK(object != NULL && object->Type() == CRayIntersection::Triangle);
+
+    // Beyond the hypotenuse, too far, and ignored
+    CHECK(!ri.Intersect(CRay(CGrVector(0.75, 0.75, 2), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK(!ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), CGrVector(0, 0, -1, 0)), 1.5, NULL, object, t, intersect));
+
+    const CRayIntersection::Object *hit;
+    ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), CGrVector(0, 0, -1, 0)), 1e20, NULL, hit, t, intersect);
+    CHECK(!ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), CGrVector(0, 0, -1, 0)), 1e20, hit, object, t, intersect));
+}
+
+static void TestPolygonInfo()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    AddSquare(ri, 1, 2);
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    CRay ray(CGrVector(1.5, 0.5, 3), CGrVector(0, 0, -1, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 2.);
+
+    CGrVector normal, texcoord;
+    IMaterial *material;
+    ITexture *texture;
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(0, 0, 1, 0)));
+    CHECK_NEAR(texcoord.X(), 0.75);
+    CHECK_NEAR(texcoord.Y(), 0.25);
+    CHECK(material == NULL);
+}
+
+// The nearest of several stacked objects is the one found
+static void TestNearest()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    for(int i=0;  i<10;  i++)
+        AddSquare(ri, i, 1);
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    CHECK(ri.Intersect(CRay(CGrVector(0.5, 0.5, 20), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(intersect.Z(), 9.);
+    CHECK(ri.Intersect(CRay(CGrVector(0.5, 0.5, -5), CGrVector(0, 0, 1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(intersect.Z(), 0.);
+}
+
+// Spheres, boxes, and cylinders with their exact normals and texture coordinates
+static void TestPrimitives()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    ri.AddSphere(CGrVector(0, 0, 0), 1);
+    ri.AddBox(CGrVector(4, 0, 0), CGrVector(6, 1, 2));
+    ri.AddCylinder(CGrVector(10, 0, 0), CGrVector(10, 2, 0), 0.5);
+    ri.LoadingComplete();
+
+    CHECK(ri.GetStatistics().m_primitives == 3);
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    CGrVector normal, texcoord;
+    IMaterial *material;
+    ITexture *texture;
+
+    // The sphere from the front, at s = 0.5 and t = 0.5
+    CRay ray(CGrVector(0, 0, 5), CGrVector(0, 0, -1, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 4.);
+    CHECK(object != NULL && object->Type() == CRayIntersection::Sphere);
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(0, 0, 1, 0)));
+    CHECK_NEAR(texcoord.X(), 0.5);
+    CHECK_NEAR(texcoord.Y(), 0.5);
+
+    // From inside, the far side
+    ray = CRay(CGrVector(0, 0, 0), CGrVector(1, 0, 0, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 1.);
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(1, 0, 0, 0)));
+    CHECK_NEAR(texcoord.X(), 0.75);
+
+    // The box top, mapped as CGrComposite::Box() maps it
+    ray = CRay(CGrVector(4.5, 3, 1.5), CGrVector(0, -1, 0, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 2.);
+    CHECK(object != NULL && object->Type() == CRayIntersection::Box);
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(0, 1, 0, 0)));
+    CHECK_NEAR(texcoord.X(), 0.25);
+    CHECK_NEAR(texcoord.Y(), 0.25);
+
+    // The box from the right side, at an angle
+    ray = CRay(CGrVector(8, 0.5, 1), CGrVector(-2, 0, 0.5, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK(Near(intersect, CGrVector(6, 0.5, 1.5)));
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(1, 0, 0, 0)));
+    CHECK_NEAR(texcoord.X(), 0.25);
+    CHECK_NEAR(texcoord.Y(), 0.5);
+
+    // The cylinder side, halfway up, and the top cap
+    ray = CRay(CGrVector(10, 1, 3), CGrVector(0, 0, -1, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 2.5);
+    CHECK(object != NULL && object->Type() == CRayIntersection::Cylinder);
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(0, 0, 1, 0)));
+    CHECK_NEAR(texcoord.X(), 0.5);
+    CHECK_NEAR(texcoord.Y(), 0.5);
+
+    ray = CRay(CGrVector(10.25, 5, 0), CGrVector(0, -1, 0, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 3.);
+    ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(0, 1, 0, 0)));
+    CHECK_NEAR(texcoord.X(), 0.75);
+
+    // Past the end of the cylinder and between the objects
+    CHECK(!ri.Intersect(CRay(CGrVector(10, 2.5, 3), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK(!ri.Intersect(CRay(CGrVector(2.5, 0.5, 3), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+}
+
+// A grid of many spheres, each ray straight down onto one
+static void TestManySpheres()
+{
+    const int N = 40;
+
+    CRayIntersection ri;
+    ri.Initialize();
+    for(int i=0;  i<N;  i++)
+        for(int j=0;  j<N;  j++)
+            ri.AddSphere(CGrVector(i * 2., 0, j * 2.), 0.5 + 0.01 * ((i + j) % 10));
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    for(int i=0;  i<N;  i++)
+    {
+        for(int j=0;  j<N;  j++)
+        {
+            double radius = 0.5 + 0.01 * ((i + j) % 10);
+            CHECK(ri.Intersect(CRay(CGrVector(i * 2., 10, j * 2.), CGrVector(0, -1, 0, 0)), 1e20, NULL, object, t, intersect));
+            CHECK_NEAR(t, 10 - radius);
+        }
+    }
+
+    CHECK(!ri.Intersect(CRay(CGrVector(1, 10, 1), CGrVector(0, -1, 0, 0)), 1e20, NULL, object, t, intersect));
+}
+
+// A horizontal disk supplied as an application primitive
+class CDisk : public CRayIntersection::Primitive
+{
+public:
+    CDisk(const CGrVector &p_center, double p_radius) : m_center(p_center), m_radius(p_radius) {}
+
+    virtual void Bounds(CGrVector &p_min, CGrVector &p_max) const
+    {
+        p_min = m_center - CGrVector(m_radius, 0, m_radius, 0);
+        p_max = m_center + CGrVector(m_radius, 0, m_radius, 0);
+    }
+
+    virtual double Intersect(const CRay &p_ray) const
+    {
+        if(p_ray.Direction(1) == 0)
+            return -1;
+
+        double t = (m_center.Y() - p_ray.Origin(1)) / p_ray.Direction(1);
+        CGrVector d = p_ray.PointOnRay(t) - m_center;
+        return d.X() * d.X() + d.Z() * d.Z() <= m_radius * m_radius ? t : -1;
+    }
+
+    virtual void IntersectInfo(const CGrVector &p_intersect, CGrVector &p_normal, CGrVector &p_texcoord) const
+    {
+        p_normal = CGrVector(0, 1, 0, 0);
+        p_texcoord = CGrVector(p_intersect.X() - m_center.X(), p_intersect.Z() - m_center.Z(), 0);
+    }
+
+private:
+    CGrVector   m_center;
+    double      m_radius;
+};
+
+// A disk that rises with the time of the ray
+class CRisingDisk : public CDisk
+{
+public:
+    CRisingDisk() : CDisk(CGrVector(0, 0, 0), 1), m_mask(0) {}
+
+    virtual void Bounds(CGrVector &p_min, CGrVector &p_max) const
+    {
+        p_min = CGrVector(-1, 0, -1);
+        p_max = CGrVector(1, 1, 1);
+    }
+
+    virtual double Intersect(const CRay &p_ray) const
+    {
+        m_mask = p_ray.Mask();
+        return CDisk::Intersect(CRay(p_ray.Origin() - CGrVector(0, p_ray.Time(), 0, 0), p_ray.Direction()));
+    }
+
+    mutable unsigned int m_mask;    // Mask of the last ray
+};
+
+// A sphere supplied as an application primitive, which the system only
+// knows the nearest points of
+class CBall : public CRayIntersection::Primitive
+{
+public:
+    CBall(const CGrVector &p_center, double p_radius) : m_center(p_center), m_radius(p_radius) {}
+
+    const CGrVector &Center() const {return m_center;}
+
+    virtual void Bounds(CGrVector &p_min, CGrVector &p_max) const
+    {
+        p_min = m_center - CGrVector(m_radius, m_radius, m_radius, 0);
+        p_max = m_center + CGrVector(m_radius, m_radius, m_radius, 0);
+    }
+
+    virtual double Intersect(const CRay &p_ray) const
+    {
+        CGrVector m = p_ray.Origin() - m_center;
+        double a = Dot3(p_ray.Direction(), p_ray.Direction());
+        double b = Dot3(m, p_ray.Direction());
+        double disc = b * b - a * (Dot3(m, m) - m_radius * m_radius);
+        return disc < 0 ? -1 : (-b - sqrt(disc)) / a;
+    }
+
+    virtual void IntersectInfo(const CGrVector &p_intersect, CGrVector &p_normal, CGrVector &p_texcoord) const
+    {
+        p_normal = p_intersect - m_center;
+        p_normal.Normalize3();
+        p_texcoord = CGrVector(0, 0, 0);
+    }
+
+    virtual bool ClosestPoint(const CGrVector &p_point, CGrVector &p_closest) const
+    {
+        CGrVector d = p_point - m_center;
+        d.Normalize3();
+        p_closest = m_center + d * m_radius;
+        return true;
+    }
+
+private:
+    CGrVector   m_center;
+    double      m_radius;
+};
+
+static void TestUserPrimitive()
+{
+    const int N = 20;
+    vector<CDisk> disks;
+    for(int i=0;  i<N;  i++)
+        for(int j=0;  j<N;  j++)
+            disks.push_back(CDisk(CGrVector(i * 2., (i + j) % 3, j * 2.), 0.75));
+
+    CRayIntersection ri;
+    ri.Initialize();
+    for(size_t d=0;  d<disks.size();  d++)
+        ri.AddPrimitive(&disks[d]);
+    ri.LoadingComplete();
+
+    CHECK(ri.GetStatistics().m_primitives == N * N);
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    for(int i=0;  i<N;  i++)
+    {
+        for(int j=0;  j<N;  j++)
+        {
+            CRay ray(CGrVector(i * 2. + 0.5, 10, j * 2.), CGrVector(0, -1, 0, 0));
+            CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+            CHECK_NEAR(t, 10. - (i + j) % 3);
+            CHECK(object != NULL && object->Type() == CRayIntersection::Other);
+            CHECK(CRayIntersection::GetPrimitive(object) == &disks[i * N + j]);
+
+            CGrVector normal, texcoord;
+            IMaterial *material;
+            ITexture *texture;
+            ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+            CHECK(Near(normal, CGrVector(0, 1, 0, 0)));
+            CHECK_NEAR(texcoord.X(), 0.5);
+        }
+    }
+
+    // Between the disks, and from below the lowest
+    CHECK(!ri.Intersect(CRay(CGrVector(1, 10, 1), CGrVector(0, -1, 0, 0)), 1e20, NULL, object, t, intersect));
+    CHECK(ri.Intersect(CRay(CGrVector(0, -5, 0), CGrVector(0, 1, 0, 0)), 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 5.);
+
+    // The primitive sees the time and mask of the ray
+    CRisingDisk rising;
+    CRayIntersection moving;
+    moving.Initialize();
+    moving.AddPrimitive(&rising);
+    moving.LoadingComplete();
+
+    CRay late(CGrVector(0, 10, 0), CGrVector(0, -1, 0, 0), 0.75);
+    late.SetMask(0x11);
+    CHECK(moving.Intersect(late, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 9.25);
+    CHECK(rising.m_mask == 0x11);
+
+    // Objects the system made itself are not application primitives
+    CRayIntersection tri;
+    tri.Initialize();
+    AddTriangle(tri, CGrVector(0, 0, 0), CGrVector(1, 0, 0), CGrVector(0, 1, 0));
+    tri.LoadingComplete();
+    CHECK(tri.Intersect(CRay(CGrVector(0.25, 0.25, 2), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK(CRayIntersection::GetPrimitive(object) == NULL);
+}
+
+
+// A point on a cubic B-spline curve of homogeneous points by de Boor's
+// algorithm, independent of the patches the system makes
+static CGrVector DeBoor(int p_size, const CGrVector *p_points, const double *p_knots, double x)
+{
+    int span = 3;
+    while(span < p_size - 1 && p_knots[span + 1] <= x)
+        span++;
+
+    CGrVector d[4];
+    for(int m=0;  m<4;  m++)
+        d[m] = p_points[span - 3 + m];
+
+    for(int r=1;  r<=3;  r++)
+    {
+        for(int m=3;  m>=r;  m--)
+        {
+            int j = span - 3 + m;
+            double a = (x - p_knots[j]) / (p_knots[j + 4 - r] - p_knots[j]);
+            d[m] = d[m - 1] * (1 - a) + d[m] * a;
+        }
+    }
+
+    return d[3];
+}
+
+// A wavy sheet over x and z, rational where the weights are not 1
+struct Sheet
+{
+    enum {USIZE=7, VSIZE=6};
+
+    Sheet(double p_weight)
+    {
+        for(int u=0;  u<USIZE;  u++)
+        {
+            for(int v=0;  v<VSIZE;  v++)
+            {
+                points[u * VSIZE + v] = CGrVector(u, sin(u * 1.3 + v * 0.7), v * 1.2, 
+                    (u + v) % 3 == 1 ? p_weight : 1.);
+            }
+        }
+
+        // Clamped in u, not uniform in v
+        const double uk[USIZE + 4] = {0, 0, 0, 0, 1, 2, 4, 5, 5, 5, 5};
+        const double vk[VSIZE + 4] = {0, 0.5, 1, 1.5, 2.5, 3, 3.5, 4, 4.5, 5};
+        for(int i=0;  i<USIZE + 4;  i++)
+            uknots[i] = uk[i];
+        for(int i=0;  i<VSIZE + 4;  i++)
+            vknots[i] = vk[i];
+    }
+
+    CGrVector Point(double s, double t) const
+    {
+        double u = uknots[3] + s * (uknots[USIZE] - uknots[3]);
+        double v = vknots[3] + t * (vknots[VSIZE] - vknots[3]);
+
+        CGrVector column[USIZE];
+        for(int i=0;  i<USIZE;  i++)
+        {
+            CGrVector row[VSIZE];
+            for(int j=0;  j<VSIZE;  j++)
+            {
+                const CGrVector &p = points[i * VSIZE + j];
+                row[j] = CGrVector(p.X() * p.W(), p.Y() * p.W(), p.Z() * p.W(), p.W());
+            }
+
+            column[i] = DeBoor(VSIZE, row, vknots, v);
+        }
+
+        CGrVector p = DeBoor(USIZE, column, uknots, u);
+        return CGrVector(p.X() / p.W(), p.Y() / p.W(), p.Z() / p.W());
+    }
+
+    CGrVector   points[USIZE * VSIZE];
+    double      uknots[USIZE + 4];
+    double      vknots[VSIZE + 4];
+};
+
+static void TestNurbs()
+{
+    const double WEIGHTS[2] = {1, 2.5};
+    unsigned long long exactMemory = 0;
+    for(int w=0;  w<2;  w++)
+    {
+        Sheet sheet(WEIGHTS[w]);
+
+        CRayIntersection ri;
+        ri.Initialize();
+        ri.AddNurbs(Sheet::USIZE, Sheet::VSIZE, sheet.points, sheet.uknots, sheet.vknots);
+        ri.LoadingComplete();
+
+        // One patch for each span with a length: 4 in u and 3 in v
+        CHECK(ri.GetStatistics().m_primitives == 12);
+        exactMemory = ri.GetStatistics().m_memory;
+
+        const CRayIntersection::Object *object;
+        double t;
+        CGrVector intersect;
+        for(int i=0;  i<=20;  i++)
+        {
+            for(int j=0;  j<=20;  j++)
+            {
+                double s = 0.01 + 0.98 * i / 20.;
+                double tc = 0.01 + 0.98 * j / 20.;
+                CGrVector p = sheet.Point(s, tc);
+                CGrVector d(0.1, -1, 0.05, 0);
+
+                CRay ray(p - d * 5, d);
+                CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+                CHECK(fabs(t - 5) < 1e-6);
+                CHECK(object != NULL && object->Type() == CRayIntersection::Nurbs);
+
+                CGrVector normal, texcoord;
+                IMaterial *material;
+                ITexture *texture;
+                ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+                CHECK(fabs(texcoord.X() - s) < 1e-6 && fabs(texcoord.Y() - tc) < 1e-6);
+
+                // The normal is perpendicular to the surface
+                const double h = 1e-5;
+                CGrVector ds = sheet.Point(s + h, tc) - sheet.Point(s - h, tc);
+                CGrVector dt = sheet.Point(s, tc + h) - sheet.Point(s, tc - h);
+                CHECK(fabs(normal.Length3() - 1) < 1e-9);
+                CHECK(fabs(Dot3(normal, Normalize3(ds))) < 1e-4 && fabs(Dot3(normal, Normalize3(dt))) < 1e-4);
+            }
+        }
+
+        // Beside the sheet
+        CHECK(!ri.Intersect(CRay(CGrVector(-1, 5, 2), CGrVector(0, -1, 0, 0)), 1e20, NULL, object, t, intersect));
+    }
+
+    // Tessellated instead, within the tolerance of the surface
+    Sheet sheet(1);
+    CRayIntersection ri;
+    ri.SetNurbsTolerance(1e-3);
+    ri.Initialize();
+    ri.AddNurbs(Sheet::USIZE, Sheet::VSIZE, sheet.points, sheet.uknots, sheet.vknots);
+    ri.LoadingComplete();
+    CHECK(ri.GetNurbsTolerance() == 1e-3);
+    CHECK(ri.GetStatistics().m_primitives == 0);
+    CHECK(ri.GetStatistics().m_triangles > 0);
+    CHECK(ri.GetStatistics().m_memory > exactMemory);
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    for(int i=0;  i<=10;  i++)
+    {
+        CGrVector p = sheet.Point(0.05 + 0.09 * i, 0.43);
+        CHECK(ri.Intersect(CRay(p + CGrVector(0, 5, 0, 0), CGrVector(0, -1, 0, 0)), 1e20, NULL, object, t, intersect));
+        CHECK(fabs(t - 5) < 2e-3);
+        CHECK(object != NULL && object->Type() == CRayIntersection::Triangle);
+    }
+
+    // Knots that decrease are not a surface
+    CRayIntersection bad;
+    bad.Initialize();
+    sheet.vknots[4] = 0;
+    bad.AddNurbs(Sheet::USIZE, Sheet::VSIZE, sheet.points, sheet.uknots, sheet.vknots);
+    bad.AddSphere(CGrVector(0, 0, 0), 1);
+    bad.LoadingComplete();
+    CHECK(bad.GetStatistics().m_primitives == 1);
+}
+
+
+//
+// A moving triangle is hit where it is at the time of the ray
+//
+
+static void TestMotion()
+{
+    // Slides from x 0 to x 10 over the shutter, with a static triangle
+    // to the side that time must not move
+    CRayIntersection ri;
+    ri.Initialize();
+    ri.TriangleBegin(2);
+    ri.Normal(CGrVector(0, 0, 1, 0));
+    ri.TexVertex(CGrVector(0, 0));
+    ri.Vertex(CGrVector(0, 0, 0));
+    ri.TexVertex(CGrVector(1, 0));
+    ri.Vertex(CGrVector(1, 0, 0));
+    ri.TexVertex(CGrVector(0, 1));
+    ri.Vertex(CGrVector(0, 1, 0));
+    ri.Vertex(CGrVector(10, 0, 0));
+    ri.Vertex(CGrVector(11, 0, 0));
+    ri.Vertex(CGrVector(10, 1, 0));
+    ri.TriangleEnd();
+    AddTriangle(ri, CGrVector(0, 5, 0), CGrVector(1, 5, 0), CGrVector(0, 6, 0));
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect, normal, texcoord;
+    IMaterial *material;
+    ITexture *texture;
+    CGrVector down(0, 0, -1, 0);
+
+    CHECK(ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), down, 0), 1e20, NULL, object, t, intersect));
+    CHECK(!ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), down, 0.5), 1e20, NULL, object, t, intersect));
+    CHECK(!ri.Intersect(CRay(CGrVector(0.25, 0.25, 2), down, 1), 1e20, NULL, object, t, intersect));
+    CHECK(!ri.Intersect(CRay(CGrVector(10.25, 0.25, 2), down, 0), 1e20, NULL, object, t, intersect));
+    CHECK(ri.Intersect(CRay(CGrVector(10.25, 0.25, 2), down, 1), 1e20, NULL, object, t, intersect));
+
+    CRay half(CGrVector(5.5, 0.25, 2), down, 0.5);
+    CHECK(ri.Intersect(half, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 2.);
+    CHECK(object->Type() == CRayIntersection::Triangle);
+    ri.IntersectInfo(half, object, t, normal, material, texture, texcoord);
+    CHECK(Near(normal, CGrVector(0, 0, 1, 0)));
+    CHECK_NEAR(texcoord.X(), 0.5);
+    CHECK_NEAR(texcoord.Y(), 0.25);
+
+    for(int i=0;  i<=4;  i++)
+        CHECK(ri.Intersect(CRay(CGrVector(0.25, 5.25, 2), down, i * 0.25), 1e20, NULL, object, t, intersect));
+
+    // A copy keeps the time
+    CRay copy(half);
+    CHECK(copy.Time() == 0.5);
+    copy = CRay(CGrVector(0, 0, 0), down);
+    CHECK(copy.Time() == 0);
+
+    CRayIntersection::Statistics stats = ri.GetStatistics();
+    CHECK(stats.m_triangles == 2);
+
+    // Three keys go out and come back, each half of the shutter linear
+    CRayIntersection bounce;
+    bounce.Initialize();
+    bounce.TriangleBegin(3);
+    bounce.Normal(CGrVector(0, 0, 1, 0));
+    for(int k=0;  k<3;  k++)
+    {
+        double x = k == 1 ? 4 : 0;
+        bounce.Vertex(CGrVector(x, 0, 0));
+        bounce.Vertex(CGrVector(x + 1, 0, 0));
+        bounce.Vertex(CGrVector(x, 1, 0));
+    }
+    bounce.TriangleEnd();
+    bounce.LoadingComplete();
+
+    CHECK(bounce.Intersect(CRay(CGrVector(2.25, 0.25, 2), down, 0.25), 1e20, NULL, object, t, intersect));
+    CHECK(bounce.Intersect(CRay(CGrVector(2.25, 0.25, 2), down, 0.75), 1e20, NULL, object, t, intersect));
+    CHECK(!bounce.Intersect(CRay(CGrVector(2.25, 0.25, 2), down, 0.5), 1e20, NULL, object, t, intersect));
+    CHECK(bounce.Intersect(CRay(CGrVector(4.25, 0.25, 2), down, 0.5), 1e20, NULL, object, t, intersect));
+
+    // Too few vertices for the keys is not a triangle
+    CRayIntersection bad;
+    bad.Initialize();
+    bad.TriangleBegin(2);
+    bad.Normal(CGrVector(0, 0, 1, 0));
+    bad.Vertex(CGrVector(0, 0, 0));
+    bad.Vertex(CGrVector(1, 0, 0));
+    bad.Vertex(CGrVector(0, 1, 0));
+    bad.TriangleEnd();
+    AddTriangle(bad, CGrVector(0, 5, 0), CGrVector(1, 5, 0), CGrVector(0, 6, 0));
+    bad.LoadingComplete();
+    CHECK(bad.GetStatistics().m_triangles == 1);
+    CHECK(!bad.Intersect(CRay(CGrVector(0.25, 0.25, 2), down), 1e20, NULL, object, t, intersect));
+}
+
+
+//
+// Objects a ray's mask does not match are invisible to it
+//
+
+static void TestMasks()
+{
+    // Squares at z 0 and 1, a sphere above them only for bit 4, and an
+    // unmasked square far below
+    CRayIntersection ri;
+    ri.Initialize();
+    ri.Mask(1);
+    AddSquare(ri, 0, 1);
+    ri.Mask(2);
+    AddSquare(ri, 1, 1);
+    ri.Mask(4);
+    ri.AddSphere(CGrVector(0.5, 0.5, 5), 0.5);
+    ri.Mask(0xffffffff);
+    AddSquare(ri, -10, 1);
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+
+    CRay ray(CGrVector(0.5, 0.5, 10), CGrVector(0, 0, -1, 0));
+    CHECK(ray.Mask() == 0xffffffff);
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 4.5);
+
+    ray.SetMask(3);
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 9.);
+
+    ray.SetMask(1);
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 10.);
+
+    ray.SetMask(8);
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(t, 20.);
+    CHECK(CRay(ray).Mask() == 8);
+
+    ray.SetMask(0);
+    CHECK(!ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+
+    // Random triangles in four groups.  A masked query of the whole scene
+    // must match a scene of just the group.
+    Random random(11);
+    const int triangles = 1000;
+    const double extent = 10;
+
+    CRayIntersection all;
+    all.Initialize();
+    CRayIntersection groups[4];
+    for(int g=0;  g<4;  g++)
+        groups[g].Initialize();
+
+    for(int i=0;  i<triangles;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        CGrVector b = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        CGrVector c = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        int g = i % 4;
+        all.Mask(1 << g);
+        AddTriangle(all, a, b, c);
+        AddTriangle(groups[g], a, b, c);
+    }
+
+    all.LoadingComplete();
+    for(int g=0;  g<4;  g++)
+        groups[g].LoadingComplete();
+
+    int hits = 0;
+    for(int r=0;  r<200;  r++)
+    {
+        int g = r % 4;
+        CRay masked(RandomPoint(random, extent), Normalize3(RandomPoint(random, 1) - CGrVector(0.5, 0.5, 0.5)));
+        masked.SetMask(1 << g);
+
+        double tg;
+        bool hit = all.Intersect(masked, 1e20, NULL, object, t, intersect);
+        CHECK(hit == groups[g].Intersect(masked, 1e20, NULL, object, tg, intersect));
+        if(hit)
+        {
+            CHECK(fabs(t - tg) < 1e-9);
+            hits++;
+        }
+    }
+
+    CHECK(hits > 0);
+}
+
+
+//
+// A filter passes rays through rejected hits in one traversal
+//
+
+// Cuts away the left half of each square by texture coordinate, except
+// for the square at z 0
+class CutOutFilter : public CRayIntersection::Filter
+{
+public:
+    CutOutFilter(const CRayIntersection &p_ri) : m_ri(p_ri), m_calls(0) {}
+
+    virtual bool Accept(const CRay &ray, const CRayIntersection::Object *object, double t, 
+                    const CGrVector &intersect) const
+    {
+        m_calls++;
+
+        CGrVector normal, texcoord;
+        IMaterial *material;
+        ITexture *texture;
+        m_ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+        return texcoord.X() >= 0.5 || intersect.Z() < 0.5;
+    }
+
+    const CRayIntersection &m_ri;
+    mutable int m_calls;
+};
+
+// Rejects stripes across x
+class StripeFilter : public CRayIntersection::Filter
+{
+public:
+    virtual bool Accept(const CRay &/*ray*/, const CRayIntersection::Object * /*object*/, double /*t*/, 
+                    const CGrVector &intersect) const
+    {
+        return !Rejected(intersect);
+    }
+
+    static bool Rejected(const CGrVector &p) {return p.X() * 2 - floor(p.X() * 2) < 0.5;}
+};
+
+// Rejects the sides that face the ray, so only the far sides are hit
+class FrontFilter : public CRayIntersection::Filter
+{
+public:
+    FrontFilter(const CRayIntersection &p_ri) : m_ri(p_ri) {}
+
+    virtual bool Accept(const CRay &ray, const CRayIntersection::Object *object, double t, 
+                    const CGrVector &/*intersect*/) const
+    {
+        CGrVector normal, texcoord;
+        IMaterial *material;
+        ITexture *texture;
+        m_ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+        return Dot3(normal, ray.Direction()) > 0;
+    }
+
+    const CRayIntersection &m_ri;
+};
+
+static void TestFilter()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    for(int i=0;  i<5;  i++)
+        AddSquare(ri, i, 1);
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    CGrVector down(0, 0, -1, 0);
+
+    CutOutFilter cutout(ri);
+    CHECK(ri.Intersect(CRay(CGrVector(0.25, 0.5, 10), down), 1e20, NULL, &cutout, object, t, intersect));
+    CHECK_NEAR(t, 10.);
+    CHECK(cutout.m_calls == 5);
+
+    cutout.m_calls = 0;
+    CHECK(ri.Intersect(CRay(CGrVector(0.75, 0.5, 10), down), 1e20, NULL, &cutout, object, t, intersect));
+    CHECK_NEAR(t, 6.);
+    CHECK(cutout.m_calls >= 1 && cutout.m_calls <= 5);
+
+    CHECK(ri.Intersect(CRay(CGrVector(0.25, 0.5, 10), down), 1e20, NULL, NULL, object, t, intersect));
+    CHECK_NEAR(t, 6.);
+
+    // A rejected near side goes on to the far side of the same object
+    CRayIntersection closed;
+    closed.Initialize();
+    closed.AddSphere(CGrVector(0, 0, 0), 2);
+    closed.AddBox(CGrVector(4, -1, -1), CGrVector(6, 1, 1));
+    closed.LoadingComplete();
+
+    FrontFilter front(closed);
+    CGrVector up(0, 0, 1, 0);
+    CHECK(closed.Intersect(CRay(CGrVector(0, 0, -10), up), 1e20, NULL, &front, object, t, intersect));
+    CHECK_NEAR(t, 12.);
+    CHECK(object->Type() == CRayIntersection::Sphere);
+    CHECK(closed.Intersect(CRay(CGrVector(5, 0, -10), up), 1e20, NULL, &front, object, t, intersect));
+    CHECK_NEAR(t, 11.);
+    CHECK(!closed.Intersect(CRay(CGrVector(0, 0, -10), up), 11, NULL, &front, object, t, intersect));
+
+    // One filtered traversal finds what restarting from each rejected 
+    // hit finds
+    Random random(13);
+    const int triangles = 1000;
+    const double extent = 10;
+
+    CRayIntersection tree;
+    tree.Initialize();
+    for(int i=0;  i<triangles;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        AddTriangle(tree, a, a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0),
+            a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0));
+    }
+    tree.LoadingComplete();
+
+    StripeFilter stripes;
+    int hits = 0;
+    for(int r=0;  r<300;  r++)
+    {
+        CGrVector origin = RandomPoint(random, extent);
+        CGrVector direction = Normalize3(RandomPoint(random, 1) - CGrVector(0.5, 0.5, 0.5));
+        bool hit = tree.Intersect(CRay(origin, direction), 1e20, NULL, &stripes, object, t, intersect);
+
+        const CRayIntersection::Object *ignore = NULL;
+        double total = 0;
+        double ti;
+        bool restart;
+        while((restart = tree.Intersect(CRay(origin, direction), 1e20, ignore, object, ti, intersect)) && 
+            StripeFilter::Rejected(intersect))
+        {
+            total += ti;
+            origin = intersect;
+            ignore = object;
+        }
+
+        CHECK(hit == restart);
+        if(hit)
+        {
+            CHECK(fabs(t - (total + ti)) < 1e-6);
+            hits++;
+        }
+    }
+
+    CHECK(hits > 0);
+}
+
+
+//
+// IntersectAll() finds every crossing along a ray, nearest first
+//
+
+static void TestIntersectAll()
+{
+    // Five squares, a second triangle in the plane of the first, and
+    // closed primitives farther down
+    CRayIntersection ri;
+    ri.Initialize();
+    for(int i=0;  i<5;  i++)
+        AddSquare(ri, i, 1);
+    AddTriangle(ri, CGrVector(0, 0, -2), CGrVector(1, 0, -2), CGrVector(0, 1, -2));
+    AddTriangle(ri, CGrVector(0, 0, -2), CGrVector(1, 0, -2), CGrVector(0, 1, -2));
+    ri.AddSphere(CGrVector(0.25, 0.25, -10), 1);
+    ri.AddBox(CGrVector(0, 0, -15), CGrVector(1, 1, -13));
+    ri.AddCylinder(CGrVector(0.25, 0.25, -20), CGrVector(0.25, 0.25, -18), 1);
+    ri.LoadingComplete();
+
+    std::vector<CRayIntersection::Hit> hits;
+    CRay ray(CGrVector(0.25, 0.25, 10), CGrVector(0, 0, -1, 0));
+
+    CHECK(ri.IntersectAll(ray, 1e20, 0, hits) == 13);
+    CHECK(hits.size() == 13);
+    const double expect[] = {6, 7, 8, 9, 10, 12, 12, 19, 21, 23, 25, 28, 30};
+    for(size_t i=0;  i<hits.size()  && i<13;  i++)
+    {
+        CHECK(fabs(hits[i].m_t - expect[i]) < 1e-6);
+        CHECK(Near(hits[i].m_intersect, ray.PointOnRay(expect[i])));
+    }
+
+    CHECK(hits[5].m_object != hits[6].m_object);
+    CHECK(hits[7].m_object->Type() == CRayIntersection::Sphere && hits[8].m_object == hits[7].m_object);
+    CHECK(hits[9].m_object->Type() == CRayIntersection::Box && hits[10].m_object == hits[9].m_object);
+    CHECK(hits[11].m_object->Type() == CRayIntersection::Cylinder && hits[12].m_object == hits[11].m_object);
+
+    // The nearest k, and the range
+    CHECK(ri.IntersectAll(ray, 1e20, 2, hits) == 2);
+    CHECK_NEAR(hits[0].m_t, 6.);
+    CHECK_NEAR(hits[1].m_t, 7.);
+    CHECK(ri.IntersectAll(ray, 7.5, 0, hits) == 2);
+    CHECK(ri.IntersectAll(ray, 1e20, 8, hits) == 8);
+    CHECK_NEAR(hits[7].m_t, 19.);
+
+    // From inside the sphere, only its exit
+    CRay inside(CGrVector(0.25, 0.25, -10), CGrVector(0, 0, -1, 0));
+    CHECK(ri.IntersectAll(inside, 2, 0, hits) == 1);
+    CHECK_NEAR(hits[0].m_t, 1.);
+
+    // Masks apply as they do to Intersect()
+    ray.SetMask(0);
+    CHECK(ri.IntersectAll(ray, 1e20, 0, hits) == 0);
+    CHECK(hits.empty());
+
+    // Random triangles, each in a scene of its own for the brute force
+    Random random(17);
+    const int triangles = 300;
+    const double extent = 5;
+
+    CRayIntersection tree;
+    tree.Initialize();
+    vector<CRayIntersection *> singles;
+    for(int i=0;  i<triangles;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        CGrVector b = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        CGrVector c = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        AddTriangle(tree, a, b, c);
+
+        CRayIntersection *single = new CRayIntersection;
+        single->Initialize();
+        AddTriangle(*single, a, b, c);
+        single->LoadingComplete();
+        singles.push_back(single);
+    }
+    tree.LoadingComplete();
+
+    int multiple = 0;
+    for(int r=0;  r<100;  r++)
+    {
+        CRay line(RandomPoint(random, extent), Normalize3(RandomPoint(random, 1) - CGrVector(0.5, 0.5, 0.5)));
+
+        vector<double> brute;
+        for(size_t i=0;  i<singles.size();  i++)
+        {
+            const CRayIntersection::Object *object;
+            double t;
+            CGrVector intersect;
+            if(singles[i]->Intersect(line, 1e20, NULL, object, t, intersect))
+                brute.push_back(t);
+        }
+        std::sort(brute.begin(), brute.end());
+
+        CHECK(tree.IntersectAll(line, 1e20, 0, hits) == int(brute.size()));
+        for(size_t i=0;  i<hits.size() && i<brute.size();  i++)
+            CHECK(fabs(hits[i].m_t - brute[i]) < 1e-6);
+
+        if(brute.size() > 1)
+            multiple++;
+
+        CHECK(tree.IntersectAll(line, 1e20, 2, hits) == int(brute.size() < 2 ? brute.size() : 2));
+        for(size_t i=0;  i<hits.size();  i++)
+            CHECK(fabs(hits[i].m_t - brute[i]) < 1e-6);
+    }
+
+    CHECK(multiple > 0);
+
+    for(size_t i=0;  i<singles.size();  i++)
+        delete singles[i];
+}
+
+
+//
+// ClosestPoint() and WithinDistance() find the nearest surface
+//
+
+static void TestClosestPoint()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    AddSquare(ri, 0, 1);
+    ri.AddSphere(CGrVector(5, 0, 0), 1);
+    ri.AddBox(CGrVector(10, 0, 0), CGrVector(11, 1, 1));
+    ri.Mask(2);
+    ri.AddCylinder(CGrVector(15, 0, 0), CGrVector(15, 2, 0), 0.5);
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    CGrVector closest;
+    double distance;
+
+    CHECK(ri.ClosestPoint(CGrVector(0.5, 0.5, 2), 1e20, object, closest, distance));
+    CHECK(object->Type() == CRayIntersection::Polygon);
+    CHECK(Near(closest, CGrVector(0.5, 0.5, 0)));
+    CHECK_NEAR(distance, 2.);
+
+    // Past an edge of the square, the edge
+    CHECK(ri.ClosestPoint(CGrVector(-1, 0.5, 1), 1e20, object, closest, distance));
+    CHECK(Near(closest, CGrVector(0, 0.5, 0)));
+    CHECK_NEAR(distance, sqrt(2.));
+
+    CHECK(ri.ClosestPoint(CGrVector(7, 0, 0), 1e20, object, closest, distance));
+    CHECK(object->Type() == CRayIntersection::Sphere);
+    CHECK(Near(closest, CGrVector(6, 0, 0)));
+
+    // Inside the box, the nearest face
+    CHECK(ri.ClosestPoint(CGrVector(10.5, 0.5, 0.4), 1e20, object, closest, distance));
+    CHECK(object->Type() == CRayIntersection::Box);
+    CHECK(Near(closest, CGrVector(10.5, 0.5, 0)));
+    CHECK_NEAR(distance, 0.4);
+
+    // The side of the cylinder, then past its top
+    CHECK(ri.ClosestPoint(CGrVector(15, 1, 2), 1e20, object, closest, distance));
+    CHECK(object->Type() == CRayIntersection::Cylinder);
+    CHECK(Near(closest, CGrVector(15, 1, 0.5)));
+    CHECK(ri.ClosestPoint(CGrVector(15, 3, 0.25), 1e20, object, closest, distance));
+    CHECK(Near(closest, CGrVector(15, 2, 0.25)));
+    CHECK_NEAR(distance, 1.);
+
+    // Limits and masks
+    CHECK(!ri.ClosestPoint(CGrVector(0.5, 0.5, 2), 1.5, object, closest, distance));
+    CHECK(ri.WithinDistance(CGrVector(0.5, 0.5, 2), 2.5));
+    CHECK(!ri.WithinDistance(CGrVector(0.5, 0.5, 2), 1.5));
+    CHECK(ri.WithinDistance(CGrVector(15, 3, 0), 1.5));
+    CHECK(!ri.WithinDistance(CGrVector(15, 3, 0), 1.5, 1));
+    CHECK(ri.ClosestPoint(CGrVector(15, 1, 2), 1e20, object, closest, distance, 1));
+    CHECK(object->Type() == CRayIntersection::Box);
+
+    // Random triangles, each in a scene of its own for the brute force
+    Random random(19);
+    const int triangles = 300;
+    const double extent = 10;
+
+    CRayIntersection tree;
+    tree.Initialize();
+    vector<CRayIntersection *> singles;
+    for(int i=0;  i<triangles;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        CGrVector b = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        CGrVector c = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        AddTriangle(tree, a, b, c);
+
+        CRayIntersection *single = new CRayIntersection;
+        single->Initialize();
+        AddTriangle(*single, a, b, c);
+        single->LoadingComplete();
+        singles.push_back(single);
+    }
+    tree.LoadingComplete();
+
+    for(int r=0;  r<100;  r++)
+    {
+        CGrVector point = RandomPoint(random, extent * 1.2) - CGrVector(1, 1, 1, 0);
+
+        double best = 1e20;
+        for(size_t i=0;  i<singles.size();  i++)
+        {
+            double d;
+            if(singles[i]->ClosestPoint(point, 1e20, object, closest, d) && d < best)
+                best = d;
+        }
+
+        CHECK(tree.ClosestPoint(point, 1e20, object, closest, distance));
+        CHECK(fabs(distance - best) < 1e-9);
+        CHECK(fabs((closest - point).Length3() - distance) < 1e-9);
+        CHECK(tree.WithinDistance(point, best * 1.001));
+        CHECK(!tree.WithinDistance(point, best * 0.999));
+    }
+
+    for(size_t i=0;  i<singles.size();  i++)
+        delete singles[i];
+}
+
+
+//
+// QueryBox() and QueryFrustum() pass each object in a region once
+//
+
+class CollectVisitor : public CRayIntersection::Visitor
+{
+public:
+    CollectVisitor(size_t p_limit=0) : m_limit(p_limit) {}
+
+    virtual bool Visit(const CRayIntersection::Object *object)
+    {
+        m_objects.push_back(object);
+        return m_limit == 0 || m_objects.size() < m_limit;
+    }
+
+    // Is every object there only once?
+    bool Unique() const
+    {
+        vector<const CRayIntersection::Object *> sorted(m_objects);
+        std::sort(sorted.begin(), sorted.end());
+        return std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+    }
+
+    size_t m_limit;
+    vector<const CRayIntersection::Object *> m_objects;
+};
+
+static void TestRegionQueries()
+{
+    // A 10 x 10 grid of small spheres, and long triangles that cross the
+    // whole grid and so are in many leaves
+    CRayIntersection ri;
+    ri.Initialize();
+    ri.Mask(1);
+    for(int i=0;  i<10;  i++)
+        for(int j=0;  j<10;  j++)
+            ri.AddSphere(CGrVector(i, j, 0), 0.2);
+
+    ri.Mask(2);
+    for(int j=0;  j<3;  j++)
+        AddTriangle(ri, CGrVector(-1, j + 0.5, 1), CGrVector(10, j + 0.5, 1), CGrVector(10, j + 0.6, 1));
+    ri.LoadingComplete();
+
+    CollectVisitor box;
+    CHECK(ri.QueryBox(CGrVector(2.5, -1, -1), CGrVector(5.5, 3.5, 0.5), box) == 12);
+    CHECK(box.m_objects.size() == 12);
+    CHECK(box.Unique());
+
+    // Reaching up to the triangles
+    CollectVisitor tall;
+    CHECK(ri.QueryBox(CGrVector(2.5, -1, -1), CGrVector(5.5, 3.5, 2), tall) == 15);
+    CHECK(tall.Unique());
+
+    // Only the triangles, by mask
+    CollectVisitor masked;
+    CHECK(ri.QueryBox(CGrVector(-5, -5, -5), CGrVector(15, 15, 5), masked, 2) == 3);
+    for(size_t i=0;  i<masked.m_objects.size();  i++)
+        CHECK(masked.m_objects[i]->Type() == CRayIntersection::Triangle);
+
+    // Touching counts, and an inside out box has nothing
+    CollectVisitor touch;
+    CHECK(ri.QueryBox(CGrVector(0.2, 0, 0), CGrVector(0.5, 0, 0), touch) == 1);
+    CollectVisitor none;
+    CHECK(ri.QueryBox(CGrVector(5, 5, 5), CGrVector(0, 0, 0), none) == 0);
+
+    // The visitor can end the query
+    CollectVisitor three(3);
+    CHECK(ri.QueryBox(CGrVector(-5, -5, -5), CGrVector(15, 15, 5), three) == 3);
+
+    // A pyramid opening up z, 2.5 to 6.5 across at z 0, which holds
+    // the spheres from 3 to 6 in x and y
+    CGrVector planes[4] = {
+        CGrVector(1, 0, 0.5, -2.5), CGrVector(-1, 0, 0.5, 6.5),
+        CGrVector(0, 1, 0.5, -2.5), CGrVector(0, -1, 0.5, 6.5)};
+    CollectVisitor frustum;
+    CHECK(ri.QueryFrustum(planes, 4, frustum, 1) == 16);
+    CHECK(frustum.Unique());
+
+    // Random triangles against their boxes
+    Random random(23);
+    const int triangles = 1000;
+    const double extent = 10;
+
+    CRayIntersection tree;
+    tree.Initialize();
+    vector<CGrVector> lo, hi;
+    for(int i=0;  i<triangles;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        CGrVector b = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        CGrVector c = a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0);
+        AddTriangle(tree, a, b, c);
+
+        CGrVector l(a), h(a);
+        for(int d=0;  d<3;  d++)
+        {
+            l[d] = std::min(a[d], std::min(b[d], c[d]));
+            h[d] = std::max(a[d], std::max(b[d], c[d]));
+        }
+        lo.push_back(l);
+        hi.push_back(h);
+    }
+    tree.LoadingComplete();
+
+    for(int q=0;  q<50;  q++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        CGrVector b = RandomPoint(random, extent);
+        CGrVector qmin(std::min(a.X(), b.X()), std::min(a.Y(), b.Y()), std::min(a.Z(), b.Z()));
+        CGrVector qmax(std::max(a.X(), b.X()), std::max(a.Y(), b.Y()), std::max(a.Z(), b.Z()));
+
+        int brute = 0;
+        for(int i=0;  i<triangles;  i++)
+        {
+            if(lo[i].X() <= qmax.X() && hi[i].X() >= qmin.X() &&
+               lo[i].Y() <= qmax.Y() && hi[i].Y() >= qmin.Y() &&
+               lo[i].Z() <= qmax.Z() && hi[i].Z() >= qmin.Z())
+                brute++;
+        }
+
+        CollectVisitor found;
+        CHECK(tree.QueryBox(qmin, qmax, found) == brute);
+        CHECK(found.Unique());
+    }
+}
+
+
+//
+// SphereCast() finds the first surface a moving sphere touches
+//
+
+static void TestSphereCast()
+{
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector contact, normal;
+
+    // Square, face on
+    CRayIntersection square;
+    square.Initialize();
+    AddSquare(square, 10, 10);
+    square.LoadingComplete();
+
+    CHECK(square.SphereCast(CRay(CGrVector(5, 5, 0), CGrVector(0, 0, 1, 0)), 1, 100, object, t, contact, normal));
+    CHECK_NEAR(t, 9.);
+    CHECK(Near(contact, CGrVector(5, 5, 10)));
+    CHECK(Near(normal, CGrVector(0, 0, -1, 0)));
+    CHECK(!square.SphereCast(CRay(CGrVector(5, 5, 0), CGrVector(0, 0, 1, 0)), 1, 8.5, object, t, contact, normal));
+
+    // Touching where it starts
+    CHECK(square.SphereCast(CRay(CGrVector(5, 5, 9.5), CGrVector(1, 0, 0, 0)), 1, 100, object, t, contact, normal));
+    CHECK_NEAR(t, 0.);
+
+    // A triangle edge and vertex a ray down the center would miss
+    CRayIntersection triangle;
+    triangle.Initialize();
+    AddTriangle(triangle, CGrVector(0, 0, 10), CGrVector(10, 0, 10), CGrVector(0, 10, 10));
+    triangle.LoadingComplete();
+
+    CRay edge(CGrVector(-0.5, 1, 0), CGrVector(0, 0, 1, 0));
+    CHECK(!triangle.Intersect(edge, 100, NULL, object, t, contact));
+    CHECK(triangle.SphereCast(edge, 1, 100, object, t, contact, normal));
+    CHECK_NEAR(t, 10 - sqrt(0.75));
+    CHECK(Near(contact, CGrVector(0, 1, 10)));
+    CHECK(Near(normal, CGrVector(-0.5, 0, -sqrt(0.75), 0)));
+
+    CHECK(triangle.SphereCast(CRay(CGrVector(-0.3, -0.4, 0), CGrVector(0, 0, 2, 0)), 1, 100, object, t, contact, normal));
+    CHECK_NEAR(t, (10 - sqrt(0.75)) / 2);
+    CHECK(Near(contact, CGrVector(0, 0, 10)));
+
+    CHECK(!triangle.SphereCast(CRay(CGrVector(-1.5, 1, 0), CGrVector(0, 0, 1, 0)), 1, 100, object, t, contact, normal));
+
+    // Through a gap one unit wide between two spheres
+    CRayIntersection gap;
+    gap.Initialize();
+    gap.AddSphere(CGrVector(-1.5, 0, 20), 1);
+    gap.AddSphere(CGrVector(1.5, 0, 20), 1);
+    gap.Mask(2);
+    gap.AddBox(CGrVector(-1, -1, 30), CGrVector(1, 1, 32));
+    gap.LoadingComplete();
+
+    CRay through(CGrVector(0, 0, 0), CGrVector(0, 0, 1, 0));
+    through.SetMask(1);
+    CHECK(!gap.SphereCast(through, 0.4, 100, object, t, contact, normal));
+    CHECK(gap.SphereCast(through, 0.6, 100, object, t, contact, normal));
+    CHECK_NEAR(t, 20 - sqrt(0.31));
+    CHECK(object->Type() == CRayIntersection::Sphere);
+    CHECK_NEAR(fabs(contact.X()), 1.5 - 1.5 / 1.6);
+
+    // The box behind the gap is only seen with its mask, and is found
+    // by stepping up to it
+    through.SetMask(3);
+    CHECK(gap.SphereCast(through, 0.4, 100, object, t, contact, normal));
+    CHECK(fabs(t - 29.6) < 1e-6);
+    CHECK(object->Type() == CRayIntersection::Box);
+    CHECK(fabs(normal.Z() + 1) < 1e-6);
+
+    // From inside a sphere to its shell
+    CRayIntersection shell;
+    shell.Initialize();
+    shell.AddSphere(CGrVector(0, 0, 0), 5);
+    shell.LoadingComplete();
+
+    CHECK(shell.SphereCast(CRay(CGrVector(0, 0, 0), CGrVector(1, 0, 0, 0)), 1, 100, object, t, contact, normal));
+    CHECK_NEAR(t, 4.);
+    CHECK(Near(contact, CGrVector(5, 0, 0)));
+    CHECK(Near(normal, CGrVector(-1, 0, 0, 0)));
+
+    // Grazing a box edge and a cylinder side, and touching a cylinder
+    // rim and cap
+    CRayIntersection solids;
+    solids.Initialize();
+    solids.AddBox(CGrVector(-1, -1, 5), CGrVector(1, 1, 7));
+    solids.AddCylinder(CGrVector(0, 0, 0), CGrVector(0, 4, 0), 1);
+    solids.LoadingComplete();
+
+    CRay graze(CGrVector(-5, 1.5, 6), CGrVector(1, 0, 0, 0));
+    CHECK(solids.SphereCast(graze, 0.5001, 100, object, t, contact, normal));
+    CHECK(object->Type() == CRayIntersection::Box);
+    CHECK(fabs(t - (4 - sqrt(0.5001 * 0.5001 - 0.25))) < 1e-9);
+    CHECK(Near(contact, CGrVector(-1, 1, 6)));
+    CHECK(!solids.SphereCast(graze, 0.4999, 100, object, t, contact, normal));
+
+    CRay side(CGrVector(-5, 2, 1.005), CGrVector(1, 0, 0, 0));
+    CHECK(solids.SphereCast(side, 0.01, 100, object, t, contact, normal));
+    CHECK(object->Type() == CRayIntersection::Cylinder);
+    CHECK(fabs(t - (5 - sqrt(1.01 * 1.01 - 1.005 * 1.005))) < 1e-9);
+    CHECK(!solids.SphereCast(side, 0.004, 100, object, t, contact, normal));
+
+    CHECK(solids.SphereCast(CRay(CGrVector(1.2, 10, 0), CGrVector(0, -1, 0, 0)), 0.5, 100, object, t, contact, normal));
+    CHECK(fabs(t - (6 - sqrt(0.21))) < 1e-9);
+    CHECK(Near(contact, CGrVector(1, 4, 0)));
+
+    CHECK(solids.SphereCast(CRay(CGrVector(0.5, 10, 0), CGrVector(0, -1, 0, 0)), 0.5, 100, object, t, contact, normal));
+    CHECK(fabs(t - 5.5) < 1e-9);
+    CHECK(Near(normal, CGrVector(0, 1, 0, 0)));
+
+    // An application primitive is stepped up to.  Passing just clear of
+    // its surface is a miss, and passing just into it is a touch where
+    // the gap closes.
+    CBall ball(CGrVector(0, 0, 20), 1);
+    CRayIntersection user;
+    user.Initialize();
+    user.AddPrimitive(&ball);
+    user.LoadingComplete();
+
+    CHECK(user.SphereCast(CRay(CGrVector(0, 0, 0), CGrVector(0, 0, 1, 0)), 0.5, 100, object, t, contact, normal));
+    CHECK(fabs(t - 18.5) < 1e-8);
+    CHECK((contact - CGrVector(0, 0, 19)).Length3() < 1e-8);
+
+    const double offsets[] = {1e-2, 1e-4, -1e-4, -1e-2};
+    for(double offset : offsets)
+    {
+        double y = 1.5 + offset;
+        CRay pass(CGrVector(-5, y, 20), CGrVector(1, 0, 0, 0));
+        bool touched = user.SphereCast(pass, 0.5, 100, object, t, contact, normal);
+        CHECK(touched == (offset < 0));
+        if(touched)
+        {
+            CHECK(fabs(t - (5 - sqrt(1.5 * 1.5 - y * y))) < 1e-6);
+            CHECK(fabs((pass.PointOnRay(t) - ball.Center()).Length3() - 1.5) < 1e-8);
+        }
+    }
+
+    // Random triangles, and random boxes and cylinders.  The sphere is 
+    // clear of every surface before the touch found, and touching one 
+    // at it.
+    Random random(29);
+    const double extent = 10;
+
+    CRayIntersection tree;
+    tree.Initialize();
+    for(int i=0;  i<500;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        AddTriangle(tree, a, a + RandomPoint(random, 1), a + RandomPoint(random, 1));
+    }
+    tree.LoadingComplete();
+
+    CRayIntersection shapes;
+    shapes.Initialize();
+    for(int i=0;  i<100;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        shapes.AddBox(a, a + RandomPoint(random, 1));
+        a = RandomPoint(random, extent);
+        shapes.AddCylinder(a, a + RandomPoint(random, 2) - CGrVector(1, 1, 1, 0), Uniform(random, 0.1, 0.5));
+    }
+    shapes.LoadingComplete();
+
+    CRayIntersection *scenes[2] = {&tree, &shapes};
+    for(int n=0;  n<2;  n++)
+    {
+        int touches = 0;
+        for(int i=0;  i<200;  i++)
+        {
+            CGrVector o(Uniform(random, -5, 0), Uniform(random, 0, extent), Uniform(random, 0, extent));
+            CGrVector d(1, Uniform(random, -0.2, 0.2), Uniform(random, -0.2, 0.2), 0);
+            double r = Uniform(random, 0.05, 0.5);
+            CRay ray(o, d);
+
+            double maxt = 20;
+            if(scenes[n]->SphereCast(ray, r, maxt, object, t, contact, normal))
+            {
+                touches++;
+                CHECK(t >= 0 && t <= maxt);
+                CHECK(fabs((ray.PointOnRay(t) - contact).Length3() - r) < 1e-9 || t == 0);
+                CHECK(fabs(normal.Length3() - 1) < 1e-9);
+                maxt = t;
+            }
+
+            const CRayIntersection::Object *nearest;
+            CGrVector closest;
+            double distance;
+            bool clear = true;
+            for(int s=0;  s<100 && maxt > 0;  s++)
+                if(scenes[n]->ClosestPoint(ray.PointOnRay(maxt * s / 100), r - 1e-7, nearest, closest, distance))
+                    clear = false;
+            CHECK(clear);
+        }
+
+        CHECK(touches > 50 && touches < 200);
+    }
+}
+
+
+//
+// Ray differentials carried to the texture coordinates
+//
+
+static void TestDifferentials()
+{
+    // A 2x2 square with texture coordinates 0 to 1, and a triangle
+    // tilted 45 degrees about the x axis
+    CRayIntersection ri;
+    ri.Initialize();
+    AddSquare(ri, 0, 2);
+
+    ri.TriangleBegin();
+    ri.Normal(Normalize3(CGrVector(0, -1, 1, 0)));
+    ri.TexVertex(CGrVector(0, 0));
+    ri.Vertex(CGrVector(10, 0, 0));
+    ri.TexVertex(CGrVector(1, 0));
+    ri.Vertex(CGrVector(12, 0, 0));
+    ri.TexVertex(CGrVector(0, 1));
+    ri.Vertex(CGrVector(10, 2, 2));
+    ri.TriangleEnd();
+    ri.LoadingComplete();
+
+    CGrVector zero(0, 0, 0, 0);
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect, normal, texcoord, dTdx, dTdy;
+    IMaterial *material;
+    ITexture *texture;
+
+    // Spreading rays from 10 above: 0.001 per pixel is 0.01 on the square
+    CRay ray(CGrVector(0.5, 0.5, 10), CGrVector(0, 0, -1, 0));
+    CRayDifferential spread(zero, zero, CGrVector(0.001, 0, 0, 0), CGrVector(0, 0.001, 0, 0));
+    CHECK(ri.Intersect(ray, 1e20, NULL, object, t, intersect));
+    ri.IntersectInfo(ray, spread, object, t, normal, material, texture, texcoord, dTdx, dTdy);
+    CHECK_NEAR(dTdx.X(), 0.005);
+    CHECK_NEAR(dTdx.Y(), 0.);
+    CHECK_NEAR(dTdy.X(), 0.);
+    CHECK_NEAR(dTdy.Y(), 0.005);
+
+    // Parallel rays moving 0.01 in y cover 0.01 sqrt(2) on the tilted
+    // triangle, whose t coordinate runs over 2 sqrt(2)
+    CRay down(CGrVector(10.5, 0.5, 10), CGrVector(0, 0, -1, 0));
+    CRayDifferential parallel(CGrVector(0.01, 0, 0, 0), CGrVector(0, 0.01, 0, 0), zero, zero);
+    CHECK(ri.Intersect(down, 1e20, NULL, object, t, intersect));
+    ri.IntersectInfo(down, parallel, object, t, normal, material, texture, texcoord, dTdx, dTdy);
+    CHECK_NEAR(dTdx.X(), 0.005);
+    CHECK_NEAR(dTdy.X(), 0.);
+    CHECK_NEAR(dTdy.Y(), 0.005);
+}
+
+
+//
+// Texture lookups, level of detail, and anisotropic filtering
+//
+
+// A texture level of RGB texels, all three the same
+struct GrayView
+{
+    GrayView(int p_width, int p_height) : m_width(p_width), m_height(p_height), m_texels(p_width * p_height * 3) {}
+
+    const BYTE *Texel(int c, int r) const {return &m_texels[(r * m_width + c) * 3];}
+    void Set(int c, int r, BYTE v) {m_texels[(r * m_width + c) * 3] = m_texels[(r * m_width + c) * 3 + 1] = m_texels[(r * m_width + c) * 3 + 2] = v;}
+
+    int m_width;
+    int m_height;
+    vector<BYTE> m_texels;
+};
+
+static void TestTextureSampling()
+{
+    CHECK(WrapIndex(-0.25, 4) == 3);
+    CHECK(WrapIndex(1.0, 4) == 0);
+    CHECK(WrapIndex(0.999999999, 4) == 3);
+
+    // An 8 x 8 checkerboard of single texels, and the level below it,
+    // where each 2 x 2 block averages to (0 + 255 + 255 + 0 + 2) / 4
+    GrayView fine(8, 8);
+    GrayView coarse(4, 4);
+    for(int r=0;  r<8;  r++)
+        for(int c=0;  c<8;  c++)
+            fine.Set(c, r, (r + c) % 2 ? 255 : 0);
+    for(int r=0;  r<4;  r++)
+        for(int c=0;  c<4;  c++)
+            coarse.Set(c, r, 128);
+
+    const float tol = 1e-5f;
+    float rgb[3];
+    Nearest(fine, 1.5 / 8, 0.5 / 8, rgb);
+    CHECK(rgb[0] == 1.f && rgb[1] == 1.f && rgb[2] == 1.f);
+    Nearest(fine, -0.5 / 8, 0.5 / 8, rgb);
+    CHECK(rgb[0] == 1.f);
+
+    // At a texel center, the texel.  Between four, their average.  At
+    // the edge, a blend with the opposite side.
+    Bilinear(fine, 2.5 / 8, 0.5 / 8, rgb);
+    CHECK(rgb[0] == 0.f);
+    Bilinear(fine, 1. / 8, 1. / 8, rgb);
+    CHECK(fabs(rgb[0] - 0.5f) < tol);
+    Bilinear(fine, 0, 0.5 / 8, rgb);
+    CHECK(fabs(rgb[0] - 0.5f) < tol);
+    Bilinear(fine, 0.25 / 8, 0.5 / 8, rgb);
+    CHECK(fabs(rgb[0] - 0.25f) < tol);
+
+    // Blending the levels
+    Trilinear(fine, coarse, 0, 1.5 / 8, 0.5 / 8, rgb);
+    CHECK(fabs(rgb[0] - 1) < tol);
+    Trilinear(fine, coarse, 1, 1.5 / 8, 0.5 / 8, rgb);
+    CHECK(fabs(rgb[0] - 128 / 255.f) < tol);
+    Trilinear(fine, coarse, 0.5f, 1.5 / 8, 0.5 / 8, rgb);
+    CHECK(fabs(rgb[0] - (1 + 128 / 255.f) / 2) < tol);
+
+    // The level where the longer side of the footprint is one texel
+    CHECK(TrilinearLod(8, 8, 0.5 / 8, 0, 0, 0.5 / 8) == 0);
+    CHECK(fabs(TrilinearLod(8, 8, 1. / 8, 0, 0, 1. / 8)) < 1e-12);
+    CHECK(fabs(TrilinearLod(8, 8, 4. / 8, 0, 0, 1. / 8) - 2) < 1e-12);
+    CHECK(fabs(TrilinearLod(8, 4, 0, 0, 0, 2. / 4) - 1) < 1e-12);
+    CHECK(fabs(TrilinearLod(8, 8, 3. / 8, 4. / 8, 0, 0) - log2(5.)) < 1e-12);
+
+    // A footprint four texels long and one wide is four samples along
+    // u at the finest level, instead of one at level 2
+    vector<double> lods, us, vs;
+    auto level = [&](double p_lod, double u, double v, float *p_rgb) {
+        lods.push_back(p_lod);
+        us.push_back(u);
+        vs.push_back(v);
+        Bilinear(fine, u, v, p_rgb);
+    };
+
+    Anisotropic(level, 8, 8, 0.5, 0.5 / 8, 4. / 8, 0, 0, 1. / 8, rgb, 16);
+    CHECK(lods.size() == 4);
+    for(size_t i=0;  i<lods.size();  i++)
+    {
+        CHECK(lods[i] == 0);
+        CHECK(fabs(us[i] - (0.5 + (i - 1.5) / 8)) < 1e-12);
+        CHECK(vs[i] == 0.5 / 8);
+    }
+    CHECK(fabs(rgb[0] - 0.5f) < tol);
+
+    // With at most two samples, each covers two texels at level 1
+    lods.clear();
+    Anisotropic(level, 8, 8, 0.5, 0.5 / 8, 4. / 8, 0, 0, 1. / 8, rgb, 2);
+    CHECK(lods.size() == 2);
+    CHECK(fabs(lods[0] - 1) < 1e-12);
+
+    // A footprint smaller than a texel is one sample
+    lods.clear();
+    Anisotropic(level, 8, 8, 0.5, 0.5, 0.1 / 8, 0, 0, 0.05 / 8, rgb, 16);
+    CHECK(lods.size() == 1 && lods[0] == 0);
+
+    // The tiled layout samples the same as the rows it was copied from,
+    // for sizes that end in partial tiles
+    Random random(43);
+    const int sizes[][2] = {{7, 5}, {4, 4}, {1, 9}, {13, 2}};
+    for(auto &size : sizes)
+    {
+        int width = size[0];
+        int height = size[1];
+        vector<BYTE> texels(width * height * 3);
+        vector<const BYTE *> rows;
+        for(BYTE &texel : texels)
+            texel = BYTE(random() & 255);
+        for(int r=0;  r<height;  r++)
+            rows.push_back(&texels[r * width * 3]);
+
+        int tilesAcross = TileView::TilesAcross(width);
+        int tilesDown = (height + TileView::MASK) >> TileView::SHIFT;
+        vector<BYTE> tiles(tilesAcross * tilesDown * TileView::SIZE * TileView::SIZE * 4);
+        for(int r=0;  r<height;  r++)
+            for(int c=0;  c<width;  c++)
+                for(int i=0;  i<3;  i++)
+                    tiles[TileView::Offset(c, r, tilesAcross) + i] = rows[r][c * 3 + i];
+
+        RowView rowView(&rows[0], width, height);
+        TileView tileView(&tiles[0], width, height);
+        for(int i=0;  i<200;  i++)
+        {
+            double u = Uniform(random, -2, 2);
+            double v = Uniform(random, -2, 2);
+            float a[3], b[3];
+
+            Nearest(rowView, u, v, a);
+            Nearest(tileView, u, v, b);
+            CHECK(a[0] == b[0] && a[1] == b[1] && a[2] == b[2]);
+
+            Bilinear(rowView, u, v, a);
+            Bilinear(tileView, u, v, b);
+            CHECK(a[0] == b[0] && a[1] == b[1] && a[2] == b[2]);
+
+            Trilinear(rowView, rowView, 0.3f, u, v, a);
+            Trilinear(tileView, tileView, 0.3f, u, v, b);
+            CHECK(a[0] == b[0] && a[1] == b[1] && a[2] == b[2]);
+        }
+    }
+}
+
+
+//
+// Decoding PPM and BMP files from a memory mapping
+//
+
+static void WriteBytes(const string &p_name, const vector<BYTE> &p_bytes)
+{
+    FILE *file = fopen(p_name.c_str(), "wb");
+    CHECK(file != NULL);
+    if(file == NULL)
+        return;
+
+    fwrite(&p_bytes[0], 1, p_bytes.size(), file);
+    fclose(file);
+}
+
+static void PutLittleEndian(vector<BYTE> &p_bytes, size_t p_at, unsigned p_value, int p_count)
+{
+    for(int i=0;  i<p_count;  i++, p_value >>= 8)
+        p_bytes[p_at + i] = BYTE(p_value & 255);
+}
+
+// The color of pixel (c, r), row 0 at the bottom.  Palette images
+// use only the first component, as the index.
+static BYTE PixelValue(int c, int r, int i)
+{
+    return BYTE((c * 37 + r * 11 + i * 101) & 255);
+}
+
+// The palette of 8 bit files, which is not gray so a swap of red and
+// blue shows
+static BYTE PaletteValue(int p_index, int i)
+{
+    return BYTE(i == 0 ? p_index : i == 1 ? 255 - p_index : p_index * 7);
+}
+
+static vector<BYTE> MakeBMP(int p_width, int p_height, int p_bitCount, bool p_topDown)
+{
+    int bytes = p_bitCount / 8;
+    int pitch = (p_width * bytes + 3) & ~3;
+    int palette = p_bitCount == 8 ? 256 * 4 : 0;
+    int offBits = 54 + palette;
+
+    vector<BYTE> file(offBits + pitch * p_height, 0);
+    file[0] = 'B';
+    file[1] = 'M';
+    PutLittleEndian(file, 2, unsigned(file.size()), 4);
+    PutLittleEndian(file, 10, offBits, 4);
+    PutLittleEndian(file, 14, 40, 4);
+    PutLittleEndian(file, 18, p_width, 4);
+    PutLittleEndian(file, 22, unsigned(p_topDown ? -p_height : p_height), 4);
+    PutLittleEndian(file, 26, 1, 2);
+    PutLittleEndian(file, 28, p_bitCount, 2);
+
+    // Palette entries and pixels are blue, green, red
+    for(int p=0;  p<palette / 4;  p++)
+        for(int i=0;  i<3;  i++)
+            file[54 + p * 4 + i] = PaletteValue(p, 2 - i);
+
+    for(int r=0;  r<p_height;  r++)
+    {
+        BYTE *row = &file[offBits + (p_topDown ? p_height - 1 - r : r) * pitch];
+        for(int c=0;  c<p_width;  c++)
+        {
+            if(p_bitCount == 8)
+                row[c] = PixelValue(c, r, 0);
+            else
+            {
+                for(int i=0;  i<3;  i++)
+                    row[c * bytes + i] = PixelValue(c, r, 2 - i);
+                if(bytes == 4)
+                    row[c * 4 + 3] = 77;
+            }
+        }
+    }
+
+    return file;
+}
+
+static BYTE ExpectedValue(int p_bitCount, int c, int r, int i)
+{
+    return p_bitCount == 8 ? PaletteValue(PixelValue(c, r, 0), i) : PixelValue(c, r, i);
+}
+
+static void TestImageFile()
+{
+    const string name = "RayCoreTests.image";
+
+    // Widths that end in the scalar tail after the byte shuffle, or
+    // that are all tail
+    const int widths[] = {1, 5, 6, 7, 13, 16, 17};
+    const int bitCounts[] = {24, 32, 8};
+    for(int bitCount : bitCounts)
+    {
+        for(int width : widths)
+        {
+            for(int topDown=0;  topDown<2;  topDown++)
+            {
+                const int height = 3;
+                WriteBytes(name, MakeBMP(width, height, bitCount, topDown != 0));
+
+                CGrImageFile image;
+                CHECK(image.Open(name.c_str()));
+                CHECK(image.Width() == width && image.Height() == height);
+                if(!image.IsOpen())
+                    continue;
+
+                // Whole rows, and rows from the second column on, with a
+                // guard after the pixels
+                for(int r=0;  r<height;  r++)
+                {
+                    for(int start=0;  start<2 && start<width;  start++)
+                    {
+                        int count = width - start;
+                        vector<BYTE> rgb(count * 3 + 16, 0xcd);
+                        image.ReadRGB(r, start, count, &rgb[0]);
+
+                        bool same = true;
+                        for(int c=0;  c<count;  c++)
+                            for(int i=0;  i<3;  i++)
+                                same = same && rgb[c * 3 + i] == ExpectedValue(bitCount, start + c, r, i);
+                        CHECK(same);
+                        CHECK(rgb[count * 3] == 0xcd);
+                    }
+
+                    vector<BYTE> rgba(width * 4);
+                    image.ReadRGBA(r, 0, width, &rgba[0]);
+                    bool same = true;
+                    for(int c=0;  c<width;  c++)
+                    {
+                        for(int i=0;  i<3;  i++)
+                            same = same && rgba[c * 4 + i] == ExpectedValue(bitCount, c, r, i);
+                        same = same && rgba[c * 4 + 3] == 255;
+                    }
+                    CHECK(same);
+                }
+            }
+        }
+    }
+
+    // A PPM with comments in the header, stored top row first
+    const int width = 7;
+    const int height = 4;
+    string header = "P6\n# a comment\n7 4 # another\n255\n";
+    vector<BYTE> ppm(header.begin(), header.end());
+    for(int r=height-1;  r>=0;  r--)
+        for(int c=0;  c<width;  c++)
+            for(int i=0;  i<3;  i++)
+                ppm.push_back(PixelValue(c, r, i));
+    WriteBytes(name, ppm);
+
+    CGrImageFile image;
+    CHECK(image.Open(name.c_str()));
+    CHECK(image.Width() == width && image.Height() == height);
+    for(int r=0;  r<height && image.IsOpen();  r++)
+    {
+        BYTE rgb[width * 3];
+        image.ReadRGB(r, 0, width, rgb);
+        CHECK(memcmp(rgb, &ppm[header.size() + (height - 1 - r) * width * 3], width * 3) == 0);
+    }
+    image.Close();
+
+    // Files too short for their sizes, or with sizes that overflow
+    ppm.pop_back();
+    WriteBytes(name, ppm);
+    CHECK(!image.Open(name.c_str()));
+
+    const char *badPPM[] = {"P6 0 4 255\n", "P6 7 4 256\n", "P6 2147483648 1 255\n", 
+        "P6 99999999999999999999 1 255\n", "P6 1431655766 1431655766 255\n"};
+    for(const char *bad : badPPM)
+    {
+        string text = string(bad) + string(64, 'x');
+        WriteBytes(name, vector<BYTE>(text.begin(), text.end()));
+        CHECK(!image.Open(name.c_str()));
+    }
+
+    vector<BYTE> bmp = MakeBMP(7, 3, 24, false);
+    bmp.pop_back();
+    WriteBytes(name, bmp);
+    CHECK(!image.Open(name.c_str()));
+
+    const unsigned badHeights[] = {0, 0x80000000, 0x7fffffff, 0x80000001};
+    for(unsigned bad : badHeights)
+    {
+        bmp = MakeBMP(7, 3, 24, false);
+        PutLittleEndian(bmp, 22, bad, 4);
+        WriteBytes(name, bmp);
+        CHECK(!image.Open(name.c_str()));
+    }
+
+    remove(name.c_str());
+}
+
+
+//
+// The kd-tree must find the same hits as testing every object
+//
+
+static void TestTreeMatchesBruteForce()
+{
+    Random random(7);
+    const int triangles = 2000;
+    const double extent = 10;
+
+    vector<CGrVector> verts;
+    for(int i=0;  i<triangles;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        verts.push_back(a);
+        verts.push_back(a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0));
+        verts.push_back(a + CGrVector(Uniform(random, -1, 1), Uniform(random, -1, 1), Uniform(random, -1, 1), 0));
+    }
+
+    CRayIntersection tree;
+    tree.Initialize();
+    for(int i=0;  i<triangles;  i++)
+        AddTriangle(tree, verts[i * 3], verts[i * 3 + 1], verts[i * 3 + 2]);
+    tree.LoadingComplete();
+
+    // One scene per triangle is a brute force test
+    vector<CRayIntersection *> singles;
+    for(int i=0;  i<triangles;  i++)
+    {
+        CRayIntersection *single = new CRayIntersection;
+        single->Initialize();
+        AddTriangle(*single, verts[i * 3], verts[i * 3 + 1], verts[i * 3 + 2]);
+        single->LoadingComplete();
+        singles.push_back(single);
+    }
+
+    int hits = 0;
+    for(int r=0;  r<300;  r++)
+    {
+        CRay ray(RandomPoint(random, extent), Normalize3(RandomPoint(random, 1) - CGrVector(0.5, 0.5, 0.5)));
+
+        const CRayIntersection::Object *object;
+        double t;
+        CGrVector intersect;
+        bool hit = tree.Intersect(ray, 1e20, NULL, object, t, intersect);
+
+        double best = 1e20;
+        for(size_t i=0;  i<singles.size();  i++)
+        {
+            double ti;
+            if(singles[i]->Intersect(ray, 1e20, NULL, object, ti, intersect) && ti < best)
+                best = ti;
+        }
+
+        CHECK(hit == (best < 1e20));
+        if(hit)
+        {
+            CHECK(fabs(t - best) < 1e-6);
+            hits++;
+        }
+    }
+
+    CHECK(hits > 0);
+
+    for(size_t i=0;  i<singles.size();  i++)
+        delete singles[i];
+}
+
+
+//
+// Building in the background
+//
+
+static void TestBuildAsync()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    AddSquare(ri, 0, 1);
+    ri.LoadingComplete();
+
+    ri.Initialize();
+    AddSquare(ri, 5, 1);
+    ri.BuildAsync();
+    ri.WaitForBuild();
+    CHECK(!ri.IsBuilding());
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    CHECK(ri.Intersect(CRay(CGrVector(0.5, 0.5, 10), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect));
+    CHECK_NEAR(intersect.Z(), 5.);
+
+    // Rendering goes on while new scenes are loaded and built
+    atomic<bool> done(false);
+    atomic<int> bad(0);
+    thread render([&]() {
+        while(!done)
+        {
+            CRayIntersection::QueryScope scope;
+            const CRayIntersection::Object *object;
+            double t;
+            CGrVector intersect, normal, texcoord;
+            IMaterial *material;
+            ITexture *texture;
+            CRay ray(CGrVector(0.5, 0.5, 10), CGrVector(0, 0, -1, 0));
+            if(ri.Intersect(ray, 1e20, NULL, object, t, intersect))
+            {
+                ri.IntersectInfo(ray, object, t, normal, material, texture, texcoord);
+                if(fabs(normal.Length3() - 1) > 1e-9)
+                    bad++;
+            }
+        }
+    });
+
+    for(int i=0;  i<50;  i++)
+    {
+        ri.Initialize();
+        ri.AddSphere(CGrVector(0.5, 0.5, i * 0.1), 1);
+        ri.BuildAsync();
+        ri.WaitForBuild();
+    }
+
+    done = true;
+    render.join();
+    CHECK(bad == 0);
+}
+
+
+//
+// Queries from many threads must find what one thread does
+//
+
+static void TestConcurrentQueries()
+{
+    Random random(11);
+    const double extent = 10;
+
+    CRayIntersection ri;
+    ri.Initialize();
+    for(int i=0;  i<1000;  i++)
+    {
+        CGrVector a = RandomPoint(random, extent);
+        AddTriangle(ri, a, a + CGrVector(1, 0, 0, 0), a + CGrVector(0, Uniform(random, 0.5, 1), 1, 0));
+    }
+    ri.LoadingComplete();
+
+    const int rays = 4000;
+    vector<CRay> queries;
+    for(int r=0;  r<rays;  r++)
+        queries.push_back(CRay(RandomPoint(random, extent), Normalize3(RandomPoint(random, 1) - CGrVector(0.5, 0.5, 0.5))));
+
+    vector<double> expected(rays);
+    for(int r=0;  r<rays;  r++)
+    {
+        const CRayIntersection::Object *object;
+        CGrVector intersect;
+        if(!ri.Intersect(queries[r], 1e20, NULL, object, expected[r], intersect))
+            expected[r] = -1;
+    }
+
+    vector<double> found(rays);
+    vector<int> runs(rays, 0);
+    CWorkStealingPool pool(4);
+    CHECK(pool.ThreadCnt() == 4);
+    pool.Run(rays, [&](int p_task, int /*p_worker*/) {
+        const CRayIntersection::Object *object;
+        CGrVector intersect;
+        if(!ri.Intersect(queries[p_task], 1e20, NULL, object, found[p_task], intersect))
+            found[p_task] = -1;
+        runs[p_task]++;
+    });
+
+    int mismatches = 0;
+    for(int r=0;  r<rays;  r++)
+    {
+        CHECK(runs[r] == 1);
+        if(found[r] != expected[r])
+            mismatches++;
+    }
+
+    CHECK(mismatches == 0);
+}
+
+
+//
+// Statistics and calibration
+//
+
+static void TestStatistics()
+{
+    CRayIntersection ri;
+    ri.Initialize();
+    for(int i=0;  i<4;  i++)
+        AddSquare(ri, i, 1);
+    AddTriangle(ri, CGrVector(0, 0, 0), CGrVector(1, 0, 0), CGrVector(0, 1, 0));
+    ri.LoadingComplete();
+
+    const CRayIntersection::Object *object;
+    double t;
+    CGrVector intersect;
+    for(int i=0;  i<25;  i++)
+        ri.Intersect(CRay(CGrVector(0.5, 0.5, 10), CGrVector(0, 0, -1, 0)), 1e20, NULL, object, t, intersect);
+
+    CRayIntersection::Statistics stats = ri.GetStatistics();
+    CHECK(stats.m_polygons + stats.m_triangles == 5);
+    CHECK(stats.m_rays == 25);
+    CHECK(stats.m_nodesVisited.m_count == 25);
+    CHECK(stats.m_leaves > 0);
+    CHECK(!stats.ToJSON().empty());
+
+    ri.ResetStatistics();
+    CHECK(ri.GetStatistics().m_rays == 0);
+}
+
+static void TestCalibration()
+{
+    CRayIntersection ri;
+    CRayIntersection::Calibration c = ri.Calibrate();
+    CHECK(c.IsValid());
+    CHECK(ri.GetCalibration().IsValid());
+
+    const char *path = "RayCoreTests.calibration";
+    CHECK(c.Save(path));
+
+    CRayIntersection::Calibration loaded;
+    CHECK(loaded.Load(path));
+    CHECK(fabs(loaded.m_traverse - c.m_traverse) < 1e-6 * c.m_traverse);
+    CHECK(fabs(loaded.m_triangle - c.m_triangle) < 1e-6 * c.m_triangle);
+    remove(path);
+
+    // The calibrated costs are used for the build
+    ri.Initialize();
+    AddSquare(ri, 0, 1);
+    ri.LoadingComplete();
+    CRayIntersection::Statistics stats = ri.GetStatistics();
+    CHECK_NEAR(stats.m_intersectionCost, stats.m_traverseCost * c.m_polygon / c.m_traverse);
+
+    // Application primitives are counted at the cost of a triangle
+    CDisk disk(CGrVector(0, 0, 0), 1);
+    ri.Initialize();
+    ri.AddPrimitive(&disk);
+    ri.LoadingComplete();
+    stats = ri.GetStatistics();
+    CHECK_NEAR(stats.m_intersectionCost, stats.m_traverseCost * c.m_triangle / c.m_traverse);
+}
+
+
+struct Test
+{
+    const char *m_name;
+    void (*m_test)();
+};
+
+int main(int argc, char *argv[])
+{
+    static const Test tests[] = {
+        {"vector", TestVector},
+        {"transform", TestTransform},
+        {"triangle", TestTriangle},
+        {"polygoninfo", TestPolygonInfo},
+        {"nearest", TestNearest},
+        {"primitives", TestPrimitives},
+        {"manyspheres", TestManySpheres},
+        {"userprimitive", TestUserPrimitive},
+        {"nurbs", TestNurbs},
+        {"motion", TestMotion},
+        {"masks", TestMasks},
+        {"filter", TestFilter},
+        {"intersectall", TestIntersectAll},
+        {"closestpoint", TestClosestPoint},
+        {"regions", TestRegionQueries},
+        {"spherecast", TestSphereCast},
+        {"differentials", TestDifferentials},
+        {"sampling", TestTextureSampling},
+        {"imagefile", TestImageFile},
+        {"bruteforce", TestTreeMatchesBruteForce},
+        {"buildasync", TestBuildAsync},
+        {"concurrent", TestConcurrentQueries},
+        {"statistics", TestStatistics},
+        {"calibration", TestCalibration},
+    };
+
+    int failed = 0;
+    int run = 0;
+    for(const Test &test : tests)
+    {
+        bool selected = argc < 2;
+        for(int a=1;  a<argc;  a++)
+            selected = selected || string(argv[a]) == test.m_name;
+        if(!selected)
+            continue;
+
+        int before = g_failures;
+        test.m_test();
+        run++;
+
+        bool ok = g_failures == before;
+        cout << (ok ? "PASS " : "FAIL ") << test.m_name << endl;
+        if(!ok)
+            failed++;
+    }
+
+    cout << run - failed << " of " << run << " tests passed" << endl;
+    return failed;
+}
@@ -0,0 +1,7 @@
+#!/bin/sh
+# Generate makefiles for the headless core (RayCore, RayCoreTests, RayCoreBench).
+# Then: make config=release_linux64
+cd "$(dirname "$0")"
+PREMAKE=./vendor/bin/premake/premake5
+[ -x "$PREMAKE" ] || PREMAKE=premake5
+"$PREMAKE" gmake2
@@ -23,7 +23,8 @@ workspace (PROJECT_ROOT)
 	platforms
 	{
 		"Win32",
-		"Win64"
+		"Win64",
+		"Linux64"
 	}
 
 	startproject (PROJECT_ROOT)
@@ -34,6 +35,7 @@ workspace (PROJECT_ROOT)
 project (PROJECT_ROOT)
 	location (PROJECT_ROOT)
 	kind "StaticLib"
+	removeplatforms { "Linux64" }
 	language "C++"
 	staticruntime "off"
 
@@ -151,4 +153,216 @@ project (PROJECT_ROOT)
 	filter "configurations:Dist"
 		optimize "On"
 		links { "msvcrt.lib" }
-		runtime "Release"
\ No newline at end of file
+		runtime "Release"
+
+-- Headless ray intersection benchmark
+project "RayBench"
+	location "RayBench"
+	kind "ConsoleApp"
+	removeplatforms { "Linux64" }
+	language "C++"
+	staticruntime "off"
+
+	targetdir ("bin/" .. outputdir .. "/%{prj.name}")
+	objdir ("obj/" .. outputdir .. "/%{prj.name}")
+
+	files
+	{
+		PremakeHelpers.IncludeCHeaders,
+		PremakeHelpers.IncludeCPPSources
+	}
+
+	includedirs
+	{
+		"%{prj.name}/src",
+		PROJECT_ROOT .. "/src",
+		PROJECT_ROOT .. "/src/graphics",
+		"%{IncludeDir.GLEW}",
+		"%{IncludeDir.GLEW}/include/GL",
+		"%{IncludeDir.GLM}",
+		"%{IncludeDir.GLM}/core",
+		"%{IncludeDir.GLM}/gtc",
+		"%{IncludeDir.Other}"
+	}
+
+	links
+	{
+		PROJECT_ROOT,
+		"opengl32.lib",
+		"glu32.lib"
+	}
+
+	defines
+	{
+		"_UNICODE",
+		"_AFXDLL"
+	}
+
+	filter "platforms:Win32"
+		architecture "x86"
+
+	filter "platforms:Win64"
+		architecture "x64"
+
+	filter "system:windows"
+		cppdialect "C++17"
+		systemversion "latest"
+
+	filter "configurations:Debug"
+		symbols "On"
+		defines { "_DEBUG" }
+		runtime "Debug"
+
+	filter "configurations:Release"
+		optimize "On"
+		runtime "Release"
+
+	filter "configurations:Dist"
+		optimize "On"
+		runtime "Release"
+
+-- Headless intersection core.  The kd-tree engine with CGrVector and
+-- CGrTransform, built without MFC, OpenGL, or Windows types so it can be
+-- used on Linux.  On Linux: premake5 gmake2, then
+-- make config=release_linux64
+RAYCORE_DEFINES = { "NOMFC", "NOOPENGL" }
+
+project "RayCore"
+	location "RayCore"
+	kind "StaticLib"
+	language "C++"
+	cppdialect "C++17"
+	staticruntime "off"
+
+	targetdir ("bin/" .. outputdir .. "/%{prj.name}")
+	objdir ("obj/" .. outputdir .. "/%{prj.name}")
+
+	files
+	{
+		PROJECT_ROOT .. "/src/BezierPatch.*",
+		PROJECT_ROOT .. "/src/BoundingBox.*",
+		PROJECT_ROOT .. "/src/Box.*",
+		PROJECT_ROOT .. "/src/Calibration.cpp",
+		PROJECT_ROOT .. "/src/Cylinder.*",
+		PROJECT_ROOT .. "/src/Epoch.*",
+		PROJECT_ROOT .. "/src/IntersectionObject.*",
+		PROJECT_ROOT .. "/src/KdNode.*",
+		PROJECT_ROOT .. "/src/MovingTriangle.*",
+		PROJECT_ROOT .. "/src/NurbsSurface.*",
+		PROJECT_ROOT .. "/src/Polygon.*",
+		PROJECT_ROOT .. "/src/RayInterfaces.cpp",
+		PROJECT_ROOT .. "/src/RayIntersection.cpp",
+		PROJECT_ROOT .. "/src/RayIntersectionD.*",
+		PROJECT_ROOT .. "/src/RayMailbox.h",
+		PROJECT_ROOT .. "/src/RayStatistics.*",
+		PROJECT_ROOT .. "/src/Rayp.*",
+		PROJECT_ROOT .. "/src/SceneBuffer.*",
+		PROJECT_ROOT .. "/src/Sphere.*",
+		PROJECT_ROOT .. "/src/Triangle.*",
+		PROJECT_ROOT .. "/src/UserPrimitive.*",
+		PROJECT_ROOT .. "/src/WorkStealingPool.*",
+		PROJECT_ROOT .. "/src/graphics/GrImageFile.*",
+		PROJECT_ROOT .. "/src/graphics/GrMappedFile.*",
+		PROJECT_ROOT .. "/src/graphics/GrPoint.h",
+		PROJECT_ROOT .. "/src/graphics/GrTextureSampling.h",
+		PROJECT_ROOT .. "/src/graphics/GrTransform.*",
+		PROJECT_ROOT .. "/src/graphics/GrVector.h",
+		PROJECT_ROOT .. "/src/graphics/RayInterfaces.h",
+		PROJECT_ROOT .. "/src/graphics/RayIntersection.h"
+	}
+
+	includedirs
+	{
+		PROJECT_ROOT .. "/src",
+		PROJECT_ROOT .. "/src/graphics"
+	}
+
+	defines (RAYCORE_DEFINES)
+
+	filter "platforms:Win32"
+		architecture "x86"
+
+	filter "platforms:Win64"
+		architecture "x64"
+
+	filter "platforms:Linux64"
+		architecture "x86_64"
+
+	filter "system:windows"
+		systemversion "latest"
+
+	filter "configurations:Debug"
+		symbols "On"
+		defines { "_DEBUG" }
+		runtime "Debug"
+
+	filter "configurations:Release"
+		optimize "On"
+		runtime "Release"
+
+	filter "configurations:Dist"
+		optimize "On"
+		runtime "Release"
+
+-- Console programs linked with the headless core
+function RayCoreProgram(name)
+	project (name)
+		location (name)
+		kind "ConsoleApp"
+		language "C++"
+		cppdialect "C++17"
+		staticruntime "off"
+
+		targetdir ("bin/" .. outputdir .. "/%{prj.name}")
+		objdir ("obj/" .. outputdir .. "/%{prj.name}")
+
+		files
+		{
+			PremakeHelpers.IncludeCHeaders,
+			PremakeHelpers.IncludeCPPSources
+		}
+
+		includedirs
+		{
+			"%{prj.name}/src",
+			PROJECT_ROOT .. "/src",
+			PROJECT_ROOT .. "/src/graphics"
+		}
+
+		defines (RAYCORE_DEFINES)
+		links { "RayCore" }
+
+		filter "system:linux"
+			links { "pthread" }
+
+		filter "platforms:Win32"
+			architecture "x86"
+
+		filter "platforms:Win64"
+			architecture "x64"
+
+		filter "platforms:Linux64"
+			architecture "x86_64"
+
+		filter "system:windows"
+			systemversion "latest"
+
+		filter "configurations:Debug"
+			symbols "On"
+			defines { "_DEBUG" }
+			runtime "Debug"
+
+		filter "configurations:Release"
+			optimize "On"
+			runtime "Release"
+
+		filter "configurations:Dist"
+			optimize "On"
+			runtime "Release"
+end
+
+-- Unit tests, the exit status is the number of failed tests
+RayCoreProgram "RayCoreTests"
+
+-- Headless benchmark for the core
+RayCoreProgram "RayCoreBench"